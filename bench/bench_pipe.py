@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+
+# Copyright 2024 David Robillard <d@drobilla.net>
+# SPDX-License-Identifier: ISC
+
+"""Measure the throughput of running sajs-pipe over an input file.
+
+Any arguments after the input are passed to the tool.  The best time of
+several runs is printed as a line of JSON, like the other benchmarks.  If the
+tool prints an "io.syscalls" statistic, then the number of system calls per
+megabyte of input is included as well.
+"""
+
+import argparse
+import json
+import os
+import shlex
+import subprocess
+import sys
+import time
+
+
+def count_syscalls(output):
+    """Return the number of system calls in tool statistics, or None."""
+
+    for line in output.decode("utf-8", "replace").splitlines():
+        fields = line.split()
+        if len(fields) == 2 and fields[0] == "io.syscalls":
+            return int(fields[1])
+
+    return None
+
+
+def main():
+    """Run the benchmark."""
+
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--tool", default="sajs-pipe", help="executable")
+    parser.add_argument("--name", default="pipe", help="benchmark name")
+    parser.add_argument("--repeats", type=int, default=5, help="runs")
+    parser.add_argument("input", help="JSON input file")
+    parser.add_argument("tool_args", nargs=argparse.REMAINDER)
+    args = parser.parse_args(sys.argv[1:])
+
+    wrapper = shlex.split(os.environ.get("MESON_EXE_WRAPPER", ""))
+    command = wrapper + [args.tool] + args.tool_args + [args.input]
+
+    best = None
+    syscalls = None
+    for _ in range(max(1, args.repeats)):
+        start = time.perf_counter()
+        proc = subprocess.run(
+            command,
+            check=False,
+            stderr=subprocess.PIPE,
+            stdout=subprocess.DEVNULL,
+        )
+        elapsed = time.perf_counter() - start
+
+        if proc.returncode != 0:
+            sys.stderr.write(proc.stderr.decode("utf-8", "replace"))
+            return 1
+
+        best = elapsed if best is None else min(best, elapsed)
+        syscalls = count_syscalls(proc.stderr)
+
+    size = os.path.getsize(args.input)
+    result = {
+        "benchmark": args.name,
+        "corpus": os.path.basename(args.input),
+        "bytes": size,
+        "seconds": round(best, 6),
+        "MB_per_s": round(size / best / 1e6, 2),
+    }
+
+    if syscalls is not None and size:
+        result["syscalls_per_MB"] = round(syscalls / (size / 1e6), 2)
+
+    print(json.dumps(result))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,970 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#define _POSIX_C_SOURCE 200809L // NOLINT(bugprone-reserved-identifier)
+
+#include "sajs/sajs.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+  Throughput benchmarks for the lexer and writer.
+
+  Each benchmark runs one way of using the library over a corpus, which is
+  either generated in memory with one of several shapes, or read from a file.
+  The best time of several runs is reported as a line of JSON on stdout, so
+  results can be collected by scripts.
+*/
+
+static size_t const   default_size    = 4194304U; ///< Generated corpus size
+static unsigned const default_repeats = 5U;       ///< Runs of each benchmark
+static size_t const   stack_size      = 4096U;    ///< Lexer stack size
+
+/// A growable text buffer
+typedef struct {
+  char*  data;
+  size_t length;
+  size_t size;
+} Corpus;
+
+/// Events and strings read from a corpus, for writer benchmarks
+typedef struct {
+  SajsEvent*      events;
+  SajsStringView* strings;
+  char*           bytes;
+  size_t          num_events;
+} EventLog;
+
+/// A function that runs a benchmark and returns the number of events or bytes
+typedef size_t (*BenchFunc)(Corpus const* corpus, EventLog const* log);
+
+/// A benchmark that measures one way of using the library
+typedef struct {
+  char const* name;      ///< Benchmark name used on the command line
+  BenchFunc   func;      ///< Function that runs the benchmark once
+  bool        needs_log; ///< True if the corpus must be read into a log first
+} Bench;
+
+/// Return a monotonic time in seconds
+static double
+now(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec t = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + ((double)t.tv_nsec * 1e-9);
+#else
+  return (double)clock() / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+/*
+  Corpus generation
+*/
+
+static uint32_t rng_state = 1U;
+
+/// Return a pseudo-random number with a fixed sequence (xorshift32)
+static uint32_t
+rng(void)
+{
+  rng_state ^= rng_state << 13U;
+  rng_state ^= rng_state >> 17U;
+  rng_state ^= rng_state << 5U;
+  return rng_state;
+}
+
+/// Return a pseudo-random number less than n
+static unsigned
+rng_below(unsigned const n)
+{
+  return (unsigned)(rng() % n);
+}
+
+static void
+append(Corpus* const corpus, size_t const length, char const* const data)
+{
+  if (corpus->length + length + 1U > corpus->size) {
+    size_t const size  = (corpus->size + length + 1U) * 2U;
+    char* const  data2 = (char*)realloc(corpus->data, size);
+    if (!data2) {
+      (void)fprintf(stderr, "error: failed to allocate corpus\n");
+      exit(1);
+    }
+
+    corpus->data = data2;
+    corpus->size = size;
+  }
+
+  memcpy(corpus->data + corpus->length, data, length);
+  corpus->length += length;
+  corpus->data[corpus->length] = '\0';
+}
+
+static void
+append_str(Corpus* const corpus, char const* const str)
+{
+  append(corpus, strlen(str), str);
+}
+
+static void
+append_int(Corpus* const corpus, long const value)
+{
+  char      buf[32U];
+  int const n = snprintf(buf, sizeof(buf), "%ld", value);
+  append(corpus, (size_t)n, buf);
+}
+
+static void
+append_real(Corpus* const corpus, double const value)
+{
+  char      buf[32U];
+  int const n = snprintf(buf, sizeof(buf), "%.17g", value);
+  append(corpus, (size_t)n, buf);
+}
+
+static void
+append_indent(Corpus* const corpus, bool const pretty, unsigned const depth)
+{
+  if (pretty) {
+    append_str(corpus, "\n");
+    for (unsigned i = 0U; i < depth; ++i) {
+      append_str(corpus, "  ");
+    }
+  }
+}
+
+/// Append a string of words, possibly with escapes and non-ASCII characters
+static void
+append_text(Corpus* const  corpus,
+            unsigned const num_words,
+            bool const     special)
+{
+  static char const* const words[] = {
+    "lorem",  "ipsum", "dolor",  "sit",   "amet",    "consectetur",
+    "adipis", "elit",  "sed",    "do",    "eiusmod", "tempor",
+    "json",   "sajs",  "stream", "lexer", "writer",  "event",
+  };
+
+  static char const* const specials[] = {
+    "\\n", "\\\"", "\\\\", "\\u00e9", "\xC3\xA9", "\xE2\x82\xAC", "\\t",
+  };
+
+  append_str(corpus, "\"");
+  for (unsigned i = 0U; i < num_words; ++i) {
+    if (i) {
+      append_str(corpus, " ");
+    }
+
+    if (special && !rng_below(8U)) {
+      append_str(corpus, specials[rng_below(7U)]);
+    }
+
+    append_str(corpus, words[rng_below(18U)]);
+  }
+  append_str(corpus, "\"");
+}
+
+static void
+append_member(Corpus* const     corpus,
+              bool const        pretty,
+              unsigned const    depth,
+              bool const        first,
+              char const* const name)
+{
+  append_str(corpus, first ? "" : ",");
+  append_indent(corpus, pretty, depth);
+  append_str(corpus, "\"");
+  append_str(corpus, name);
+  append_str(corpus, pretty ? "\": " : "\":");
+}
+
+/// Generate an array of strings with some escapes
+static void
+gen_strings(Corpus* const corpus, size_t const size)
+{
+  append_str(corpus, "[");
+  for (unsigned i = 0U; corpus->length < size; ++i) {
+    append_str(corpus, i ? "," : "");
+    append_text(corpus, 1U + rng_below(40U), true);
+  }
+  append_str(corpus, "]\n");
+}
+
+/// Generate an array of integers and reals
+static void
+gen_numbers(Corpus* const corpus, size_t const size)
+{
+  append_str(corpus, "[");
+  for (unsigned i = 0U; corpus->length < size; ++i) {
+    append_str(corpus, i ? "," : "");
+    if (rng_below(2U)) {
+      append_int(corpus, (long)rng() - (long)INT32_MAX);
+    } else {
+      append_real(corpus, ((double)rng() - 2147483648.0) / (double)rng());
+    }
+  }
+  append_str(corpus, "]\n");
+}
+
+/// Generate repeated deeply nested arrays and objects
+static void
+gen_nested(Corpus* const corpus, size_t const size)
+{
+  append_str(corpus, "[");
+  for (unsigned i = 0U; corpus->length < size; ++i) {
+    unsigned const depth = 1U + rng_below(500U);
+
+    append_str(corpus, i ? "," : "");
+    for (unsigned d = 0U; d < depth; ++d) {
+      append_str(corpus, (d & 1U) ? "{\"k\":" : "[");
+    }
+
+    append_int(corpus, (long)i);
+    for (unsigned d = depth; d > 0U; --d) {
+      append_str(corpus, ((d - 1U) & 1U) ? "}" : ",true]");
+    }
+  }
+  append_str(corpus, "]\n");
+}
+
+/// Append a log record object
+static void
+append_record(Corpus* const  corpus,
+              bool const     pretty,
+              unsigned const depth,
+              unsigned const i)
+{
+  static char const* const levels[] = {"debug", "info", "warning", "error"};
+
+  append_str(corpus, "{");
+  append_member(corpus, pretty, depth + 1U, true, "id");
+  append_int(corpus, (long)i);
+  append_member(corpus, pretty, depth + 1U, false, "level");
+  append_str(corpus, "\"");
+  append_str(corpus, levels[rng_below(4U)]);
+  append_str(corpus, "\"");
+  append_member(corpus, pretty, depth + 1U, false, "time");
+  append_real(corpus, 1700000000.0 + ((double)i * 0.125));
+  append_member(corpus, pretty, depth + 1U, false, "message");
+  append_text(corpus, 4U + rng_below(12U), false);
+  append_member(corpus, pretty, depth + 1U, false, "ok");
+  append_str(corpus, rng_below(2U) ? "true" : "false");
+  append_member(corpus, pretty, depth + 1U, false, "tags");
+  append_str(corpus, "[");
+  for (unsigned t = 0U, n = rng_below(4U); t < n; ++t) {
+    append_str(corpus, t ? "," : "");
+    append_indent(corpus, pretty, depth + 2U);
+    append_text(corpus, 1U, false);
+  }
+  append_indent(corpus, pretty, depth + 1U);
+  append_str(corpus, "]");
+  append_indent(corpus, pretty, depth);
+  append_str(corpus, "}");
+}
+
+/// Generate a pretty-printed array of records
+static void
+gen_pretty(Corpus* const corpus, size_t const size)
+{
+  append_str(corpus, "[");
+  for (unsigned i = 0U; corpus->length < size; ++i) {
+    append_str(corpus, i ? "," : "");
+    append_indent(corpus, true, 1U);
+    append_record(corpus, true, 1U, i);
+  }
+  append_str(corpus, "\n]\n");
+}
+
+/// Generate newline-delimited records
+static void
+gen_ndjson(Corpus* const corpus, size_t const size)
+{
+  for (unsigned i = 0U; corpus->length < size; ++i) {
+    append_record(corpus, false, 0U, i);
+    append_str(corpus, "\n");
+  }
+}
+
+/// Generate something shaped like the Twitter API (twitter.json)
+static void
+gen_twitter(Corpus* const corpus, size_t const size)
+{
+  append_str(corpus, "{\"statuses\":[");
+  for (unsigned i = 0U; corpus->length < size; ++i) {
+    append_str(corpus, i ? "," : "");
+    append_str(corpus, "{\"metadata\":{\"result_type\":\"recent\",");
+    append_str(corpus, "\"iso_language_code\":\"ja\"},\"created_at\":");
+    append_str(corpus, "\"Sun Aug 31 00:29:15 +0000 2014\",\"id\":");
+    append_int(corpus, 505874924095815680L + (long)i);
+    append_str(corpus, ",\"text\":");
+    append_text(corpus, 8U + rng_below(20U), true);
+    append_str(corpus, ",\"in_reply_to_status_id\":null,\"user\":{\"id\":");
+    append_int(corpus, (long)rng());
+    append_str(corpus, ",\"name\":");
+    append_text(corpus, 2U, true);
+    append_str(corpus, ",\"description\":");
+    append_text(corpus, 10U + rng_below(30U), true);
+    append_str(corpus, ",\"followers_count\":");
+    append_int(corpus, (long)rng_below(100000U));
+    append_str(corpus, ",\"protected\":false,\"verified\":false,");
+    append_str(corpus, "\"profile_background_color\":\"C0DEED\"},");
+    append_str(corpus, "\"entities\":{\"hashtags\":[");
+    for (unsigned h = 0U, n = rng_below(3U); h < n; ++h) {
+      append_str(corpus, h ? "," : "");
+      append_str(corpus, "{\"text\":");
+      append_text(corpus, 1U, false);
+      append_str(corpus, ",\"indices\":[");
+      append_int(corpus, (long)rng_below(100U));
+      append_str(corpus, ",");
+      append_int(corpus, (long)rng_below(100U) + 100);
+      append_str(corpus, "]}");
+    }
+    append_str(corpus, "],\"urls\":[],\"user_mentions\":[]},");
+    append_str(corpus, "\"retweet_count\":");
+    append_int(corpus, (long)rng_below(1000U));
+    append_str(corpus, ",\"favorited\":false,\"lang\":\"ja\"}");
+  }
+  append_str(corpus, "],\"search_metadata\":{\"count\":100}}\n");
+}
+
+/// Generate something shaped like a ticketing database (citm_catalog.json)
+static void
+gen_citm(Corpus* const corpus, size_t const size)
+{
+  append_str(corpus, "{\"events\":{");
+  for (unsigned i = 0U; corpus->length < size / 2U; ++i) {
+    long const id = 138586341L + (long)i;
+
+    append_str(corpus, i ? ",\"" : "\"");
+    append_int(corpus, id);
+    append_str(corpus, "\":{\"description\":null,\"id\":");
+    append_int(corpus, id);
+    append_str(corpus, ",\"logo\":null,\"name\":");
+    append_text(corpus, 2U + rng_below(4U), false);
+    append_str(corpus, ",\"subTopicIds\":[");
+    for (unsigned t = 0U, n = 1U + rng_below(4U); t < n; ++t) {
+      append_str(corpus, t ? "," : "");
+      append_int(corpus, 337184262L + (long)rng_below(1000U));
+    }
+    append_str(corpus, "],\"subjectCode\":null,\"subtitle\":null,");
+    append_str(corpus, "\"topicIds\":[324846099,107888604]}");
+  }
+
+  append_str(corpus, "},\"performances\":[");
+  for (unsigned i = 0U; corpus->length < size; ++i) {
+    append_str(corpus, i ? "," : "");
+    append_str(corpus, "{\"eventId\":");
+    append_int(corpus, 138586341L + (long)rng_below(1000U));
+    append_str(corpus, ",\"id\":");
+    append_int(corpus, 339887544L + (long)i);
+    append_str(corpus, ",\"logo\":null,\"name\":null,\"prices\":[");
+    for (unsigned p = 0U, n = 1U + rng_below(4U); p < n; ++p) {
+      append_str(corpus, p ? "," : "");
+      append_str(corpus, "{\"amount\":");
+      append_int(corpus, 10000L + (long)rng_below(90000U));
+      append_str(corpus, ",\"audienceSubCategoryId\":337100890,");
+      append_str(corpus, "\"seatCategoryId\":");
+      append_int(corpus, 338937295L + (long)rng_below(10U));
+      append_str(corpus, "}");
+    }
+    append_str(corpus, "],\"seatCategories\":[{\"areas\":[{\"areaId\":");
+    append_int(corpus, 205705999L + (long)rng_below(100U));
+    append_str(corpus, ",\"blockIds\":[]}],\"seatCategoryId\":338937295}],");
+    append_str(corpus, "\"seatMapImage\":null,\"start\":");
+    append_int(corpus, 1372701600000L + (long)rng_below(1000000U));
+    append_str(corpus, ",\"venueCode\":\"PLEYEL_PLEYEL\"}");
+  }
+  append_str(corpus, "]}\n");
+}
+
+/// A kind of generated corpus
+typedef struct {
+  char const* name;
+  void (*func)(Corpus* corpus, size_t size);
+} CorpusShape;
+
+static CorpusShape const shapes[] = {
+  {"citm", gen_citm},
+  {"nested", gen_nested},
+  {"ndjson", gen_ndjson},
+  {"numbers", gen_numbers},
+  {"pretty", gen_pretty},
+  {"strings", gen_strings},
+  {"twitter", gen_twitter},
+};
+
+static bool
+generate(char const* const name, size_t const size, Corpus* const corpus)
+{
+  for (size_t i = 0U; i < sizeof(shapes) / sizeof(shapes[0]); ++i) {
+    if (!strcmp(name, shapes[i].name)) {
+      rng_state = 1U;
+      shapes[i].func(corpus, size);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool
+load(char const* const path, Corpus* const corpus)
+{
+  FILE* const stream = fopen(path, "rb");
+  if (!stream) {
+    return false;
+  }
+
+  char   buf[65536U];
+  size_t n = 0U;
+  while ((n = fread(buf, 1U, sizeof(buf), stream))) {
+    append(corpus, n, buf);
+  }
+
+  return !fclose(stream);
+}
+
+/*
+  Benchmarks
+*/
+
+static void
+check_end(SajsStatus const st)
+{
+  if (st != SAJS_FAILURE) {
+    (void)fprintf(stderr, "error: %s\n", sajs_strerror(st));
+    exit(1);
+  }
+}
+
+/// Read the corpus one byte at a time
+static size_t
+bench_byte(Corpus const* const corpus, EventLog const* const log)
+{
+  uintptr_t        mem[(64U + stack_size) / sizeof(uintptr_t)];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+  size_t           count = 0U;
+
+  (void)log;
+  for (size_t i = 0U; i <= corpus->length; ++i) {
+    int const       c = (i < corpus->length) ? (uint8_t)corpus->data[i] : -1;
+    SajsEvent const e = sajs_read_byte(lexer, c);
+    if (e.status) {
+      check_end(e.status);
+      break;
+    }
+
+    count += e.type ? 1U : 0U;
+  }
+
+  return count;
+}
+
+/// Read the corpus with a buffer read function
+static size_t
+read_all(Corpus const* const corpus,
+         SajsEvent (*const read_func)(SajsLexer*, size_t, char const*, size_t*))
+{
+  uintptr_t        mem[(64U + stack_size) / sizeof(uintptr_t)];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  size_t           events = 0U;
+
+  for (size_t offset = 0U; offset <= corpus->length;) {
+    size_t          count = 0U;
+    SajsEvent const e =
+      read_func(lexer, corpus->length - offset, corpus->data + offset, &count);
+    if (e.status) {
+      check_end(e.status);
+      break;
+    }
+
+    offset += count;
+    events += e.type ? 1U : 0U;
+  }
+
+  return events;
+}
+
+/// Read the corpus with sajs_read_buffer()
+static size_t
+bench_buffer(Corpus const* const corpus, EventLog const* const log)
+{
+  (void)log;
+  return read_all(corpus, sajs_read_buffer);
+}
+
+/// Read the corpus with sajs_read_spans()
+static size_t
+bench_spans(Corpus const* const corpus, EventLog const* const log)
+{
+  (void)log;
+  return read_all(corpus, sajs_read_spans);
+}
+
+static SajsStatus
+count_container(void* const handle, SajsValueKind const kind)
+{
+  (void)kind;
+  ++*(size_t*)handle;
+  return SAJS_SUCCESS;
+}
+
+static SajsStatus
+count_string(void* const handle, SajsStringView const bytes, bool const last)
+{
+  (void)bytes;
+  (void)last;
+  ++*(size_t*)handle;
+  return SAJS_SUCCESS;
+}
+
+static SajsStatus
+count_number(void* const handle, SajsNumber const number)
+{
+  (void)number;
+  ++*(size_t*)handle;
+  return SAJS_SUCCESS;
+}
+
+static SajsStatus
+count_literal(void* const handle, char const literal)
+{
+  (void)literal;
+  ++*(size_t*)handle;
+  return SAJS_SUCCESS;
+}
+
+/// Read the corpus with sajs_lex(), counting handler calls
+static size_t
+bench_lex(Corpus const* const corpus, EventLog const* const log)
+{
+  static SajsHandlers const handlers = {count_container,
+                                        count_container,
+                                        count_string,
+                                        count_string,
+                                        count_number,
+                                        count_literal};
+
+  uintptr_t        mem[(64U + stack_size) / sizeof(uintptr_t)];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+  size_t           calls = 0U;
+
+  (void)log;
+  for (size_t offset = 0U; offset <= corpus->length;) {
+    size_t           count = 0U;
+    SajsStatus const st    = sajs_lex(lexer,
+                                   corpus->length - offset,
+                                   corpus->data + offset,
+                                   &count,
+                                   &handlers,
+                                   &calls);
+
+    offset += count;
+    if (st) {
+      check_end(st);
+      break;
+    }
+  }
+
+  return calls;
+}
+
+/// Check the corpus with sajs_validate()
+static size_t
+bench_validate(Corpus const* const corpus, EventLog const* const log)
+{
+  uintptr_t        mem[(64U + stack_size) / sizeof(uintptr_t)];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  size_t           values = 0U;
+
+  (void)log;
+  for (size_t offset = 0U; offset <= corpus->length;) {
+    size_t           count = 0U;
+    SajsStatus const st    = sajs_validate(
+      lexer, corpus->length - offset, corpus->data + offset, &count);
+
+    offset += count;
+    if (st == SAJS_SUCCESS) {
+      ++values;
+    } else if (st != SAJS_RETRY) {
+      check_end(st);
+      break;
+    }
+  }
+
+  return values;
+}
+
+/// Read the corpus, skipping every container inside a top-level value
+static size_t
+bench_skip(Corpus const* const corpus, EventLog const* const log)
+{
+  uintptr_t        mem[(64U + stack_size) / sizeof(uintptr_t)];
+  SajsLexer* const lexer    = sajs_lexer_init(sizeof(mem), mem);
+  size_t           events   = 0U;
+  bool             skipping = false;
+
+  (void)log;
+  for (size_t offset = 0U; offset <= corpus->length;) {
+    size_t const length = corpus->length - offset;
+    size_t       count  = 0U;
+    if (skipping) {
+      SajsStatus const st =
+        sajs_skip_value(lexer, length, corpus->data + offset, &count);
+
+      offset += count;
+      if (st && st != SAJS_RETRY) {
+        check_end(st);
+        break;
+      }
+
+      skipping = st == SAJS_RETRY;
+      continue;
+    }
+
+    SajsEvent const e =
+      sajs_read_spans(lexer, length, corpus->data + offset, &count);
+    if (e.status) {
+      check_end(e.status);
+      break;
+    }
+
+    offset += count;
+    events += e.type ? 1U : 0U;
+    skipping = e.type == SAJS_EVENT_START &&
+               (e.kind == SAJS_ARRAY || e.kind == SAJS_OBJECT) &&
+               sajs_lexer_depth(lexer) == 2U;
+  }
+
+  return events;
+}
+
+/// Write events into a buffer, discard the text, and return its total length
+static size_t
+write_all(EventLog const* const log, SajsWriteFlags const flags)
+{
+  static char text[65536U];
+
+  uintptr_t         mem[8U];
+  SajsWriter* const writer = sajs_writer_init(sizeof(mem), mem);
+  size_t            total  = 0U;
+
+  SajsStatus st     = SAJS_RETRY;
+  size_t     offset = 0U;
+  while (st == SAJS_RETRY) {
+    size_t num_written = 0U;
+    size_t length      = 0U;
+    st                 = sajs_write_events(writer,
+                                           flags,
+                                           log->num_events - offset,
+                                           log->events + offset,
+                                           log->strings + offset,
+                                           &num_written,
+                                           sizeof(text),
+                                           text,
+                                           &length);
+
+    offset += num_written;
+    total += length;
+  }
+
+  return total;
+}
+
+/// Write the events read from the corpus tersely
+static size_t
+bench_write(Corpus const* const corpus, EventLog const* const log)
+{
+  (void)corpus;
+  return write_all(log, SAJS_WRITE_TERSE | SAJS_WRITE_NEWLINES);
+}
+
+/// Write the events read from the corpus with indentation
+static size_t
+bench_indent(Corpus const* const corpus, EventLog const* const log)
+{
+  (void)corpus;
+  return write_all(log, SAJS_WRITE_NEWLINES);
+}
+
+/// Reformat the corpus into a buffer, discard the text, and return its length
+static size_t
+copy_all(Corpus const* const corpus, SajsWriteFlags const flags)
+{
+  static char text[65536U];
+
+  uintptr_t         mem[8U];
+  SajsWriter* const writer = sajs_writer_init(sizeof(mem), mem);
+  size_t            total  = 0U;
+
+  // Keep going until a final call with no input finishes everything
+  SajsStatus st       = SAJS_RETRY;
+  size_t     offset   = 0U;
+  bool       finished = false;
+  while (st == SAJS_RETRY || !finished) {
+    size_t const left   = corpus->length - offset;
+    size_t       count  = 0U;
+    size_t       length = 0U;
+    st                  = sajs_write_text(writer,
+                                          flags,
+                                          left,
+                                          corpus->data + offset,
+                                          &count,
+                                          sizeof(text),
+                                          text,
+                                          &length);
+
+    offset += count;
+    total += length;
+    finished = !left;
+  }
+
+  return total;
+}
+
+/// Reformat the corpus tersely without reading events
+static size_t
+bench_minify(Corpus const* const corpus, EventLog const* const log)
+{
+  (void)log;
+  return copy_all(corpus, SAJS_WRITE_TERSE | SAJS_WRITE_NEWLINES);
+}
+
+/// Reformat the corpus with indentation without reading events
+static size_t
+bench_reindent(Corpus const* const corpus, EventLog const* const log)
+{
+  (void)log;
+  return copy_all(corpus, SAJS_WRITE_NEWLINES);
+}
+
+/// Grow the arrays of a log to hold `size` events
+static void
+grow_log(EventLog* const log, size_t const size)
+{
+  SajsEvent* const events =
+    (SajsEvent*)realloc(log->events, size * sizeof(SajsEvent));
+  SajsStringView* const strings =
+    (SajsStringView*)realloc(log->strings, size * sizeof(SajsStringView));
+  char* const bytes = (char*)realloc(log->bytes, size * 4U);
+
+  if (events) {
+    log->events = events;
+  }
+
+  if (strings) {
+    log->strings = strings;
+  }
+
+  if (bytes) {
+    log->bytes = bytes;
+  }
+
+  if (!events || !strings || !bytes) {
+    (void)fprintf(stderr, "error: failed to allocate events\n");
+    exit(1);
+  }
+}
+
+/// Read all the events in a corpus with spans, copying strings in the lexer
+static void
+read_log(Corpus const* const corpus, EventLog* const log)
+{
+  uintptr_t        mem[(64U + stack_size) / sizeof(uintptr_t)];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+  size_t           size  = 0U;
+
+  log->num_events = 0U;
+  for (size_t offset = 0U; offset <= corpus->length;) {
+    size_t          count = 0U;
+    SajsEvent const e     = sajs_read_spans(
+      lexer, corpus->length - offset, corpus->data + offset, &count);
+    if (e.status) {
+      check_end(e.status);
+      break;
+    }
+
+    offset += count;
+    if (e.type) {
+      if (log->num_events == size) {
+        size = size ? (size * 2U) : 4096U;
+        grow_log(log, size);
+      }
+
+      size_t const   i      = log->num_events++;
+      SajsStringView string = sajs_string(lexer);
+      if (string.length <= 4U) {
+        memcpy(log->bytes + (i * 4U), string.data, string.length);
+        string.data = log->bytes + (i * 4U);
+      }
+
+      log->events[i]  = e;
+      log->strings[i] = string;
+    }
+  }
+
+  // Point strings into the final copy of the bytes
+  for (size_t i = 0U; i < log->num_events; ++i) {
+    if (log->strings[i].length <= 4U) {
+      log->strings[i].data = log->bytes + (i * 4U);
+    }
+  }
+}
+
+static Bench const benches[] = {
+  {"byte", bench_byte, false},
+  {"buffer", bench_buffer, false},
+  {"spans", bench_spans, false},
+  {"lex", bench_lex, false},
+  {"validate", bench_validate, false},
+  {"skip", bench_skip, false},
+  {"write", bench_write, true},
+  {"indent", bench_indent, true},
+  {"minify", bench_minify, false},
+  {"reindent", bench_reindent, false},
+};
+
+/// Run a benchmark several times and print the best result
+static void
+run_bench(Bench const* const    bench,
+          char const* const     corpus_name,
+          Corpus const* const   corpus,
+          EventLog const* const log,
+          unsigned const        repeats)
+{
+  double best  = 0.0;
+  size_t count = 0U;
+  for (unsigned r = 0U; r < repeats; ++r) {
+    double const start = now();
+    count              = bench->func(corpus, log);
+    double const t     = now() - start;
+    if (!r || t < best) {
+      best = t;
+    }
+  }
+
+  bool const   is_write = bench->needs_log;
+  size_t const bytes    = is_write ? count : corpus->length;
+  size_t const events   = is_write ? log->num_events : count;
+  double const secs     = (best > 0.0) ? best : 1e-9;
+
+  printf("{\"benchmark\": \"%s\", \"corpus\": \"%s\", \"bytes\": %zu, "
+         "\"events\": %zu, \"seconds\": %.6f, \"MB_per_s\": %.2f, "
+         "\"events_per_s\": %.0f}\n",
+         bench->name,
+         corpus_name,
+         bytes,
+         events,
+         best,
+         (double)bytes / secs / 1e6,
+         (double)events / secs);
+}
+
+static int
+print_usage(char const* const name, bool const error)
+{
+  (void)fprintf(
+    error ? stderr : stdout,
+    "Usage: %s [OPTION]... [INPUT]\n"
+    "Run throughput benchmarks on a generated corpus or an INPUT file.\n\n"
+    "  -b BENCH    Run only BENCH (byte, buffer, spans, validate, skip,\n"
+    "              write, indent, minify, reindent).\n"
+    "  -c CORPUS   Generate CORPUS (citm, nested, ndjson, numbers,\n"
+    "              pretty, strings, twitter).\n"
+    "  -g          Only generate the corpus and write it to stdout.\n"
+    "  -h          Display this help and exit.\n"
+    "  -n REPEATS  Run each benchmark REPEATS times and report the best.\n"
+    "  -s BYTES    Generate a corpus of about BYTES bytes.\n",
+    name);
+  return error ? 1 : 0;
+}
+
+int
+main(int const argc, char** const argv)
+{
+  char const* bench_name  = NULL;
+  char const* corpus_name = "twitter";
+  size_t      size        = default_size;
+  unsigned    repeats     = default_repeats;
+  bool        gen_only    = false;
+
+  int a = 1;
+  for (; a < argc && argv[a][0] == '-' && argv[a][1]; ++a) {
+    char const  opt = argv[a][1];
+    char const* arg = (a + 1 < argc) ? argv[a + 1] : NULL;
+    if (argv[a][2]) {
+      return print_usage(argv[0], true);
+    }
+
+    if (opt == 'g') {
+      gen_only = true;
+    } else if (opt == 'h') {
+      return print_usage(argv[0], false);
+    } else if (!arg) {
+      return print_usage(argv[0], true);
+    } else if (opt == 'b') {
+      bench_name = argv[++a];
+    } else if (opt == 'c') {
+      corpus_name = argv[++a];
+    } else if (opt == 'n') {
+      repeats = (unsigned)strtoul(argv[++a], NULL, 10);
+    } else if (opt == 's') {
+      size = (size_t)strtoull(argv[++a], NULL, 10);
+    } else {
+      return print_usage(argv[0], true);
+    }
+  }
+
+  // Load or generate the corpus
+  Corpus corpus = {NULL, 0U, 0U};
+  if (a < argc) {
+    corpus_name = argv[a];
+    if (!load(argv[a], &corpus)) {
+      (void)fprintf(stderr, "error: failed to read \"%s\"\n", argv[a]);
+      return 1;
+    }
+  } else if (!generate(corpus_name, size, &corpus)) {
+    (void)fprintf(stderr, "error: unknown corpus \"%s\"\n", corpus_name);
+    return 1;
+  }
+
+  if (gen_only) {
+    int const rc =
+      fwrite(corpus.data, 1U, corpus.length, stdout) != corpus.length;
+    free(corpus.data);
+    return rc;
+  }
+
+  // Run the selected benchmarks
+  EventLog log   = {NULL, NULL, NULL, 0U};
+  bool     found = false;
+  for (size_t i = 0U; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+    Bench const* const bench = &benches[i];
+    if (!bench_name || !strcmp(bench_name, bench->name)) {
+      if (bench->needs_log && !log.num_events) {
+        read_log(&corpus, &log);
+      }
+
+      run_bench(bench, corpus_name, &corpus, &log, repeats ? repeats : 1U);
+      found = true;
+    }
+  }
+
+  free(log.bytes);
+  free(log.strings);
+  free(log.events);
+  free(corpus.data);
+  if (!found) {
+    (void)fprintf(stderr, "error: unknown benchmark \"%s\"\n", bench_name);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,214 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#ifndef SAJS_IO_H
+#define SAJS_IO_H
+
+#include "sajs/sajs.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+   @defgroup sajs_io Sajs I/O
+   An optional driver for reformatting JSON with non-blocking I/O.
+
+   The core library never does any I/O, so every program needs a loop that
+   reads input into a buffer, lexes it, and writes the events as text into
+   another buffer to be written out.  This is that loop, written so that it
+   never blocks: whenever it runs out of input, or the output buffer is full,
+   it returns #SAJS_RETRY so the caller can wait for the I/O to be ready, for
+   example with poll, epoll, or kqueue, and call it again.
+
+   The driver can read and write non-blocking file descriptors itself with
+   #sajs_io_pump, or the caller can do the I/O and pass buffers back and
+   forth, for completion-based I/O like io_uring where reads and writes are
+   submitted and finish later.
+
+   This is a separate library, since it uses the system I/O functions, which
+   the core library doesn't depend on.  It's only available on POSIX systems.
+   @{
+*/
+
+// SAJS_IO_API exposes symbols in the I/O library API
+#ifndef SAJS_IO_API
+#  if defined(_WIN32) && !defined(SAJS_STATIC) && defined(SAJS_IO_INTERNAL)
+#    define SAJS_IO_API __declspec(dllexport)
+#  elif defined(_WIN32) && !defined(SAJS_STATIC)
+#    define SAJS_IO_API __declspec(dllimport)
+#  elif defined(__GNUC__)
+#    define SAJS_IO_API __attribute__((visibility("default")))
+#  else
+#    define SAJS_IO_API
+#  endif
+#endif
+
+/**
+   Non-blocking I/O driver.
+
+   This is a lexer and writer, with a batch of events and buffers for input
+   and output, all in provided memory.
+*/
+typedef struct SajsIoImpl SajsIo;
+
+/// I/O that a driver is waiting for
+typedef enum {
+  SAJS_IO_READ  = 1U << 0U, ///< Waiting for input to read
+  SAJS_IO_WRITE = 1U << 1U, ///< Waiting for output to be written
+} SajsIoFlag;
+
+/// Bitwise OR of SajsIoFlag values
+typedef unsigned SajsIoFlags;
+
+/// A mutable buffer to read input into
+typedef struct {
+  char* SAJS_NONNULL data; ///< Pointer to the first byte
+  size_t             size; ///< Size of buffer in bytes
+} SajsIoBuffer;
+
+/// Statistics about the I/O done by #sajs_io_pump
+typedef struct {
+  uint64_t reads;         ///< Calls to read, including any that block
+  uint64_t writes;        ///< Calls to write, including any that block
+  uint64_t blocked;       ///< Calls that would have blocked
+  uint64_t bytes_read;    ///< Bytes read altogether
+  uint64_t bytes_written; ///< Bytes written altogether
+} SajsIoStats;
+
+/**
+   Return the size of memory needed for a driver.
+
+   @param buffer_size Size of both the input and the output buffer.
+   @return The size of memory for #sajs_io_init, or zero if it's too large.
+*/
+SAJS_IO_API SAJS_CONST_FUNC size_t
+sajs_io_mem_size(size_t buffer_size);
+
+/**
+   Set up a driver in provided memory.
+
+   The memory must be word-aligned.  The driver state takes a couple of
+   kilobytes, and the rest is split evenly between the input and output
+   buffers, which can be sized with #sajs_io_mem_size.  Larger buffers mean
+   fewer system calls, and can be any size, but NULL is returned if there
+   isn't room for at least 64 bytes in each.
+
+   The driver uses the given lexer and writer, which must stay valid as long
+   as it does, and writes text with the given `flags` as in
+   #sajs_write_events.  Any number of root values may be read, one after
+   another.
+*/
+SAJS_IO_API SAJS_MALLOC_FUNC SajsIo* SAJS_ALLOCATED
+sajs_io_init(size_t                   mem_size,
+             void* SAJS_NONNULL       mem,
+             SajsLexer* SAJS_NONNULL  lexer,
+             SajsWriter* SAJS_NONNULL writer,
+             SajsWriteFlags           flags);
+
+/**
+   Reset a driver to process new input.
+
+   This discards all buffered input and output, and resets the lexer and
+   writer, so a driver can be reused for another stream.
+*/
+SAJS_IO_API void
+sajs_io_reset(SajsIo* SAJS_NONNULL io);
+
+/**
+   Set the statistics that a driver counts, or clear them with null.
+
+   Statistics are only counted by #sajs_io_pump, since the driver doesn't do
+   any I/O otherwise.  Unlike lexer and writer statistics, these are always
+   supported, since they cost very little compared to a system call.
+
+   @return #SAJS_SUCCESS.
+*/
+SAJS_IO_API SajsStatus
+sajs_io_set_stats(SajsIo* SAJS_NONNULL io, SajsIoStats* stats);
+
+/**
+   Return the I/O that a driver is waiting for.
+
+   This is #SAJS_IO_READ if all the input has been consumed, and
+   #SAJS_IO_WRITE if there is output in the buffer.  It may be both, in which
+   case either one lets the driver continue, and the two can happen at the
+   same time, since they use separate buffers.  It's zero once everything has
+   been read and written.
+*/
+SAJS_IO_API SAJS_PURE_FUNC SajsIoFlags
+sajs_io_waiting(SajsIo const* SAJS_NONNULL io);
+
+/**
+   Return the buffer to read more input into.
+
+   This is only meaningful while the driver is waiting for #SAJS_IO_READ,
+   and is the whole input buffer, since input is only read once it's all
+   consumed.  Once some input has been read into it, it's passed to the driver
+   with #sajs_io_add_input.
+*/
+SAJS_IO_API SAJS_PURE_FUNC SajsIoBuffer
+sajs_io_input(SajsIo const* SAJS_NONNULL io);
+
+/**
+   Add input that has been read into the input buffer, and process it.
+
+   The first `length` bytes of the buffer from #sajs_io_input are read, and
+   the events written as text into the output buffer, until the input is
+   consumed or the output is full.  A `length` of zero signals the end of
+   input.
+
+   @return #SAJS_RETRY if the driver is waiting for I/O, #SAJS_SUCCESS if
+   everything has been read, an error if the input is invalid, or
+   #SAJS_FAILURE if the driver isn't waiting for input.  After an error, the
+   output still has the text for all the events before it.
+*/
+SAJS_IO_API SajsStatus
+sajs_io_add_input(SajsIo* SAJS_NONNULL io, size_t length);
+
+/**
+   Return the output that is waiting to be written.
+
+   This remains valid, and only grows at the end, until it's all been
+   dropped with #sajs_io_drop_output.  So, a write can be started for this
+   output while more input is added, but only one write can be in progress at
+   a time.
+*/
+SAJS_IO_API SAJS_PURE_FUNC SajsStringView
+sajs_io_output(SajsIo const* SAJS_NONNULL io);
+
+/**
+   Drop output that has been written from the output buffer, and continue.
+
+   The first `length` bytes of the output from #sajs_io_output are dropped,
+   and if that was all of it, the driver continues processing input into the
+   free space.
+
+   @return The same as #sajs_io_add_input, or #SAJS_FAILURE if `length` is
+   more than the pending output.
+*/
+SAJS_IO_API SajsStatus
+sajs_io_drop_output(SajsIo* SAJS_NONNULL io, size_t length);
+
+/**
+   Read and write non-blocking file descriptors until they would block.
+
+   This calls read and write as many times as possible, processing input as
+   it arrives, until both descriptors would block, or everything is done.  So,
+   after waiting for whatever #sajs_io_waiting returns, a single call drains
+   as much as possible from the input to the output.  The descriptors should
+   be non-blocking (with O_NONBLOCK), otherwise this still works but blocks
+   like any other read or write.
+
+   @return #SAJS_RETRY if the driver is waiting for I/O, #SAJS_SUCCESS if
+   everything has been read and written, #SAJS_BAD_READ or #SAJS_BAD_WRITE if
+   I/O fails (with `errno` set by the failed call), or an error if the input
+   is invalid, once all the output before it has been written.
+*/
+SAJS_IO_API SajsStatus
+sajs_io_pump(SajsIo* SAJS_NONNULL io, int in_fd, int out_fd);
+
+/**
+   @}
+*/
+
+#endif /* SAJS_IO_H */
@@ -4,7 +4,9 @@
 #ifndef SAJS_SAJS_H
 #define SAJS_SAJS_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /**
    @defgroup sajs Sajs
@@ -69,6 +71,7 @@ typedef enum {
   SAJS_EXPECTED_UTF16_LO,      ///< Expected UTF-16 low surrogate escape
   SAJS_EXPECTED_UTF8,          ///< Expected valid UTF-8 bytes
   SAJS_EXPECTED_VALUE,         ///< Expected value
+  SAJS_BAD_READ,               ///< Failed read
 } SajsStatus;
 
 /**
@@ -92,6 +95,8 @@ typedef enum {
   SAJS_IS_ELEMENT      = 1U << 2U, ///< Array element
   SAJS_IS_FIRST        = 1U << 3U, ///< First element or member in container
   SAJS_HAS_BYTES       = 1U << 4U, ///< Event has bytes
+  SAJS_IS_ROOT         = 1U << 5U, ///< Top-level value (document root)
+  SAJS_IS_CONTINUED    = 1U << 6U, ///< Bytes continue in the next buffer
 } SajsFlag;
 
 /// Bitwise OR of SajsFlag values
@@ -124,8 +129,9 @@ typedef enum {
      The end of both a value and its container.
 
      This happens when a single character, '}' or ']', ends both the current
-     number/literal and the object/array it's in.  The `kind` will be set to
-     the kind of the container (the kind of the number/literal is implicit).
+     number/literal and the object/array it's in.  The `kind` and `flags`
+     will be set to those of the container (the kind of the number/literal is
+     implicit).
   */
   SAJS_EVENT_DOUBLE_END,
 
@@ -133,8 +139,11 @@ typedef enum {
      Character bytes for a string, number, or literal.
 
      One or more of these may occur after the start, and before the end, of a
-     string, number, or literal.  Each event represents one character, given as
-     up to four bytes in UTF-8 encoding.
+     string, number, or literal.  Each event usually represents one character,
+     given as up to four bytes in UTF-8 encoding, but may represent a longer
+     span of characters when reading with #sajs_read_spans.  The bytes of
+     strings are always valid UTF-8, without overlong encodings, surrogates,
+     or code points past U+10FFFF.
   */
   SAJS_EVENT_BYTES,
 } SajsEventType;
@@ -174,14 +183,40 @@ sajs_strerror(SajsStatus status);
 
    The initial few bytes of the memory will be used for lexer state, and
    following memory will be used as a stack.  One byte of stack is needed for
-   each level of value nesting in the input.
+   each level of value nesting in the input, or if the library is built with a
+   compact stack, one bit after the first four bytes.
 
-   The memory must be word-aligned and at least 48 bytes.  NULL is returned if
-   not enough space is available.
+   The memory must be word-aligned and at least 64 bytes, or 72 if the library
+   is built with statistics enabled.  NULL is returned if not enough space is
+   available.
 */
 SAJS_API SAJS_MALLOC_FUNC SajsLexer* SAJS_ALLOCATED
 sajs_lexer_init(size_t mem_size, void* SAJS_NONNULL mem);
 
+/**
+   Reset a lexer to read a new document.
+
+   A lexer reads any number of top-level values in sequence, like a stream of
+   concatenated or newline-delimited JSON documents.  The start and end events
+   of each top-level value have the #SAJS_IS_ROOT flag set, and after the end,
+   the lexer is ready to read the next one.  This function only needs to be
+   called to abandon a document part way through, for example to recover from
+   an error.  It doesn't change the stack memory, so it's much cheaper than
+   initializing a new lexer.
+*/
+SAJS_API void
+sajs_lexer_reset(SajsLexer* SAJS_NONNULL lexer);
+
+/**
+   Return the current depth of value nesting.
+
+   This is the number of values that have been started but not yet ended,
+   including the current string, number, or literal.  It's zero between
+   top-level values.
+*/
+SAJS_API SAJS_PURE_FUNC size_t
+sajs_lexer_depth(SajsLexer const* SAJS_NONNULL lexer);
+
 /**
    Read one byte and return any produced event.
 
@@ -192,6 +227,175 @@ sajs_lexer_init(size_t mem_size, void* SAJS_NONNULL mem);
 SAJS_API SajsEvent
 sajs_read_byte(SajsLexer* SAJS_NONNULL lexer, int byte);
 
+/**
+   Read bytes from a buffer until an event is produced.
+
+   This runs the lexer over the given `length` bytes of `data`, and returns as
+   soon as an event is produced, an error occurs, or the end of the buffer is
+   reached.  The number of bytes consumed is written to `count`, so reading
+   can be resumed from `data + count` with the same lexer.  Any produced bytes
+   are available from #sajs_string until the next read.
+
+   If an error occurs, the offending byte is not counted as consumed, so
+   `data[count]` is the byte that caused the error.  If the end of the buffer
+   is reached without producing an event, #SAJS_SUCCESS is returned with
+   #SAJS_EVENT_NOTHING, and `count` is `length`.
+
+   An empty buffer signals the end of input, which is equivalent to reading -1
+   with #sajs_read_byte.
+*/
+SAJS_API SajsEvent
+sajs_read_buffer(SajsLexer* SAJS_NONNULL  lexer,
+                 size_t                   length,
+                 char const* SAJS_NONNULL data,
+                 size_t* SAJS_NONNULL     count);
+
+/**
+   Read bytes from a buffer until an event is produced, using spans.
+
+   This is like #sajs_read_buffer, except a run of characters in a value that
+   appear verbatim in the input is produced as a single #SAJS_EVENT_BYTES
+   event, rather than one event per character.  This applies to all unescaped
+   characters in strings, and all characters after the first in numbers and
+   literals (except the last character of a literal, which is produced with
+   its end event).  The bytes returned by #sajs_string then point directly into
+   `data`, so it must remain valid until the next read.
+
+   Escapes in strings, and characters split across buffers, are still produced
+   one character at a time.
+
+   The lexer never buffers input, so a value split across buffers is produced
+   in parts, each from the buffer it's in.  Bytes that reach the end of the
+   buffer have the #SAJS_IS_CONTINUED flag set, since the value continues in
+   the next buffer, but this is only a hint for handling the bytes: the value
+   still ends with its end event, which may be produced by the next byte read.
+   Either way, a buffer can be released as soon as it's been read, without
+   copying anything from it.
+*/
+SAJS_API SajsEvent
+sajs_read_spans(SajsLexer* SAJS_NONNULL  lexer,
+                size_t                   length,
+                char const* SAJS_NONNULL data,
+                size_t* SAJS_NONNULL     count);
+
+/**
+   Check that input is valid without producing events.
+
+   This runs the lexer like #sajs_read_spans, but only reports errors, which
+   is faster when the output isn't needed.  The given `length` bytes of `data`
+   are read until the end of a top-level value, an error, or the end of the
+   buffer, and the number of bytes consumed is written to `count`.
+
+   @return #SAJS_SUCCESS if a top-level value was completed, #SAJS_RETRY if
+   the end of the buffer was reached without completing a value, or an error.
+   As with #sajs_read_buffer, the offending byte isn't counted, so `data[count]`
+   is where the error occurred.  An empty buffer signals the end of input, and
+   returns #SAJS_FAILURE if it's reached between values, #SAJS_SUCCESS if it
+   ends a top-level number, or #SAJS_NO_DATA if a value is incomplete.
+*/
+SAJS_API SajsStatus
+sajs_validate(SajsLexer* SAJS_NONNULL  lexer,
+              size_t                   length,
+              char const* SAJS_NONNULL data,
+              size_t* SAJS_NONNULL     count);
+
+/**
+   Skip the rest of the current value without producing events.
+
+   This is typically called after the #SAJS_EVENT_START of a value that isn't
+   needed, and consumes input until the end of that value, as if it had been
+   read.  It can also be called anywhere in an array or object to skip the
+   rest of it.  The `length` bytes of `data` are read, and the number consumed
+   is written to `count`, like #sajs_validate.
+
+   Skipping an array or object is fast, since only brackets and quotes are
+   looked at, many bytes at a time.  Note that this means the contents aren't
+   checked, so invalid JSON in the skipped value may not be reported.  Only
+   the closing bracket is checked, which must match the container.  Strings,
+   numbers, and literals are skipped like #sajs_validate, and fully checked.
+   As with reading a number normally, the character that ends a number is
+   consumed as well.
+
+   @return #SAJS_SUCCESS if the end of the value was reached, #SAJS_RETRY if
+   the end of the buffer was reached first, in which case this must be called
+   again with more input, or an error.  #SAJS_FAILURE is returned if there is
+   no current value to skip.
+*/
+SAJS_API SajsStatus
+sajs_skip_value(SajsLexer* SAJS_NONNULL  lexer,
+                size_t                   length,
+                char const* SAJS_NONNULL data,
+                size_t* SAJS_NONNULL     count);
+
+/// A class of lexer states, which bytes read are counted by
+typedef enum {
+  SAJS_STATE_STRUCTURE, ///< Whitespace, punctuation, or the start of a value
+  SAJS_STATE_STRING,    ///< Character in a string
+  SAJS_STATE_ESCAPE,    ///< Escape in a string (after the backslash)
+  SAJS_STATE_NUMBER,    ///< Character in a number (after the first)
+  SAJS_STATE_LITERAL,   ///< Character in a literal (after the first)
+} SajsStateClass;
+
+/**
+   Statistics about reading.
+
+   These are counted by a lexer if the library was built with statistics
+   enabled.  Counters are only ever increased, so a single struct can collect
+   statistics from many documents, or many lexers in turn.
+*/
+typedef struct {
+  uint64_t events[SAJS_EVENT_BYTES + 1U];  ///< Number of each SajsEventType
+  uint64_t bytes[SAJS_STATE_LITERAL + 1U]; ///< Bytes read in each state class
+  uint64_t retries;                        ///< Bytes read again to end numbers
+  uint64_t escapes;                        ///< Escapes in strings
+  uint64_t max_depth;                      ///< Maximum stack depth reached
+} SajsLexerStats;
+
+/**
+   Set the statistics that a lexer updates while reading, or null to stop.
+
+   This is only supported if the library was built with statistics enabled
+   (the `stats` build option), since counting has a small cost even when no
+   statistics are set, and returns #SAJS_FAILURE otherwise.  The count for
+   #SAJS_EVENT_NOTHING is the number of bytes read one at a time that produced
+   no event, so bytes skipped in whitespace or spans aren't counted there.
+*/
+SAJS_API SajsStatus
+sajs_lexer_set_stats(SajsLexer* SAJS_NONNULL lexer, SajsLexerStats* stats);
+
+/**
+   A position in the input.
+
+   Offsets and columns are counted in bytes, and lines are separated by
+   newlines.  Lines and columns start at 1, so the start of the input is
+   offset 0, line 1, column 1.
+*/
+typedef struct {
+  uint64_t offset; ///< Number of bytes before the position
+  uint64_t line;   ///< Line number, or zero if lines aren't counted
+  uint64_t column; ///< Column number in the line
+} SajsPosition;
+
+/**
+   Set the position that a lexer advances while reading, or null to stop.
+
+   After every read, the position is advanced past the bytes consumed, so it's
+   the position of the next byte to read.  Since the byte that causes an error
+   isn't consumed, this is where any error occurred.  The position isn't
+   changed when the lexer is reset, so it can continue over many documents in
+   a stream.
+
+   The offset is advanced once per call, so counting it costs almost nothing.
+   Lines are only counted if `line` is set to 1 (with `column` also 1) at the
+   start, since this requires scanning the input again for newlines.  If
+   `line` is zero, then only the offset is updated.
+
+   This returns #SAJS_FAILURE if the library was built without position
+   tracking (the `positions` build option).
+*/
+SAJS_API SajsStatus
+sajs_lexer_set_position(SajsLexer* SAJS_NONNULL lexer, SajsPosition* position);
+
 /// A view of an immutable string slice with a length
 typedef struct {
   char const* SAJS_NONNULL data;   ///< Pointer to the first character
@@ -201,13 +405,483 @@ typedef struct {
 /**
    Return a view of the bytes for the last read character.
 
-   If the last event returned from #sajs_read_byte indicates that bytes are
-   available, this function will return them until the state is
-   changed by reading another character, or is reset.
+   If the last event returned from #sajs_read_byte or #sajs_read_buffer
+   indicates that bytes are available, this function will return them until
+   the state is changed by reading another character, or is reset.
 */
 SAJS_API SAJS_PURE_FUNC SajsStringView
 sajs_string(SajsLexer const* SAJS_NONNULL lexer);
 
+/// Flags describing a number value
+typedef enum {
+  SAJS_NUMBER_NEGATIVE = 1U << 0U, ///< Number has a leading '-'
+  SAJS_NUMBER_INTEGER  = 1U << 1U, ///< Number has no fraction or exponent
+  SAJS_NUMBER_OVERFLOW = 1U << 2U, ///< Number is too large to represent
+  SAJS_NUMBER_INEXACT  = 1U << 3U, ///< Real may not be correctly rounded
+} SajsNumberFlag;
+
+/// Bitwise OR of SajsNumberFlag values
+typedef unsigned SajsNumberFlags;
+
+/**
+   The value of a number.
+
+   Every number has a `real` value, which is the nearest double.  Integers
+   also have an exact `magnitude` (absolute value), so the integer is
+   `-magnitude` if #SAJS_NUMBER_NEGATIVE is set.
+
+   If #SAJS_NUMBER_OVERFLOW is set, then either the number is an integer that
+   doesn't fit in 64 bits (and `magnitude` is `UINT64_MAX`), or it's too large
+   for a double (and `real` is infinite).
+
+   The lexer only keeps as many significant digits as fit in 64 bits, so a
+   number with more digits than that may be very close to halfway between two
+   doubles, too close to round correctly.  In that case, #SAJS_NUMBER_INEXACT
+   is set, and `real` may be off by one unit in the last place.
+*/
+typedef struct {
+  double          real;      ///< Nearest double value
+  uint64_t        magnitude; ///< Absolute value of an integer
+  SajsNumberFlags flags;     ///< Flags describing the value
+} SajsNumber;
+
+/**
+   Return the value of the last read number.
+
+   Digits are accumulated as they're read, so this can be called after the
+   #SAJS_EVENT_END of a number (or the #SAJS_EVENT_DOUBLE_END that ends it and
+   its container) to get its value without parsing the text again.  The result
+   is only meaningful at that point, until another value is read.
+*/
+SAJS_API SAJS_PURE_FUNC SajsNumber
+sajs_number(SajsLexer const* SAJS_NONNULL lexer);
+
+/**
+   Reset a lexer to continue reading part way through a top-level container.
+
+   This sets up the lexer as if it had just read a comma between elements of
+   a top-level array, or members of a top-level object, such as a split found
+   by #sajs_find_split.  Reading can then continue from the following byte,
+   so different parts of a large document can be read in parallel.
+
+   @return #SAJS_SUCCESS, #SAJS_FAILURE if `kind` isn't #SAJS_ARRAY or
+   #SAJS_OBJECT, or #SAJS_OVERFLOW if the stack is too small.
+*/
+SAJS_API SajsStatus
+sajs_lexer_resume(SajsLexer* SAJS_NONNULL lexer, SajsValueKind kind);
+
+/**
+   Functions called by #sajs_lex for each part of the input.
+
+   Every handler is passed the `handle` given to #sajs_lex, and returns
+   #SAJS_SUCCESS to continue reading, or any other status to stop.  Any
+   handler may be null to ignore those values.
+
+   The bytes of member names and strings are passed as they arrive, in spans
+   like #sajs_read_spans, which are only valid during the call.  The last
+   call for each string has `last` set, and may have no bytes, so every
+   string has exactly one such call.
+*/
+typedef struct {
+  /// Start of an object or array
+  SajsStatus (*start)(void* handle, SajsValueKind kind);
+
+  /// End of an object or array
+  SajsStatus (*end)(void* handle, SajsValueKind kind);
+
+  /// Bytes of an object member name
+  SajsStatus (*name)(void* handle, SajsStringView bytes, bool last);
+
+  /// Bytes of a string value
+  SajsStatus (*string)(void* handle, SajsStringView bytes, bool last);
+
+  /// Value of a number, after its end
+  SajsStatus (*number)(void* handle, SajsNumber number);
+
+  /// Literal value, the first character of "false", "null", or "true"
+  SajsStatus (*literal)(void* handle, char literal);
+} SajsHandlers;
+
+/**
+   Read a buffer and call handlers for everything in it.
+
+   This reads the `length` bytes of `data` like #sajs_read_spans, but calls
+   the corresponding handler for everything read, rather than returning each
+   event to the caller, which is faster for consumers that act on every
+   value.  The number of bytes consumed is written to `count`.  An empty
+   buffer signals the end of input, as with #sajs_read_byte.
+
+   @return #SAJS_SUCCESS if the whole buffer was read, #SAJS_FAILURE if the
+   end of input was reached between values, a status returned by a handler
+   (in which case `count` is just after what it was called for), or an error
+   (in which case `data[count]` is the offending byte).
+*/
+SAJS_API SajsStatus
+sajs_lex(SajsLexer* SAJS_NONNULL           lexer,
+         size_t                            length,
+         char const* SAJS_NONNULL          data,
+         size_t* SAJS_NONNULL              count,
+         SajsHandlers const* SAJS_NONNULL handlers,
+         void*                             handle);
+
+/**
+   The structure of a chunk of a document, used to split it up for reading.
+
+   A large document can be split into chunks at arbitrary offsets, and each
+   chunk scanned independently (possibly in parallel) by #sajs_scan_chunk.
+   This sets the `change` fields, since a chunk can be scanned without knowing
+   whether it starts in a string.  Then, #sajs_link_chunk is called for each
+   chunk in order to set the remaining fields, before #sajs_find_split can find
+   where reading can resume in the chunk.
+*/
+typedef struct {
+  size_t  begin;      ///< Offset of the first byte in the chunk
+  size_t  end;        ///< Offset one past the last byte in the chunk
+  int64_t change[2];  ///< Container depth change if not, or if, in a string
+  int64_t depth;      ///< Container depth at the start of the chunk
+  uint8_t odd_quotes; ///< 1 if the chunk has an odd number of quotes
+  uint8_t in_string;  ///< 1 if the chunk starts in a string
+} SajsChunk;
+
+/**
+   Scan the structure of a chunk of a document.
+
+   The caller must set the `begin` and `end` of the chunk, which is read from
+   the given `length` bytes of `data` (the whole document, since escapes may
+   need to be checked before the chunk).  This sets the `change` and
+   `odd_quotes` fields, which only depend on the bytes in the chunk.
+*/
+SAJS_API void
+sajs_scan_chunk(size_t                   length,
+                char const* SAJS_NONNULL data,
+                SajsChunk* SAJS_NONNULL  chunk);
+
+/**
+   Link a scanned chunk to the previous chunk in a document.
+
+   This sets the `depth` and `in_string` fields from the previous chunk, which
+   must already be linked, or null for the first chunk in the document.
+*/
+SAJS_API void
+sajs_link_chunk(SajsChunk const* prev, SajsChunk* SAJS_NONNULL chunk);
+
+/**
+   Return the first offset in a linked chunk where reading can resume.
+
+   This is just after the first comma at depth 1 (between elements or members
+   of the top-level container) in the chunk, where a lexer set up with
+   #sajs_lexer_resume can continue reading.  Returns zero if there is none.
+
+   The split is found without lexing, so it's only correct if the document is
+   valid.  A lexer that reads from the start of the document should still be
+   in the same top-level container, at depth 1, after reading the comma.
+   Otherwise, the rest of the document must be read from there, not from a
+   lexer set up with #sajs_lexer_resume.
+*/
+SAJS_API size_t
+sajs_find_split(size_t                        length,
+                char const* SAJS_NONNULL      data,
+                SajsChunk const* SAJS_NONNULL chunk);
+
+/**
+   JSON Pointer filter state.
+
+   This is a small trie of JSON Pointers, and the state of matching them
+   against the values read by a lexer.
+*/
+typedef struct SajsFilterImpl SajsFilter;
+
+/**
+   Set up a JSON Pointer filter in provided memory.
+
+   The filter matches nothing until pointers are added with #sajs_filter_add.
+   The memory must be word-aligned and at least 4096 bytes, which is mostly
+   used for the structure of the pointers, and the rest is used to store their
+   text.  NULL is returned if not enough space is available.
+*/
+SAJS_API SAJS_MALLOC_FUNC SajsFilter* SAJS_ALLOCATED
+sajs_filter_init(size_t mem_size, void* SAJS_NONNULL mem);
+
+/**
+   Reset a filter to read a new document.
+
+   Like #sajs_lexer_reset, this only needs to be called to abandon a document
+   part way through, along with the lexer.  The pointers in the filter are
+   kept.
+*/
+SAJS_API void
+sajs_filter_reset(SajsFilter* SAJS_NONNULL filter);
+
+/**
+   Add a JSON Pointer to the values matched by a filter.
+
+   The pointer is a string like "/a/b/0", as defined in RFC 6901, where each
+   segment after a slash is an object member name or an array index, with "~1"
+   and "~0" escaping '/' and '~'.  The empty pointer "" matches every
+   top-level value.  As an extension, a segment that's only "*" is a wildcard
+   that matches any member or element, so a member named "*" can't be
+   matched by name.
+
+   Pointers with common prefixes share segments, and at most 63 different
+   segments can be added in total.
+
+   @return #SAJS_SUCCESS, #SAJS_FAILURE if the pointer is invalid, or
+   #SAJS_OVERFLOW if there isn't enough space to add it.
+*/
+SAJS_API SajsStatus
+sajs_filter_add(SajsFilter* SAJS_NONNULL filter,
+                size_t                   length,
+                char const* SAJS_NONNULL pointer);
+
+/**
+   Read bytes from a buffer until an event in a matching value is produced.
+
+   This reads like #sajs_read_spans, and returns in the same way, except only
+   the events of values matched by a pointer in the filter are produced.
+   Everything else is skipped with #sajs_skip_value, which is much faster
+   when only a small part of the input is needed.  The lexer must be used
+   only with the filter, from the start of a document.
+
+   Each matching value is produced as if it were a top-level value: its start
+   and end events have only the #SAJS_IS_ROOT flag (and #SAJS_HAS_BYTES, if
+   they have bytes), so the events can be written as a stream of values.  If
+   the value is a number that ends with its container, then it ends with a
+   #SAJS_EVENT_END, rather than a #SAJS_EVENT_DOUBLE_END.  Values inside a
+   matching value are only produced as part of it.
+
+   Note that skipped containers are only loosely checked, as described for
+   #sajs_skip_value.
+*/
+SAJS_API SajsEvent
+sajs_filter_read(SajsFilter* SAJS_NONNULL filter,
+                 SajsLexer* SAJS_NONNULL  lexer,
+                 size_t                   length,
+                 char const* SAJS_NONNULL data,
+                 size_t* SAJS_NONNULL     count);
+
+/**
+   Dictionary of object member names.
+
+   This is a sorted set of keys, and the state of matching them against the
+   member names read by a lexer.
+*/
+typedef struct SajsKeysImpl SajsKeys;
+
+/**
+   Set up an empty key dictionary in provided memory.
+
+   The memory must be word-aligned, and is used to store 12 bytes for each key
+   plus its text.  NULL is returned if there isn't space for at least one key.
+*/
+SAJS_API SAJS_MALLOC_FUNC SajsKeys* SAJS_ALLOCATED
+sajs_keys_init(size_t mem_size, void* SAJS_NONNULL mem);
+
+/**
+   Add a key to a dictionary.
+
+   The key is a UTF-8 string, without escapes, like the bytes of a name as
+   read by a lexer.  Its ID is the number of keys added before it, so keys
+   added in a fixed order have small, fixed IDs that can be used as indices
+   or switch cases.
+
+   @return #SAJS_SUCCESS, #SAJS_FAILURE if the key is already in the
+   dictionary, or #SAJS_OVERFLOW if there isn't enough space to add it.
+*/
+SAJS_API SajsStatus
+sajs_keys_add(SajsKeys* SAJS_NONNULL   keys,
+              size_t                   length,
+              char const* SAJS_NONNULL key);
+
+/**
+   Match the member names in a stream of events against a dictionary.
+
+   This must be called with every successful event read by a lexer (or at
+   least, every event in every member name), along with its string.  The name
+   is matched as its bytes arrive, so its text doesn't need to be assembled
+   anywhere, and the match is exact however the name is split into events or
+   escaped.
+
+   @return The ID of the key at the end of a member name that's in the
+   dictionary, otherwise `SIZE_MAX`.
+*/
+SAJS_API size_t
+sajs_keys_match(SajsKeys* SAJS_NONNULL keys,
+                SajsEvent              event,
+                SajsStringView         string);
+
+/**
+   Binary event tape writer state.
+
+   A tape is a compact recording of the events read by a lexer, which can be
+   replayed by a #SajsTapeReader much faster than reading the JSON again.
+   Consecutive bytes in a value are stored together, so a string is usually a
+   single #SAJS_EVENT_BYTES event when replayed, numbers include their value,
+   and containers can be skipped in constant time.
+*/
+typedef struct SajsTapeWriterImpl SajsTapeWriter;
+
+/**
+   Set up a tape writer in provided memory.
+
+   The memory must be word-aligned and at least 32 bytes.  NULL is returned if
+   not enough space is available.
+*/
+SAJS_API SAJS_MALLOC_FUNC SajsTapeWriter* SAJS_ALLOCATED
+sajs_tape_writer_init(size_t mem_size, void* SAJS_NONNULL mem);
+
+/**
+   Record an event read by a lexer on a tape.
+
+   The event is appended to the tape of `*length` bytes in the buffer `tape`
+   of `size` bytes, and `length` is updated.  A new tape is started if
+   `*length` is zero.  The whole tape must stay in the buffer while it's being
+   written, since the start of a container is updated when it ends, but the
+   buffer can be moved (for example, with realloc) between calls.
+
+   Events with an error status, and #SAJS_EVENT_NOTHING, are ignored.  The
+   lexer is only used to get the bytes of the event, and the value of any
+   number it ends.
+
+   @return #SAJS_SUCCESS, or #SAJS_OVERFLOW if there isn't enough space for
+   the event, in which case nothing is written.
+*/
+SAJS_API SajsStatus
+sajs_tape_write(SajsTapeWriter* SAJS_NONNULL  writer,
+                SajsLexer const* SAJS_NONNULL lexer,
+                SajsEvent                     event,
+                size_t                        size,
+                void* SAJS_NONNULL            tape,
+                size_t* SAJS_NONNULL          length);
+
+/**
+   Binary event tape reader state.
+
+   This replays the events on a tape readable in memory, such as a mapped file.
+*/
+typedef struct SajsTapeReaderImpl SajsTapeReader;
+
+/**
+   Set up a tape reader in provided memory.
+
+   The memory must be word-aligned and at least 96 bytes.  NULL is returned if
+   not enough space is available, or the data doesn't start with a tape
+   header.  The tape must stay in memory while it's being read.
+*/
+SAJS_API SAJS_MALLOC_FUNC SajsTapeReader* SAJS_ALLOCATED
+sajs_tape_reader_init(size_t                   mem_size,
+                      void* SAJS_NONNULL       mem,
+                      size_t                   length,
+                      void const* SAJS_NONNULL tape);
+
+/**
+   Read the next event from a tape.
+
+   The events are those recorded, except that #SAJS_EVENT_BYTES events in
+   the same value are combined, so they write the same text.  Any bytes of
+   the event are available from #sajs_tape_string, and the value of a number
+   is available from #sajs_tape_number after its end, as with a lexer.
+
+   @return An event with status #SAJS_SUCCESS, #SAJS_FAILURE at the end of
+   the tape, #SAJS_NO_DATA if the tape is truncated, or #SAJS_EXPECTED_VALUE
+   if a record is invalid.
+*/
+SAJS_API SajsEvent
+sajs_tape_read(SajsTapeReader* SAJS_NONNULL reader);
+
+/**
+   Return the bytes of the last event read from a tape.
+
+   The string points into the tape, so it remains valid as long as the tape
+   does.
+*/
+SAJS_API SAJS_PURE_FUNC SajsStringView
+sajs_tape_string(SajsTapeReader const* SAJS_NONNULL reader);
+
+/// Return the value of the last number read from a tape
+SAJS_API SAJS_PURE_FUNC SajsNumber
+sajs_tape_number(SajsTapeReader const* SAJS_NONNULL reader);
+
+/**
+   Skip the rest of the value started by the last event read from a tape.
+
+   This works like #sajs_skip_value, except containers are skipped in
+   constant time.  If a skipped number ends with its container, then the rest
+   of the container is skipped as well.
+
+   @return #SAJS_SUCCESS, #SAJS_FAILURE if the last event wasn't the start of
+   a value, or an error if the tape is invalid.
+*/
+SAJS_API SajsStatus
+sajs_tape_skip(SajsTapeReader* SAJS_NONNULL reader);
+
+/**
+   Structural index writer state.
+
+   An index records the offsets of every array and object, and every member
+   name, in a document, so values can be found by #sajs_index_find without
+   reading the document from the start.  Offsets are stored as small deltas,
+   so an index is typically much smaller than the document.
+*/
+typedef struct SajsIndexerImpl SajsIndexer;
+
+/**
+   Set up an indexer in provided memory.
+
+   The initial few bytes of the memory are used for indexer state, and the
+   rest for two words for each level of container nesting in the input, so
+   an indexer with 16 times the memory of its lexer (on 64-bit systems) can
+   index anything the lexer can read.  The memory must be word-aligned and
+   at least 32 bytes.  NULL is returned if not enough space is available.
+*/
+SAJS_API SAJS_MALLOC_FUNC SajsIndexer* SAJS_ALLOCATED
+sajs_indexer_init(size_t mem_size, void* SAJS_NONNULL mem);
+
+/**
+   Add an event read by a lexer to an index.
+
+   This must be called with every event read from a document, along with the
+   `offset` in the document just after the input consumed to read it (the
+   total `count` read so far).  Events that aren't part of the structure are
+   ignored.  The record is appended to the index of `*length` bytes in the
+   buffer `index` of `size` bytes, and `length` is updated, as with
+   #sajs_tape_write.  A new index is started if `*length` is zero.
+
+   @return #SAJS_SUCCESS, or #SAJS_OVERFLOW if there isn't enough space for
+   the record, in which case nothing is written, or if the container is
+   nested too deeply for the indexer memory.
+*/
+SAJS_API SajsStatus
+sajs_index_event(SajsIndexer* SAJS_NONNULL     indexer,
+                 SajsLexer const* SAJS_NONNULL lexer,
+                 SajsEvent                     event,
+                 size_t                        offset,
+                 size_t                        size,
+                 void* SAJS_NONNULL            index,
+                 size_t* SAJS_NONNULL          length);
+
+/**
+   Find a value in a document with an index.
+
+   The value at a JSON Pointer, as described for #sajs_filter_add (but without
+   wildcards), in the first top-level value in the document is found, and its
+   offset in `data` is stored in `offset`.  Only the parts of the document
+   needed to match member names and count array elements are read, so this
+   takes time proportional to the size of the containers on the path, not the
+   document.  The value can then be read from there like a top-level value.
+
+   @return #SAJS_SUCCESS, #SAJS_FAILURE if the pointer is invalid or there is
+   no value at it, #SAJS_NO_DATA if the index is truncated, or
+   #SAJS_EXPECTED_VALUE if the index is invalid or doesn't match the document.
+*/
+SAJS_API SajsStatus
+sajs_index_find(size_t                   index_length,
+                void const* SAJS_NONNULL index,
+                size_t                   length,
+                char const* SAJS_NONNULL data,
+                size_t                   pointer_length,
+                char const* SAJS_NONNULL pointer,
+                size_t* SAJS_NONNULL     offset);
+
 /**
    JSON writer state.
 
@@ -219,12 +893,21 @@ typedef struct SajsWriterImpl SajsWriter;
    Set up a JSON writer in provided memory.
 
    The writer uses a small fixed amount of memory.  The memory must be
-   word-aligned and at least 32 bytes.  NULL is returned if not enough space is
+   word-aligned and at least 64 bytes.  NULL is returned if not enough space is
    available.
 */
 SAJS_API SAJS_MALLOC_FUNC SajsWriter* SAJS_ALLOCATED
 sajs_writer_init(size_t mem_size, void* SAJS_NONNULL mem);
 
+/**
+   Reset a writer to write a new document.
+
+   Like #sajs_lexer_reset, this abandons any document being written, so a
+   writer can be reused without setting it up again.
+*/
+SAJS_API void
+sajs_writer_reset(SajsWriter* SAJS_NONNULL writer);
+
 /// A prefix of some text output
 typedef enum {
   SAJS_PREFIX_NONE,
@@ -270,6 +953,159 @@ sajs_write_event(SajsWriter* SAJS_NONNULL writer,
                  SajsEvent                event,
                  SajsStringView           string);
 
+/// Flags that control how text is written by #sajs_write_events
+typedef enum {
+  SAJS_WRITE_TERSE    = 1U << 0U, ///< Write no whitespace between tokens
+  SAJS_WRITE_NEWLINES = 1U << 1U, ///< Write a newline after each root value
+} SajsWriteFlag;
+
+/// Bitwise OR of SajsWriteFlag values
+typedef unsigned SajsWriteFlags;
+
+/**
+   Write a sequence of lexed events as text into a buffer.
+
+   This is like calling #sajs_write_event for each event, but renders the
+   whole text, including prefixes and indentation, directly into `buf`, so
+   output can be written in large blocks.  Each event is given with a string,
+   which is the result of #sajs_string when the event was read.  Note that
+   bytes in the lexer change with every read, so they must be copied unless
+   they're a span in the input.  Unless #SAJS_WRITE_TERSE is given, values are
+   indented with two spaces per level.
+
+   The bytes of a string may be given as a single span of any length, which is
+   escaped as necessary, so this can also be used to write strings that
+   weren't read from JSON.  Runs of bytes that don't need escaping are copied
+   directly, which is much faster than writing a byte at a time.
+
+   Events are written until they're all done, or the `size` bytes of `buf` are
+   full.  The number of events completely written is stored in `num_written`,
+   and the number of bytes of text in `length`.  If the buffer fills part way
+   through an event, then it isn't counted, and the next call must pass the
+   remaining events starting with that one, to finish writing its text.
+
+   @return #SAJS_SUCCESS if all events were written, or #SAJS_RETRY if the
+   buffer is full.
+*/
+SAJS_API SajsStatus
+sajs_write_events(SajsWriter* SAJS_NONNULL           writer,
+                  SajsWriteFlags                     flags,
+                  size_t                             num_events,
+                  SajsEvent const* SAJS_NONNULL      events,
+                  SajsStringView const* SAJS_NONNULL strings,
+                  size_t* SAJS_NONNULL               num_written,
+                  size_t                             size,
+                  char* SAJS_NONNULL                 buf,
+                  size_t* SAJS_NONNULL               length);
+
+/**
+   Reformat valid JSON text into a buffer, without reading any events.
+
+   This writes exactly the same text as reading `data` and writing every
+   event with #sajs_write_events, but is much faster, since bytes in strings,
+   numbers, and literals are copied through a run at a time, and only
+   whitespace, punctuation, and escapes are rewritten.  The input isn't
+   checked at all, so it must already be known to be valid, for example by
+   #sajs_validate, otherwise the output is meaningless.  Any number of root
+   values may be given, separated as usual.
+
+   The `length` bytes of `data` are read, and the number consumed is written
+   to `count`, like #sajs_validate.  The final call must give a `length` of
+   zero, to finish a number or literal at the end.  Text is written into
+   `buf` like #sajs_write_events, with the number of bytes stored in
+   `text_length`.  Writer statistics don't count any events, but do count
+   escapes and depth.  A writer can't be used for this and for events in the
+   same document.
+
+   @return #SAJS_SUCCESS if all the input was consumed, or #SAJS_RETRY if the
+   buffer is full first.
+*/
+SAJS_API SajsStatus
+sajs_write_text(SajsWriter* SAJS_NONNULL  writer,
+                SajsWriteFlags            flags,
+                size_t                    length,
+                char const* SAJS_NONNULL  data,
+                size_t* SAJS_NONNULL      count,
+                size_t                    size,
+                char* SAJS_NONNULL        buf,
+                size_t* SAJS_NONNULL      text_length);
+
+/// Statistics about writing, like #SajsLexerStats
+typedef struct {
+  uint64_t events[SAJS_EVENT_BYTES + 1U]; ///< Number of each SajsEventType
+  uint64_t escapes;                       ///< String bytes written as escapes
+  uint64_t max_depth;                     ///< Maximum container depth reached
+} SajsWriterStats;
+
+/**
+   Set the statistics that a writer updates while writing, or null to stop.
+
+   Like #sajs_lexer_set_stats, this returns #SAJS_FAILURE if the library was
+   built without statistics enabled.
+*/
+SAJS_API SajsStatus
+sajs_writer_set_stats(SajsWriter* SAJS_NONNULL writer, SajsWriterStats* stats);
+
+/**
+   Pool of lexers and writers.
+
+   This is a fixed number of slabs, each with a lexer and a writer, that can
+   be acquired and released in constant time, to serve many concurrent
+   documents without allocating memory for each one.
+*/
+typedef struct SajsPoolImpl SajsPool;
+
+/**
+   Return the size of memory needed for a pool.
+
+   @param num_slabs Number of slabs, each with a lexer and a writer.
+   @param max_depth Stack depth of each lexer.
+   @return The size of pool memory for #sajs_pool_init, or zero if it's too
+   large.
+*/
+SAJS_API SAJS_CONST_FUNC size_t
+sajs_pool_mem_size(size_t num_slabs, size_t max_depth);
+
+/**
+   Set up a pool in provided memory.
+
+   The memory must be word-aligned, and is split into as many slabs as fit,
+   which can be calculated with #sajs_pool_mem_size.  Each slab has a lexer
+   with room for at least `max_depth` levels of nesting, and a writer.  Slabs
+   are aligned to 64-byte cache lines and don't share any, so slabs can be
+   used by different threads without contention.  The pool itself isn't
+   synchronized, so it must only be used by one thread at a time, or there
+   can be a pool for each thread.
+
+   Every lexer and writer is set up here, so acquiring them later only needs
+   to reset them.  NULL is returned if there isn't space for at least one
+   slab, or if a slab can't hold a lexer or writer with this build.
+*/
+SAJS_API SAJS_MALLOC_FUNC SajsPool* SAJS_ALLOCATED
+sajs_pool_init(size_t mem_size, void* SAJS_NONNULL mem, size_t max_depth);
+
+/**
+   Acquire a lexer and writer from a pool.
+
+   Both are reset to start a new document, without statistics or a position.
+   They remain valid until they're returned with #sajs_pool_release.
+
+   @return #SAJS_SUCCESS, or #SAJS_OVERFLOW if every slab is in use.
+*/
+SAJS_API SajsStatus
+sajs_pool_acquire(SajsPool* SAJS_NONNULL                pool,
+                  SajsLexer* SAJS_NONNULL* SAJS_NONNULL  lexer,
+                  SajsWriter* SAJS_NONNULL* SAJS_NONNULL writer);
+
+/**
+   Return a lexer, and the writer acquired with it, to a pool.
+
+   @return #SAJS_SUCCESS, #SAJS_FAILURE if the lexer isn't from this pool, or
+   #SAJS_UNDERFLOW if no slabs are in use.
+*/
+SAJS_API SajsStatus
+sajs_pool_release(SajsPool* SAJS_NONNULL pool, SajsLexer* SAJS_NONNULL lexer);
+
 /**
    @}
 */
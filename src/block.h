@@ -0,0 +1,217 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#ifndef SAJS_SRC_BLOCK_H
+#define SAJS_SRC_BLOCK_H
+
+#include "scan.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Scanning the structure of input in blocks of 64 bytes.
+
+  A block is reduced to bit masks of interesting characters, with one bit per
+  byte, which can be combined to find the bytes in strings without looking at
+  each byte.  Strings and escapes may continue from one block to the next,
+  which is tracked by a small carry.
+*/
+
+/// Masks of interesting characters in a block of 64 bytes
+typedef struct {
+  uint64_t quotes;  ///< Quotes
+  uint64_t slashes; ///< Backslashes
+  uint64_t opens;   ///< Opening brackets or braces
+  uint64_t closes;  ///< Closing brackets or braces
+  uint64_t commas;  ///< Commas
+} SajsBlock;
+
+/// State carried from one block to the next while scanning
+typedef struct {
+  uint64_t escape; ///< 1 if the first byte of the next block is escaped
+  uint64_t string; ///< All ones if the next block starts in a string
+} SajsCarry;
+
+/// Scan a full block of 64 bytes
+static inline SajsBlock
+scan_full_block(uint8_t const* const p)
+{
+  SajsBlock block = {0U, 0U, 0U, 0U, 0U};
+
+  /* Setting bit 5 maps '[' to '{' and ']' to '}', and nothing else to either,
+     so opening and closing brackets can each be found with one comparison. */
+
+#if defined(SAJS_SCAN_AVX2)
+  __m256i const quote = _mm256_set1_epi8('"');
+  __m256i const slash = _mm256_set1_epi8('\\');
+  __m256i const lower = _mm256_set1_epi8(0x20);
+  __m256i const open  = _mm256_set1_epi8('{');
+  __m256i const close = _mm256_set1_epi8('}');
+  __m256i const comma = _mm256_set1_epi8(',');
+  for (unsigned i = 0U; i < 64U; i += 32U) {
+    __m256i const v = _mm256_loadu_si256((__m256i const*)(void const*)(p + i));
+    __m256i const l = _mm256_or_si256(v, lower);
+
+    block.quotes |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                      _mm256_cmpeq_epi8(v, quote))
+                    << i;
+    block.slashes |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                       _mm256_cmpeq_epi8(v, slash))
+                     << i;
+    block.opens |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                     _mm256_cmpeq_epi8(l, open))
+                   << i;
+    block.closes |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                      _mm256_cmpeq_epi8(l, close))
+                    << i;
+    block.commas |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                      _mm256_cmpeq_epi8(v, comma))
+                    << i;
+  }
+
+#elif defined(SAJS_SCAN_SSE2)
+  __m128i const quote = _mm_set1_epi8('"');
+  __m128i const slash = _mm_set1_epi8('\\');
+  __m128i const lower = _mm_set1_epi8(0x20);
+  __m128i const open  = _mm_set1_epi8('{');
+  __m128i const close = _mm_set1_epi8('}');
+  __m128i const comma = _mm_set1_epi8(',');
+  for (unsigned i = 0U; i < 64U; i += 16U) {
+    __m128i const v = _mm_loadu_si128((__m128i const*)(void const*)(p + i));
+    __m128i const l = _mm_or_si128(v, lower);
+
+    block.quotes |= (uint64_t)(uint32_t)_mm_movemask_epi8(
+                      _mm_cmpeq_epi8(v, quote))
+                    << i;
+    block.slashes |= (uint64_t)(uint32_t)_mm_movemask_epi8(
+                       _mm_cmpeq_epi8(v, slash))
+                     << i;
+    block.opens |= (uint64_t)(uint32_t)_mm_movemask_epi8(
+                     _mm_cmpeq_epi8(l, open))
+                   << i;
+    block.closes |= (uint64_t)(uint32_t)_mm_movemask_epi8(
+                      _mm_cmpeq_epi8(l, close))
+                    << i;
+    block.commas |= (uint64_t)(uint32_t)_mm_movemask_epi8(
+                      _mm_cmpeq_epi8(v, comma))
+                    << i;
+  }
+
+#else
+  for (unsigned i = 0U; i < 64U; i += 8U) {
+    uint64_t const v = scan_load_word(p + i);
+    uint64_t const l = v | (SAJS_SCAN_ONES * 0x20U);
+
+    block.quotes |= (uint64_t)scan_word_bits(
+                      scan_word_zero(v ^ (SAJS_SCAN_ONES * '"')))
+                    << i;
+    block.slashes |= (uint64_t)scan_word_bits(
+                       scan_word_zero(v ^ (SAJS_SCAN_ONES * '\\')))
+                     << i;
+    block.opens |= (uint64_t)scan_word_bits(
+                     scan_word_zero(l ^ (SAJS_SCAN_ONES * '{')))
+                   << i;
+    block.closes |= (uint64_t)scan_word_bits(
+                      scan_word_zero(l ^ (SAJS_SCAN_ONES * '}')))
+                    << i;
+    block.commas |= (uint64_t)scan_word_bits(
+                      scan_word_zero(v ^ (SAJS_SCAN_ONES * ',')))
+                    << i;
+  }
+#endif
+
+  return block;
+}
+
+/// Return the size of a block with `remaining` bytes left in the input
+static inline unsigned
+block_size(size_t const remaining)
+{
+  return remaining < 64U ? (unsigned)remaining : 64U;
+}
+
+/// Scan a block of `n` bytes, which is only a full block if `n` is at least 64
+static inline SajsBlock
+scan_block(uint8_t const* const p, size_t const n)
+{
+  if (n >= 64U) {
+    return scan_full_block(p);
+  }
+
+  SajsBlock block = {0U, 0U, 0U, 0U, 0U};
+  for (size_t i = 0U; i < n; ++i) {
+    uint64_t const bit = (uint64_t)1U << i;
+    uint8_t const  c   = p[i];
+
+    block.quotes |= (c == '"') ? bit : 0U;
+    block.slashes |= (c == '\\') ? bit : 0U;
+    block.opens |= (c == '[' || c == '{') ? bit : 0U;
+    block.closes |= (c == ']' || c == '}') ? bit : 0U;
+    block.commas |= (c == ',') ? bit : 0U;
+  }
+
+  return block;
+}
+
+/**
+   Return a mask of the bytes in a block which are escaped by a backslash.
+
+   The block has `n` bytes, and a backslash at the end escapes the first byte
+   of the next block, which is recorded in the carry.
+
+   Backslashes are rare enough that simply looping over them is fast.  Note
+   that backslashes outside strings are treated the same way, which doesn't
+   matter since they're invalid there anyway.
+*/
+static inline uint64_t
+escaped_mask(uint64_t const   slashes,
+             unsigned const   n,
+             SajsCarry* const carry)
+{
+  uint64_t escaped = carry->escape;
+
+  carry->escape = 0U;
+  for (uint64_t s = slashes; s; s &= s - 1U) {
+    unsigned const i = scan_first_bit(s);
+    if (!((escaped >> i) & 1U)) {
+      if (i + 1U == n) {
+        carry->escape = 1U;
+      } else {
+        escaped |= (uint64_t)1U << (i + 1U);
+      }
+    }
+  }
+
+  return escaped;
+}
+
+/// Return the XOR of every bit with all the bits below it
+static inline uint64_t
+prefix_xor(uint64_t const bits)
+{
+  uint64_t x = bits;
+  x ^= x << 1U;
+  x ^= x << 2U;
+  x ^= x << 4U;
+  x ^= x << 8U;
+  x ^= x << 16U;
+  x ^= x << 32U;
+  return x;
+}
+
+/// Return a mask of the bytes in strings in a block of `n` bytes
+static inline uint64_t
+string_mask(SajsBlock const* const block,
+            unsigned const         n,
+            SajsCarry* const       carry)
+{
+  uint64_t const escaped = escaped_mask(block->slashes, n, carry);
+  uint64_t const quotes  = block->quotes & ~escaped;
+  uint64_t const in      = prefix_xor(quotes) ^ carry->string;
+
+  carry->string = 0U - (in >> 63U);
+  return in;
+}
+
+#endif // SAJS_SRC_BLOCK_H
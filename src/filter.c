@@ -0,0 +1,478 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#include "scan.h"
+
+#include "sajs/sajs.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Filtering values with JSON Pointers.
+
+  Pointers are compiled into a trie of segments, with at most 64 nodes, so a
+  set of nodes fits in a bit mask.  Each container being searched has a frame
+  with the mask of nodes that may match its children, so matching a member
+  name or element index against every pointer at once is a few bit operations
+  (and a comparison of the name with each candidate segment).  Values that
+  can't match anything are skipped with sajs_skip_value(), so the filter only
+  needs a frame for each container on the path to a possible match, and the
+  fast skipping does most of the work when only a small part of the input is
+  needed.
+*/
+
+#define MAX_NODES 64U       ///< Maximum number of nodes in a trie
+#define MIN_SIZE 4096U      ///< Minimum size of filter memory
+#define NO_INDEX UINT64_MAX ///< Index of a segment that isn't an array index
+
+/// A node in the trie of pointer segments
+typedef struct {
+  uint64_t children; ///< Bit mask of child nodes
+  uint64_t index;    ///< Array index matched by segment, or NO_INDEX
+  uint32_t offset;   ///< Offset of segment text after the filter
+  uint32_t length;   ///< Length of segment text
+} FilterNode;
+
+/// A container being searched for matches
+typedef struct {
+  uint64_t children; ///< Bit mask of nodes that may match a child
+  uint64_t index;    ///< Index of the next element in an array
+} FilterFrame;
+
+/// Filter state (followed by segment text)
+struct SajsFilterImpl {
+  FilterNode    nodes[MAX_NODES];  ///< Trie nodes, with the root first
+  FilterFrame   frames[MAX_NODES]; ///< Frames for containers being searched
+  uint64_t      terminals;         ///< Nodes at the end of a pointer
+  uint64_t      wildcards;         ///< Nodes that match any name or index
+  uint64_t      key_nodes;         ///< Nodes that may match the current name
+  uint64_t      value_nodes;       ///< Nodes matched by the last name
+  size_t        key_length;        ///< Length of the current name so far
+  size_t        match_depth;       ///< Depth of the matching value, or zero
+  size_t        skip_depth;        ///< Depth of the skipped value, or zero
+  uint32_t      text_size;         ///< Size of text after the filter
+  uint32_t      text_length;       ///< Length of text after the filter
+  unsigned      num_nodes;         ///< Number of nodes in the trie
+  SajsValueKind match_kind;        ///< Kind of the matching value
+};
+
+/*
+ * Pointers
+ */
+
+/// Return the segment text stored after the filter
+static char*
+filter_text(SajsFilter* const filter)
+{
+  return (char*)(filter + 1);
+}
+
+/// Return true if two strings of the same length are equal
+static bool
+same_bytes(char const* const a, char const* const b, size_t const length)
+{
+  for (size_t i = 0U; i < length; ++i) {
+    if (a[i] != b[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// Return the array index of a segment, or NO_INDEX if it isn't one
+static uint64_t
+parse_index(char const* const text, size_t const length)
+{
+  if (!length || (text[0] == '0' && length > 1U)) {
+    return NO_INDEX; // Empty or leading zero
+  }
+
+  uint64_t index = 0U;
+  for (size_t i = 0U; i < length; ++i) {
+    uint64_t const d = (uint64_t)(uint8_t)text[i] - '0';
+    if (d > 9U || index > (NO_INDEX - 1U - d) / 10U) {
+      return NO_INDEX; // Not a digit or too large
+    }
+
+    index = (index * 10U) + d;
+  }
+
+  return index;
+}
+
+/// Check that a pointer is valid, with a slash before every segment
+static SajsStatus
+check_pointer(size_t const length, char const* const pointer)
+{
+  if (length && pointer[0] != '/') {
+    return SAJS_FAILURE;
+  }
+
+  for (size_t i = 0U; i < length; ++i) {
+    if (pointer[i] == '~' && (i + 1U == length || (pointer[i + 1U] != '0' &&
+                                                   pointer[i + 1U] != '1'))) {
+      return SAJS_FAILURE;
+    }
+  }
+
+  return SAJS_SUCCESS;
+}
+
+/**
+   Add a segment below a parent node and move to it.
+
+   The segment is decoded into the free text space, which is only kept if a
+   new node is needed, so pointers with common prefixes share nodes.
+*/
+static SajsStatus
+add_segment(SajsFilter* const filter,
+            unsigned* const   parent,
+            size_t const      length,
+            char const* const segment)
+{
+  if (length > filter->text_size - filter->text_length) {
+    return SAJS_OVERFLOW;
+  }
+
+  // Decode the escapes in the segment into the free text space
+  char* const text     = filter_text(filter) + filter->text_length;
+  bool const  wildcard = length == 1U && segment[0] == '*';
+  size_t      n        = 0U;
+  for (size_t i = 0U; i < length; ++i) {
+    bool const escape = segment[i] == '~';
+
+    text[n++] = !escape ? segment[i] : (segment[++i] == '1') ? '/' : '~';
+  }
+
+  // Move to an existing child with the same segment if there is one
+  FilterNode* const node = &filter->nodes[*parent];
+  for (uint64_t c = node->children; c; c &= c - 1U) {
+    unsigned const          i           = scan_first_bit(c);
+    FilterNode const* const child       = &filter->nodes[i];
+    bool const              is_wildcard = (filter->wildcards >> i) & 1U;
+
+    if (is_wildcard == wildcard && child->length == n &&
+        same_bytes(filter_text(filter) + child->offset, text, n)) {
+      *parent = i;
+      return SAJS_SUCCESS;
+    }
+  }
+
+  if (filter->num_nodes == MAX_NODES) {
+    return SAJS_OVERFLOW;
+  }
+
+  // Add a new child node
+  unsigned const    i     = filter->num_nodes++;
+  FilterNode* const child = &filter->nodes[i];
+  child->children         = 0U;
+  child->index            = wildcard ? NO_INDEX : parse_index(text, n);
+  child->offset           = filter->text_length;
+  child->length           = (uint32_t)n;
+
+  node->children |= (uint64_t)1U << i;
+  filter->wildcards |= (uint64_t)(wildcard ? 1U : 0U) << i;
+  filter->text_length += (uint32_t)n;
+  *parent = i;
+  return SAJS_SUCCESS;
+}
+
+SajsFilter*
+sajs_filter_init(size_t const mem_size, void* const mem)
+{
+  if (mem_size < MIN_SIZE || mem_size <= sizeof(SajsFilter)) {
+    return NULL;
+  }
+
+  size_t const text_size = mem_size - sizeof(SajsFilter);
+
+  SajsFilter* const filter  = (SajsFilter*)mem;
+  filter->nodes[0].children = 0U;
+  filter->nodes[0].index    = NO_INDEX;
+  filter->nodes[0].offset   = 0U;
+  filter->nodes[0].length   = 0U;
+  filter->terminals         = 0U;
+  filter->wildcards         = 0U;
+  filter->text_size =
+    (text_size > UINT32_MAX) ? UINT32_MAX : (uint32_t)text_size;
+  filter->text_length = 0U;
+  filter->num_nodes   = 1U;
+  sajs_filter_reset(filter);
+  return filter;
+}
+
+void
+sajs_filter_reset(SajsFilter* const filter)
+{
+  filter->key_nodes   = 0U;
+  filter->value_nodes = 0U;
+  filter->key_length  = 0U;
+  filter->match_depth = 0U;
+  filter->skip_depth  = 0U;
+  filter->match_kind  = (SajsValueKind)0U;
+}
+
+SajsStatus
+sajs_filter_add(SajsFilter* const filter,
+                size_t const      length,
+                char const* const pointer)
+{
+  SajsStatus st = check_pointer(length, pointer);
+  if (st) {
+    return st;
+  }
+
+  // Add every segment, starting from the root
+  unsigned const num_nodes   = filter->num_nodes;
+  uint32_t const text_length = filter->text_length;
+  unsigned       node        = 0U;
+  for (size_t i = 0U; !st && i < length;) {
+    size_t const start = ++i;
+    while (i < length && pointer[i] != '/') {
+      ++i;
+    }
+
+    st = add_segment(filter, &node, i - start, pointer + start);
+  }
+
+  if (st) {
+    // Remove any nodes added for the first segments of the pointer
+    uint64_t const added =
+      (num_nodes < MAX_NODES) ? (~(uint64_t)0U << num_nodes) : 0U;
+    for (unsigned i = 0U; i < num_nodes; ++i) {
+      filter->nodes[i].children &= ~added;
+    }
+
+    filter->wildcards &= ~added;
+    filter->text_length = text_length;
+    filter->num_nodes   = num_nodes;
+    return st;
+  }
+
+  filter->terminals |= (uint64_t)1U << node;
+  return SAJS_SUCCESS;
+}
+
+/*
+ * Matching
+ */
+
+/// Return a mask of the children of every node in a mask
+static uint64_t
+node_children(SajsFilter const* const filter, uint64_t const nodes)
+{
+  uint64_t children = 0U;
+  for (uint64_t n = nodes; n; n &= n - 1U) {
+    children |= filter->nodes[scan_first_bit(n)].children;
+  }
+
+  return children;
+}
+
+/// Return a mask of the nodes that match the next element in an array
+static uint64_t
+element_nodes(SajsFilter const* const filter,
+              FilterFrame* const      frame,
+              bool* const             is_last)
+{
+  uint64_t const index = frame->index++;
+  uint64_t       nodes = frame->children & filter->wildcards;
+  bool           later = nodes != 0U;
+
+  for (uint64_t c = frame->children & ~filter->wildcards; c; c &= c - 1U) {
+    unsigned const i          = scan_first_bit(c);
+    uint64_t const node_index = filter->nodes[i].index;
+
+    nodes |= (uint64_t)((node_index == index) ? 1U : 0U) << i;
+    later = later || (node_index > index && node_index != NO_INDEX);
+  }
+
+  *is_last = !later;
+  return nodes;
+}
+
+/// Start reading a member name in a container being searched
+static void
+start_key(SajsFilter* const filter, size_t const depth)
+{
+  uint64_t const children = filter->frames[depth - 2U].children;
+
+  filter->value_nodes = children & filter->wildcards;
+  filter->key_nodes   = children & ~filter->wildcards;
+  filter->key_length  = 0U;
+  if (!filter->key_nodes) {
+    filter->skip_depth = depth; // The name can't matter, so skip it
+  }
+}
+
+/// Match some bytes of a member name against every candidate node
+static void
+match_key(SajsFilter* const    filter,
+          SajsStringView const string,
+          size_t const         depth)
+{
+  char const* const text = filter_text(filter);
+
+  for (uint64_t c = filter->key_nodes; c; c &= c - 1U) {
+    unsigned const          i    = scan_first_bit(c);
+    FilterNode const* const node = &filter->nodes[i];
+
+    char const* const expected = text + node->offset + filter->key_length;
+    if (node->length - filter->key_length < string.length ||
+        !same_bytes(expected, string.data, string.length)) {
+      filter->key_nodes &= ~((uint64_t)1U << i);
+    }
+  }
+
+  filter->key_length += string.length;
+  if (!filter->key_nodes) {
+    filter->skip_depth = depth; // Nothing matches, so skip the rest
+  }
+}
+
+/// Finish reading a member name, adding any matches for its value
+static void
+end_key(SajsFilter* const filter)
+{
+  for (uint64_t c = filter->key_nodes; c; c &= c - 1U) {
+    unsigned const i = scan_first_bit(c);
+    if (filter->nodes[i].length == filter->key_length) {
+      filter->value_nodes |= (uint64_t)1U << i;
+    }
+  }
+
+  filter->key_nodes = 0U;
+}
+
+/// Start a value, and return its start event if it matches
+static SajsEvent
+start_value(SajsFilter* const filter, SajsEvent event, size_t const depth)
+{
+  static SajsEvent const nothing = {
+    SAJS_SUCCESS, SAJS_EVENT_NOTHING, (SajsValueKind)0U, 0U};
+
+  bool           is_last = false;
+  uint64_t const nodes =
+    (event.flags & SAJS_IS_ROOT) ? 1U
+    : (event.flags & SAJS_IS_MEMBER_VALUE)
+      ? filter->value_nodes
+      : element_nodes(filter, &filter->frames[depth - 2U], &is_last);
+
+  if (nodes & filter->terminals) {
+    // Produce the whole value as if it was a top-level value
+    filter->match_depth = depth;
+    filter->match_kind  = event.kind;
+    event.flags         = SAJS_IS_ROOT | (event.flags & SAJS_HAS_BYTES);
+    return event;
+  }
+
+  uint64_t const children = node_children(filter, nodes);
+  if (children && (event.kind == SAJS_OBJECT || event.kind == SAJS_ARRAY)) {
+    // Search the container for matching children
+    filter->frames[depth - 1U].children = children;
+    filter->frames[depth - 1U].index    = 0U;
+  } else {
+    // Skip the value, and the rest of the array if nothing else can match
+    filter->skip_depth = is_last ? (depth - 1U) : depth;
+  }
+
+  return nothing;
+}
+
+/// Handle the end of a matching value, and return the event to produce
+static SajsEvent
+end_match(SajsFilter* const filter, SajsEvent event, size_t const depth)
+{
+  if (depth + 2U == filter->match_depth) {
+    // A number that ended with its container, which isn't produced
+    event.type  = SAJS_EVENT_END;
+    event.kind  = filter->match_kind;
+    event.flags = SAJS_IS_ROOT;
+  } else {
+    event.flags = SAJS_IS_ROOT | (event.flags & SAJS_HAS_BYTES);
+  }
+
+  filter->match_depth = 0U;
+  return event;
+}
+
+/// Process an event from the lexer, and return the event to produce
+static SajsEvent
+filter_event(SajsFilter* const      filter,
+             SajsLexer const* const lexer,
+             SajsEvent const        event)
+{
+  static SajsEvent const nothing = {
+    SAJS_SUCCESS, SAJS_EVENT_NOTHING, (SajsValueKind)0U, 0U};
+
+  size_t const depth = sajs_lexer_depth(lexer);
+  if (filter->match_depth) {
+    return (depth >= filter->match_depth) ? event
+                                          : end_match(filter, event, depth);
+  }
+
+  if (event.type == SAJS_EVENT_START) {
+    if (!(event.flags & SAJS_IS_MEMBER_NAME)) {
+      return start_value(filter, event, depth);
+    }
+
+    start_key(filter, depth);
+  } else if (event.type == SAJS_EVENT_BYTES && filter->key_nodes) {
+    match_key(filter, sajs_string(lexer), depth);
+  } else if (event.type == SAJS_EVENT_END && filter->key_nodes) {
+    end_key(filter);
+  }
+
+  return nothing;
+}
+
+SajsEvent
+sajs_filter_read(SajsFilter* const filter,
+                 SajsLexer* const  lexer,
+                 size_t const      length,
+                 char const* const data,
+                 size_t* const     count)
+{
+  SajsEvent result = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, (SajsValueKind)0U, 0U};
+  size_t    offset = 0U;
+
+  do {
+    size_t n = 0U;
+    if (filter->skip_depth) {
+      // Continue skipping until the lexer leaves the skipped value
+      SajsStatus const st =
+        sajs_skip_value(lexer, length - offset, data + offset, &n);
+
+      offset += n;
+      if (st) {
+        SajsStatus const status = (st == SAJS_RETRY) ? SAJS_SUCCESS : st;
+        SajsEvent const  e      = {
+          status, SAJS_EVENT_NOTHING, (SajsValueKind)0U, 0U};
+
+        result = e;
+        break;
+      }
+
+      if (sajs_lexer_depth(lexer) < filter->skip_depth) {
+        filter->skip_depth = 0U;
+      }
+    } else {
+      SajsEvent const e =
+        sajs_read_spans(lexer, length - offset, data + offset, &n);
+
+      offset += n;
+      if (e.status || !e.type) {
+        result = e;
+        break;
+      }
+
+      result = filter_event(filter, lexer, e);
+    }
+  } while (!result.type && (offset < length || !length));
+
+  *count = offset;
+  return result;
+}
@@ -0,0 +1,662 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#include "scan.h"
+
+#include "sajs/sajs.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Indexing the structure of a document for random access.
+
+  An index is an 8-byte header followed by a record for every container start,
+  member name, and container end in a document, in order.  Each record starts
+  with a variable-length integer, with 7 bits in each byte (least significant
+  first) and the high bit set in all but the last.  The low 2 bits of this
+  integer are the record type, and the rest is the distance in the document
+  from the previous record, or for the end of a container, from its start.
+  Records are rarely far apart, so most are only a byte or two.
+
+  The start of a container is followed by the 4-byte little-endian distance
+  from there to its end record, so its contents can be skipped without reading
+  them.  This is zero if the end is too far away, in which case the records in
+  between are scanned instead.
+
+  Finding a value only reads the records of the containers on the way to it.
+  The document is only read to compare member names (with a lexer, so escapes
+  are handled like anywhere else), and to count the scalar elements in arrays,
+  which aren't in the index.
+*/
+
+#define INDEX_HEADER_SIZE 8U ///< Size of index header
+#define SKIP_SIZE 4U         ///< Size of skip distance after a container start
+#define MAX_RECORD 14U       ///< Maximum size of a record
+
+static uint8_t const index_header[INDEX_HEADER_SIZE] = {
+  'S', 'A', 'J', 'S', 'I', 'X', 1U, 0U};
+
+/// Type of record, in the low bits of its first integer
+typedef enum {
+  INDEX_OBJECT, ///< Start of an object
+  INDEX_ARRAY,  ///< Start of an array
+  INDEX_NAME,   ///< Start of a member name
+  INDEX_END,    ///< End of an array or object
+} IndexTag;
+
+/// A container being indexed
+typedef struct {
+  size_t skip;   ///< Offset of skip distance in index
+  size_t offset; ///< Offset of start in document
+} IndexFrame;
+
+/// Indexer state (followed by a frame for each level of nesting)
+struct SajsIndexerImpl {
+  size_t max_depth; ///< Maximum number of open containers
+  size_t base;      ///< Document offset of the last record
+};
+
+/// A record read from an index
+typedef struct {
+  IndexTag tag;   ///< Type of record
+  uint64_t delta; ///< Distance in document from the previous record or start
+  size_t   end;   ///< Index offset of the end of a container, or zero
+} IndexRecord;
+
+/// The state of finding a value in a document with an index
+typedef struct {
+  uint8_t const* index;        ///< Index being read
+  uint8_t const* data;         ///< Document
+  size_t         index_length; ///< Length of index
+  size_t         length;       ///< Length of document
+  size_t         next;         ///< Offset of the next record in the index
+  size_t         base;         ///< Document offset of the last record read
+} IndexSearch;
+
+/*
+ * Integers
+ */
+
+static void
+put_skip(uint8_t* const dst, uint32_t const value)
+{
+  for (unsigned i = 0U; i < 4U; ++i) {
+    dst[i] = (uint8_t)(value >> (8U * i));
+  }
+}
+
+static uint32_t
+get_skip(uint8_t const* const src)
+{
+  uint32_t value = 0U;
+  for (unsigned i = 0U; i < 4U; ++i) {
+    value |= (uint32_t)src[i] << (8U * i);
+  }
+
+  return value;
+}
+
+/// Write a variable-length integer and return its size
+static size_t
+put_varint(uint8_t* const dst, uint64_t value)
+{
+  size_t n = 0U;
+  for (; value >= 0x80U; value >>= 7U) {
+    dst[n++] = (uint8_t)(value | 0x80U);
+  }
+
+  dst[n++] = (uint8_t)value;
+  return n;
+}
+
+/*
+ * Indexing
+ */
+
+SajsIndexer*
+sajs_indexer_init(size_t const mem_size, void* const mem)
+{
+  if (mem_size < sizeof(SajsIndexer) + sizeof(IndexFrame)) {
+    return NULL;
+  }
+
+  SajsIndexer* const indexer = (SajsIndexer*)mem;
+
+  indexer->max_depth = (mem_size - sizeof(SajsIndexer)) / sizeof(IndexFrame);
+  indexer->base      = 0U;
+  return indexer;
+}
+
+SajsStatus
+sajs_index_event(SajsIndexer* const     indexer,
+                 SajsLexer const* const lexer,
+                 SajsEvent const        event,
+                 size_t const           offset,
+                 size_t const           size,
+                 void* const            index,
+                 size_t* const          length)
+{
+  uint8_t* const    out    = (uint8_t*)index;
+  IndexFrame* const frames = (IndexFrame*)(indexer + 1);
+
+  // Start a new index with a header
+  if (!*length) {
+    if (size < INDEX_HEADER_SIZE) {
+      return SAJS_OVERFLOW;
+    }
+
+    for (unsigned i = 0U; i < INDEX_HEADER_SIZE; ++i) {
+      out[i] = index_header[i];
+    }
+
+    indexer->base = 0U;
+    *length       = INDEX_HEADER_SIZE;
+  }
+
+  bool const is_container =
+    event.kind == SAJS_OBJECT || event.kind == SAJS_ARRAY;
+  bool const is_start =
+    event.type == SAJS_EVENT_START &&
+    (is_container || (event.flags & SAJS_IS_MEMBER_NAME));
+  bool const is_end = event.type == SAJS_EVENT_DOUBLE_END ||
+                      (event.type == SAJS_EVENT_END && is_container);
+
+  if (event.status || !offset || (!is_start && !is_end)) {
+    return SAJS_SUCCESS;
+  }
+
+  IndexTag const tag = is_end                         ? INDEX_END
+                       : !is_container                ? INDEX_NAME
+                       : (event.kind == SAJS_OBJECT) ? INDEX_OBJECT
+                                                     : INDEX_ARRAY;
+
+  // Find the frame of the container, which is below any scalar in the lexer
+  size_t const depth = sajs_lexer_depth(lexer);
+  size_t const level = is_end ? depth : (depth - 1U);
+  if (tag != INDEX_NAME && level >= indexer->max_depth) {
+    return SAJS_OVERFLOW;
+  }
+
+  // The event was produced by the last byte of its input
+  size_t const at     = offset - 1U;
+  size_t const origin = is_end ? frames[level].offset : indexer->base;
+
+  // Build the record and check that it fits
+  uint8_t record[MAX_RECORD];
+  size_t  n =
+    put_varint(record, ((uint64_t)(at - origin) << 2U) | (uint64_t)tag);
+  if (tag <= INDEX_ARRAY) {
+    put_skip(record + n, 0U);
+    n += SKIP_SIZE;
+  }
+
+  if (n > size - *length) {
+    return SAJS_OVERFLOW;
+  }
+
+  for (size_t i = 0U; i < n; ++i) {
+    out[*length + i] = record[i];
+  }
+
+  // Open or close the container
+  if (tag <= INDEX_ARRAY) {
+    frames[level].skip   = *length + n - SKIP_SIZE;
+    frames[level].offset = at;
+  } else if (tag == INDEX_END) {
+    size_t const distance = *length - frames[level].skip;
+    if (distance <= UINT32_MAX) {
+      put_skip(out + frames[level].skip, (uint32_t)distance);
+    }
+  }
+
+  indexer->base = at;
+  *length += n;
+  return SAJS_SUCCESS;
+}
+
+/*
+ * Finding
+ */
+
+/// Return the offset of the first non-whitespace byte in a document
+static size_t
+skip_space(IndexSearch const* const search, size_t const offset)
+{
+  uint8_t const* const end = search->data + search->length;
+
+  return (size_t)(scan_space(search->data + offset, end) - search->data);
+}
+
+/// Return the offset after a string that starts at `offset` (after a quote)
+static size_t
+skip_string(IndexSearch const* const search, size_t const offset)
+{
+  uint8_t const* const end = search->data + search->length;
+  uint8_t const*       p   = search->data + offset;
+  while ((p = scan_string(p, end)) < end) {
+    if (*p == '"') {
+      return (size_t)(p + 1 - search->data);
+    }
+
+    p += (*p == '\\' && end - p > 1) ? 2 : 1;
+  }
+
+  return search->length;
+}
+
+/// Read the next record from the index
+static SajsStatus
+read_record(IndexSearch* const search, IndexRecord* const record)
+{
+  uint64_t value = 0U;
+  for (unsigned shift = 0U;; shift += 7U) {
+    if (search->next == search->index_length) {
+      return SAJS_NO_DATA;
+    }
+
+    if (shift > 63U) {
+      return SAJS_EXPECTED_VALUE;
+    }
+
+    uint8_t const byte = search->index[search->next++];
+    value |= (uint64_t)(byte & 0x7FU) << shift;
+    if (!(byte & 0x80U)) {
+      break;
+    }
+  }
+
+  record->tag   = (IndexTag)(value & 3U);
+  record->delta = value >> 2U;
+  record->end   = 0U;
+  if (record->tag <= INDEX_ARRAY) {
+    if (search->index_length - search->next < SKIP_SIZE) {
+      return SAJS_NO_DATA;
+    }
+
+    size_t const distance = get_skip(search->index + search->next);
+    if (distance) {
+      if (distance >= search->index_length - search->next) {
+        return SAJS_NO_DATA;
+      }
+
+      record->end = search->next + distance;
+    }
+
+    search->next += SKIP_SIZE;
+  }
+
+  return SAJS_SUCCESS;
+}
+
+/// Return the document offset of a record and check that it has byte `c`
+static SajsStatus
+record_offset(IndexSearch const* const search,
+              size_t const             origin,
+              IndexRecord const* const record,
+              char const               c,
+              size_t* const            offset)
+{
+  if (record->delta >= search->length - origin ||
+      search->data[origin + record->delta] != (uint8_t)c) {
+    return SAJS_EXPECTED_VALUE; // Doesn't match document
+  }
+
+  *offset = origin + (size_t)record->delta;
+  return SAJS_SUCCESS;
+}
+
+/// Read the record for the start of the container at an offset
+static SajsStatus
+enter_container(IndexSearch* const search,
+                size_t const       offset,
+                SajsValueKind      kind,
+                IndexRecord* const record)
+{
+  size_t     start = 0U;
+  SajsStatus st    = read_record(search, record);
+  if (!st && record->tag != (kind == SAJS_OBJECT ? INDEX_OBJECT
+                                                 : INDEX_ARRAY)) {
+    return SAJS_EXPECTED_VALUE;
+  }
+
+  if (!st && !(st = record_offset(search,
+                                  search->base,
+                                  record,
+                                  kind == SAJS_OBJECT ? '{' : '[',
+                                  &start))) {
+    search->base = start;
+    if (start != offset) {
+      return SAJS_EXPECTED_VALUE;
+    }
+  }
+
+  return st;
+}
+
+/// Skip the records in a container that was just entered, up to its end
+static SajsStatus
+leave_container(IndexSearch* const       search,
+                IndexRecord const* const start,
+                SajsValueKind const      kind)
+{
+  IndexRecord end   = {INDEX_END, 0U, 0U};
+  SajsStatus  st    = SAJS_SUCCESS;
+  size_t      depth = 1U;
+  if (start->end) {
+    search->next = start->end;
+    st           = read_record(search, &end);
+  } else {
+    // Too far to skip, so scan the records to find the end
+    while (depth && !(st = read_record(search, &end))) {
+      depth += (end.tag <= INDEX_ARRAY) ? 1U : 0U;
+      depth -= (end.tag == INDEX_END) ? 1U : 0U;
+    }
+  }
+
+  return st                        ? st
+         : (end.tag != INDEX_END) ? SAJS_EXPECTED_VALUE
+                                  : record_offset(search,
+                                                  search->base,
+                                                  &end,
+                                                  kind == SAJS_OBJECT ? '}'
+                                                                      : ']',
+                                                  &search->base);
+}
+
+/// Return the next byte of a pointer segment, or -1 at the end
+static int
+segment_byte(size_t const length, char const* const segment, size_t* const i)
+{
+  if (*i == length) {
+    return -1;
+  }
+
+  char const c = segment[(*i)++];
+  if (c == '~') {
+    return (segment[(*i)++] == '1') ? '/' : '~';
+  }
+
+  return (int)(uint8_t)c;
+}
+
+/**
+   Compare a member name with a pointer segment.
+
+   The name is read from the quote at `offset` with a lexer, and if it matches
+   the segment, `end` is set to the offset just after it.
+*/
+static SajsStatus
+match_name(IndexSearch const* const search,
+           size_t const             offset,
+           size_t const             length,
+           char const* const        segment,
+           size_t* const            end)
+{
+  uintptr_t         mem[16U];
+  SajsLexer* const  lexer = sajs_lexer_init(sizeof(mem), mem);
+  char const* const data  = (char const*)search->data;
+
+  sajs_lexer_resume(lexer, SAJS_OBJECT);
+  size_t i = 0U;
+  for (size_t o = offset;;) {
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_read_spans(lexer, search->length - o, data + o, &count);
+
+    o += count;
+    if (e.status) {
+      return SAJS_EXPECTED_VALUE;
+    }
+
+    if (e.flags & SAJS_HAS_BYTES) {
+      SajsStringView const string = sajs_string(lexer);
+      for (size_t j = 0U; j < string.length; ++j) {
+        int const c = (int)(uint8_t)string.data[j];
+        if (segment_byte(length, segment, &i) != c) {
+          return SAJS_FAILURE;
+        }
+      }
+    }
+
+    if (e.type == SAJS_EVENT_END) {
+      *end = o;
+      return (i == length) ? SAJS_SUCCESS : SAJS_FAILURE;
+    }
+  }
+}
+
+/// Find the value of a member in an object that was just entered
+static SajsStatus
+find_member(IndexSearch* const search,
+            size_t const       length,
+            char const* const  segment,
+            size_t* const      offset)
+{
+  IndexRecord record = {INDEX_END, 0U, 0U};
+  SajsStatus  st     = SAJS_SUCCESS;
+  while (!(st = read_record(search, &record))) {
+    if (record.tag == INDEX_END) {
+      return SAJS_FAILURE; // End of object
+    }
+
+    if (record.tag <= INDEX_ARRAY) { // Value of another member
+      SajsValueKind const kind =
+        (record.tag == INDEX_OBJECT) ? SAJS_OBJECT : SAJS_ARRAY;
+
+      size_t start = 0U;
+      if ((st = record_offset(search,
+                              search->base,
+                              &record,
+                              (kind == SAJS_OBJECT) ? '{' : '[',
+                              &start))) {
+        return st;
+      }
+
+      search->base = start;
+      if ((st = leave_container(search, &record, kind))) {
+        return st;
+      }
+
+      continue;
+    }
+
+    size_t name = 0U;
+    size_t end  = 0U;
+    if ((st = record_offset(search, search->base, &record, '"', &name))) {
+      return st;
+    }
+
+    search->base = name;
+    st           = match_name(search, name, length, segment, &end);
+    if (st == SAJS_SUCCESS) {
+      size_t const colon = skip_space(search, end);
+      if (colon == search->length || search->data[colon] != ':') {
+        return SAJS_EXPECTED_VALUE;
+      }
+
+      *offset = skip_space(search, colon + 1U);
+      return (*offset < search->length) ? SAJS_SUCCESS : SAJS_EXPECTED_VALUE;
+    }
+
+    if (st != SAJS_FAILURE) {
+      return st;
+    }
+  }
+
+  return st;
+}
+
+/// Return the array index of a segment, or SIZE_MAX if it isn't one
+static size_t
+segment_index(size_t const length, char const* const segment)
+{
+  if (!length || (segment[0] == '0' && length > 1U)) {
+    return SIZE_MAX; // Empty or leading zero
+  }
+
+  size_t index = 0U;
+  for (size_t i = 0U; i < length; ++i) {
+    size_t const d = (size_t)(uint8_t)segment[i] - '0';
+    if (d > 9U || index > (SIZE_MAX - 1U - d) / 10U) {
+      return SIZE_MAX; // Not a digit or too large
+    }
+
+    index = (index * 10U) + d;
+  }
+
+  return index;
+}
+
+/// Find an element in an array that was just entered at `start`
+static SajsStatus
+find_element(IndexSearch* const search,
+             size_t const       start,
+             size_t const       index,
+             size_t* const      offset)
+{
+  size_t o = start + 1U;
+  for (size_t i = 0U;; ++i) {
+    o = skip_space(search, o);
+    if (o == search->length) {
+      return SAJS_EXPECTED_VALUE;
+    }
+
+    uint8_t const c = search->data[o];
+    if (c == ']') {
+      return SAJS_FAILURE; // Empty array
+    }
+
+    if (i == index) {
+      *offset = o;
+      return SAJS_SUCCESS;
+    }
+
+    // Skip the element, using the index for containers
+    if (c == '[' || c == '{') {
+      SajsValueKind const kind   = (c == '{') ? SAJS_OBJECT : SAJS_ARRAY;
+      IndexRecord         record = {INDEX_END, 0U, 0U};
+      SajsStatus          st     = enter_container(search, o, kind, &record);
+      if (st || (st = leave_container(search, &record, kind))) {
+        return st;
+      }
+
+      o = search->base + 1U;
+    } else if (c == '"') {
+      o = skip_string(search, o + 1U);
+    } else {
+      while (o < search->length && search->data[o] != ',' &&
+             search->data[o] != ']' && search->data[o] > ' ') {
+        ++o;
+      }
+    }
+
+    o = skip_space(search, o);
+    if (o == search->length ||
+        (search->data[o] != ',' && search->data[o] != ']')) {
+      return SAJS_EXPECTED_VALUE;
+    }
+
+    if (search->data[o++] == ']') {
+      return SAJS_FAILURE; // End of array
+    }
+  }
+}
+
+/// Check that a pointer is valid, with a slash before every segment
+static bool
+is_valid_pointer(size_t const length, char const* const pointer)
+{
+  if (length && pointer[0] != '/') {
+    return false;
+  }
+
+  for (size_t i = 0U; i < length; ++i) {
+    if (pointer[i] == '~' && (i + 1U == length || (pointer[i + 1U] != '0' &&
+                                                   pointer[i + 1U] != '1'))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+SajsStatus
+sajs_index_find(size_t const      index_length,
+                void const* const index,
+                size_t const      length,
+                char const* const data,
+                size_t const      pointer_length,
+                char const* const pointer,
+                size_t* const     offset)
+{
+  IndexSearch search = {
+    (uint8_t const*)index, (uint8_t const*)data, index_length, length, 0U, 0U};
+
+  if (index_length < INDEX_HEADER_SIZE) {
+    return SAJS_EXPECTED_VALUE;
+  }
+
+  for (unsigned i = 0U; i < INDEX_HEADER_SIZE; ++i) {
+    if (search.index[i] != index_header[i]) {
+      return SAJS_EXPECTED_VALUE;
+    }
+  }
+
+  if (!is_valid_pointer(pointer_length, pointer)) {
+    return SAJS_FAILURE;
+  }
+
+  // Start at the first value in the document
+  size_t value = skip_space(&search, 0U);
+  if (value == length) {
+    return SAJS_FAILURE;
+  }
+
+  search.next = INDEX_HEADER_SIZE;
+  for (size_t p = 0U; p < pointer_length;) {
+    // Find the next segment
+    size_t const first = p + 1U;
+    size_t       last  = first;
+    while (last < pointer_length && pointer[last] != '/') {
+      ++last;
+    }
+
+    // Enter the container at the current value
+    uint8_t const       c    = search.data[value];
+    SajsValueKind const kind = (c == '{')   ? SAJS_OBJECT
+                               : (c == '[') ? SAJS_ARRAY
+                                            : (SajsValueKind)0;
+    if (!kind) {
+      return SAJS_FAILURE; // Scalar has no children
+    }
+
+    IndexRecord record = {INDEX_END, 0U, 0U};
+    SajsStatus  st     = enter_container(&search, value, kind, &record);
+    if (st) {
+      return st;
+    }
+
+    // Find the child
+    char const* const segment    = pointer + first;
+    size_t const      seg_length = last - first;
+    if (kind == SAJS_OBJECT) {
+      st = find_member(&search, seg_length, segment, &value);
+    } else {
+      size_t const i = segment_index(seg_length, segment);
+      st             = (i == SIZE_MAX)
+                         ? SAJS_FAILURE
+                         : find_element(&search, search.base, i, &value);
+    }
+
+    if (st) {
+      return st;
+    }
+
+    p = last;
+  }
+
+  *offset = value;
+  return SAJS_SUCCESS;
+}
@@ -0,0 +1,403 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#define _POSIX_C_SOURCE 200809L // NOLINT(bugprone-reserved-identifier)
+
+#include "sajs/io.h"
+#include "sajs/sajs.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+  A non-blocking I/O driver in provided memory.
+
+  The driver state, with a batch of events, is followed by the input buffer,
+  then the output buffer.  Input is only read once it's all consumed, so the
+  input buffer is always filled from the start.  Output is appended to the
+  end of what's pending, and the buffer is only reused from the start once
+  it's all been written, so pending output never moves.
+
+  Events are lexed into a batch, then written as text into the output buffer
+  all at once.  Spans in the batch point into the input buffer, so no more
+  input is read until the whole batch has been written.
+*/
+
+#define BATCH_SIZE 128U     ///< Number of events in a batch
+#define MIN_BUFFER_SIZE 64U ///< Minimum size of input and output buffers
+
+/// Driver state (followed by input and output buffers)
+struct SajsIoImpl {
+  SajsEvent      events[BATCH_SIZE];    ///< Batch of events to write
+  SajsStringView strings[BATCH_SIZE];   ///< String for each event
+  char           bytes[BATCH_SIZE][4U]; ///< Copies of short strings
+  SajsLexer*     lexer;                 ///< Lexer for reading input
+  SajsWriter*    writer;                ///< Writer for writing output
+  SajsIoStats*   stats;                 ///< Statistics, or null
+  char*          in_data;               ///< Input buffer
+  char*          out_data;              ///< Output buffer
+  size_t         in_size;               ///< Size of input buffer
+  size_t         in_offset;             ///< Offset of next input to read
+  size_t         in_length;             ///< Length of input in buffer
+  size_t         out_size;              ///< Size of output buffer
+  size_t         out_offset;            ///< Offset of next output to write
+  size_t         out_length;            ///< Length of output in buffer
+  unsigned       num_events;            ///< Number of events in batch
+  unsigned       first_event;           ///< First event not yet written
+  SajsWriteFlags flags;                 ///< Flags for writing text
+  SajsStatus     status;                ///< Final status, or SAJS_RETRY
+  bool           at_end;                ///< True if all input was read
+};
+
+size_t
+sajs_io_mem_size(size_t const buffer_size)
+{
+  return (buffer_size > (SIZE_MAX - sizeof(SajsIo)) / 2U)
+           ? 0U
+           : (sizeof(SajsIo) + (buffer_size * 2U));
+}
+
+SajsIo*
+sajs_io_init(size_t const         mem_size,
+             void* const          mem,
+             SajsLexer* const     lexer,
+             SajsWriter* const    writer,
+             SajsWriteFlags const flags)
+{
+  if (mem_size < sizeof(SajsIo) + (MIN_BUFFER_SIZE * 2U)) {
+    return NULL;
+  }
+
+  SajsIo* const io = (SajsIo*)mem;
+  size_t const  n  = mem_size - sizeof(SajsIo);
+
+  io->lexer    = lexer;
+  io->writer   = writer;
+  io->stats    = NULL;
+  io->in_data  = (char*)(io + 1U);
+  io->in_size  = n / 2U;
+  io->out_data = io->in_data + io->in_size;
+  io->out_size = n - io->in_size;
+  io->flags    = flags;
+  sajs_io_reset(io);
+  return io;
+}
+
+void
+sajs_io_reset(SajsIo* const io)
+{
+  io->in_offset   = 0U;
+  io->in_length   = 0U;
+  io->out_offset  = 0U;
+  io->out_length  = 0U;
+  io->num_events  = 0U;
+  io->first_event = 0U;
+  io->status      = SAJS_RETRY;
+  io->at_end      = false;
+
+  sajs_lexer_reset(io->lexer);
+  sajs_writer_reset(io->writer);
+}
+
+SajsStatus
+sajs_io_set_stats(SajsIo* const io, SajsIoStats* const stats)
+{
+  io->stats = stats;
+  return SAJS_SUCCESS;
+}
+
+SajsIoFlags
+sajs_io_waiting(SajsIo const* const io)
+{
+  bool const wants_input = io->status == SAJS_RETRY && !io->at_end &&
+                           io->in_offset == io->in_length &&
+                           io->first_event == io->num_events;
+
+  return (wants_input ? (unsigned)SAJS_IO_READ : 0U) |
+         ((io->out_offset < io->out_length) ? (unsigned)SAJS_IO_WRITE : 0U);
+}
+
+SajsIoBuffer
+sajs_io_input(SajsIo const* const io)
+{
+  SajsIoBuffer const buffer = {io->in_data, io->in_size};
+  return buffer;
+}
+
+SajsStringView
+sajs_io_output(SajsIo const* const io)
+{
+  SajsStringView const output = {io->out_data + io->out_offset,
+                                 io->out_length - io->out_offset};
+  return output;
+}
+
+/*
+ * Processing
+ */
+
+// Add an event to the batch, copying any bytes that are in the lexer
+static void
+add_event(SajsIo* const io, SajsEvent const event, SajsStringView const string)
+{
+  unsigned const i = io->num_events++;
+
+  io->events[i]  = event;
+  io->strings[i] = string;
+  if (string.length <= sizeof(io->bytes[i])) {
+    for (size_t j = 0U; j < string.length; ++j) {
+      io->bytes[i][j] = string.data[j];
+    }
+
+    io->strings[i].data = io->bytes[i];
+  }
+}
+
+// Write the rest of the batch into the output buffer, or return SAJS_RETRY
+static SajsStatus
+write_batch(SajsIo* const io)
+{
+  while (io->first_event < io->num_events) {
+    if (io->out_length == io->out_size) {
+      return SAJS_RETRY; // Output buffer is full until it's all written
+    }
+
+    unsigned const   first       = io->first_event;
+    size_t           num_written = 0U;
+    size_t           length      = 0U;
+    SajsStatus const st          = sajs_write_events(
+      io->writer,
+      io->flags,
+      io->num_events - first,
+      io->events + first,
+      io->strings + first,
+      &num_written,
+      io->out_size - io->out_length,
+      io->out_data + io->out_length,
+      &length);
+
+    io->first_event += (unsigned)num_written;
+    io->out_length += length;
+    if (st && st != SAJS_RETRY) {
+      return (io->status = st);
+    }
+  }
+
+  io->first_event = 0U;
+  io->num_events  = 0U;
+  return SAJS_SUCCESS;
+}
+
+// Read events into the batch until it's full or the input is consumed
+static void
+read_batch(SajsIo* const io)
+{
+  while (io->num_events < BATCH_SIZE &&
+         (io->in_offset < io->in_length || io->at_end)) {
+    size_t          count = 0U;
+    SajsEvent const e     = sajs_read_spans(io->lexer,
+                                            io->in_length - io->in_offset,
+                                            io->in_data + io->in_offset,
+                                            &count);
+
+    io->in_offset += count;
+    if (e.status) {
+      io->status = e.status;
+      break;
+    }
+
+    if (e.type) {
+      add_event(io, e, sajs_string(io->lexer));
+    }
+  }
+}
+
+// Process as much input into the output buffer as possible
+static SajsStatus
+process(SajsIo* const io)
+{
+  for (;;) {
+    SajsStatus const st = write_batch(io);
+    if (st) {
+      return st;
+    }
+
+    if (io->status != SAJS_RETRY) {
+      // Reaching the end of input between values is the normal end
+      return (io->status == SAJS_FAILURE) ? SAJS_SUCCESS : io->status;
+    }
+
+    if (io->in_offset == io->in_length && !io->at_end) {
+      return SAJS_RETRY; // Waiting for input
+    }
+
+    read_batch(io);
+  }
+}
+
+// Add input without processing it
+static void
+add_input(SajsIo* const io, size_t const length)
+{
+  io->in_offset = 0U;
+  io->in_length = length;
+  io->at_end    = !length;
+}
+
+// Drop written output without processing more
+static void
+drop_output(SajsIo* const io, size_t const length)
+{
+  io->out_offset += length;
+  if (io->out_offset == io->out_length) {
+    io->out_offset = 0U;
+    io->out_length = 0U;
+  }
+}
+
+SajsStatus
+sajs_io_add_input(SajsIo* const io, size_t const length)
+{
+  if (!(sajs_io_waiting(io) & SAJS_IO_READ) || length > io->in_size) {
+    return SAJS_FAILURE;
+  }
+
+  add_input(io, length);
+  return process(io);
+}
+
+SajsStatus
+sajs_io_drop_output(SajsIo* const io, size_t const length)
+{
+  if (length > io->out_length - io->out_offset) {
+    return SAJS_FAILURE;
+  }
+
+  drop_output(io, length);
+  return process(io);
+}
+
+/*
+ * File Descriptors
+ */
+
+// Return true if an error means that I/O would block
+static bool
+would_block(int const error)
+{
+#if defined(EWOULDBLOCK) && EWOULDBLOCK != EAGAIN
+  return error == EAGAIN || error == EWOULDBLOCK;
+#else
+  return error == EAGAIN;
+#endif
+}
+
+// Write pending output until it's all written, or return SAJS_RETRY
+static SajsStatus
+write_fd(SajsIo* const io, int const fd)
+{
+  SajsIoStats* const stats = io->stats;
+
+  while (io->out_offset < io->out_length) {
+    ssize_t const n =
+      write(fd, io->out_data + io->out_offset, io->out_length - io->out_offset);
+
+    if (stats) {
+      ++stats->writes;
+      stats->bytes_written += (n > 0) ? (uint64_t)n : 0U;
+    }
+
+    if (n > 0) {
+      drop_output(io, (size_t)n);
+    } else if (n < 0 && would_block(errno)) {
+      if (stats) {
+        ++stats->blocked;
+      }
+
+      return SAJS_RETRY;
+    } else if (n == 0 || errno != EINTR) {
+      return SAJS_BAD_WRITE;
+    }
+  }
+
+  return SAJS_SUCCESS;
+}
+
+// Read into the empty input buffer, or return SAJS_RETRY
+static SajsStatus
+read_fd(SajsIo* const io, int const fd)
+{
+  SajsIoStats* const stats = io->stats;
+
+  for (;;) {
+    ssize_t const n = read(fd, io->in_data, io->in_size);
+
+    if (stats) {
+      ++stats->reads;
+      stats->bytes_read += (n > 0) ? (uint64_t)n : 0U;
+    }
+
+    if (n >= 0) {
+      add_input(io, (size_t)n);
+      return SAJS_SUCCESS;
+    }
+
+    if (would_block(errno)) {
+      if (stats) {
+        ++stats->blocked;
+      }
+
+      return SAJS_RETRY;
+    }
+
+    if (errno != EINTR) {
+      return SAJS_BAD_READ;
+    }
+  }
+}
+
+SajsStatus
+sajs_io_pump(SajsIo* const io, int const in_fd, int const out_fd)
+{
+  bool read_blocked  = false;
+  bool write_blocked = false;
+  for (;;) {
+    SajsStatus const st       = process(io);
+    bool             progress = false;
+
+    // Write all the output, which frees the buffer for processing more
+    size_t const pending = io->out_length - io->out_offset;
+    if (pending && !write_blocked) {
+      SajsStatus const write_st = write_fd(io, out_fd);
+      if (write_st > SAJS_RETRY) {
+        return write_st;
+      }
+
+      write_blocked = write_st == SAJS_RETRY;
+      progress      = io->out_length - io->out_offset < pending;
+    }
+
+    SajsIoFlags const waiting = sajs_io_waiting(io);
+    if (st != SAJS_RETRY && !(waiting & SAJS_IO_WRITE)) {
+      return st; // Finished, and all the output is written
+    }
+
+    // Read more input if it's all been consumed
+    if ((waiting & SAJS_IO_READ) && !read_blocked) {
+      SajsStatus const read_st = read_fd(io, in_fd);
+      if (read_st > SAJS_RETRY) {
+        return read_st;
+      }
+
+      read_blocked = read_st == SAJS_RETRY;
+      progress     = progress || !read_st;
+    }
+
+    if (!progress) {
+      return SAJS_RETRY; // Everything would block
+    }
+  }
+}
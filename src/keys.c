@@ -0,0 +1,253 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#include "sajs/sajs.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Matching member names against a dictionary of keys.
+
+  Keys are kept sorted, shorter keys before longer ones with the same prefix,
+  so the keys that start with the part of a name read so far are always a
+  contiguous range.  Each byte of a name narrows the range with a binary
+  search on that column, which usually leaves a single candidate after a byte
+  or two, after which the rest of the name is simply compared to it.  This is
+  exact, unlike matching a hash of the name, and never needs the whole name to
+  be assembled in one place.
+
+  Entries are stored after the dictionary, and the key text is stored
+  backwards from the end of the memory, so the two grow towards each other.
+*/
+
+/// A key in the dictionary
+typedef struct {
+  uint32_t offset; ///< Offset of key text after the dictionary
+  uint32_t length; ///< Length of key text
+  uint32_t id;     ///< Key ID, the number of keys added before it
+} KeyEntry;
+
+/// Dictionary state (followed by entries and key text)
+struct SajsKeysImpl {
+  uint32_t size;       ///< Size of memory after the dictionary
+  uint32_t text_start; ///< Offset of the start of key text
+  uint32_t num_keys;   ///< Number of keys (and entries)
+  uint32_t lo;         ///< Start of range of keys that match the name
+  uint32_t hi;         ///< End of range of keys that match the name
+  uint32_t offset;     ///< Length of the name read so far
+  bool     in_name;    ///< True while reading a member name
+};
+
+/*
+ * Keys
+ */
+
+/// Return the entries stored after the dictionary
+static KeyEntry*
+key_entries(SajsKeys* const keys)
+{
+  return (KeyEntry*)(keys + 1);
+}
+
+/// Return the text of a key
+static uint8_t const*
+key_text(SajsKeys* const keys, KeyEntry const* const entry)
+{
+  return (uint8_t const*)(keys + 1) + entry->offset;
+}
+
+/// Return the byte of key text at an offset, or -1 if the key ends before it
+static int
+key_byte(SajsKeys* const keys, KeyEntry const* const entry, size_t const i)
+{
+  return (i < entry->length) ? (int)key_text(keys, entry)[i] : -1;
+}
+
+/// Compare a key with a string, returning less, equal, or greater than zero
+static int
+compare_key(SajsKeys* const       keys,
+            KeyEntry const* const entry,
+            size_t const          length,
+            uint8_t const* const  string)
+{
+  uint8_t const* const text = key_text(keys, entry);
+  for (size_t i = 0U; i < entry->length && i < length; ++i) {
+    if (text[i] != string[i]) {
+      return (int)text[i] - (int)string[i];
+    }
+  }
+
+  return (entry->length < length) ? -1 : (entry->length > length) ? 1 : 0;
+}
+
+SajsKeys*
+sajs_keys_init(size_t const mem_size, void* const mem)
+{
+  if (mem_size < sizeof(SajsKeys) + sizeof(KeyEntry)) {
+    return NULL;
+  }
+
+  size_t const    space = mem_size - sizeof(SajsKeys);
+  SajsKeys* const keys  = (SajsKeys*)mem;
+
+  keys->size       = (space > UINT32_MAX) ? UINT32_MAX : (uint32_t)space;
+  keys->text_start = keys->size;
+  keys->num_keys   = 0U;
+  keys->lo         = 0U;
+  keys->hi         = 0U;
+  keys->offset     = 0U;
+  keys->in_name    = false;
+  return keys;
+}
+
+SajsStatus
+sajs_keys_add(SajsKeys* const keys, size_t const length, char const* const key)
+{
+  uint8_t const* const string  = (uint8_t const*)key;
+  KeyEntry* const      entries = key_entries(keys);
+
+  // Find where the key belongs in the sorted entries
+  uint32_t lo = 0U;
+  uint32_t hi = keys->num_keys;
+  while (lo < hi) {
+    uint32_t const mid = lo + ((hi - lo) / 2U);
+    int const      cmp = compare_key(keys, &entries[mid], length, string);
+    if (!cmp) {
+      return SAJS_FAILURE; // Already added
+    }
+
+    if (cmp < 0) {
+      lo = mid + 1U;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // Check that there's space for another entry and its text
+  size_t const used = (size_t)(keys->num_keys + 1U) * sizeof(KeyEntry);
+  if (used > keys->text_start || length > keys->text_start - used) {
+    return SAJS_OVERFLOW;
+  }
+
+  // Store the text at the end of the free space
+  keys->text_start -= (uint32_t)length;
+  uint8_t* const text = (uint8_t*)(keys + 1) + keys->text_start;
+  for (size_t i = 0U; i < length; ++i) {
+    text[i] = string[i];
+  }
+
+  // Move later entries up to insert the new one
+  for (uint32_t i = keys->num_keys; i > lo; --i) {
+    entries[i] = entries[i - 1U];
+  }
+
+  entries[lo].offset = keys->text_start;
+  entries[lo].length = (uint32_t)length;
+  entries[lo].id     = keys->num_keys++;
+  return SAJS_SUCCESS;
+}
+
+/*
+ * Matching
+ */
+
+/**
+   Return the first key in a range with a byte at an offset not less than `c`.
+
+   Keys that end before the offset compare less than any byte.
+*/
+static uint32_t
+lower_bound(SajsKeys* const keys,
+            uint32_t        lo,
+            uint32_t        hi,
+            size_t const    offset,
+            int const       c)
+{
+  KeyEntry const* const entries = key_entries(keys);
+  while (lo < hi) {
+    uint32_t const mid = lo + ((hi - lo) / 2U);
+    if (key_byte(keys, &entries[mid], offset) < c) {
+      lo = mid + 1U;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+/// Narrow the range of candidate keys with some bytes of the name
+static void
+match_bytes(SajsKeys* const keys, SajsStringView const string)
+{
+  KeyEntry const* const entries = key_entries(keys);
+  uint8_t const* const  bytes   = (uint8_t const*)string.data;
+
+  size_t i = 0U;
+  for (; i < string.length && keys->hi - keys->lo > 1U; ++i) {
+    size_t const offset = keys->offset + i;
+    int const    c      = (int)bytes[i];
+
+    keys->lo = lower_bound(keys, keys->lo, keys->hi, offset, c);
+    keys->hi = lower_bound(keys, keys->lo, keys->hi, offset, c + 1);
+  }
+
+  // Compare the rest of the bytes with the only remaining candidate
+  if (i < string.length && keys->lo < keys->hi) {
+    KeyEntry const* const entry  = &entries[keys->lo];
+    size_t const          offset = keys->offset + i;
+    size_t const          n      = string.length - i;
+    if (offset > entry->length || n > entry->length - offset) {
+      keys->hi = keys->lo; // Name is longer than the key
+      return;
+    }
+
+    uint8_t const* const text = key_text(keys, entry) + offset;
+    for (size_t j = 0U; j < n; ++j) {
+      if (text[j] != bytes[i + j]) {
+        keys->hi = keys->lo;
+        return;
+      }
+    }
+  }
+
+  if (keys->lo < keys->hi) {
+    keys->offset += (uint32_t)string.length;
+  }
+}
+
+size_t
+sajs_keys_match(SajsKeys* const      keys,
+                SajsEvent const      event,
+                SajsStringView const string)
+{
+  if (event.type == SAJS_EVENT_START) {
+    keys->in_name = (event.kind == SAJS_STRING &&
+                     (event.flags & SAJS_IS_MEMBER_NAME));
+    keys->lo      = 0U;
+    keys->hi      = keys->in_name ? keys->num_keys : 0U;
+    keys->offset  = 0U;
+  }
+
+  if (!keys->in_name) {
+    return SIZE_MAX;
+  }
+
+  if (event.flags & SAJS_HAS_BYTES) {
+    match_bytes(keys, string);
+  }
+
+  if (event.type == SAJS_EVENT_END) {
+    keys->in_name = false;
+    if (keys->lo < keys->hi) {
+      KeyEntry const* const entry = &key_entries(keys)[keys->lo];
+      if (entry->length == keys->offset) {
+        return entry->id;
+      }
+    }
+  }
+
+  return SIZE_MAX;
+}
@@ -1,6 +1,12 @@
 // Copyright 2017-2023 David Robillard <d@drobilla.net>
 // SPDX-License-Identifier: ISC
 
+#include "block.h"
+#include "lexer.h"
+#include "number.h"
+#include "scan.h"
+#include "utf8.h"
+
 #include "sajs/sajs.h"
 
 #include <stdbool.h>
@@ -41,18 +47,46 @@ typedef enum {
 
 #define SAJS_NUM_STATE 24U ///< The number of SajsState entries
 
+/// Syntax flags for the number being read
+typedef enum {
+  NUM_NEGATIVE     = 1U << 0U, ///< Leading '-'
+  NUM_REAL         = 1U << 1U, ///< Has a fraction or exponent
+  NUM_DROPPED      = 1U << 2U, ///< Integer digits dropped from significand
+  NUM_TRUNCATED    = 1U << 3U, ///< Nonzero digits dropped from significand
+  NUM_EXP_NEGATIVE = 1U << 4U, ///< Exponent has a leading '-'
+} SajsNumberSyntax;
+
+#define MAX_EXPONENT 100000U ///< Exponent digits are ignored past this
+
 /// Lexer stack frame
 typedef uint8_t SajsFrame;
 
+#ifdef SAJS_COMPACT_STACK
+#  define WINDOW_SIZE 4U ///< Number of frames at the top kept as whole bytes
+#  define MIN_STACK_SIZE (WINDOW_SIZE + 1U) ///< Window and one byte of bits
+#else
+#  define MIN_STACK_SIZE sizeof(SajsFrame) ///< A single frame
+#endif
+
 /// Lexer state (followed by stack memory)
 struct SajsLexerImpl {
-  size_t    max_depth; ///< Maximum stack depth
-  size_t    top;       ///< Current top of stack
-  uint32_t  value;     ///< Temporary working value
-  uint32_t  length;    ///< Temporary working length
-  SajsFlags flags;     ///< Pending flags for the top frame
-  uint32_t  num_bytes; ///< Number of bytes for current event
-  uint8_t   bytes[4];  ///< Bytes for current event
+  uint8_t const* span;        ///< Input bytes for current event, or null
+  uint64_t       significand; ///< Decimal significand of current number
+  uint32_t       max_depth;   ///< Maximum stack depth
+  uint32_t       top;         ///< Current top of stack
+  uint32_t       value;       ///< Temporary working value
+  uint32_t       length;      ///< Temporary working length
+  int32_t        exponent;    ///< Decimal exponent of significand digits
+  uint32_t       num_bytes;   ///< Number of bytes for current event
+  uint8_t        bytes[4];    ///< Bytes for current event
+  uint8_t        flags;       ///< Pending flags for the top frame
+  uint8_t        syntax;      ///< Syntax flags for current number
+#ifndef SAJS_NO_POSITIONS
+  SajsPosition* position; ///< Position to advance, or null
+#endif
+#ifdef SAJS_STATS
+  SajsLexerStats* stats; ///< Statistics to update, or null
+#endif
 };
 
 /*
@@ -81,80 +115,363 @@ is_space(int const c)
 
 /* Text Encoding */
 
-static uint32_t
-utf16_surrogates_codepoint(uint16_t const high, uint16_t const low)
+static uint8_t
+hex_nibble(uint8_t const c)
 {
-  return ((high - 0xD800U) * 0x400U) + (low - 0xDC00U) + 0x10000U;
+  return (uint8_t)(is_digit(c)              ? (c - '0')
+                   : (c >= 'A' && c <= 'F') ? (10 + c - 'A')
+                   : (c >= 'a' && c <= 'f') ? (10 + c - 'a')
+                                            : UINT8_MAX);
 }
 
-static inline uint8_t
-utf8_num_bytes_for_codepoint(uint32_t const code)
+/*
+ * Lexer State
+ */
+
+/*
+  With SAJS_COMPACT_STACK, the stack is a small window of whole frames,
+  followed by one bit per level, so the depth is 8 times greater for the same
+  memory.  This works because only the top two frames can be in any state.
+  Below that, every frame is an array or object with a container in it, so
+  it's waiting for the separator after that container, and only needs to
+  remember which kind it is (except the bottom frame, which is always the
+  start state).  When a frame falls out of the top two levels, it's saved as
+  a bit, and loaded back when it returns.  Frames in the window are indexed
+  by level, so a pointer to a frame stays valid while the stack changes above
+  it.  The frame just above the top is also left untouched after a pop, as it
+  is with a full stack.
+*/
+
+/// Return a frame near the top of the stack
+static SajsFrame*
+frame_at(SajsLexer* const lexer, uint32_t const level)
 {
-  return (code < 0x00000080U)   ? 1U
-         : (code < 0x00000800U) ? 2U
-         : (code < 0x00010000U) ? 3U
-         : (code < 0x00110000U) ? 4U
-                                : 0U;
+  SajsFrame* const stack = (SajsFrame*)(lexer + 1U);
+#ifdef SAJS_COMPACT_STACK
+  return &stack[level & (WINDOW_SIZE - 1U)];
+#else
+  return &stack[level];
+#endif
 }
 
-static uint8_t
-utf8_from_codepoint(uint8_t out[4], uint32_t const code)
+static SajsFrame*
+top_frame(SajsLexer* const lexer)
 {
-  static uint32_t const masks[4] = {0x0U, 0xC0U, 0x800U, 0x10000U};
+  return frame_at(lexer, lexer->top);
+}
 
-  uint8_t const size = utf8_num_bytes_for_codepoint(code);
-  if (size) {
-    uint32_t c = code;
-    for (uint8_t s = size; --s;) {
-      out[s] = (uint8_t)(0x80U | (c & 0x3FU));
-      c >>= 6U;
-      c |= masks[s];
+/// Save the frame two levels below the top after a push, if necessary
+static inline void
+save_frame(SajsLexer* const lexer)
+{
+#ifdef SAJS_COMPACT_STACK
+  if (lexer->top >= 3U) {
+    uint32_t const level = lexer->top - 2U;
+    uint8_t* const bits  = (uint8_t*)(lexer + 1U) + WINDOW_SIZE;
+    uint8_t const  mask  = (uint8_t)(1U << (level & 7U));
+
+    if (*frame_at(lexer, level) == STATE_MEM_SEP) {
+      bits[level / 8U] |= mask;
+    } else {
+      bits[level / 8U] &= (uint8_t)~mask;
     }
-
-    out[0] = (uint8_t)c;
   }
-
-  return size;
+#else
+  (void)lexer;
+#endif
 }
 
-static uint8_t
-hex_nibble(uint8_t const c)
+/// Load the frame one level below the top after a pop, if necessary
+static inline void
+load_frame(SajsLexer* const lexer)
 {
-  return (uint8_t)(is_digit(c)              ? (c - '0')
-                   : (c >= 'A' && c <= 'F') ? (10 + c - 'A')
-                   : (c >= 'a' && c <= 'f') ? (10 + c - 'a')
-                                            : UINT8_MAX);
+#ifdef SAJS_COMPACT_STACK
+  if (lexer->top) {
+    uint32_t const       level  = lexer->top - 1U;
+    uint8_t const* const bits   = (uint8_t const*)(lexer + 1U) + WINDOW_SIZE;
+    bool const           object = (bits[level / 8U] >> (level & 7U)) & 1U;
+
+    *frame_at(lexer, level) = (SajsFrame)(!level   ? STATE_START
+                                          : object ? STATE_MEM_SEP
+                                                   : STATE_ELEM_SEP);
+  }
+#else
+  (void)lexer;
+#endif
 }
 
-/*
- * Lexer State
- */
+/// Return the maximum stack depth, which may be fixed at compile time
+static inline uint32_t
+stack_limit(SajsLexer const* const lexer)
+{
+#ifdef SAJS_MAX_DEPTH
+  (void)lexer;
+  return (uint32_t)(SAJS_MAX_DEPTH);
+#else
+  return lexer->max_depth;
+#endif
+}
 
-static SajsFrame*
-top_frame(SajsLexer* const lexer)
+SAJS_LOCAL size_t
+sajs_lexer_mem_size(size_t const max_depth)
 {
-  SajsFrame* const stack = (SajsFrame*)(lexer + 1U);
-  return &stack[lexer->top];
+#ifdef SAJS_MAX_DEPTH
+  size_t const depth =
+    (max_depth < (SAJS_MAX_DEPTH)) ? (size_t)(SAJS_MAX_DEPTH) : max_depth;
+#else
+  size_t const depth = max_depth;
+#endif
+
+#ifdef SAJS_COMPACT_STACK
+  size_t const stack_size = WINDOW_SIZE + ((depth + 7U) / 8U);
+#else
+  size_t const stack_size = depth * sizeof(SajsFrame);
+#endif
+
+  return sizeof(SajsLexer) +
+         ((stack_size < MIN_STACK_SIZE) ? MIN_STACK_SIZE : stack_size);
 }
 
 SajsLexer*
 sajs_lexer_init(size_t const mem_size, void* const mem)
 {
-  if (mem_size < sizeof(SajsLexer) + sizeof(SajsFrame)) {
+  if (mem_size < sizeof(SajsLexer) + MIN_STACK_SIZE) {
     return NULL;
   }
 
   SajsLexer* const lexer      = (SajsLexer*)mem;
   size_t const     stack_size = mem_size - sizeof(SajsLexer);
+#ifdef SAJS_COMPACT_STACK
+  size_t const bits_size = stack_size - WINDOW_SIZE;
+  size_t const max_depth =
+    (bits_size > UINT32_MAX / 8U) ? UINT32_MAX : (bits_size * 8U);
+#else
+  size_t const max_depth = stack_size / sizeof(SajsFrame);
+#endif
+
+#ifdef SAJS_MAX_DEPTH
+  if (max_depth < (SAJS_MAX_DEPTH)) {
+    return NULL;
+  }
+#endif
+
+  lexer->max_depth = max_depth < UINT32_MAX ? (uint32_t)max_depth : UINT32_MAX;
+#ifndef SAJS_NO_POSITIONS
+  lexer->position = NULL;
+#endif
+#ifdef SAJS_STATS
+  lexer->stats = NULL;
+#endif
+  sajs_lexer_reset(lexer);
+  return lexer;
+}
 
-  lexer->max_depth  = stack_size / sizeof(SajsFrame);
+void
+sajs_lexer_reset(SajsLexer* const lexer)
+{
   lexer->top        = 0U;
+  lexer->span       = NULL;
   lexer->value      = 0U;
   lexer->length     = 0U;
+  lexer->num_bytes  = 0U;
   lexer->flags      = 0U;
+  lexer->syntax     = 0U;
   *top_frame(lexer) = STATE_START;
+}
 
-  return lexer;
+size_t
+sajs_lexer_depth(SajsLexer const* const lexer)
+{
+  return lexer->top;
+}
+
+SajsStatus
+sajs_lexer_resume(SajsLexer* const lexer, SajsValueKind const kind)
+{
+  if (kind != SAJS_ARRAY && kind != SAJS_OBJECT) {
+    return SAJS_FAILURE;
+  }
+
+  if (stack_limit(lexer) < 2U) {
+    return SAJS_OVERFLOW;
+  }
+
+  sajs_lexer_reset(lexer);
+
+  bool const array = kind == SAJS_ARRAY;
+
+  lexer->top           = 1U;
+  *frame_at(lexer, 1U) = (SajsFrame)(array ? STATE_ELEM_NEXT : STATE_MEM_NEXT);
+  lexer->flags         = (uint8_t)(array ? SAJS_IS_ELEMENT : 0U);
+  return SAJS_SUCCESS;
+}
+
+/*
+ * Statistics
+ */
+
+/*
+  These only count anything if SAJS_STATS is defined, but are always called
+  so the lexer doesn't need conditionals everywhere.  Otherwise, they're empty
+  and compiled out completely.
+*/
+
+SajsStatus
+sajs_lexer_set_stats(SajsLexer* const lexer, SajsLexerStats* const stats)
+{
+#ifdef SAJS_STATS
+  lexer->stats = stats;
+  return SAJS_SUCCESS;
+#else
+  (void)lexer;
+  return stats ? SAJS_FAILURE : SAJS_SUCCESS;
+#endif
+}
+
+#ifdef SAJS_STATS
+
+/// Return the class of a state that reads a byte
+static SajsStateClass
+state_class(SajsState const state)
+{
+  return (state <= STATE_MEM_NEXT)           ? SAJS_STATE_STRUCTURE
+         : (state == STATE_STRING)           ? SAJS_STATE_STRING
+         : (state <= STATE_STRING_ESC_LO)    ? SAJS_STATE_ESCAPE
+         : (state <= STATE_NUM_EXP_INT_CONT) ? SAJS_STATE_NUMBER
+                                             : SAJS_STATE_LITERAL;
+}
+
+#endif
+
+/// Count bytes read in a state
+static inline void
+count_bytes(SajsLexer* const lexer, SajsState const state, size_t const n)
+{
+#ifdef SAJS_STATS
+  if (lexer->stats) {
+    lexer->stats->bytes[state_class(state)] += n;
+  }
+#else
+  (void)lexer;
+  (void)state;
+  (void)n;
+#endif
+}
+
+/// Count a single byte about to be read in the current state
+static inline void
+count_byte(SajsLexer* const lexer, int const c)
+{
+#ifdef SAJS_STATS
+  if (lexer->stats && c >= 0) {
+    SajsState const state = (SajsState)*top_frame(lexer);
+
+    count_bytes(lexer, state, 1U);
+    if (state == STATE_STRING && c == '\\') {
+      ++lexer->stats->escapes;
+    }
+  }
+#else
+  (void)lexer;
+  (void)c;
+#endif
+}
+
+/// Count a byte that must be read again after ending a number
+static inline void
+count_retry(SajsLexer* const lexer)
+{
+#ifdef SAJS_STATS
+  if (lexer->stats) {
+    ++lexer->stats->retries;
+  }
+#else
+  (void)lexer;
+#endif
+}
+
+/// Count an event produced by reading
+static inline void
+count_event(SajsLexer* const lexer, SajsEvent const e)
+{
+#ifdef SAJS_STATS
+  if (lexer->stats && !e.status) {
+    ++lexer->stats->events[e.type];
+  }
+#else
+  (void)lexer;
+  (void)e;
+#endif
+}
+
+/// Count the current stack depth after a push
+static inline void
+count_depth(SajsLexer* const lexer)
+{
+#ifdef SAJS_STATS
+  if (lexer->stats && lexer->top > lexer->stats->max_depth) {
+    lexer->stats->max_depth = lexer->top;
+  }
+#else
+  (void)lexer;
+#endif
+}
+
+/*
+ * Positions
+ */
+
+/*
+  The position is only advanced once per call, past all the bytes consumed,
+  so the cost is negligible unless lines are counted.  Since only whole lines
+  matter, that's done by counting newlines in a block at a time, and the
+  column is only found by searching back from the end if there are any.
+*/
+
+SajsStatus
+sajs_lexer_set_position(SajsLexer* const lexer, SajsPosition* const position)
+{
+#ifndef SAJS_NO_POSITIONS
+  lexer->position = position;
+  return SAJS_SUCCESS;
+#else
+  (void)lexer;
+  return position ? SAJS_FAILURE : SAJS_SUCCESS;
+#endif
+}
+
+/// Advance the position past `count` consumed bytes of `data`
+static inline void
+count_position(SajsLexer* const  lexer,
+               char const* const data,
+               size_t const      count)
+{
+#ifndef SAJS_NO_POSITIONS
+  SajsPosition* const position = lexer->position;
+  if (position) {
+    position->offset += count;
+    if (position->line) {
+      uint8_t const* const start = (uint8_t const*)data;
+      uint8_t const* const end   = start + count;
+      size_t const         lines = scan_count_lines(start, end);
+      if (lines) {
+        uint8_t const* p = end;
+        while (p[-1] != '\n') {
+          --p;
+        }
+
+        position->line += lines;
+        position->column = 1U + (uint64_t)(end - p);
+      } else {
+        position->column += count;
+      }
+    }
+  }
+#else
+  (void)lexer;
+  (void)data;
+  (void)count;
+#endif
 }
 
 /*
@@ -204,21 +521,25 @@ push(SajsLexer* const    lexer,
      SajsState const     state,
      uint8_t const       first)
 {
-  if (lexer->top + 1U >= lexer->max_depth) {
+  if (lexer->top + 1U >= stack_limit(lexer)) {
     return do_nothing(SAJS_OVERFLOW);
   }
 
-  SajsFrame* const stack = (SajsFrame*)(lexer + 1U);
-  SajsFrame* const frame = &stack[++lexer->top];
+  SajsFrame* const frame = frame_at(lexer, ++lexer->top);
+
+  save_frame(lexer);
+  count_depth(lexer);
 
   *frame           = (SajsFrame)state;
-  lexer->flags     = flags;
+  lexer->flags     = (uint8_t)flags;
+  lexer->value     = 0U;
   lexer->length    = first ? 1U : 0U;
   lexer->num_bytes = lexer->length;
   lexer->bytes[0]  = first;
   lexer->bytes[1]  = 0U;
 
-  SajsFlags const rflags = flags | (first ? SAJS_HAS_BYTES : 0U);
+  SajsFlags const rflags = flags | (first ? SAJS_HAS_BYTES : 0U) |
+                           ((lexer->top == 1U) ? SAJS_IS_ROOT : 0U);
   SajsEvent const e = {SAJS_SUCCESS, SAJS_EVENT_START, kind, (uint8_t)rflags};
   return e;
 }
@@ -232,16 +553,18 @@ pop(SajsLexer* const    lexer,
   lexer->bytes[0] = last;
   lexer->bytes[1] = 0U;
 
-  uint8_t const flags = last ? (uint8_t)SAJS_HAS_BYTES : 0U;
+  uint8_t const flags = (uint8_t)((last ? SAJS_HAS_BYTES : 0U) |
+                                  ((lexer->top <= 1U) ? SAJS_IS_ROOT : 0U));
   SajsEvent     e     = {SAJS_UNDERFLOW, SAJS_EVENT_END, kind, flags};
 
   if (lexer->top) {
     --lexer->top;
+    load_frame(lexer);
     e.status = success_status;
   }
 
   lexer->length    = 0U;
-  lexer->num_bytes = 0U;
+  lexer->num_bytes = last ? 1U : 0U;
   lexer->flags     = 0U;
   return e;
 }
@@ -256,7 +579,7 @@ do_reset(SajsLexer* const lexer,
          SajsFlags const  flags)
 {
   *frame       = (SajsFrame)state;
-  lexer->flags = flags;
+  lexer->flags = (uint8_t)flags;
   return do_nothing(SAJS_SUCCESS);
 }
 
@@ -270,7 +593,7 @@ do_reset_if(SajsLexer* const lexer,
 {
   if (!e.status) {
     *frame       = (SajsFrame)state;
-    lexer->flags = flags;
+    lexer->flags = (uint8_t)flags;
   }
 
   return e;
@@ -306,6 +629,103 @@ do_byte_change(SajsLexer* const lexer,
   return do_byte(lexer, c);
 }
 
+/* Number Values */
+
+#ifdef SAJS_NO_NUMBER_VALUES
+
+/// Ignore a number character, since number values aren't calculated
+static void
+accumulate(SajsLexer* const lexer, SajsState const state, uint8_t const c)
+{
+  (void)lexer;
+  (void)state;
+  (void)c;
+}
+
+#else
+
+/// Accumulate a significand digit, which may be after the decimal point
+static void
+accumulate_digit(SajsLexer* const lexer, uint8_t const d, bool const frac)
+{
+  if (lexer->significand <= (UINT64_MAX - d) / 10U) {
+    // Append digit to significand (leading zeros in a fraction stay zero)
+    lexer->significand = (lexer->significand * 10U) + d;
+    lexer->exponent -=
+      (frac && lexer->exponent > -(int32_t)MAX_EXPONENT) ? 1 : 0;
+  } else if (!frac) {
+    // Drop integer digit and scale up instead
+    lexer->syntax |= (uint8_t)(NUM_DROPPED | (d ? NUM_TRUNCATED : 0U));
+    lexer->exponent += (lexer->exponent < (int32_t)MAX_EXPONENT) ? 1 : 0;
+  } else if (d) {
+    // Drop fraction digit
+    lexer->syntax |= (uint8_t)NUM_TRUNCATED;
+  }
+}
+
+/// Accumulate a number character that moves to a new state
+static void
+accumulate(SajsLexer* const lexer, SajsState const state, uint8_t const c)
+{
+  switch (state) {
+  case STATE_NUM_INT_START:
+    lexer->syntax |= (uint8_t)NUM_NEGATIVE;
+    break;
+  case STATE_NUM_INT_CONT:
+  case STATE_NUM_INT_END:
+    accumulate_digit(lexer, (uint8_t)(c - '0'), false);
+    break;
+  case STATE_NUM_FRAC_START:
+  case STATE_NUM_EXP_START:
+    lexer->syntax |= (uint8_t)NUM_REAL;
+    break;
+  case STATE_NUM_FRAC_CONT:
+    accumulate_digit(lexer, (uint8_t)(c - '0'), true);
+    break;
+  case STATE_NUM_EXP_INT_START:
+    lexer->syntax |= (uint8_t)((c == '-') ? NUM_EXP_NEGATIVE : 0U);
+    break;
+  case STATE_NUM_EXP_INT_CONT:
+    if (lexer->value < MAX_EXPONENT) {
+      lexer->value = (lexer->value * 10U) + (uint32_t)(c - '0');
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+#endif
+
+/// Start a number with its first character
+static SajsEvent
+push_number(SajsLexer* const lexer,
+            SajsFlags const  flags,
+            SajsState const  state,
+            uint8_t const    c)
+{
+  SajsEvent const e = push(lexer, SAJS_NUMBER, flags, state, c);
+  if (!e.status) {
+    lexer->significand = 0U;
+    lexer->exponent    = 0;
+    lexer->syntax      = 0U;
+    accumulate(lexer, state, c);
+  }
+
+  return e;
+}
+
+/// Change the top frame to a new state, and produce a number character
+static SajsEvent
+do_number_byte(SajsLexer* const lexer,
+               SajsFrame* const frame,
+               SajsState const  state,
+               uint8_t const    c)
+{
+  accumulate(lexer, state, c);
+  return do_byte_change(lexer, frame, state, c);
+}
+
 /*
  * Character Handlers
  */
@@ -319,9 +739,9 @@ eat_value(SajsLexer* const lexer, SajsFlags const flags, uint8_t const c)
   case '\"':
     return push(lexer, SAJS_STRING, flags, STATE_STRING, 0);
   case '-':
-    return push(lexer, SAJS_NUMBER, flags, STATE_NUM_INT_START, c);
+    return push_number(lexer, flags, STATE_NUM_INT_START, c);
   case '0':
-    return push(lexer, SAJS_NUMBER, flags, STATE_NUM_INT_END, c);
+    return push_number(lexer, flags, STATE_NUM_INT_END, c);
   case '[':
     return push(lexer, SAJS_ARRAY, flags, STATE_ELEM_FIRST, 0);
   case '{':
@@ -336,7 +756,7 @@ eat_value(SajsLexer* const lexer, SajsFlags const flags, uint8_t const c)
     break;
   }
 
-  return is_digit(c) ? push(lexer, SAJS_NUMBER, flags, STATE_NUM_INT_CONT, c)
+  return is_digit(c) ? push_number(lexer, flags, STATE_NUM_INT_CONT, c)
                      : do_nothing(SAJS_EXPECTED_VALUE);
 }
 
@@ -434,9 +854,32 @@ eat_mem_next(SajsLexer* const lexer, SajsFrame* const frame, uint8_t const c)
 
 /* Strings */
 
+/*
+  While a string is being read, the working value is the state of the UTF-8
+  decoder, which is zero between characters (including around escapes).
+*/
+
+/// Produce a byte of a multi-byte character in a string, if it's valid
+static SajsEvent
+eat_utf8(SajsLexer* const lexer, uint8_t const c)
+{
+  uint32_t const state = utf8_next(lexer->value, c);
+  if (state == UTF8_REJECT) {
+    return do_nothing(lexer->value ? SAJS_EXPECTED_CONTINUATION
+                                   : SAJS_EXPECTED_UTF8);
+  }
+
+  lexer->value = state;
+  return do_byte(lexer, c);
+}
+
 static SajsEvent
 eat_string(SajsLexer* const lexer, SajsFrame* const frame, uint8_t const c)
 {
+  if (c >= 0x80U || lexer->value) {
+    return eat_utf8(lexer, c);
+  }
+
   return (c == '\"')   ? pop(lexer, SAJS_STRING, SAJS_SUCCESS, 0U)
          : (c == '\\') ? do_change(frame, STATE_STRING_ESC)
          : (c < ' ')   ? pop(lexer, SAJS_STRING, SAJS_EXPECTED_PRINTABLE, 0U)
@@ -485,6 +928,11 @@ eat_string_esc_hex(SajsLexer* const lexer,
     return do_nothing(SAJS_SUCCESS); // Still reading hex digits
   }
 
+#ifdef SAJS_NO_SURROGATES
+  if (lexer->value >= 0xD800U && lexer->value <= 0xDFFFU) {
+    return do_nothing(SAJS_EXPECTED_UTF8); // Surrogate pairs not supported
+  }
+#else
   if (lexer->value >= 0xDC00U && lexer->value <= 0xDFFFU) {
     return do_nothing(SAJS_EXPECTED_UTF16_HI); // Lone low surrogate
   }
@@ -493,9 +941,11 @@ eat_string_esc_hex(SajsLexer* const lexer,
     // High surrogate, wait for following low surrogate escape
     return do_change(frame, STATE_STRING_ESC_LO);
   }
+#endif
 
   // Emit UTF-8 character and return to normal string state
   SajsEvent const e = do_codepoint(lexer, lexer->value);
+  lexer->value      = UTF8_ACCEPT;
   lexer->length     = 0U;
   *frame            = STATE_STRING;
   return e;
@@ -531,6 +981,7 @@ eat_string_esc_lo(SajsLexer* const lexer,
 
   // Emit UTF-8 character and return to normal string state
   SajsEvent const e = do_codepoint(lexer, codepoint);
+  lexer->value      = UTF8_ACCEPT;
   lexer->length     = 0U;
   *frame            = STATE_STRING;
   return e;
@@ -549,8 +1000,8 @@ eat_num_int_start(SajsLexer* const lexer,
                   SajsFrame* const frame,
                   uint8_t const    c)
 {
-  return (c == '0')    ? do_byte_change(lexer, frame, STATE_NUM_INT_END, c)
-         : is_digit(c) ? do_byte_change(lexer, frame, STATE_NUM_INT_CONT, c)
+  return (c == '0')    ? do_number_byte(lexer, frame, STATE_NUM_INT_END, c)
+         : is_digit(c) ? do_number_byte(lexer, frame, STATE_NUM_INT_CONT, c)
                        : do_nothing(SAJS_EXPECTED_DIGIT);
 }
 
@@ -558,9 +1009,9 @@ static SajsEvent
 eat_num_int_end(SajsLexer* const lexer, SajsFrame* const frame, uint8_t const c)
 {
   return is_number_end(c) ? pop(lexer, SAJS_NUMBER, SAJS_RETRY, 0U)
-         : (c == '.') ? do_byte_change(lexer, frame, STATE_NUM_FRAC_START, c)
+         : (c == '.') ? do_number_byte(lexer, frame, STATE_NUM_FRAC_START, c)
          : (c == 'E' || c == 'e')
-           ? do_byte_change(lexer, frame, STATE_NUM_EXP_START, c)
+           ? do_number_byte(lexer, frame, STATE_NUM_EXP_START, c)
            : do_nothing(SAJS_EXPECTED_DECIMAL);
 }
 
@@ -569,7 +1020,8 @@ eat_num_int_cont(SajsLexer* const lexer,
                  SajsFrame* const frame,
                  uint8_t const    c)
 {
-  return is_digit(c) ? do_byte(lexer, c) : eat_num_int_end(lexer, frame, c);
+  return is_digit(c) ? do_number_byte(lexer, frame, STATE_NUM_INT_CONT, c)
+                     : eat_num_int_end(lexer, frame, c);
 }
 
 static SajsEvent
@@ -577,7 +1029,7 @@ eat_num_frac_start(SajsLexer* const lexer,
                    SajsFrame* const frame,
                    uint8_t const    c)
 {
-  return is_digit(c) ? do_byte_change(lexer, frame, STATE_NUM_FRAC_CONT, c)
+  return is_digit(c) ? do_number_byte(lexer, frame, STATE_NUM_FRAC_CONT, c)
                      : do_nothing(SAJS_EXPECTED_DIGIT);
 }
 
@@ -586,9 +1038,11 @@ eat_num_frac_cont(SajsLexer* const lexer,
                   SajsFrame* const frame,
                   uint8_t const    c)
 {
-  return is_digit(c)  ? do_byte(lexer, c)
-         : (c == 'e') ? do_byte_change(lexer, frame, STATE_NUM_EXP_START, c)
-                      : pop(lexer, SAJS_NUMBER, SAJS_RETRY, 0U);
+  return is_digit(c) ? do_number_byte(lexer, frame, STATE_NUM_FRAC_CONT, c)
+         : (c == 'E' || c == 'e')
+           ? do_number_byte(lexer, frame, STATE_NUM_EXP_START, c)
+         : is_number_end(c) ? pop(lexer, SAJS_NUMBER, SAJS_RETRY, 0U)
+                            : pop(lexer, SAJS_NUMBER, SAJS_EXPECTED_DIGIT, 0U);
 }
 
 static SajsEvent
@@ -596,7 +1050,7 @@ eat_num_exp_int_start(SajsLexer* const lexer,
                       SajsFrame* const frame,
                       uint8_t const    c)
 {
-  return is_digit(c) ? do_byte_change(lexer, frame, STATE_NUM_EXP_INT_CONT, c)
+  return is_digit(c) ? do_number_byte(lexer, frame, STATE_NUM_EXP_INT_CONT, c)
                      : do_nothing(SAJS_EXPECTED_DIGIT);
 }
 
@@ -606,7 +1060,7 @@ eat_num_exp_start(SajsLexer* const lexer,
                   uint8_t const    c)
 {
   return (c == '+' || c == '-')
-           ? do_byte_change(lexer, frame, STATE_NUM_EXP_INT_START, c)
+           ? do_number_byte(lexer, frame, STATE_NUM_EXP_INT_START, c)
            : eat_num_exp_int_start(lexer, frame, c);
 }
 
@@ -615,8 +1069,7 @@ eat_num_exp_int_cont(SajsLexer* const lexer,
                      SajsFrame* const frame,
                      uint8_t const    c)
 {
-  (void)frame;
-  return is_digit(c)        ? do_byte(lexer, c)
+  return is_digit(c) ? do_number_byte(lexer, frame, STATE_NUM_EXP_INT_CONT, c)
          : is_number_end(c) ? pop(lexer, SAJS_NUMBER, SAJS_RETRY, 0U)
                             : pop(lexer, SAJS_NUMBER, SAJS_EXPECTED_DIGIT, 0U);
 }
@@ -655,6 +1108,312 @@ eat_true(SajsLexer* const lexer, SajsFrame* const frame, uint8_t const c)
   return eat_literal(lexer, frame, 4U, "true", c);
 }
 
+/*
+ * Structural Transition Table
+ */
+
+#ifdef SAJS_TABLE_DISPATCH
+
+/// A class of characters that are handled identically in structural states
+typedef enum {
+  CLASS_OTHER        = 0U,  ///< Any other character (an error)
+  CLASS_SPACE        = 1U,  ///< Whitespace
+  CLASS_QUOTE        = 2U,  ///< '"'
+  CLASS_COMMA        = 3U,  ///< ','
+  CLASS_COLON        = 4U,  ///< ':'
+  CLASS_ARRAY_START  = 5U,  ///< '['
+  CLASS_ARRAY_END    = 6U,  ///< ']'
+  CLASS_OBJECT_START = 7U,  ///< '{'
+  CLASS_OBJECT_END   = 8U,  ///< '}'
+  CLASS_MINUS        = 9U,  ///< '-'
+  CLASS_ZERO         = 10U, ///< '0'
+  CLASS_DIGIT        = 11U, ///< '1' through '9'
+  CLASS_FALSE        = 12U, ///< 'f'
+  CLASS_NULL         = 13U, ///< 'n'
+  CLASS_TRUE         = 14U, ///< 't'
+} SajsClass;
+
+#  define SAJS_NUM_CLASS 15U ///< The number of SajsClass entries
+
+/// An action to take on a character in a structural state
+typedef enum {
+  ACTION_ERROR      = 0U, ///< Fail with the state's error status
+  ACTION_NOTHING    = 1U, ///< Ignore whitespace
+  ACTION_VALUE      = 2U, ///< Start a value
+  ACTION_NAME       = 3U, ///< Start a member name
+  ACTION_NEXT       = 4U, ///< Move past a delimiter to the next state
+  ACTION_ARRAY_END  = 5U, ///< End an array
+  ACTION_OBJECT_END = 6U, ///< End an object
+} SajsAction;
+
+/// Description of a structural state
+typedef struct {
+  uint8_t flags;  ///< Flags for a started value, or after a delimiter
+  uint8_t next;   ///< Next state after a started value or delimiter
+  uint8_t status; ///< Error status for unexpected characters
+} SajsStructuralState;
+
+static uint8_t const sajs_classes[256U] = {
+  ['\t'] = CLASS_SPACE,       ['\n'] = CLASS_SPACE,
+  ['\r'] = CLASS_SPACE,       [' ']  = CLASS_SPACE,
+  ['"']  = CLASS_QUOTE,       [',']  = CLASS_COMMA,
+  [':']  = CLASS_COLON,       ['[']  = CLASS_ARRAY_START,
+  [']']  = CLASS_ARRAY_END,   ['{']  = CLASS_OBJECT_START,
+  ['}']  = CLASS_OBJECT_END,  ['-']  = CLASS_MINUS,
+  ['0']  = CLASS_ZERO,        ['1']  = CLASS_DIGIT,
+  ['2']  = CLASS_DIGIT,       ['3']  = CLASS_DIGIT,
+  ['4']  = CLASS_DIGIT,       ['5']  = CLASS_DIGIT,
+  ['6']  = CLASS_DIGIT,       ['7']  = CLASS_DIGIT,
+  ['8']  = CLASS_DIGIT,       ['9']  = CLASS_DIGIT,
+  ['f']  = CLASS_FALSE,       ['n']  = CLASS_NULL,
+  ['t']  = CLASS_TRUE,
+};
+
+#  define E ACTION_ERROR
+#  define W ACTION_NOTHING
+#  define V ACTION_VALUE
+#  define N ACTION_NAME
+#  define S ACTION_NEXT
+#  define A ACTION_ARRAY_END
+#  define O ACTION_OBJECT_END
+
+static uint8_t const sajs_actions[STATE_MEM_NEXT + 1U][SAJS_NUM_CLASS] = {
+  // ?  sp "  ,  :  [  ]  {  }  -  0  1  f  n  t
+  {E, W, V, E, E, V, E, V, E, V, V, V, V, V, V}, // START
+  {E, W, V, E, E, V, A, V, E, V, V, V, V, V, V}, // ELEM_FIRST
+  {E, W, E, S, E, E, A, E, E, E, E, E, E, E, E}, // ELEM_SEP
+  {E, W, V, E, E, V, E, V, E, V, V, V, V, V, V}, // ELEM_NEXT
+  {E, W, N, E, E, E, E, E, O, E, E, E, E, E, E}, // MEM_NAME_FIRST
+  {E, W, E, E, S, E, E, E, E, E, E, E, E, E, E}, // MEM_NAME_SEP
+  {E, W, V, E, E, V, E, V, E, V, V, V, V, V, V}, // MEM_VALUE_START
+  {E, W, E, S, E, E, E, E, O, E, E, E, E, E, E}, // MEM_SEP
+  {E, W, N, E, E, E, E, E, E, E, E, E, E, E, E}, // MEM_NEXT
+};
+
+#  undef O
+#  undef A
+#  undef S
+#  undef N
+#  undef V
+#  undef W
+#  undef E
+
+static SajsStructuralState const sajs_structural_states[STATE_MEM_NEXT + 1U] = {
+  {0U, STATE_START, SAJS_EXPECTED_VALUE},
+  {SAJS_IS_ELEMENT | SAJS_IS_FIRST, STATE_ELEM_SEP, SAJS_EXPECTED_VALUE},
+  {SAJS_IS_ELEMENT, STATE_ELEM_NEXT, SAJS_EXPECTED_COMMA},
+  {SAJS_IS_ELEMENT, STATE_ELEM_SEP, SAJS_EXPECTED_VALUE},
+  {SAJS_IS_FIRST | SAJS_IS_MEMBER_NAME,
+   STATE_MEM_NAME_SEP,
+   SAJS_EXPECTED_QUOTE},
+  {SAJS_IS_MEMBER_VALUE, STATE_MEM_VALUE_START, SAJS_EXPECTED_COLON},
+  {SAJS_IS_MEMBER_VALUE, STATE_MEM_SEP, SAJS_EXPECTED_VALUE},
+  {0U, STATE_MEM_NEXT, SAJS_EXPECTED_COMMA},
+  {SAJS_IS_MEMBER_NAME, STATE_MEM_NAME_SEP, SAJS_EXPECTED_QUOTE},
+};
+
+/// The kind of value started by each character class
+static uint8_t const sajs_class_kinds[SAJS_NUM_CLASS] = {
+  0U,
+  0U,
+  SAJS_STRING,
+  0U,
+  0U,
+  SAJS_ARRAY,
+  0U,
+  SAJS_OBJECT,
+  0U,
+  SAJS_NUMBER,
+  SAJS_NUMBER,
+  SAJS_NUMBER,
+  SAJS_LITERAL,
+  SAJS_LITERAL,
+  SAJS_LITERAL,
+};
+
+/// The initial state of a value started by each character class
+static uint8_t const sajs_class_states[SAJS_NUM_CLASS] = {
+  STATE_START,
+  STATE_START,
+  STATE_STRING,
+  STATE_START,
+  STATE_START,
+  STATE_ELEM_FIRST,
+  STATE_START,
+  STATE_MEM_NAME_FIRST,
+  STATE_START,
+  STATE_NUM_INT_START,
+  STATE_NUM_INT_END,
+  STATE_NUM_INT_CONT,
+  STATE_FALSE,
+  STATE_NULL,
+  STATE_TRUE,
+};
+
+static SajsEvent
+eat_structural(SajsLexer* const lexer,
+               SajsFrame* const frame,
+               SajsState const  state,
+               uint8_t const    c)
+{
+  uint8_t const                    cls = sajs_classes[c];
+  SajsStructuralState const* const s   = &sajs_structural_states[state];
+
+  switch ((SajsAction)sajs_actions[state][cls]) {
+  case ACTION_ERROR:
+    break;
+  case ACTION_NOTHING:
+    return do_nothing(SAJS_SUCCESS);
+  case ACTION_VALUE: {
+    SajsValueKind const kind = (SajsValueKind)sajs_class_kinds[cls];
+    SajsState const     init = (SajsState)sajs_class_states[cls];
+    uint8_t const       head = (kind >= SAJS_NUMBER) ? c : 0U;
+
+    return do_change_if(frame,
+                        (SajsState)s->next,
+                        (kind == SAJS_NUMBER)
+                          ? push_number(lexer, s->flags, init, c)
+                          : push(lexer, kind, s->flags, init, head));
+  }
+  case ACTION_NAME:
+    return do_change_if(
+      frame,
+      (SajsState)s->next,
+      push(lexer, SAJS_STRING, s->flags, STATE_STRING, 0U));
+  case ACTION_NEXT:
+    return do_reset(lexer, frame, (SajsState)s->next, s->flags);
+  case ACTION_ARRAY_END:
+    return pop(lexer, SAJS_ARRAY, SAJS_SUCCESS, 0U);
+  case ACTION_OBJECT_END:
+    return pop(lexer, SAJS_OBJECT, SAJS_SUCCESS, 0U);
+  }
+
+  return do_nothing((SajsStatus)s->status);
+}
+
+#endif
+
+/*
+ * Spans
+ */
+
+/// Return the number state after a verbatim character, or STATE_START
+static SajsState
+num_next_state(SajsState const state, uint8_t const c)
+{
+  bool const digit = is_digit(c);
+  bool const exp   = c == 'E' || c == 'e';
+
+  switch (state) {
+  case STATE_NUM_INT_START:
+    return (c == '0') ? STATE_NUM_INT_END
+           : digit    ? STATE_NUM_INT_CONT
+                      : STATE_START;
+  case STATE_NUM_INT_CONT:
+    return digit ? STATE_NUM_INT_CONT
+           : (c == '.') ? STATE_NUM_FRAC_START
+           : exp        ? STATE_NUM_EXP_START
+                        : STATE_START;
+  case STATE_NUM_INT_END:
+    return (c == '.') ? STATE_NUM_FRAC_START
+           : exp      ? STATE_NUM_EXP_START
+                      : STATE_START;
+  case STATE_NUM_FRAC_START:
+    return digit ? STATE_NUM_FRAC_CONT : STATE_START;
+  case STATE_NUM_FRAC_CONT:
+    return digit ? STATE_NUM_FRAC_CONT
+           : exp ? STATE_NUM_EXP_START
+                 : STATE_START;
+  case STATE_NUM_EXP_START:
+    return (c == '+' || c == '-') ? STATE_NUM_EXP_INT_START
+           : digit                ? STATE_NUM_EXP_INT_CONT
+                                  : STATE_START;
+  case STATE_NUM_EXP_INT_START:
+  case STATE_NUM_EXP_INT_CONT:
+    return digit ? STATE_NUM_EXP_INT_CONT : STATE_START;
+  default:
+    break;
+  }
+
+  return STATE_START;
+}
+
+/// Return the number of leading number characters, and update the state
+static size_t
+scan_number(SajsLexer* const     lexer,
+            SajsFrame* const     frame,
+            uint8_t const* const start,
+            uint8_t const* const end)
+{
+  uint8_t const* p     = start;
+  SajsState      state = (SajsState)*frame;
+  for (SajsState next = STATE_START; p < end; ++p, state = next) {
+    if (!(next = num_next_state(state, *p))) {
+      break;
+    }
+
+    accumulate(lexer, next, *p);
+  }
+
+  *frame = (SajsFrame)state;
+  return (size_t)(p - start);
+}
+
+/// Return the number of leading literal characters before the last one
+static size_t
+scan_literal(SajsLexer* const     lexer,
+             SajsState const      state,
+             uint8_t const* const start,
+             uint8_t const* const end)
+{
+  char const* const string = (state == STATE_FALSE)  ? "false"
+                             : (state == STATE_NULL) ? "null"
+                                                     : "true";
+
+  // Stop before the last character, which ends the literal
+  uint8_t const* p = start;
+  while (p < end && string[lexer->length + 1U] &&
+         (char)*p == string[lexer->length]) {
+    ++p;
+    ++lexer->length;
+  }
+
+  return (size_t)(p - start);
+}
+
+/// Scan a span of whole and valid UTF-8 characters in a string
+static size_t
+scan_text(SajsLexer const* const lexer,
+          uint8_t const* const   start,
+          uint8_t const* const   end)
+{
+  if (lexer->value) {
+    return 0U; // Finish the current character a byte at a time
+  }
+
+  return (size_t)(scan_utf8(start, scan_string(start, end)) - start);
+}
+
+/// Scan a span of verbatim bytes in a string, number, or literal
+static size_t
+scan_span(SajsLexer* const     lexer,
+          uint8_t const* const start,
+          uint8_t const* const end)
+{
+  SajsFrame* const frame = top_frame(lexer);
+  SajsState const  state = (SajsState)*frame;
+
+  size_t const n =
+    (state == STATE_STRING) ? scan_text(lexer, start, end)
+    : (state >= STATE_NUM_INT_START && state <= STATE_NUM_EXP_INT_CONT)
+      ? scan_number(lexer, frame, start, end)
+    : (state >= STATE_FALSE) ? scan_literal(lexer, state, start, end)
+                             : 0U;
+
+  count_bytes(lexer, state, n);
+  return n;
+}
+
 /*
  * Interface
  */
@@ -673,9 +1432,15 @@ sajs_process_byte(SajsLexer* const lexer, int const c)
              : do_nothing(state ? SAJS_NO_DATA : SAJS_FAILURE);
   }
 
+#ifdef SAJS_TABLE_DISPATCH
+  if (state <= STATE_MEM_NEXT) {
+    return eat_structural(lexer, frame, state, (uint8_t)c);
+  }
+#else
   if (is_space(c) && state <= STATE_MEM_NEXT) {
     return do_nothing(SAJS_SUCCESS);
   }
+#endif
 
   typedef SajsEvent (*const SajsEatFunc)(SajsLexer*, SajsFrame*, uint8_t c);
 
@@ -709,26 +1474,408 @@ sajs_process_byte(SajsLexer* const lexer, int const c)
   return handlers[state](lexer, frame, (uint8_t)c);
 }
 
-SajsEvent
-sajs_read_byte(SajsLexer* const lexer, int const byte)
+static inline SajsEvent
+read_byte(SajsLexer* const lexer, int const byte)
 {
-  SajsEvent e = sajs_process_byte(lexer, byte);
+  count_byte(lexer, byte);
 
+  SajsEvent e = sajs_process_byte(lexer, byte);
   if (e.status == SAJS_RETRY) {
+    count_retry(lexer);
+
     SajsEvent f = sajs_process_byte(lexer, byte);
     e.status    = f.status;
     if (e.type == SAJS_EVENT_END && f.type == SAJS_EVENT_END) {
-      e.kind = f.kind;
-      e.type = SAJS_EVENT_DOUBLE_END;
+      e.kind  = f.kind;
+      e.type  = SAJS_EVENT_DOUBLE_END;
+      e.flags = f.flags;
+    }
+  }
+
+  count_event(lexer, e);
+  return e;
+}
+
+static SajsEvent
+read_buffer(SajsLexer* const  lexer,
+            size_t const      length,
+            char const* const data,
+            size_t* const     count,
+            bool const        spans)
+{
+  lexer->span = NULL;
+  if (!length) {
+    *count = 0U;
+    return read_byte(lexer, -1);
+  }
+
+  uint8_t const* const bytes = (uint8_t const*)data;
+  for (size_t i = 0U; i < length; ++i) {
+    SajsState const state = (SajsState)*top_frame(lexer);
+    if (state <= STATE_MEM_NEXT && is_space(bytes[i])) {
+      // Skip the whole run of whitespace between tokens
+      size_t const run_start = i;
+
+      i = (size_t)(scan_space(bytes + i + 1U, bytes + length) - bytes);
+      count_bytes(lexer, state, i - run_start);
+      if (i == length) {
+        break;
+      }
+    }
+
+    if (spans && state >= STATE_STRING) {
+      // Limit the span length so the byte count can't overflow
+      size_t const   max_span = (length - i) < UINT32_MAX ? (length - i)
+                                                          : UINT32_MAX;
+      uint8_t const* start    = bytes + i;
+      size_t const   n        = scan_span(lexer, start, start + max_span);
+      if (n) {
+        lexer->span      = start;
+        lexer->num_bytes = (uint32_t)n;
+        *count           = i + n;
+
+        SajsEvent span_event = bytes_event();
+        span_event.flags |= (i + n == length) ? SAJS_IS_CONTINUED : 0U;
+        count_event(lexer, span_event);
+        return span_event;
+      }
+    }
+
+    SajsEvent e = read_byte(lexer, bytes[i]);
+    if (e.status) {
+      *count = i; // Leave the offending byte unconsumed
+      return e;
+    }
+
+    if (e.type) {
+      *count = i + 1U;
+      e.flags |= (spans && e.type == SAJS_EVENT_BYTES && *count == length)
+                   ? SAJS_IS_CONTINUED
+                   : 0U;
+      return e;
+    }
+  }
+
+  *count = length;
+  return do_nothing(SAJS_SUCCESS);
+}
+
+/// Validate input until the stack is below `depth`, like sajs_validate()
+static SajsStatus
+validate(SajsLexer* const  lexer,
+         size_t const      depth,
+         size_t const      length,
+         char const* const data,
+         size_t* const     count)
+{
+  uint8_t const* const bytes = (uint8_t const*)data;
+  uint8_t const* const end   = bytes + length;
+  for (uint8_t const* p = bytes; p < end; ++p) {
+    SajsState const state = (SajsState)*top_frame(lexer);
+    if (state <= STATE_MEM_NEXT && is_space(*p)) {
+      uint8_t const* const run_start = p;
+
+      p = scan_space(p + 1U, end);
+      count_bytes(lexer, state, (size_t)(p - run_start));
+      if (p == end) {
+        break;
+      }
+    } else if (state >= STATE_STRING) {
+      if ((p += scan_span(lexer, p, end)) == end) {
+        break;
+      }
+    }
+
+    SajsEvent const e = read_byte(lexer, *p);
+    if (e.status) {
+      *count = (size_t)(p - bytes); // Leave the offending byte unconsumed
+      return e.status;
+    }
+
+    if (e.type >= SAJS_EVENT_END && e.type <= SAJS_EVENT_DOUBLE_END &&
+        lexer->top < depth) {
+      *count = (size_t)(p + 1U - bytes); // End of value
+      return SAJS_SUCCESS;
+    }
+  }
+
+  *count = length;
+  return SAJS_RETRY;
+}
+
+/**
+   Skip to the end of the container at the top of the stack.
+
+   This only looks at brackets and quotes, a block at a time, to find the
+   closing bracket.  The depth inside the container is kept in `length`, and
+   the string and escape carry in `value`, so skipping can continue in the
+   next buffer.  The closing bracket itself is read normally, which checks
+   that it matches the container and ends it as usual.
+*/
+static SajsStatus
+skip_container(SajsLexer* const  lexer,
+               size_t const      length,
+               char const* const data,
+               size_t* const     count)
+{
+  uint8_t const* const bytes = (uint8_t const*)data;
+  SajsFrame* const     frame = top_frame(lexer);
+  SajsState const      state = (SajsState)*frame;
+
+  // Start a new skip, or continue one that reached the end of the last buffer
+  uint32_t const skip  = lexer->length ? lexer->value : 0U;
+  uint32_t       depth = lexer->length ? lexer->length : 1U;
+  SajsCarry      carry = {skip & 1U, (skip & 2U) ? ~(uint64_t)0U : 0U};
+  for (size_t i = 0U; i < length; i += 64U) {
+    unsigned const  n       = block_size(length - i);
+    SajsBlock const block   = scan_block(bytes + i, n);
+    uint64_t const  outside = ~string_mask(&block, n, &carry);
+    uint64_t const  opens   = block.opens & outside;
+    uint64_t const  closes  = block.closes & outside;
+    if (scan_count_bits(closes) < depth) {
+      depth += scan_count_bits(opens) - scan_count_bits(closes);
+      continue;
+    }
+
+    // Walk through the brackets in this block to find the closing one
+    for (uint64_t s = opens | closes; s; s &= s - 1U) {
+      if (opens & s & (0U - s)) {
+        ++depth;
+      } else if (!--depth) {
+        size_t const end = i + scan_first_bit(s);
+
+        count_bytes(lexer, state, end);
+        lexer->length = 0U;
+        lexer->value  = 0U;
+        *frame = (SajsFrame)((state <= STATE_ELEM_NEXT) ? STATE_ELEM_SEP
+                                                        : STATE_MEM_SEP);
+
+        SajsEvent const e = read_byte(lexer, bytes[end]);
+        *count            = e.status ? end : (end + 1U);
+        return e.status;
+      }
     }
   }
 
+  count_bytes(lexer, state, length);
+  lexer->length = depth;
+  lexer->value  = (carry.escape ? 1U : 0U) | (carry.string ? 2U : 0U);
+  *count        = length;
+  return SAJS_RETRY;
+}
+
+SajsStatus
+sajs_validate(SajsLexer* const  lexer,
+              size_t const      length,
+              char const* const data,
+              size_t* const     count)
+{
+  lexer->span = NULL;
+  if (!length) {
+    *count = 0U;
+    return read_byte(lexer, -1).status;
+  }
+
+  SajsStatus const st = validate(lexer, 1U, length, data, count);
+  count_position(lexer, data, *count);
+  return st;
+}
+
+SajsStatus
+sajs_skip_value(SajsLexer* const  lexer,
+                size_t const      length,
+                char const* const data,
+                size_t* const     count)
+{
+  SajsState const state = (SajsState)*top_frame(lexer);
+
+  lexer->span = NULL;
+  if (!lexer->top) {
+    *count = 0U;
+    return SAJS_FAILURE;
+  }
+
+  if (!length) {
+    *count = 0U;
+    return read_byte(lexer, -1).status;
+  }
+
+  SajsStatus const st =
+    (state <= STATE_MEM_NEXT)
+      ? skip_container(lexer, length, data, count)
+      : validate(lexer, lexer->top, length, data, count);
+
+  count_position(lexer, data, *count);
+  return st;
+}
+
+SajsEvent
+sajs_read_byte(SajsLexer* const lexer, int const byte)
+{
+  lexer->span = NULL;
+
+  SajsEvent const e = read_byte(lexer, byte);
+  if (!e.status && byte >= 0) {
+    char const c = (char)byte;
+    count_position(lexer, &c, 1U);
+  }
+
   return e;
 }
 
+SajsEvent
+sajs_read_buffer(SajsLexer* const  lexer,
+                 size_t const      length,
+                 char const* const data,
+                 size_t* const     count)
+{
+  SajsEvent const e = read_buffer(lexer, length, data, count, false);
+  count_position(lexer, data, *count);
+  return e;
+}
+
+SajsEvent
+sajs_read_spans(SajsLexer* const  lexer,
+                size_t const      length,
+                char const* const data,
+                size_t* const     count)
+{
+  SajsEvent const e = read_buffer(lexer, length, data, count, true);
+  count_position(lexer, data, *count);
+  return e;
+}
+
+/**
+   Call the handler for an event read by sajs_lex().
+
+   The stack says what the event is part of.  A string is a member name if
+   its container is waiting for the ':' after it, and the frame of a literal
+   is still just above the top of the stack after it ends.
+*/
+static inline SajsStatus
+handle_event(SajsLexer* const          lexer,
+             SajsEvent const           e,
+             SajsHandlers const* const handlers,
+             void* const               handle)
+{
+  static SajsStringView const empty = {"", 0U};
+
+  SajsState const state = (SajsState)*top_frame(lexer);
+
+  if (e.type == SAJS_EVENT_START) {
+    return (e.kind <= SAJS_ARRAY && handlers->start)
+             ? handlers->start(handle, e.kind)
+             : SAJS_SUCCESS;
+  }
+
+  if (e.type == SAJS_EVENT_BYTES) {
+    if (state < STATE_STRING || state > STATE_STRING_ESC_LO) {
+      return SAJS_SUCCESS; // Number or literal character
+    }
+
+    bool const is_name =
+      *frame_at(lexer, lexer->top - 1U) == STATE_MEM_NAME_SEP;
+    SajsStatus (*const func)(void*, SajsStringView, bool) =
+      is_name ? handlers->name : handlers->string;
+
+    return func ? func(handle, sajs_string(lexer), false) : SAJS_SUCCESS;
+  }
+
+  // End of a value, and possibly its container
+  SajsValueKind const kind =
+    (e.type == SAJS_EVENT_DOUBLE_END) ? SAJS_NUMBER : e.kind;
+
+  SajsStatus st = SAJS_SUCCESS;
+  if (kind == SAJS_STRING) {
+    SajsStatus (*const func)(void*, SajsStringView, bool) =
+      (state == STATE_MEM_NAME_SEP) ? handlers->name : handlers->string;
+
+    st = func ? func(handle, empty, true) : SAJS_SUCCESS;
+  } else if (kind == SAJS_NUMBER) {
+    st = handlers->number ? handlers->number(handle, sajs_number(lexer))
+                          : SAJS_SUCCESS;
+  } else if (kind == SAJS_LITERAL) {
+    SajsState const literal = (SajsState)*frame_at(lexer, lexer->top + 1U);
+    char const      c       = (literal == STATE_FALSE)  ? 'f'
+                              : (literal == STATE_NULL) ? 'n'
+                                                        : 't';
+
+    st = handlers->literal ? handlers->literal(handle, c) : SAJS_SUCCESS;
+  }
+
+  if (!st && (kind <= SAJS_ARRAY || e.type == SAJS_EVENT_DOUBLE_END)) {
+    st = handlers->end ? handlers->end(handle, e.kind) : SAJS_SUCCESS;
+  }
+
+  return st;
+}
+
+SajsStatus
+sajs_lex(SajsLexer* const          lexer,
+         size_t const              length,
+         char const* const         data,
+         size_t* const             count,
+         SajsHandlers const* const handlers,
+         void* const               handle)
+{
+  size_t offset = 0U;
+  do {
+    size_t          n = 0U;
+    SajsEvent const e =
+      read_buffer(lexer, length - offset, data + offset, &n, true);
+
+    count_position(lexer, data + offset, n);
+
+    SajsStatus const st = e.status ? e.status
+                          : e.type ? handle_event(lexer, e, handlers, handle)
+                                   : SAJS_SUCCESS;
+
+    offset += n;
+    if (st) {
+      *count = offset;
+      return st;
+    }
+  } while (offset < length || !length);
+
+  *count = length;
+  return SAJS_SUCCESS;
+}
+
 SajsStringView
 sajs_string(SajsLexer const* const lexer)
 {
-  SajsStringView const string = {(char const*)lexer->bytes, lexer->num_bytes};
+  SajsStringView const string = {
+    lexer->span ? (char const*)lexer->span : (char const*)lexer->bytes,
+    lexer->num_bytes};
   return string;
 }
+
+SajsNumber
+sajs_number(SajsLexer const* const lexer)
+{
+  uint8_t const syntax   = lexer->syntax;
+  int32_t const explicit = (int32_t)lexer->value;
+  int32_t const exponent =
+    lexer->exponent + ((syntax & NUM_EXP_NEGATIVE) ? -explicit : explicit);
+
+  SajsNumber number = {0.0, 0U, 0U};
+
+  number.flags |= (syntax & NUM_NEGATIVE) ? SAJS_NUMBER_NEGATIVE : 0U;
+  if (!(syntax & NUM_REAL)) {
+    number.flags |= SAJS_NUMBER_INTEGER;
+    if (syntax & NUM_DROPPED) {
+      number.flags |= SAJS_NUMBER_OVERFLOW;
+      number.magnitude = UINT64_MAX;
+    } else {
+      number.magnitude = lexer->significand;
+    }
+  }
+
+  double const real = sajs_decimal_to_double(lexer->significand,
+                                             exponent,
+                                             syntax & NUM_TRUNCATED,
+                                             &number.flags);
+
+  number.real = (syntax & NUM_NEGATIVE) ? -real : real;
+  return number;
+}
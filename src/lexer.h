@@ -0,0 +1,21 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#ifndef SAJS_SRC_LEXER_H
+#define SAJS_SRC_LEXER_H
+
+#include "local.h"
+
+#include <stddef.h>
+
+/**
+   Return the size of memory for a lexer with a stack of at least `max_depth`.
+
+   This is the smallest size that sajs_lexer_init() accepts for the depth,
+   which depends on the lexer state and stack layout of the build, and at
+   least any depth fixed at compile time.
+*/
+SAJS_LOCAL size_t
+sajs_lexer_mem_size(size_t max_depth);
+
+#endif // SAJS_SRC_LEXER_H
@@ -0,0 +1,12 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#ifndef SAJS_SRC_LOCAL_H
+#define SAJS_SRC_LOCAL_H
+
+// SAJS_LOCAL is the linkage of internal functions used by other source files
+#ifndef SAJS_LOCAL
+#  define SAJS_LOCAL
+#endif
+
+#endif // SAJS_SRC_LOCAL_H
@@ -0,0 +1,28 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#ifndef SAJS_SRC_NUMBER_H
+#define SAJS_SRC_NUMBER_H
+
+#include "local.h"
+
+#include "sajs/sajs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+   Return the nearest double to a decimal `significand * 10^exponent`.
+
+   If `truncated` is true, then nonzero digits were dropped from the end of
+   the significand, so the exact value is somewhat larger.  This sets
+   #SAJS_NUMBER_OVERFLOW in `flags` if the result is infinite, and
+   #SAJS_NUMBER_INEXACT if it couldn't be rounded correctly.
+*/
+SAJS_LOCAL double
+sajs_decimal_to_double(uint64_t         significand,
+                       int32_t          exponent,
+                       bool             truncated,
+                       SajsNumberFlags* flags);
+
+#endif // SAJS_SRC_NUMBER_H
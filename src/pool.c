@@ -0,0 +1,156 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#include "lexer.h"
+
+#include "sajs/sajs.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  A pool of lexer and writer slabs in provided memory.
+
+  The pool state is followed by a stack of free slab indices, then the slabs
+  themselves, starting at the next cache line.  Each slab is a lexer with its
+  stack, followed by a writer, padded to a whole number of cache lines.  So,
+  slabs in use by different threads never share a cache line, with each other
+  or with the pool.  Every lexer and writer is set up once when the pool is,
+  and only reset when it's acquired again.
+*/
+
+#define LINE_SIZE 64U             ///< Size of a cache line and slab alignment
+#define WRITER_SIZE 64U           ///< Size of writer memory in each slab
+#define MAX_DEPTH (SIZE_MAX / 4U) ///< Maximum stack depth of slabs
+
+/// Pool state (followed by free stack and slabs)
+struct SajsPoolImpl {
+  uint8_t*  slabs;      ///< Start of first slab
+  uint32_t* free;       ///< Stack of free slab indices
+  size_t    slab_size;  ///< Size of each slab
+  size_t    lexer_size; ///< Size of lexer memory at the start of each slab
+  uint32_t  num_slabs;  ///< Number of slabs
+  uint32_t  num_free;   ///< Number of free slabs on the stack
+};
+
+/// Return `size` rounded up to a multiple of `align`, a power of two
+static size_t
+align_up(size_t const size, size_t const align)
+{
+  return (size + (align - 1U)) & ~(align - 1U);
+}
+
+/// Return the size of lexer memory with room for a stack of `max_depth`
+static size_t
+lexer_size(size_t const max_depth)
+{
+  return align_up(sajs_lexer_mem_size(max_depth), sizeof(uintptr_t));
+}
+
+/// Return the size of a slab with room for a stack of `max_depth`
+static size_t
+slab_size(size_t const max_depth)
+{
+  return align_up(lexer_size(max_depth) + WRITER_SIZE, LINE_SIZE);
+}
+
+size_t
+sajs_pool_mem_size(size_t const num_slabs, size_t const max_depth)
+{
+  if (max_depth > MAX_DEPTH || num_slabs > UINT32_MAX) {
+    return 0U;
+  }
+
+  size_t const header_size = sizeof(SajsPool) + (LINE_SIZE - 1U);
+  size_t const entry_size  = slab_size(max_depth) + sizeof(uint32_t);
+
+  return (num_slabs > (SIZE_MAX - header_size) / entry_size)
+           ? 0U
+           : (header_size + (num_slabs * entry_size));
+}
+
+SajsPool*
+sajs_pool_init(size_t const mem_size, void* const mem, size_t const max_depth)
+{
+  size_t const header_size = sizeof(SajsPool) + (LINE_SIZE - 1U);
+  if (max_depth > MAX_DEPTH || mem_size < header_size) {
+    return NULL;
+  }
+
+  size_t const   entry_size = slab_size(max_depth) + sizeof(uint32_t);
+  size_t const   n          = (mem_size - header_size) / entry_size;
+  uint32_t const num_slabs  = (n > UINT32_MAX) ? UINT32_MAX : (uint32_t)n;
+  if (!num_slabs) {
+    return NULL;
+  }
+
+  // Place the free stack after the pool, and slabs at the next cache line
+  SajsPool* const pool  = (SajsPool*)mem;
+  uint32_t* const stack = (uint32_t*)(pool + 1U);
+  uintptr_t const end   = (uintptr_t)(stack + num_slabs);
+  uintptr_t const slabs = (uintptr_t)align_up(end, LINE_SIZE);
+
+  pool->slabs      = (uint8_t*)mem + (slabs - (uintptr_t)mem);
+  pool->free       = stack;
+  pool->slab_size  = slab_size(max_depth);
+  pool->lexer_size = lexer_size(max_depth);
+  pool->num_slabs  = num_slabs;
+  pool->num_free   = num_slabs;
+
+  // Set up every slab, with the first on the top of the free stack
+  for (uint32_t i = 0U; i < num_slabs; ++i) {
+    uint8_t* const slab = pool->slabs + (i * pool->slab_size);
+
+    if (!sajs_lexer_init(pool->lexer_size, slab) ||
+        !sajs_writer_init(WRITER_SIZE, slab + pool->lexer_size)) {
+      return NULL; // Slab is too small for this build's lexer or writer
+    }
+
+    stack[num_slabs - 1U - i] = i;
+  }
+
+  return pool;
+}
+
+SajsStatus
+sajs_pool_acquire(SajsPool* const    pool,
+                  SajsLexer** const  lexer,
+                  SajsWriter** const writer)
+{
+  if (!pool->num_free) {
+    return SAJS_OVERFLOW;
+  }
+
+  uint32_t const index = pool->free[--pool->num_free];
+  uint8_t* const slab  = pool->slabs + (index * pool->slab_size);
+
+  *lexer  = (SajsLexer*)slab;
+  *writer = (SajsWriter*)(slab + pool->lexer_size);
+
+  sajs_lexer_reset(*lexer);
+  sajs_writer_reset(*writer);
+  (void)sajs_lexer_set_position(*lexer, NULL);
+  (void)sajs_lexer_set_stats(*lexer, NULL);
+  (void)sajs_writer_set_stats(*writer, NULL);
+  return SAJS_SUCCESS;
+}
+
+SajsStatus
+sajs_pool_release(SajsPool* const pool, SajsLexer* const lexer)
+{
+  uintptr_t const slabs  = (uintptr_t)pool->slabs;
+  uintptr_t const slab   = (uintptr_t)lexer;
+  size_t const    offset = (size_t)(slab - slabs);
+  size_t const    index  = offset / pool->slab_size;
+
+  if (slab < slabs || index >= pool->num_slabs || offset % pool->slab_size) {
+    return SAJS_FAILURE; // Not a slab from this pool
+  }
+
+  if (pool->num_free == pool->num_slabs) {
+    return SAJS_UNDERFLOW;
+  }
+
+  pool->free[pool->num_free++] = (uint32_t)index;
+  return SAJS_SUCCESS;
+}
@@ -0,0 +1,69 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+/**
+   Single-file build of the whole library.
+
+   Including this in a source file compiles a private copy of the library
+   into it, from the same sources that the library is built from.  Every
+   public function is static inline by default, so the compiler can inline
+   the lexer into the loops that call it, and drop whatever isn't used.  To
+   build a copy with exported symbols instead, define SAJS_API before
+   including this.  Since this includes sajs/sajs.h, it must come before any
+   other inclusion of it, and the src and include directories must both be
+   on the include path.
+
+   Behaviour can be specialised with the same switches as the library build,
+   defined before including this:
+
+   - SAJS_NO_SIMD: Use only portable code for scanning.
+   - SAJS_TABLE_DISPATCH: Use a transition table for structural states.
+   - SAJS_STATS: Count reading and writing statistics.
+
+   Along with a few that are only useful for specialised builds:
+
+   - SAJS_MAX_DEPTH: Fix the maximum stack depth of every lexer at compile
+     time.  Lexers must be given enough memory for this many frames, and
+     can't use any more.
+
+   - SAJS_NO_SURROGATES: Don't support UTF-16 surrogate pairs, so any string
+     escape like "\uD834" is an error (#SAJS_EXPECTED_UTF8).  Supplementary
+     characters can still be given directly as UTF-8.
+
+   - SAJS_COMPACT_STACK: Store every stack frame below the top few as a
+     single bit, so lexers can read values nested 8 times deeper in the same
+     memory, at a small cost when entering and leaving containers.
+
+   - SAJS_NO_POSITIONS: Don't support tracking input positions, which removes
+     a check from every read call, and a pointer from the lexer.
+
+   - SAJS_NO_NUMBER_VALUES: Check the syntax of numbers, but don't calculate
+     their values, which all read as zero.  This saves some work when only
+     validating, skipping, or copying numbers as text.
+*/
+
+#ifndef SAJS_SRC_SAJS_IMPL_H
+#define SAJS_SRC_SAJS_IMPL_H
+
+#ifdef SAJS_SAJS_H
+#  error "sajs_impl.h must be included before sajs/sajs.h"
+#endif
+
+#ifndef SAJS_API
+#  define SAJS_API static inline
+#endif
+
+#define SAJS_LOCAL static
+
+#include "filter.c"
+#include "index.c"
+#include "keys.c"
+#include "lexer.c"
+#include "number.c"
+#include "pool.c"
+#include "split.c"
+#include "status.c"
+#include "tape.c"
+#include "writer.c"
+
+#endif // SAJS_SRC_SAJS_IMPL_H
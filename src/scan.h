@@ -0,0 +1,356 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#ifndef SAJS_SRC_SCAN_H
+#define SAJS_SRC_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Fast scanning for interesting bytes in a buffer.
+
+  These use SIMD instructions if they're available at compile time, or
+  portable word-at-a-time (SWAR) arithmetic otherwise.  Defining SAJS_NO_SIMD
+  forces the portable fallback.
+*/
+
+#ifndef SAJS_NO_SIMD
+#  if defined(__AVX2__)
+#    define SAJS_SCAN_AVX2 1
+#    include <immintrin.h>
+#  elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define SAJS_SCAN_SSE2 1
+#    include <emmintrin.h>
+#  elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#    define SAJS_SCAN_NEON 1
+#    include <arm_neon.h>
+#  endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#  include <intrin.h>
+#endif
+
+/// Return the index of the lowest set bit in a non-zero word
+static inline unsigned
+scan_first_bit(uint64_t const word)
+{
+#if defined(__GNUC__)
+  return (unsigned)__builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index = 0U;
+  _BitScanForward64(&index, word);
+  return (unsigned)index;
+#else
+  unsigned index = 0U;
+  for (uint64_t w = word; !(w & 1U); w >>= 1U) {
+    ++index;
+  }
+  return index;
+#endif
+}
+
+/// Return the number of set bits in a word
+static inline unsigned
+scan_count_bits(uint64_t const word)
+{
+  // Only use the builtin if it's an instruction and not a runtime library call
+#if defined(__GNUC__) && (defined(__POPCNT__) || defined(__aarch64__))
+  return (unsigned)__builtin_popcountll(word);
+#else
+  uint64_t w = word - ((word >> 1U) & 0x5555555555555555U);
+  w = (w & 0x3333333333333333U) + ((w >> 2U) & 0x3333333333333333U);
+  w = (w + (w >> 4U)) & 0x0F0F0F0F0F0F0F0FU;
+  return (unsigned)((w * 0x0101010101010101U) >> 56U);
+#endif
+}
+
+/// Load 8 bytes as a little-endian word, regardless of host byte order
+static inline uint64_t
+scan_load_word(uint8_t const* const p)
+{
+  return (uint64_t)p[0] | ((uint64_t)p[1] << 8U) | ((uint64_t)p[2] << 16U) |
+         ((uint64_t)p[3] << 24U) | ((uint64_t)p[4] << 32U) |
+         ((uint64_t)p[5] << 40U) | ((uint64_t)p[6] << 48U) |
+         ((uint64_t)p[7] << 56U);
+}
+
+#define SAJS_SCAN_ONES 0x0101010101010101U  ///< 0x01 in every byte
+#define SAJS_SCAN_HIGHS 0x8080808080808080U ///< 0x80 in every byte
+
+/// Return the high bit of each byte in a word which is less than `n` (<= 128)
+static inline uint64_t
+scan_word_less(uint64_t const word, uint8_t const n)
+{
+  return (word - (SAJS_SCAN_ONES * n)) & ~word & SAJS_SCAN_HIGHS;
+}
+
+/// Return the high bit of each byte in a word which is equal to `c`
+static inline uint64_t
+scan_word_equal(uint64_t const word, uint8_t const c)
+{
+  return scan_word_less(word ^ (SAJS_SCAN_ONES * c), 1U);
+}
+
+/*
+  Note that the above word functions may set spurious bits above a matching
+  byte (due to borrows), but the lowest set bit always indicates the first
+  match, which is all the string scanning function below needs.
+*/
+
+/// Return the high bit of each byte in a word which is zero, exactly
+static inline uint64_t
+scan_word_zero(uint64_t const word)
+{
+  uint64_t const lows = ~SAJS_SCAN_HIGHS;
+
+  return ~(((word & lows) + lows) | word | lows);
+}
+
+/// Return the high bit of each byte in a word which is JSON whitespace
+static inline uint64_t
+scan_word_space(uint64_t const word)
+{
+  return scan_word_zero(word ^ (SAJS_SCAN_ONES * ' ')) |
+         scan_word_zero(word ^ (SAJS_SCAN_ONES * '\t')) |
+         scan_word_zero(word ^ (SAJS_SCAN_ONES * '\n')) |
+         scan_word_zero(word ^ (SAJS_SCAN_ONES * '\r'));
+}
+
+/**
+   Gather the high bit of each byte in a word into the low 8 bits.
+
+   This is a portable equivalent of a SIMD "movemask", which only makes sense
+   for an exact mask like those returned by scan_word_zero().
+*/
+static inline unsigned
+scan_word_bits(uint64_t const highs)
+{
+  return (unsigned)((((highs & SAJS_SCAN_HIGHS) >> 7U) * 0x0102040810204080U) >>
+                    56U);
+}
+
+/**
+   Return a pointer to the first special string byte in a range.
+
+   Special bytes are '"', '\\', and control characters (below 0x20), which is
+   everything that ends a run of plain characters in a string.  Returns `end`
+   if there are none.
+*/
+static inline uint8_t const*
+scan_string(uint8_t const* const start, uint8_t const* const end)
+{
+  uint8_t const* p = start;
+
+#if defined(SAJS_SCAN_AVX2)
+  __m256i const quote = _mm256_set1_epi8('"');
+  __m256i const slash = _mm256_set1_epi8('\\');
+  __m256i const ctrl  = _mm256_set1_epi8(0x1F);
+  for (; end - p >= 32; p += 32) {
+    __m256i const v = _mm256_loadu_si256((__m256i const*)(void const*)p);
+    __m256i const q = _mm256_cmpeq_epi8(v, quote);
+    __m256i const b = _mm256_cmpeq_epi8(v, slash);
+    __m256i const c = _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctrl), ctrl);
+    __m256i const m = _mm256_or_si256(_mm256_or_si256(q, b), c);
+
+    uint32_t const mask = (uint32_t)_mm256_movemask_epi8(m);
+    if (mask) {
+      return p + scan_first_bit(mask);
+    }
+  }
+
+#elif defined(SAJS_SCAN_SSE2)
+  __m128i const quote = _mm_set1_epi8('"');
+  __m128i const slash = _mm_set1_epi8('\\');
+  __m128i const ctrl  = _mm_set1_epi8(0x1F);
+  for (; end - p >= 16; p += 16) {
+    __m128i const v = _mm_loadu_si128((__m128i const*)(void const*)p);
+    __m128i const q = _mm_cmpeq_epi8(v, quote);
+    __m128i const b = _mm_cmpeq_epi8(v, slash);
+    __m128i const c = _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl);
+    __m128i const m = _mm_or_si128(_mm_or_si128(q, b), c);
+
+    uint32_t const mask = (uint32_t)_mm_movemask_epi8(m);
+    if (mask) {
+      return p + scan_first_bit(mask);
+    }
+  }
+
+#elif defined(SAJS_SCAN_NEON)
+  uint8x16_t const quote = vdupq_n_u8((uint8_t)'"');
+  uint8x16_t const slash = vdupq_n_u8((uint8_t)'\\');
+  uint8x16_t const space = vdupq_n_u8(0x20U);
+  for (; end - p >= 16; p += 16) {
+    uint8x16_t const v = vld1q_u8(p);
+    uint8x16_t const q = vceqq_u8(v, quote);
+    uint8x16_t const b = vceqq_u8(v, slash);
+    uint8x16_t const c = vcltq_u8(v, space);
+    uint8x16_t const m = vorrq_u8(vorrq_u8(q, b), c);
+
+    // Narrow to a 64-bit mask with 4 bits per byte
+    uint64_t const mask = vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    if (mask) {
+      return p + (scan_first_bit(mask) >> 2U);
+    }
+  }
+#endif
+
+  for (; end - p >= 8; p += 8) {
+    uint64_t const word = scan_load_word(p);
+    uint64_t const mask = scan_word_equal(word, '"') |
+                          scan_word_equal(word, '\\') |
+                          scan_word_less(word, 0x20U);
+    if (mask) {
+      return p + (scan_first_bit(mask) >> 3U);
+    }
+  }
+
+  while (p < end && *p >= 0x20U && *p != '"' && *p != '\\') {
+    ++p;
+  }
+
+  return p;
+}
+
+/**
+   Return a pointer to the first non-whitespace byte in a range.
+
+   Whitespace is the four characters allowed between JSON tokens: space, tab,
+   newline, and carriage return.  Returns `end` if there are none.
+*/
+static inline uint8_t const*
+scan_space(uint8_t const* const start, uint8_t const* const end)
+{
+  uint8_t const* p = start;
+
+#if defined(SAJS_SCAN_AVX2)
+  __m256i const space = _mm256_set1_epi8(' ');
+  __m256i const tab   = _mm256_set1_epi8('\t');
+  __m256i const nl    = _mm256_set1_epi8('\n');
+  __m256i const cr    = _mm256_set1_epi8('\r');
+  for (; end - p >= 32; p += 32) {
+    __m256i const v = _mm256_loadu_si256((__m256i const*)(void const*)p);
+    __m256i const m =
+      _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                                      _mm256_cmpeq_epi8(v, tab)),
+                      _mm256_or_si256(_mm256_cmpeq_epi8(v, nl),
+                                      _mm256_cmpeq_epi8(v, cr)));
+
+    uint32_t const mask = ~(uint32_t)_mm256_movemask_epi8(m);
+    if (mask) {
+      return p + scan_first_bit(mask);
+    }
+  }
+
+#elif defined(SAJS_SCAN_SSE2)
+  __m128i const space = _mm_set1_epi8(' ');
+  __m128i const tab   = _mm_set1_epi8('\t');
+  __m128i const nl    = _mm_set1_epi8('\n');
+  __m128i const cr    = _mm_set1_epi8('\r');
+  for (; end - p >= 16; p += 16) {
+    __m128i const v = _mm_loadu_si128((__m128i const*)(void const*)p);
+    __m128i const m =
+      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                _mm_cmpeq_epi8(v, tab)),
+                   _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)));
+
+    uint32_t const mask = ~(uint32_t)_mm_movemask_epi8(m) & 0xFFFFU;
+    if (mask) {
+      return p + scan_first_bit(mask);
+    }
+  }
+
+#elif defined(SAJS_SCAN_NEON)
+  uint8x16_t const space = vdupq_n_u8((uint8_t)' ');
+  uint8x16_t const tab   = vdupq_n_u8((uint8_t)'\t');
+  uint8x16_t const nl    = vdupq_n_u8((uint8_t)'\n');
+  uint8x16_t const cr    = vdupq_n_u8((uint8_t)'\r');
+  for (; end - p >= 16; p += 16) {
+    uint8x16_t const v = vld1q_u8(p);
+    uint8x16_t const m =
+      vmvnq_u8(vorrq_u8(vorrq_u8(vceqq_u8(v, space), vceqq_u8(v, tab)),
+                        vorrq_u8(vceqq_u8(v, nl), vceqq_u8(v, cr))));
+
+    // Narrow to a 64-bit mask with 4 bits per byte
+    uint64_t const mask = vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    if (mask) {
+      return p + (scan_first_bit(mask) >> 2U);
+    }
+  }
+#endif
+
+  for (; end - p >= 8; p += 8) {
+    uint64_t const mask = ~scan_word_space(scan_load_word(p)) & SAJS_SCAN_HIGHS;
+    if (mask) {
+      return p + (scan_first_bit(mask) >> 3U);
+    }
+  }
+
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+    ++p;
+  }
+
+  return p;
+}
+
+/**
+   Return the number of newlines in a range.
+
+   This is used to count lines in input that has already been read, so only
+   needs to be fast, not to find where the newlines are.
+*/
+static inline size_t
+scan_count_lines(uint8_t const* const start, uint8_t const* const end)
+{
+  uint8_t const* p = start;
+  size_t         n = 0U;
+
+#if defined(SAJS_SCAN_AVX2)
+  __m256i const nl = _mm256_set1_epi8('\n');
+  for (; end - p >= 32; p += 32) {
+    __m256i const v = _mm256_loadu_si256((__m256i const*)(void const*)p);
+    __m256i const m = _mm256_cmpeq_epi8(v, nl);
+
+    n += scan_count_bits((uint32_t)_mm256_movemask_epi8(m));
+  }
+
+#elif defined(SAJS_SCAN_SSE2)
+  __m128i const nl = _mm_set1_epi8('\n');
+  for (; end - p >= 16; p += 16) {
+    __m128i const v = _mm_loadu_si128((__m128i const*)(void const*)p);
+    __m128i const m = _mm_cmpeq_epi8(v, nl);
+
+    n += scan_count_bits((uint32_t)_mm_movemask_epi8(m));
+  }
+
+#elif defined(SAJS_SCAN_NEON)
+  uint8x16_t const nl = vdupq_n_u8((uint8_t)'\n');
+  for (; end - p >= 16; p += 16) {
+    uint8x16_t const m = vceqq_u8(vld1q_u8(p), nl);
+
+    // Narrow to a 64-bit mask with 4 bits per byte
+    uint64_t const mask = vget_lane_u64(
+      vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+
+    n += scan_count_bits(mask) >> 2U;
+  }
+#endif
+
+  for (; end - p >= 8; p += 8) {
+    uint64_t const word = scan_load_word(p);
+
+    n += scan_count_bits(scan_word_zero(word ^ (SAJS_SCAN_ONES * '\n')));
+  }
+
+  for (; p < end; ++p) {
+    n += (*p == '\n') ? 1U : 0U;
+  }
+
+  return n;
+}
+
+#endif // SAJS_SRC_SCAN_H
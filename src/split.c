@@ -0,0 +1,119 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#include "block.h"
+#include "scan.h"
+
+#include "sajs/sajs.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Splitting documents for parallel reading.
+
+  This finds the structure of a document without lexing it, in 64-byte
+  blocks, like the first stage of simdjson.  Each block is reduced to bit
+  masks of interesting characters, escaped quotes are removed, and a prefix
+  XOR of the remaining quote bits gives a mask of the bytes in strings.  The
+  brackets and commas outside strings then give the container depth.
+
+  A chunk can be scanned without knowing whether it starts in a string,
+  because if it does, the bytes in strings are exactly the bytes outside
+  strings if it doesn't.  So, the depth change is counted both ways, and each
+  chunk is linked to the previous one afterwards in a quick sequential pass.
+*/
+
+/// Return 1 if the byte at `offset` is escaped by the preceding backslashes
+static uint64_t
+is_escaped(uint8_t const* const bytes, size_t const offset)
+{
+  size_t n = 0U;
+  while (n < offset && bytes[offset - n - 1U] == '\\') {
+    ++n;
+  }
+
+  return n & 1U;
+}
+
+/// Return the change in depth from the brackets in a mask of a block
+static int64_t
+depth_change(SajsBlock const* const block, uint64_t const mask)
+{
+  return (int64_t)scan_count_bits(block->opens & mask) -
+         (int64_t)scan_count_bits(block->closes & mask);
+}
+
+void
+sajs_scan_chunk(size_t const      length,
+                char const* const data,
+                SajsChunk* const  chunk)
+{
+  uint8_t const* const bytes = (uint8_t const*)data;
+  size_t const         end   = chunk->end < length ? chunk->end : length;
+
+  SajsCarry carry   = {is_escaped(bytes, chunk->begin), 0U};
+  int64_t   outside = 0;
+  int64_t   inside  = 0;
+  for (size_t i = chunk->begin; i < end; i += 64U) {
+    SajsBlock const block = scan_block(bytes + i, end - i);
+    uint64_t const  in    = string_mask(&block, block_size(end - i), &carry);
+
+    outside += depth_change(&block, ~in);
+    inside += depth_change(&block, in);
+  }
+
+  chunk->change[0]  = outside;
+  chunk->change[1]  = inside;
+  chunk->odd_quotes = (uint8_t)(carry.string & 1U);
+}
+
+void
+sajs_link_chunk(SajsChunk const* const prev, SajsChunk* const chunk)
+{
+  if (prev) {
+    chunk->depth     = prev->depth + prev->change[prev->in_string];
+    chunk->in_string = (uint8_t)(prev->in_string ^ prev->odd_quotes);
+  } else {
+    chunk->depth     = 0;
+    chunk->in_string = 0U;
+  }
+}
+
+size_t
+sajs_find_split(size_t const            length,
+                char const* const       data,
+                SajsChunk const* const  chunk)
+{
+  uint8_t const* const bytes = (uint8_t const*)data;
+  size_t const         end   = chunk->end < length ? chunk->end : length;
+
+  SajsCarry carry = {is_escaped(bytes, chunk->begin),
+                     chunk->in_string ? ~(uint64_t)0U : 0U};
+  int64_t   depth = chunk->depth;
+  for (size_t i = chunk->begin; i < end; i += 64U) {
+    SajsBlock const block   = scan_block(bytes + i, end - i);
+    uint64_t const  outside = ~string_mask(&block, block_size(end - i), &carry);
+    uint64_t const  commas  = block.commas & outside;
+    if (!commas) {
+      depth += depth_change(&block, outside);
+      continue;
+    }
+
+    // Walk through the structural characters in this block in order
+    uint64_t const opens  = block.opens & outside;
+    uint64_t const closes = block.closes & outside;
+    for (uint64_t s = opens | closes | commas; s; s &= s - 1U) {
+      uint64_t const bit = s & (0U - s);
+      if (opens & bit) {
+        ++depth;
+      } else if (closes & bit) {
+        --depth;
+      } else if (depth == 1) {
+        return i + scan_first_bit(s) + 1U;
+      }
+    }
+  }
+
+  return 0U;
+}
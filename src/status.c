@@ -3,7 +3,7 @@
 
 #include "sajs/sajs.h"
 
-#define SAJS_NUM_STATUS 22U ///< The number of SajsStatus entries
+#define SAJS_NUM_STATUS 23U ///< The number of SajsStatus entries
 
 static char const* const sajs_status_strings[SAJS_NUM_STATUS] = {
   "Success",
@@ -28,6 +28,7 @@ static char const* const sajs_status_strings[SAJS_NUM_STATUS] = {
   "Expected low surrogate escape",
   "Expected valid UTF-8 byte",
   "Expected value",
+  "Failed read",
 };
 
 char const*
@@ -0,0 +1,489 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#include "sajs/sajs.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Recording and replaying events with a binary tape.
+
+  A tape is an 8-byte header followed by a record for each event.  All
+  integers are little-endian, and nothing is aligned, so a tape can be mapped
+  into memory and read anywhere.  Each record starts with 4 bytes:
+
+  - The event type in the low 4 bits, and the value kind in the high 4 bits.
+  - The event flags, except #SAJS_IS_CONTINUED, which depends on how the
+    input was split up when it was recorded.
+  - The contents of the rest of the record (TAPE_SKIP, TAPE_NUMBER, and
+    TAPE_RUN), which follow in that order.
+  - The number flags if the record has a number, otherwise the single byte of
+    the event if it has one and no run.
+
+  The start of a container has the 8-byte offset of the record after its end,
+  so it can be skipped without reading it.  While the container is open, this
+  field links to the start of its parent instead, so the writer only needs to
+  remember the innermost open container.
+
+  The end of a number has its value: the 8-byte magnitude if it's an integer,
+  then the 8 bytes of the double unless it's simply the magnitude.
+
+  The bytes of a bytes event are a run with a 4-byte length.  Since this is
+  last, the bytes of any following bytes events are simply appended to it, so
+  the contents of a string are usually a single record no matter how they
+  were read.  The start or end of a value has at most one byte, which is
+  stored in the record header.
+*/
+
+#define HEADER_SIZE 8U ///< Size of tape header
+#define RECORD_SIZE 4U ///< Size of record header
+
+static uint8_t const header[HEADER_SIZE] = {
+  'S', 'A', 'J', 'S', 'T', 'P', 1U, 0U};
+
+/// Contents of a record after the header
+typedef enum {
+  TAPE_SKIP   = 1U << 0U, ///< Offset of the end of a container
+  TAPE_NUMBER = 1U << 1U, ///< Value of a number
+  TAPE_RUN    = 1U << 2U, ///< Length and bytes of a string
+} TapeContent;
+
+/// Tape writer state
+struct SajsTapeWriterImpl {
+  size_t        open; ///< Offset of innermost open container, or zero
+  size_t        run;  ///< Offset of the length of the last run, or zero
+  SajsValueKind kind; ///< Kind of the last scalar value started
+};
+
+/// Tape reader state
+struct SajsTapeReaderImpl {
+  uint8_t const* tape;   ///< Tape being read
+  size_t         length; ///< Length of tape
+  size_t         offset; ///< Offset of the next record
+  size_t         skip;   ///< Offset after the last container started
+  SajsStringView string; ///< Bytes of the last event
+  SajsNumber     number; ///< Value of the last number ended
+  SajsEvent      event;  ///< Last event read
+};
+
+/// Return true if a number's double isn't simply its magnitude
+static bool
+has_real(SajsNumberFlags const flags)
+{
+  return !(flags & SAJS_NUMBER_INTEGER) || (flags & SAJS_NUMBER_OVERFLOW);
+}
+
+/// Return the size of the value of a number on a tape
+static size_t
+number_size(SajsNumberFlags const flags)
+{
+  return ((flags & SAJS_NUMBER_INTEGER) ? 8U : 0U) +
+         (has_real(flags) ? 8U : 0U);
+}
+
+/// A double and its bits
+typedef union {
+  double   real;
+  uint64_t bits;
+} DoubleBits;
+
+/*
+ * Integers
+ */
+
+static void
+put_u32(uint8_t* const dst, uint32_t const value)
+{
+  for (unsigned i = 0U; i < 4U; ++i) {
+    dst[i] = (uint8_t)(value >> (8U * i));
+  }
+}
+
+static void
+put_u64(uint8_t* const dst, uint64_t const value)
+{
+  for (unsigned i = 0U; i < 8U; ++i) {
+    dst[i] = (uint8_t)(value >> (8U * i));
+  }
+}
+
+static uint32_t
+get_u32(uint8_t const* const src)
+{
+  uint32_t value = 0U;
+  for (unsigned i = 0U; i < 4U; ++i) {
+    value |= (uint32_t)src[i] << (8U * i);
+  }
+
+  return value;
+}
+
+static uint64_t
+get_u64(uint8_t const* const src)
+{
+  uint64_t value = 0U;
+  for (unsigned i = 0U; i < 8U; ++i) {
+    value |= (uint64_t)src[i] << (8U * i);
+  }
+
+  return value;
+}
+
+/*
+ * Writing
+ */
+
+SajsTapeWriter*
+sajs_tape_writer_init(size_t const mem_size, void* const mem)
+{
+  if (mem_size < sizeof(SajsTapeWriter)) {
+    return NULL;
+  }
+
+  SajsTapeWriter* const writer = (SajsTapeWriter*)mem;
+  writer->open                 = 0U;
+  writer->run                  = 0U;
+  writer->kind                 = (SajsValueKind)0;
+  return writer;
+}
+
+/// Append bytes to the last run in a tape
+static SajsStatus
+extend_run(SajsTapeWriter* const writer,
+           SajsStringView const  string,
+           size_t const          size,
+           uint8_t* const        tape,
+           size_t* const         length)
+{
+  uint32_t const run_length = get_u32(tape + writer->run);
+  if (string.length > size - *length) {
+    return SAJS_OVERFLOW;
+  }
+
+  for (size_t i = 0U; i < string.length; ++i) {
+    tape[*length + i] = (uint8_t)string.data[i];
+  }
+
+  put_u32(tape + writer->run, run_length + (uint32_t)string.length);
+  *length += string.length;
+  return SAJS_SUCCESS;
+}
+
+/// Set the skip offset of the innermost open container, and close it
+static void
+close_container(SajsTapeWriter* const writer,
+                uint8_t* const        tape,
+                size_t const          end)
+{
+  if (writer->open) {
+    uint8_t* const field = tape + writer->open + RECORD_SIZE;
+
+    writer->open = (size_t)get_u64(field);
+    put_u64(field, end);
+  }
+}
+
+SajsStatus
+sajs_tape_write(SajsTapeWriter* const  writer,
+                SajsLexer const* const lexer,
+                SajsEvent const        event,
+                size_t const           size,
+                void* const            tape,
+                size_t* const          length)
+{
+  uint8_t* const out = (uint8_t*)tape;
+
+  // Start a new tape with a header
+  if (!*length) {
+    if (size < HEADER_SIZE) {
+      return SAJS_OVERFLOW;
+    }
+
+    for (unsigned i = 0U; i < HEADER_SIZE; ++i) {
+      out[i] = header[i];
+    }
+
+    writer->open = 0U;
+    writer->run  = 0U;
+    *length      = HEADER_SIZE;
+  }
+
+  if (event.status || !event.type) {
+    return SAJS_SUCCESS;
+  }
+
+  SajsStringView string = {"", 0U};
+  if (event.flags & SAJS_HAS_BYTES) {
+    string = sajs_string(lexer);
+  }
+
+  // Append bytes to the last run if possible
+  if (event.type == SAJS_EVENT_BYTES && writer->run &&
+      string.length <= UINT32_MAX - get_u32(out + writer->run)) {
+    return extend_run(writer, string, size, out, length);
+  }
+
+  bool const is_start     = event.type == SAJS_EVENT_START;
+  bool const is_container = event.kind == SAJS_OBJECT ||
+                            event.kind == SAJS_ARRAY;
+  bool const is_end =
+    event.type == SAJS_EVENT_END || event.type == SAJS_EVENT_DOUBLE_END;
+
+  if (is_start && !is_container) {
+    writer->kind = event.kind;
+  }
+
+  // Determine the contents of the record
+  bool const has_skip = is_start && is_container;
+  bool const has_number =
+    writer->kind == SAJS_NUMBER &&
+    ((event.type == SAJS_EVENT_END && event.kind == SAJS_NUMBER) ||
+     event.type == SAJS_EVENT_DOUBLE_END);
+
+  bool const has_bytes = event.flags & SAJS_HAS_BYTES;
+  bool const has_run   = has_bytes && (event.type == SAJS_EVENT_BYTES ||
+                                     string.length != 1U || has_number);
+
+  SajsNumber number = {0.0, 0U, 0U};
+  if (has_number) {
+    number = sajs_number(lexer);
+  }
+
+  if (string.length > UINT32_MAX) {
+    return SAJS_OVERFLOW;
+  }
+
+  size_t const record_size =
+    RECORD_SIZE + (has_skip ? 8U : 0U) +
+    (has_number ? number_size(number.flags) : 0U) +
+    (has_run ? 4U + string.length : 0U);
+
+  if (record_size > size - *length) {
+    return SAJS_OVERFLOW;
+  }
+
+  // Write the record header
+  uint8_t* const record = out + *length;
+  size_t         offset = RECORD_SIZE;
+
+  record[0] = (uint8_t)((unsigned)event.type | ((unsigned)event.kind << 4U));
+  record[1] = (uint8_t)(event.flags & ~(SajsFlags)SAJS_IS_CONTINUED);
+  record[2] = (uint8_t)((has_skip ? TAPE_SKIP : 0U) |
+                        (has_number ? TAPE_NUMBER : 0U) |
+                        (has_run ? TAPE_RUN : 0U));
+  record[3] = (has_bytes && !has_run) ? (uint8_t)string.data[0]
+                                      : (uint8_t)number.flags;
+
+  // Write the contents
+  if (has_skip) {
+    put_u64(record + offset, writer->open);
+    writer->open = *length;
+    offset += 8U;
+  }
+
+  if (has_number) {
+    DoubleBits const real = {number.real};
+    if (number.flags & SAJS_NUMBER_INTEGER) {
+      put_u64(record + offset, number.magnitude);
+      offset += 8U;
+    }
+
+    if (has_real(number.flags)) {
+      put_u64(record + offset, real.bits);
+      offset += 8U;
+    }
+  }
+
+  writer->run = 0U;
+  if (has_run) {
+    put_u32(record + offset, (uint32_t)string.length);
+    for (size_t i = 0U; i < string.length; ++i) {
+      record[offset + 4U + i] = (uint8_t)string.data[i];
+    }
+
+    writer->run = (event.type == SAJS_EVENT_BYTES) ? (*length + offset) : 0U;
+  }
+
+  *length += record_size;
+
+  // Close the container ended by this event
+  if ((is_end && is_container) || event.type == SAJS_EVENT_DOUBLE_END) {
+    close_container(writer, out, *length);
+  }
+
+  if (is_end) {
+    writer->kind = (SajsValueKind)0;
+  }
+
+  return SAJS_SUCCESS;
+}
+
+/*
+ * Reading
+ */
+
+/// Return an event with an error status
+static SajsEvent
+tape_error(SajsStatus const status)
+{
+  SajsEvent const event = {status, SAJS_EVENT_NOTHING, (SajsValueKind)0, 0U};
+  return event;
+}
+
+SajsTapeReader*
+sajs_tape_reader_init(size_t const      mem_size,
+                      void* const       mem,
+                      size_t const      length,
+                      void const* const tape)
+{
+  uint8_t const* const data = (uint8_t const*)tape;
+  if (mem_size < sizeof(SajsTapeReader) || length < HEADER_SIZE) {
+    return NULL;
+  }
+
+  for (unsigned i = 0U; i < HEADER_SIZE; ++i) {
+    if (data[i] != header[i]) {
+      return NULL;
+    }
+  }
+
+  SajsTapeReader* const reader = (SajsTapeReader*)mem;
+  SajsNumber const      zero   = {0.0, 0U, 0U};
+  SajsStringView const  empty  = {"", 0U};
+
+  reader->tape   = data;
+  reader->length = length;
+  reader->offset = HEADER_SIZE;
+  reader->skip   = 0U;
+  reader->string = empty;
+  reader->number = zero;
+  reader->event  = tape_error(SAJS_SUCCESS);
+  return reader;
+}
+
+SajsEvent
+sajs_tape_read(SajsTapeReader* const reader)
+{
+  size_t const space = reader->length - reader->offset;
+  if (!space) {
+    return tape_error(SAJS_FAILURE);
+  }
+
+  if (space < RECORD_SIZE) {
+    return tape_error(SAJS_NO_DATA);
+  }
+
+  uint8_t const* const record  = reader->tape + reader->offset;
+  unsigned const       type    = record[0] & 0x0FU;
+  unsigned const       kind    = (unsigned)record[0] >> 4U;
+  unsigned const       flags   = record[1];
+  unsigned const       content = record[2];
+  bool const           is_byte =
+    (flags & SAJS_HAS_BYTES) && !(content & TAPE_RUN);
+
+  if (!type || type > SAJS_EVENT_BYTES || kind > SAJS_LITERAL ||
+      content > (TAPE_SKIP | TAPE_NUMBER | TAPE_RUN) ||
+      (is_byte && (content & TAPE_NUMBER))) {
+    return tape_error(SAJS_EXPECTED_VALUE);
+  }
+
+  // Check that the record is complete
+  size_t const fixed_size = RECORD_SIZE + ((content & TAPE_SKIP) ? 8U : 0U) +
+                            ((content & TAPE_NUMBER) ? number_size(record[3])
+                                                     : 0U) +
+                            ((content & TAPE_RUN) ? 4U : 0U);
+
+  if (fixed_size > space) {
+    return tape_error(SAJS_NO_DATA);
+  }
+
+  size_t const run_length =
+    (content & TAPE_RUN) ? get_u32(record + fixed_size - 4U) : 0U;
+
+  if (run_length > space - fixed_size) {
+    return tape_error(SAJS_NO_DATA);
+  }
+
+  // Read the contents
+  size_t offset = RECORD_SIZE;
+  if (content & TAPE_SKIP) {
+    uint64_t const skip = get_u64(record + offset);
+    if (skip <= reader->offset || skip > reader->length) {
+      return tape_error(SAJS_NO_DATA);
+    }
+
+    reader->skip = (size_t)skip;
+    offset += 8U;
+  }
+
+  if (content & TAPE_NUMBER) {
+    SajsNumber* const number = &reader->number;
+
+    number->flags     = record[3];
+    number->magnitude = 0U;
+    if (number->flags & SAJS_NUMBER_INTEGER) {
+      number->magnitude = get_u64(record + offset);
+      offset += 8U;
+    }
+
+    if (has_real(number->flags)) {
+      DoubleBits real = {0.0};
+      real.bits       = get_u64(record + offset);
+      number->real    = real.real;
+    } else {
+      number->real = (number->flags & SAJS_NUMBER_NEGATIVE)
+                       ? -(double)number->magnitude
+                       : (double)number->magnitude;
+    }
+  }
+
+  reader->string.data   = (char const*)record + (is_byte ? 3U : fixed_size);
+  reader->string.length = is_byte ? 1U : run_length;
+  reader->offset += fixed_size + run_length;
+
+  SajsEvent const event = {
+    SAJS_SUCCESS, (SajsEventType)type, (SajsValueKind)kind, record[1]};
+
+  return (reader->event = event);
+}
+
+SajsStringView
+sajs_tape_string(SajsTapeReader const* const reader)
+{
+  return reader->string;
+}
+
+SajsNumber
+sajs_tape_number(SajsTapeReader const* const reader)
+{
+  return reader->number;
+}
+
+SajsStatus
+sajs_tape_skip(SajsTapeReader* const reader)
+{
+  SajsEvent const start = reader->event;
+  if (start.type != SAJS_EVENT_START) {
+    return SAJS_FAILURE;
+  }
+
+  if (start.kind == SAJS_OBJECT || start.kind == SAJS_ARRAY) {
+    reader->offset     = reader->skip;
+    reader->event.type = SAJS_EVENT_END;
+    return SAJS_SUCCESS;
+  }
+
+  // Read the rest of a scalar up to its end
+  for (;;) {
+    SajsEvent const e = sajs_tape_read(reader);
+    if (e.status) {
+      return (e.status == SAJS_FAILURE) ? SAJS_NO_DATA : e.status;
+    }
+
+    if (e.type == SAJS_EVENT_END || e.type == SAJS_EVENT_DOUBLE_END) {
+      return SAJS_SUCCESS;
+    }
+  }
+}
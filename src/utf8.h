@@ -0,0 +1,287 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#ifndef SAJS_SRC_UTF8_H
+#define SAJS_SRC_UTF8_H
+
+#include "scan.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  UTF-8 encoding and validation.
+
+  Code points are encoded for escapes, which are always valid, since lone
+  surrogates are rejected before getting here.  Characters given directly
+  are checked one byte at a time by a small state machine, which is used by
+  the lexer for single bytes, and to finish any character that a span
+  doesn't.  Spans are checked many bytes at a time, with the range
+  lookup algorithm of Keiser and Lemire if AVX2 is available, or by skipping
+  ASCII a block at a time otherwise.
+*/
+
+/// Return the code point encoded by a pair of UTF-16 surrogates
+static inline uint32_t
+utf16_surrogates_codepoint(uint16_t const high, uint16_t const low)
+{
+  return ((high - 0xD800U) * 0x400U) + (low - 0xDC00U) + 0x10000U;
+}
+
+/// Return the length of the UTF-8 encoding of a code point, or zero
+static inline uint8_t
+utf8_num_bytes_for_codepoint(uint32_t const code)
+{
+  return (code < 0x00000080U)   ? 1U
+         : (code < 0x00000800U) ? 2U
+         : (code < 0x00010000U) ? 3U
+         : (code < 0x00110000U) ? 4U
+                                : 0U;
+}
+
+/// Write the UTF-8 encoding of a code point and return its length, or zero
+static inline uint8_t
+utf8_from_codepoint(uint8_t out[4], uint32_t const code)
+{
+  static uint32_t const masks[4] = {0x0U, 0xC0U, 0x800U, 0x10000U};
+
+  uint8_t const size = utf8_num_bytes_for_codepoint(code);
+  if (size) {
+    uint32_t c = code;
+    for (uint8_t s = size; --s;) {
+      out[s] = (uint8_t)(0x80U | (c & 0x3FU));
+      c >>= 6U;
+      c |= masks[s];
+    }
+
+    out[0] = (uint8_t)c;
+  }
+
+  return size;
+}
+
+#define UTF8_ACCEPT 0U ///< Decoder state between characters
+#define UTF8_REJECT 1U ///< Decoder state after an invalid byte
+
+/**
+   Return the next state of a UTF-8 decoder after a byte.
+
+   In a character, the state is the number of continuation bytes left,
+   shifted up by 16 bits, and the range of the next byte, as the low byte
+   shifted up by 8 bits and the high byte.  So, it's never zero or one, and
+   the ranges exclude overlong encodings, surrogates, and code points past
+   U+10FFFF exactly as the Unicode standard does.
+*/
+static inline uint32_t
+utf8_next(uint32_t const state, uint8_t const c)
+{
+  if (state) {
+    if (c < ((state >> 8U) & 0xFFU) || c > (state & 0xFFU)) {
+      return UTF8_REJECT;
+    }
+
+    uint32_t const left = (state >> 16U) - 1U;
+    return left ? ((left << 16U) | 0x80BFU) : UTF8_ACCEPT;
+  }
+
+  return (c < 0x80U)    ? UTF8_ACCEPT
+         : (c < 0xC2U)  ? UTF8_REJECT
+         : (c < 0xE0U)  ? 0x180BFU
+         : (c == 0xE0U) ? 0x2A0BFU
+         : (c == 0xEDU) ? 0x2809FU
+         : (c < 0xF0U)  ? 0x280BFU
+         : (c == 0xF0U) ? 0x390BFU
+         : (c < 0xF4U)  ? 0x380BFU
+         : (c == 0xF4U) ? 0x3808FU
+                        : UTF8_REJECT;
+}
+
+#if defined(SAJS_SCAN_AVX2)
+
+/*
+  Bits for errors found by looking up the high and low nibbles of a byte, and
+  the high nibble of the next.  A pair of bytes is invalid if all three
+  lookups share a bit.  Two continuations in a row are "errors" here, which
+  are fine if they're after a three or four byte lead, checked separately.
+*/
+
+#  define UTF8_TOO_SHORT (1U << 0U)      ///< Lead not followed by continuation
+#  define UTF8_TOO_LONG (1U << 1U)       ///< ASCII followed by continuation
+#  define UTF8_OVERLONG_3 (1U << 2U)     ///< Overlong 3-byte sequence
+#  define UTF8_TOO_LARGE (1U << 3U)      ///< Code point past U+10FFFF
+#  define UTF8_SURROGATE (1U << 4U)      ///< Encoded UTF-16 surrogate
+#  define UTF8_OVERLONG_2 (1U << 5U)     ///< Overlong 2-byte sequence
+#  define UTF8_TOO_LARGE_1000 (1U << 6U) ///< Code point past U+10FFFF
+#  define UTF8_OVERLONG_4 (1U << 6U)     ///< Overlong 4-byte sequence
+#  define UTF8_TWO_CONTS (1U << 7U)      ///< Two continuations in a row
+
+#  define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+/// Look up the value for the low nibble of each byte in a 16-byte table
+static inline __m256i
+utf8_lookup(uint8_t const table[16], __m256i const nibbles)
+{
+  __m128i const t = _mm_loadu_si128((__m128i const*)(void const*)table);
+  return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(t), nibbles);
+}
+
+/// Return a non-zero vector if a block of 32 bytes has any invalid UTF-8
+static inline __m256i
+utf8_block_errors(__m256i const input, __m256i const prev_input)
+{
+  static uint8_t const byte_1_high[16] = {
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TOO_LONG,
+    UTF8_TWO_CONTS,
+    UTF8_TWO_CONTS,
+    UTF8_TWO_CONTS,
+    UTF8_TWO_CONTS,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+  };
+
+  static uint8_t const byte_1_low[16] = {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+  };
+
+  static uint8_t const byte_2_high[16] = {
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+      UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+      UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE |
+      UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE |
+      UTF8_TOO_LARGE,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT,
+  };
+
+  // Shift the input along by 1, 2, and 3 bytes, to line up with the previous
+  __m256i const prev  = _mm256_permute2x128_si256(prev_input, input, 0x21);
+  __m256i const prev1 = _mm256_alignr_epi8(input, prev, 15);
+  __m256i const prev2 = _mm256_alignr_epi8(input, prev, 14);
+  __m256i const prev3 = _mm256_alignr_epi8(input, prev, 13);
+
+  // Look up the errors for each pair of bytes
+  __m256i const low  = _mm256_set1_epi8(0x0F);
+  __m256i const hi1  = _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low);
+  __m256i const lo1  = _mm256_and_si256(prev1, low);
+  __m256i const hi2  = _mm256_and_si256(_mm256_srli_epi16(input, 4), low);
+  __m256i const pair = _mm256_and_si256(
+    _mm256_and_si256(utf8_lookup(byte_1_high, hi1),
+                     utf8_lookup(byte_1_low, lo1)),
+    utf8_lookup(byte_2_high, hi2));
+
+  // Two continuations must be exactly where a three or four byte lead needs
+  __m256i const third  = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0x60));
+  __m256i const fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0x70));
+  __m256i const must23 = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                          _mm256_set1_epi8((char)0x80));
+
+  return _mm256_xor_si256(must23, pair);
+}
+
+#endif
+
+/**
+   Return the end of the valid UTF-8 at the start of a range.
+
+   The returned pointer is just after the last complete and valid character,
+   so it's `end` if the whole range is valid, and otherwise the start of a
+   character that is invalid, or that continues past the end.  The range must
+   start at the start of a character.
+*/
+static inline uint8_t const*
+scan_utf8(uint8_t const* const start, uint8_t const* const end)
+{
+  uint8_t const* p = start;
+
+#if defined(SAJS_SCAN_AVX2)
+  __m256i prev = _mm256_setzero_si256();
+  for (; end - p >= 32; p += 32) {
+    __m256i const v = _mm256_loadu_si256((__m256i const*)(void const*)p);
+    __m256i const e = utf8_block_errors(v, prev);
+    if (!_mm256_testz_si256(e, e)) {
+      break;
+    }
+
+    prev = v;
+  }
+
+  // Back up to the start of any character that isn't all in checked blocks
+  uint8_t const* const checked = p;
+  while (p > start && checked - p < 3 && (p[-1] & 0xC0U) == 0x80U) {
+    --p;
+  }
+
+  if (p > start && p[-1] >= 0xC0U) {
+    --p;
+  }
+#endif
+
+  while (p < end) {
+#if defined(SAJS_SCAN_SSE2)
+    if (end - p >= 16 &&
+        !_mm_movemask_epi8(_mm_loadu_si128((__m128i const*)(void const*)p))) {
+      p += 16;
+      continue;
+    }
+#endif
+
+    if (end - p >= 8 && !(scan_load_word(p) & SAJS_SCAN_HIGHS)) {
+      p += 8;
+      continue;
+    }
+
+    // Check a single character
+    uint8_t const* q     = p;
+    uint32_t       state = utf8_next(UTF8_ACCEPT, *q++);
+    while (state > UTF8_REJECT && q < end) {
+      state = utf8_next(state, *q++);
+    }
+
+    if (state) {
+      break; // Invalid, or continues past the end
+    }
+
+    p = q;
+  }
+
+  return p;
+}
+
+#endif // SAJS_SRC_UTF8_H
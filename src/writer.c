@@ -1,6 +1,9 @@
 // Copyright 2017-2023 David Robillard <d@drobilla.net>
 // SPDX-License-Identifier: ISC
 
+#include "scan.h"
+#include "utf8.h"
+
 #include "sajs/sajs.h"
 
 #include <stdbool.h>
@@ -14,8 +17,76 @@ struct SajsWriterImpl {
   SajsValueKind top_kind;     ///< Current value kind
   SajsFlags     top_flags;    ///< Current string/number/literal flags
   SajsByte      top_bytes[8]; ///< Last written character bytes
+  uint32_t      copy_code;    ///< Escape code point or literal bytes left
+  size_t        text_length;  ///< Length of bytes in pending text
+  size_t        text_offset;  ///< Offset of next byte in pending text
+  unsigned      text_depth;   ///< Indentation depth of pending text
+  uint8_t       text_prefix;  ///< Prefix of pending text
+  uint8_t       text_flags;   ///< Pending text flags (SajsTextFlag)
+  uint8_t       text_escape;  ///< Bytes written of the current escape
+  uint8_t       copy_state;   ///< State of text being copied (SajsCopyState)
+  uint8_t       copy_prefix;  ///< Prefix of next value in copied text
+#ifdef SAJS_STATS
+  SajsWriterStats* stats; ///< Statistics to update, or null
+#endif
 };
 
+/// Flags describing the pending text of a batch write
+typedef enum {
+  TEXT_PENDING = 1U << 0U, ///< Text is partially written
+  TEXT_LOCAL   = 1U << 1U, ///< Text bytes are in top_bytes
+  TEXT_NEWLINE = 1U << 2U, ///< Text ends with a newline
+  TEXT_ESCAPE  = 1U << 3U, ///< Text bytes are a string span to escape
+} SajsTextFlag;
+
+/// Where #sajs_write_text is in the text it's copying
+typedef enum {
+  COPY_SPACE,  ///< Between tokens
+  COPY_STRING, ///< In a string
+  COPY_ESCAPE, ///< In a string escape, after the backslash
+  COPY_SCALAR, ///< In a number or literal
+} SajsCopyState;
+
+// Count an event given to the writer, if statistics are enabled
+static inline void
+count_write(SajsWriter* const writer, SajsEventType const type)
+{
+#ifdef SAJS_STATS
+  if (writer->stats) {
+    ++writer->stats->events[type];
+  }
+#else
+  (void)writer;
+  (void)type;
+#endif
+}
+
+// Count a string byte written as an escape, if statistics are enabled
+static inline void
+count_escape(SajsWriter* const writer)
+{
+#ifdef SAJS_STATS
+  if (writer->stats) {
+    ++writer->stats->escapes;
+  }
+#else
+  (void)writer;
+#endif
+}
+
+// Count the current depth after a start, if statistics are enabled
+static inline void
+count_write_depth(SajsWriter* const writer)
+{
+#ifdef SAJS_STATS
+  if (writer->stats && writer->depth > writer->stats->max_depth) {
+    writer->stats->max_depth = writer->depth;
+  }
+#else
+  (void)writer;
+#endif
+}
+
 static SajsTextOutput
 make_output(SajsStatus const      status,
             SajsTextPrefix        prefix,
@@ -55,17 +126,6 @@ emit_sep(SajsWriter* const    writer,
   return make_output(SAJS_SUCCESS, prefix, depth, 1U, writer->top_bytes);
 }
 
-// Write two adjacent bytes to the output
-static SajsTextOutput
-emit_pair(SajsWriter* const writer, SajsByte const a, SajsByte const b)
-{
-  writer->top_bytes[0U] = a;
-  writer->top_bytes[1U] = b;
-  writer->top_bytes[2U] = '\0';
-
-  return make_output(SAJS_SUCCESS, SAJS_PREFIX_NONE, 0U, 2U, writer->top_bytes);
-}
-
 // Called when a value is started
 static SajsTextOutput
 on_start(SajsWriter* const   writer,
@@ -100,47 +160,80 @@ on_start(SajsWriter* const   writer,
   return emit_sep(writer, prefix, writer->depth, head);
 }
 
-// Called on characters in a value
-static SajsTextOutput
-on_byte(SajsWriter* const writer, SajsByte const byte)
+/**
+   Write the escaped form of a string byte into `out` and return its length.
+
+   This is the byte itself, unless it's a quote, backslash, or control
+   character, which are written as a two-character or `\u00XX` escape.
+*/
+static size_t
+escape_byte(SajsByte const byte, SajsByte* const out)
 {
-  if (writer->top_kind != SAJS_STRING) {
-    // Write syntactic (non-string) character directly
-    return emit_byte(writer, byte);
-  }
+  static char const hex[] = "0123456789ABCDEF";
 
+  SajsByte short_escape = '\0';
   switch (byte) {
   case '\"':
   case '\\':
-    return emit_pair(writer, '\\', byte);
+    short_escape = byte;
+    break;
   case '\b':
-    return emit_pair(writer, '\\', 'b');
+    short_escape = 'b';
+    break;
   case '\f':
-    return emit_pair(writer, '\\', 'f');
+    short_escape = 'f';
+    break;
   case '\n':
-    return emit_pair(writer, '\\', 'n');
+    short_escape = 'n';
+    break;
   case '\r':
-    return emit_pair(writer, '\\', 'r');
+    short_escape = 'r';
+    break;
   case '\t':
-    return emit_pair(writer, '\\', 't');
+    short_escape = 't';
+    break;
   default:
     break;
   }
 
+  if (short_escape) {
+    out[0U] = '\\';
+    out[1U] = short_escape;
+    return 2U;
+  }
+
   if ((uint8_t)byte >= 0x20) {
-    return emit_byte(writer, byte); // Printable ASCII or UTF-8
+    out[0U] = byte; // Printable ASCII or UTF-8
+    return 1U;
   }
 
   // Generic control character escape
-  writer->top_bytes[0U] = '\\';
-  writer->top_bytes[1U] = 'u';
-  writer->top_bytes[2U] = '0';
-  writer->top_bytes[3U] = '0';
-  writer->top_bytes[4U] = (SajsByte)('0' + (((uint8_t)byte & 0xF0U) >> 4U));
-  writer->top_bytes[5U] = (SajsByte)('0' + ((uint8_t)byte & 0x0FU));
-  writer->top_bytes[6U] = '\0';
+  out[0U] = '\\';
+  out[1U] = 'u';
+  out[2U] = '0';
+  out[3U] = '0';
+  out[4U] = hex[((uint8_t)byte & 0xF0U) >> 4U];
+  out[5U] = hex[(uint8_t)byte & 0x0FU];
+  return 6U;
+}
+
+// Called on characters in a value
+static SajsTextOutput
+on_byte(SajsWriter* const writer, SajsByte const byte)
+{
+  if (writer->top_kind != SAJS_STRING) {
+    // Write syntactic (non-string) character directly
+    return emit_byte(writer, byte);
+  }
+
+  size_t const length       = escape_byte(byte, writer->top_bytes);
+  writer->top_bytes[length] = '\0';
+  if (length > 1U) {
+    count_escape(writer);
+  }
+
   return make_output(
-    SAJS_SUCCESS, SAJS_PREFIX_NONE, writer->depth, 6U, writer->top_bytes);
+    SAJS_SUCCESS, SAJS_PREFIX_NONE, writer->depth, length, writer->top_bytes);
 }
 
 // Called when a value is finished
@@ -172,23 +265,59 @@ sajs_writer_init(size_t const mem_size, void* const mem)
   }
 
   SajsWriter* const writer = (SajsWriter*)mem;
-  writer->top_kind         = (SajsValueKind)0U;
-  writer->top_flags        = 0U;
-  writer->top_bytes[0]     = 0U;
+#ifdef SAJS_STATS
+  writer->stats = NULL;
+#endif
+  sajs_writer_reset(writer);
   return writer;
 }
 
+void
+sajs_writer_reset(SajsWriter* const writer)
+{
+  writer->depth        = 0U;
+  writer->top_kind     = (SajsValueKind)0U;
+  writer->top_flags    = 0U;
+  writer->top_bytes[0] = 0U;
+  writer->text_length  = 0U;
+  writer->text_offset  = 0U;
+  writer->text_depth   = 0U;
+  writer->text_prefix  = 0U;
+  writer->text_flags   = 0U;
+  writer->text_escape  = 0U;
+  writer->copy_code    = 0U;
+  writer->copy_state   = COPY_SPACE;
+  writer->copy_prefix  = SAJS_PREFIX_NONE;
+}
+
+SajsStatus
+sajs_writer_set_stats(SajsWriter* const writer, SajsWriterStats* const stats)
+{
+#ifdef SAJS_STATS
+  writer->stats = stats;
+  return SAJS_SUCCESS;
+#else
+  (void)writer;
+  return stats ? SAJS_FAILURE : SAJS_SUCCESS;
+#endif
+}
+
 SajsTextOutput
 sajs_write_event(SajsWriter* const    writer,
                  SajsEvent const      event,
                  SajsStringView const string)
 {
+  count_write(writer, event.type);
+
   if (event.type == SAJS_EVENT_START) {
-    return on_start(
+    SajsTextOutput const out = on_start(
       writer,
       event.kind,
       event.flags,
       (SajsByte)((event.flags & SAJS_HAS_BYTES) ? string.data[0] : 0));
+
+    count_write_depth(writer);
+    return out;
   }
 
   if (event.type == SAJS_EVENT_END) {
@@ -214,3 +343,495 @@ sajs_write_event(SajsWriter* const    writer,
 
   return emit_nothing();
 }
+
+/// Return the delimiter at the start of a prefix, or zero
+static SajsByte
+prefix_delimiter(SajsTextPrefix const prefix)
+{
+  return (prefix == SAJS_PREFIX_MEMBER_COLON) ? ':'
+         : (prefix == SAJS_PREFIX_MEMBER_COMMA ||
+            prefix == SAJS_PREFIX_ARRAY_COMMA)
+           ? ','
+           : '\0';
+}
+
+/// Return the length of the whitespace after any delimiter in a prefix
+static size_t
+prefix_space(SajsTextPrefix const prefix, unsigned const depth, bool terse)
+{
+  return (terse || prefix == SAJS_PREFIX_NONE) ? 0U
+         : (prefix == SAJS_PREFIX_MEMBER_COLON) ? 1U
+                                                : (1U + (2U * (size_t)depth));
+}
+
+/**
+   Render some of a string span into a buffer, escaping as necessary.
+
+   Runs of bytes that don't need escaping are found with a fast scan and
+   copied directly, so only the rare special bytes are escaped one at a time.
+   An escape may be split between buffers, in which case `text_escape` keeps
+   track of how much of it has been written.  The position in the text is
+   advanced past every source byte that has been completely written.
+*/
+static size_t
+render_escaped(SajsWriter* const     writer,
+               SajsByte const* const bytes,
+               size_t const          length,
+               size_t const          size,
+               SajsByte* const       buf,
+               size_t* const         pos)
+{
+  uint8_t const* const start = (uint8_t const*)bytes;
+  uint8_t const* const end   = start + length;
+  uint8_t const*       p     = start;
+  size_t               n     = 0U;
+
+  while (p < end && n < size) {
+    if (!writer->text_escape) {
+      // Copy the run of plain bytes up to the next escape
+      uint8_t const* const run_end =
+        scan_string(p, (size_t)(end - p) < size - n ? end : p + (size - n));
+
+      for (; p < run_end; ++p) {
+        buf[n++] = (SajsByte)*p;
+      }
+
+      if (p == end || n == size) {
+        break;
+      }
+    }
+
+    // Write as much of the escape as fits
+    SajsByte     escape[8U];
+    size_t const escape_length = escape_byte((SajsByte)*p, escape);
+    size_t       i             = writer->text_escape;
+    if (!i) {
+      count_escape(writer);
+    }
+
+    for (; i < escape_length && n < size; ++i) {
+      buf[n++] = escape[i];
+    }
+
+    if (i < escape_length) {
+      writer->text_escape = (uint8_t)i;
+    } else {
+      writer->text_escape = 0U;
+      ++p;
+    }
+  }
+
+  *pos += (size_t)(p - start);
+  return n;
+}
+
+/**
+   Render some of the pending text into a buffer.
+
+   The text is laid out as a delimiter, whitespace, the bytes, and a newline,
+   which may each be empty.  This writes as much of it as fits and returns
+   the number of bytes written, clearing #TEXT_PENDING if it's all done.
+*/
+static size_t
+render_text(SajsWriter* const     writer,
+            bool const            terse,
+            SajsByte const* const bytes,
+            size_t const          size,
+            SajsByte* const       buf)
+{
+  SajsTextPrefix const prefix      = (SajsTextPrefix)writer->text_prefix;
+  SajsByte const       delim       = prefix_delimiter(prefix);
+  size_t const         space_start = delim ? 1U : 0U;
+  size_t const         bytes_start =
+    space_start + prefix_space(prefix, writer->text_depth, terse);
+  size_t const bytes_end = bytes_start + writer->text_length;
+  size_t const text_end =
+    bytes_end + ((writer->text_flags & TEXT_NEWLINE) ? 1U : 0U);
+
+  size_t pos = writer->text_offset;
+  size_t n   = 0U;
+  while (pos < text_end && n < size) {
+    if (pos < space_start) {
+      buf[n++] = delim;
+      ++pos;
+    } else if (pos < bytes_start) {
+      bool const newline =
+        pos == space_start && prefix != SAJS_PREFIX_MEMBER_COLON;
+
+      buf[n++] = newline ? '\n' : ' ';
+      ++pos;
+    } else if (pos < bytes_end && (writer->text_flags & TEXT_ESCAPE)) {
+      n += render_escaped(writer, bytes + (pos - bytes_start), bytes_end - pos,
+                          size - n, buf + n, &pos);
+    } else if (pos < bytes_end) {
+      size_t const begin = pos - bytes_start;
+      size_t const count = (bytes_end - pos < size - n) ? (bytes_end - pos)
+                                                        : (size - n);
+      for (size_t i = 0U; i < count; ++i) {
+        buf[n + i] = bytes[begin + i];
+      }
+
+      n += count;
+      pos += count;
+    } else {
+      buf[n++] = '\n';
+      ++pos;
+    }
+  }
+
+  writer->text_offset = pos;
+  if (pos == text_end) {
+    writer->text_flags = 0U;
+  }
+
+  return n;
+}
+
+SajsStatus
+sajs_write_events(SajsWriter* const           writer,
+                  SajsWriteFlags const        flags,
+                  size_t const                num_events,
+                  SajsEvent const* const      events,
+                  SajsStringView const* const strings,
+                  size_t* const               num_written,
+                  size_t const                size,
+                  char* const                 buf,
+                  size_t* const               length)
+{
+  bool const terse = flags & SAJS_WRITE_TERSE;
+  size_t     e     = 0U;
+  size_t     n     = 0U;
+
+  for (; e < num_events; ++e) {
+    if (!(writer->text_flags & TEXT_PENDING)) {
+      // Start the text for the next event
+      SajsEvent const      event = events[e];
+      SajsTextOutput const out   = sajs_write_event(writer, event, strings[e]);
+      bool const           is_root_end =
+        (event.type == SAJS_EVENT_END || event.type == SAJS_EVENT_DOUBLE_END) &&
+        (event.flags & SAJS_IS_ROOT);
+      bool const is_span =
+        event.type == SAJS_EVENT_BYTES && out.bytes != writer->top_bytes;
+
+      writer->text_length = out.length;
+      writer->text_offset = 0U;
+      writer->text_depth  = out.depth;
+      writer->text_prefix = (uint8_t)out.prefix;
+      writer->text_escape = 0U;
+      writer->text_flags  = (uint8_t)(
+        TEXT_PENDING | ((out.bytes == writer->top_bytes) ? TEXT_LOCAL : 0U) |
+        ((is_span && writer->top_kind == SAJS_STRING) ? TEXT_ESCAPE : 0U) |
+        ((is_root_end && (flags & SAJS_WRITE_NEWLINES)) ? TEXT_NEWLINE : 0U));
+    }
+
+    SajsByte const* const bytes =
+      (writer->text_flags & TEXT_LOCAL) ? writer->top_bytes : strings[e].data;
+
+    n += render_text(writer, terse, bytes, size - n, buf + n);
+    if (writer->text_flags & TEXT_PENDING) {
+      break; // Buffer is full
+    }
+  }
+
+  *num_written = e;
+  *length      = n;
+  return (e < num_events) ? SAJS_RETRY : SAJS_SUCCESS;
+}
+
+/*
+ * Text
+ */
+
+/// Start writing some bytes in top_bytes after a prefix as pending text
+static void
+start_copy(SajsWriter* const    writer,
+           SajsTextPrefix const prefix,
+           unsigned const       depth,
+           size_t const         length,
+           bool const           newline)
+{
+  writer->text_length = length;
+  writer->text_offset = 0U;
+  writer->text_depth  = depth;
+  writer->text_prefix = (uint8_t)prefix;
+  writer->text_flags  = (uint8_t)(TEXT_PENDING | TEXT_LOCAL |
+                                 (newline ? TEXT_NEWLINE : 0U));
+}
+
+/// Start writing a single punctuation byte after a prefix
+static void
+start_copy_byte(SajsWriter* const    writer,
+                SajsTextPrefix const prefix,
+                unsigned const       depth,
+                SajsByte const       byte,
+                bool const           newline)
+{
+  writer->top_bytes[0] = byte;
+  start_copy(writer, prefix, depth, 1U, newline);
+}
+
+/**
+   Render the pending text of a copy into a buffer.
+
+   This is usually a short prefix and a byte or two, so it's written directly
+   if it all fits, and otherwise by render_text() as much as fits.
+*/
+static size_t
+render_copy(SajsWriter* const writer,
+            bool const        terse,
+            size_t const      size,
+            SajsByte* const   buf)
+{
+  SajsTextPrefix const prefix  = (SajsTextPrefix)writer->text_prefix;
+  unsigned const       depth   = writer->text_depth;
+  SajsByte const       delim   = prefix_delimiter(prefix);
+  size_t const         space   = prefix_space(prefix, depth, terse);
+  bool const           newline = writer->text_flags & TEXT_NEWLINE;
+  size_t const         total   = (delim ? 1U : 0U) + space +
+                         writer->text_length + (newline ? 1U : 0U);
+
+  if (writer->text_offset || total > size) {
+    return render_text(writer, terse, writer->top_bytes, size, buf);
+  }
+
+  size_t n = 0U;
+  if (delim) {
+    buf[n++] = delim;
+  }
+
+  for (size_t i = 0U; i < space; ++i) {
+    buf[n++] = (i || prefix == SAJS_PREFIX_MEMBER_COLON) ? ' ' : '\n';
+  }
+
+  for (size_t i = 0U; i < writer->text_length; ++i) {
+    buf[n++] = writer->top_bytes[i];
+  }
+
+  if (newline) {
+    buf[n++] = '\n';
+  }
+
+  writer->text_flags = 0U;
+  return n;
+}
+
+/// Return the value of a hex digit, which is known to be valid
+static uint32_t
+hex_value(uint8_t const c)
+{
+  return (c <= '9') ? (c - (uint32_t)'0') : ((c | 0x20U) - (uint32_t)'a' + 10U);
+}
+
+/**
+   Copy a byte of a string escape, and return the length of any text for it.
+
+   Escapes are read like the lexer reads them, and the character is written
+   like the writer writes a character from an event, so the text is the same
+   as writing everything read from the input.  The position in an escape
+   after the backslash is kept in `text_escape`, which counts to the end of
+   "u1234\u5678" for a surrogate pair.
+*/
+static size_t
+copy_escape(SajsWriter* const writer, uint8_t const c)
+{
+  uint8_t const i = writer->text_escape++;
+  if (!i && c != 'u') {
+    SajsByte const byte = (c == 'b')   ? '\b'
+                          : (c == 'f') ? '\f'
+                          : (c == 'n') ? '\n'
+                          : (c == 'r') ? '\r'
+                          : (c == 't') ? '\t'
+                                       : (SajsByte)c;
+
+    writer->copy_code = (uint8_t)byte;
+  } else if (i == 5U || i == 6U || !i) {
+    return 0U; // The "u" of an escape, or the "\u" between surrogates
+  } else {
+    writer->copy_code = (writer->copy_code << 4U) | hex_value(c);
+
+    uint32_t const code = writer->copy_code;
+    if (i == 4U && code >= 0xD800U && code <= 0xDBFFU) {
+      return 0U; // High surrogate, continue to the low surrogate
+    }
+
+    if (i == 10U) {
+      writer->copy_code = utf16_surrogates_codepoint(
+        (uint16_t)(code >> 16U), (uint16_t)(code & 0xFFFFU));
+    } else if (i != 4U) {
+      return 0U; // Still reading hex digits
+    }
+  }
+
+  // Write the character like any other string byte
+  uint32_t const code = writer->copy_code;
+  writer->copy_code   = 0U;
+  writer->copy_state  = COPY_STRING;
+  writer->text_escape = 0U;
+  if (code >= 0x80U) {
+    return utf8_from_codepoint((uint8_t*)writer->top_bytes, code);
+  }
+
+  size_t const length = escape_byte((SajsByte)code, writer->top_bytes);
+  if (length > 1U) {
+    count_escape(writer);
+  }
+
+  return length;
+}
+
+/// Return true if `c` can be in a number
+static bool
+is_number_byte(uint8_t const c)
+{
+  return (c >= '0' && c <= '9') || c == 'E' || c == 'e' || c == '+' ||
+         c == '-' || c == '.';
+}
+
+/// Finish copying a number or literal
+static void
+end_scalar(SajsWriter* const writer, bool const newlines)
+{
+  writer->copy_state  = COPY_SPACE;
+  writer->copy_prefix = SAJS_PREFIX_NONE;
+  if (!writer->depth && newlines) {
+    start_copy(writer, SAJS_PREFIX_NONE, 0U, 0U, true);
+  }
+}
+
+/// Copy a byte of punctuation or the start of a value between tokens
+static void
+copy_token(SajsWriter* const writer, uint8_t const c, bool const newlines)
+{
+  SajsTextPrefix const prefix = (SajsTextPrefix)writer->copy_prefix;
+
+  writer->copy_prefix = SAJS_PREFIX_NONE;
+  switch (c) {
+  case '{':
+  case '[':
+    start_copy_byte(writer, prefix, writer->depth++, (SajsByte)c, false);
+    count_write_depth(writer);
+    writer->copy_prefix = (uint8_t)((c == '{') ? SAJS_PREFIX_OBJECT_START
+                                               : SAJS_PREFIX_ARRAY_START);
+    break;
+  case '}':
+  case ']':
+    --writer->depth;
+    start_copy_byte(writer,
+                    (c == '}') ? SAJS_PREFIX_OBJECT_END : SAJS_PREFIX_ARRAY_END,
+                    writer->depth,
+                    (SajsByte)c,
+                    !writer->depth && newlines);
+    break;
+  case ',':
+    // Members and elements are separated the same way
+    writer->copy_prefix = SAJS_PREFIX_ARRAY_COMMA;
+    break;
+  case ':':
+    writer->copy_prefix = SAJS_PREFIX_MEMBER_COLON;
+    break;
+  case '"':
+    start_copy_byte(writer, prefix, writer->depth, '"', false);
+    writer->copy_state = COPY_STRING;
+    break;
+  default:
+    start_copy_byte(writer, prefix, writer->depth, (SajsByte)c, false);
+    writer->copy_state = COPY_SCALAR;
+    writer->copy_code  = (c == 'f') ? 4U : (c == 'n' || c == 't') ? 3U : 0U;
+    break;
+  }
+}
+
+SajsStatus
+sajs_write_text(SajsWriter* const    writer,
+                SajsWriteFlags const flags,
+                size_t const         length,
+                char const* const    data,
+                size_t* const        count,
+                size_t const         size,
+                char* const          buf,
+                size_t* const        text_length)
+{
+  bool const           terse    = flags & SAJS_WRITE_TERSE;
+  bool const           newlines = flags & SAJS_WRITE_NEWLINES;
+  uint8_t const* const start    = (uint8_t const*)data;
+  uint8_t const* const end      = start + length;
+  uint8_t const*       p        = start;
+  size_t               n        = 0U;
+
+  for (;;) {
+    // Finish writing any pending punctuation and whitespace first
+    if (writer->text_flags & TEXT_PENDING) {
+      n += render_copy(writer, terse, size - n, buf + n);
+      if (writer->text_flags & TEXT_PENDING) {
+        break; // Buffer is full
+      }
+    }
+
+    if (p == end) {
+      if (!length && writer->copy_state == COPY_SCALAR) {
+        end_scalar(writer, newlines); // The end of input ends a root scalar
+        continue;
+      }
+
+      break;
+    }
+
+    if (n == size) {
+      break; // Buffer is full
+    }
+
+    uint8_t const* const limit =
+      ((size_t)(end - p) < size - n) ? end : (p + (size - n));
+
+    if (writer->copy_state == COPY_STRING) {
+      // Copy the run of plain bytes up to the next quote or escape
+      uint8_t const* const run_end = scan_string(p, limit);
+      for (; p < run_end; ++p) {
+        buf[n++] = (SajsByte)*p;
+      }
+
+      // The run ends at an escape or the closing quote, if it's in the limit
+      if (p < limit && *p++ == '\\') {
+        writer->copy_state = COPY_ESCAPE;
+      } else if (p > run_end) {
+        writer->copy_state = COPY_SPACE;
+        start_copy_byte(
+          writer, SAJS_PREFIX_NONE, 0U, '\"', !writer->depth && newlines);
+      }
+
+    } else if (writer->copy_state == COPY_ESCAPE) {
+      size_t const escape_length = copy_escape(writer, *p++);
+      if (escape_length) {
+        start_copy(writer, SAJS_PREFIX_NONE, 0U, escape_length, false);
+      }
+
+    } else if (writer->copy_state == COPY_SCALAR && writer->copy_code) {
+      // Copy the rest of the literal, which may be followed by another root
+      for (; p < limit && writer->copy_code; ++p, --writer->copy_code) {
+        buf[n++] = (SajsByte)*p;
+      }
+
+      if (!writer->copy_code) {
+        end_scalar(writer, newlines);
+      }
+
+    } else if (writer->copy_state == COPY_SCALAR) {
+      // Copy the rest of the number, which is usually short
+      for (; p < limit && is_number_byte(*p); ++p) {
+        buf[n++] = (SajsByte)*p;
+      }
+
+      if (p < end && !is_number_byte(*p)) {
+        end_scalar(writer, newlines);
+      }
+
+    } else if (*p > ' ' || (p = scan_space(p, end)) < end) {
+      copy_token(writer, *p++, newlines); // Tokens are often not spaced
+    }
+  }
+
+  *count       = (size_t)(p - start);
+  *text_length = n;
+  return ((writer->text_flags & TEXT_PENDING) || p < end) ? SAJS_RETRY
+                                                          : SAJS_SUCCESS;
+}
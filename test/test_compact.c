@@ -0,0 +1,141 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#ifndef SAJS_COMPACT_STACK
+#  define SAJS_COMPACT_STACK
+#endif
+
+#include "sajs_impl.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define DEPTH 1024U ///< Maximum depth of the lexer stack
+
+/// Memory for a lexer with room for exactly the maximum depth
+#define MEM_SIZE (sizeof(SajsLexer) + 4U + (DEPTH / 8U))
+
+static char doc[16U * DEPTH];
+static char out[16U * DEPTH];
+
+/// Make a terse document with a mix of containers nested `depth` levels deep
+static size_t
+make_doc(size_t const depth)
+{
+  static char const* const opens[]  = {"[", "{\"a\":", "[true,"};
+  static char const* const closes[] = {"]", "}", ",{\"b\":null}]"};
+
+  size_t length = 0U;
+  for (size_t i = 0U; i < depth; ++i) {
+    size_t const n = strlen(opens[i % 3U]);
+    memcpy(doc + length, opens[i % 3U], n);
+    length += n;
+  }
+
+  memcpy(doc + length, "-1.5", 4U);
+  length += 4U;
+
+  for (size_t i = depth; i > 0U; --i) {
+    size_t const n = strlen(closes[(i - 1U) % 3U]);
+    memcpy(doc + length, closes[(i - 1U) % 3U], n);
+    length += n;
+  }
+
+  doc[length] = '\0';
+  return length;
+}
+
+/// Return the status of reading a whole document a byte at a time
+static SajsStatus
+read_doc(SajsLexer* const lexer, size_t const length)
+{
+  SajsEvent e = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, SAJS_OBJECT, 0U};
+
+  sajs_lexer_reset(lexer);
+  for (size_t offset = 0U; !e.status && offset <= length;) {
+    size_t const n     = (offset < length) ? 1U : 0U;
+    size_t       count = 0U;
+
+    e = sajs_read_buffer(lexer, n, doc + offset, &count);
+    offset += count;
+  }
+
+  return e.status;
+}
+
+static void
+test_min_size(void)
+{
+  uintptr_t mem[(sizeof(SajsLexer) + 8U) / sizeof(uintptr_t)];
+
+  // The stack needs room for the window and at least one byte of bits
+  assert(!sajs_lexer_init(sizeof(SajsLexer) + 4U, mem));
+  assert(sajs_lexer_init(sizeof(SajsLexer) + 5U, mem));
+}
+
+static void
+test_round_trip(void)
+{
+  uintptr_t         mem[(MEM_SIZE + sizeof(uintptr_t)) / sizeof(uintptr_t)];
+  uintptr_t         writer_mem[8U];
+  SajsLexer* const  lexer  = sajs_lexer_init(MEM_SIZE, mem);
+  SajsWriter* const writer = sajs_writer_init(sizeof(writer_mem), writer_mem);
+  size_t const      length = make_doc(DEPTH - 2U);
+
+  // Every frame is restored correctly, so writing events gives the same text
+  size_t    offset = 0U;
+  size_t    n_out  = 0U;
+  SajsEvent e      = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, SAJS_OBJECT, 0U};
+  while (!e.status) {
+    size_t count = 0U;
+    e = sajs_read_spans(lexer, length - offset, doc + offset, &count);
+    offset += count;
+    if (!e.status) {
+      SajsStringView const string      = sajs_string(lexer);
+      size_t               num_written = 0U;
+      size_t               n           = 0U;
+
+      assert(!sajs_write_events(writer,
+                                SAJS_WRITE_TERSE,
+                                1U,
+                                &e,
+                                &string,
+                                &num_written,
+                                sizeof(out) - n_out,
+                                out + n_out,
+                                &n));
+      assert(num_written == 1U);
+      n_out += n;
+    }
+  }
+
+  assert(e.status == SAJS_FAILURE);
+  assert(offset == length);
+  assert(n_out == length);
+  assert(!memcmp(out, doc, length));
+}
+
+static void
+test_overflow(void)
+{
+  uintptr_t        mem[(MEM_SIZE + sizeof(uintptr_t)) / sizeof(uintptr_t)];
+  SajsLexer* const lexer = sajs_lexer_init(MEM_SIZE, mem);
+
+  // The memory has room for exactly the maximum depth, including the scalar
+  assert(read_doc(lexer, make_doc(DEPTH - 2U)) == SAJS_FAILURE);
+  assert(read_doc(lexer, make_doc(DEPTH - 1U)) == SAJS_OVERFLOW);
+  assert(read_doc(lexer, make_doc(DEPTH / 2U)) == SAJS_FAILURE);
+}
+
+int
+main(void)
+{
+  test_min_size();
+  test_round_trip();
+  test_overflow();
+  return 0;
+}
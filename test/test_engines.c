@@ -0,0 +1,1235 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#define _POSIX_C_SOURCE 200809L // NOLINT(bugprone-reserved-identifier)
+
+#include "sajs_impl.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+  Differential tests and benchmarks of every way of reading input.
+
+  The library has several engines for reading that must all agree: reading
+  a byte at a time, reading buffers with or without spans, validating,
+  lexing with handlers, reformatting text directly, and reading a document
+  in parts split like a parallel reader.  Each input is read by all of them,
+  in buffers of several sizes, and checked against reading a byte at a time:
+  every engine must stop with the same status at the same offset, and
+  produce the same events (up to how bytes are grouped into events), values,
+  or text.  Inputs are the files given on the command line, and random
+  documents, half of which are mutated to be invalid.
+
+  This includes its own copy of the library, so it can be built with
+  switches like SAJS_NO_SIMD and SAJS_TABLE_DISPATCH to check those engines
+  as well.  With -b, it instead reports the throughput of each engine over
+  the valid inputs.  If SAJS_FUZZ is defined, it's built as a libFuzzer
+  target that runs the same checks on every input instead of having a main.
+*/
+
+#define STACK_SIZE 4096U ///< Size of lexer stacks
+#define TEXT_SIZE 256U   ///< Size of text buffers, small to fill often
+#define NUM_CHUNKS 4U    ///< Number of chunks to split documents into
+#define MAX_EOFS 4U      ///< Maximum number of reads at the end of input
+#define GEN_DEPTH 6U     ///< Maximum depth of random documents
+
+/// Number of words of memory for a lexer
+#define LEXER_WORDS ((64U + STACK_SIZE) / sizeof(uintptr_t))
+
+static size_t const steps[] = {0U, 1U, 7U, 64U}; ///< Buffer sizes
+
+/// A growable byte string
+typedef struct {
+  char*  data;
+  size_t length;
+  size_t size;
+} Buffer;
+
+/// An input to read
+typedef struct {
+  char const* name;   ///< Name used in messages
+  char const* data;   ///< Input bytes
+  size_t      length; ///< Length of input in bytes
+} Input;
+
+/// How reading an input ended
+typedef struct {
+  SajsStatus status; ///< Error, or SAJS_FAILURE if the input ended cleanly
+  size_t     offset; ///< Offset in the input where reading stopped
+  size_t     roots;  ///< Number of top-level values ended, if counted
+} Outcome;
+
+/**
+   A record of what an engine read, in forms that every engine can produce.
+
+   Events are recorded with the bytes of every value in order, regardless of
+   which events they came with, so reading with spans or in smaller buffers
+   records the same thing as reading a byte at a time.  Values are recorded
+   as the sequence of calls to SajsHandlers, which can be derived from events
+   as well.  Like handler calls, strings are only recorded once some bytes or
+   the end is read, and literals once they end, so the partial values before
+   an error are the same.  Markers in both are prefixed with 0xFF, which
+   never appears in the bytes of a value, since they're valid UTF-8.
+*/
+typedef struct {
+  Buffer        events;    ///< Events, with the bytes of each value joined
+  Buffer        values;    ///< Values, as passed to SajsHandlers
+  Buffer        text;      ///< Text written by the engine
+  SajsValueKind leaf;      ///< Kind of the current string, number, or literal
+  char          tag;       ///< Tag of a string that isn't recorded yet
+  char          literal;   ///< First byte of the current literal
+  bool          in_string; ///< True if in a string passed to handlers
+} Trace;
+
+/// A trace with nothing recorded
+static Trace const no_trace = {{NULL, 0U, 0U},
+                               {NULL, 0U, 0U},
+                               {NULL, 0U, 0U},
+                               (SajsValueKind)0,
+                               '\0',
+                               '\0',
+                               false};
+
+/// What an engine records in a trace, to be checked against the reference
+typedef enum {
+  TRACE_EVENTS = 1U << 0U, ///< Records events
+  TRACE_VALUES = 1U << 1U, ///< Records values
+  TRACE_TERSE  = 1U << 2U, ///< Writes terse text
+  TRACE_PRETTY = 1U << 3U, ///< Writes indented text
+} TraceFlag;
+
+/// A function that reads an input in buffers of `step` bytes (or all of it)
+typedef Outcome (*EngineFunc)(Input const* input, size_t step, Trace* trace);
+
+/// A way of reading input, which must agree with reading a byte at a time
+typedef struct {
+  char const* name;       ///< Name used in messages and benchmark results
+  EngineFunc  func;       ///< Function that reads an input
+  unsigned    traced;     ///< Bitwise OR of TraceFlag values
+  bool        valid_only; ///< True if only valid input can be read
+} Engine;
+
+/// A pointer to a reading function like sajs_read_buffer()
+typedef SajsEvent (*ReadFunc)(SajsLexer*, size_t, char const*, size_t*);
+
+static void
+append(Buffer* const buffer, size_t const length, void const* const data)
+{
+  if (buffer->length + length > buffer->size) {
+    size_t const size  = (buffer->size + length) * 2U;
+    char* const  data2 = (char*)realloc(buffer->data, size);
+    if (!data2) {
+      (void)fprintf(stderr, "error: failed to allocate buffer\n");
+      exit(1);
+    }
+
+    buffer->data = data2;
+    buffer->size = size;
+  }
+
+  if (length) {
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+  }
+}
+
+static bool
+equals(Buffer const* const lhs, Buffer const* const rhs)
+{
+  return lhs->length == rhs->length &&
+         (!lhs->length || !memcmp(lhs->data, rhs->data, lhs->length));
+}
+
+/*
+  Tracing
+*/
+
+static void
+put_marker(Buffer* const  buffer,
+           char const     tag,
+           unsigned const kind,
+           unsigned const flags)
+{
+  char const marker[4] = {'\xFF', tag, (char)kind, (char)flags};
+
+  append(buffer, sizeof(marker), marker);
+}
+
+static void
+put_number(Buffer* const buffer, SajsNumber const number)
+{
+  put_marker(buffer, 'N', 0U, number.flags);
+  append(buffer, sizeof(number.real), &number.real);
+  append(buffer, sizeof(number.magnitude), &number.magnitude);
+}
+
+/// Record an event and its bytes, and the values it implies
+static void
+trace_event(Trace* const t, SajsLexer const* const lexer, SajsEvent const e)
+{
+  static unsigned const ignored = SAJS_HAS_BYTES | SAJS_IS_CONTINUED;
+
+  SajsStringView const string = sajs_string(lexer);
+  size_t const         length = (e.flags & SAJS_HAS_BYTES) ? string.length : 0U;
+  unsigned const       flags  = e.flags & ~ignored;
+
+  if (e.type == SAJS_EVENT_START) {
+    put_marker(&t->events, 'S', e.kind, flags);
+    if (e.kind == SAJS_OBJECT || e.kind == SAJS_ARRAY) {
+      put_marker(&t->values, 'S', e.kind, 0U);
+    } else {
+      t->leaf    = e.kind;
+      t->literal = '\0';
+      if (e.kind == SAJS_STRING) {
+        t->tag = (flags & SAJS_IS_MEMBER_NAME) ? 'n' : 's';
+      }
+    }
+  }
+
+  // Record the start of a string once it has bytes, or ends
+  if (t->tag && (length || e.type == SAJS_EVENT_END)) {
+    put_marker(&t->values, t->tag, 0U, 0U);
+    t->tag = '\0';
+  }
+
+  if (length) {
+    append(&t->events, length, string.data);
+    if (t->leaf == SAJS_STRING) {
+      append(&t->values, length, string.data);
+    } else if (t->leaf == SAJS_LITERAL && !t->literal) {
+      t->literal = string.data[0];
+    }
+  }
+
+  if (e.type == SAJS_EVENT_END || e.type == SAJS_EVENT_DOUBLE_END) {
+    char const tag = (e.type == SAJS_EVENT_END) ? 'E' : 'D';
+
+    put_marker(&t->events, tag, e.kind, flags);
+    if (t->leaf == SAJS_NUMBER) {
+      put_number(&t->events, sajs_number(lexer));
+      put_number(&t->values, sajs_number(lexer));
+    } else if (t->leaf == SAJS_STRING) {
+      put_marker(&t->values, 'e', 0U, 0U);
+    } else if (t->leaf == SAJS_LITERAL) {
+      put_marker(&t->values, 'L', (uint8_t)t->literal, 0U);
+    }
+
+    if (!t->leaf || e.type == SAJS_EVENT_DOUBLE_END) {
+      put_marker(&t->values, 'E', e.kind, 0U);
+    }
+
+    t->leaf = (SajsValueKind)0;
+  }
+}
+
+static SajsStatus
+trace_start(void* const handle, SajsValueKind const kind)
+{
+  put_marker(&((Trace*)handle)->values, 'S', kind, 0U);
+  return SAJS_SUCCESS;
+}
+
+static SajsStatus
+trace_end(void* const handle, SajsValueKind const kind)
+{
+  put_marker(&((Trace*)handle)->values, 'E', kind, 0U);
+  return SAJS_SUCCESS;
+}
+
+static SajsStatus
+trace_text(Trace* const         t,
+           char const           tag,
+           SajsStringView const bytes,
+           bool const           last)
+{
+  if (!t->in_string && (bytes.length || last)) {
+    put_marker(&t->values, tag, 0U, 0U);
+    t->in_string = true;
+  }
+
+  append(&t->values, bytes.length, bytes.data);
+  if (last) {
+    put_marker(&t->values, 'e', 0U, 0U);
+    t->in_string = false;
+  }
+  return SAJS_SUCCESS;
+}
+
+static SajsStatus
+trace_name(void* const handle, SajsStringView const bytes, bool const last)
+{
+  return trace_text((Trace*)handle, 'n', bytes, last);
+}
+
+static SajsStatus
+trace_string(void* const handle, SajsStringView const bytes, bool const last)
+{
+  return trace_text((Trace*)handle, 's', bytes, last);
+}
+
+static SajsStatus
+trace_number(void* const handle, SajsNumber const number)
+{
+  put_number(&((Trace*)handle)->values, number);
+  return SAJS_SUCCESS;
+}
+
+static SajsStatus
+trace_literal(void* const handle, char const literal)
+{
+  put_marker(&((Trace*)handle)->values, 'L', (uint8_t)literal, 0U);
+  return SAJS_SUCCESS;
+}
+
+static void
+free_trace(Trace* const trace)
+{
+  free(trace->text.data);
+  free(trace->values.data);
+  free(trace->events.data);
+}
+
+/*
+  Engines
+*/
+
+/// Return the length of the next buffer to read, or zero for the end
+static size_t
+next_length(size_t const end, size_t const offset, size_t const step)
+{
+  size_t const left = end - offset;
+  return (step && step < left) ? step : left;
+}
+
+/// Read an input a byte at a time, which every other engine must agree with
+static Outcome
+engine_byte(Input const* const input, size_t const step, Trace* const trace)
+{
+  uintptr_t        mem[LEXER_WORDS];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  Outcome          result = {SAJS_RETRY, 0U, 0U};
+
+  (void)step;
+  for (unsigned eofs = 0U; eofs < MAX_EOFS;) {
+    size_t const    i = result.offset;
+    int const       c = (i < input->length) ? (uint8_t)input->data[i] : -1;
+    SajsEvent const e = sajs_read_byte(lexer, c);
+    if (e.status) {
+      result.status = e.status;
+      break;
+    }
+
+    if (trace && e.type) {
+      trace_event(trace, lexer, e);
+    }
+
+    if (i < input->length) {
+      ++result.offset;
+    } else {
+      ++eofs;
+    }
+  }
+
+  return result;
+}
+
+/**
+   Read part of an input from `offset` to `end` with an existing lexer.
+
+   If `end` is the end of the input, then this reads until the end of input
+   is reached, otherwise it stops with #SAJS_SUCCESS at `end`.
+*/
+static Outcome
+read_part(SajsLexer* const   lexer,
+          Input const* const input,
+          size_t const       offset,
+          size_t const       end,
+          size_t const       step,
+          Trace* const       trace,
+          ReadFunc const     read_func)
+{
+  Outcome result = {SAJS_RETRY, offset, 0U};
+
+  for (unsigned eofs = 0U; eofs < MAX_EOFS;) {
+    if (result.offset == end && end < input->length) {
+      result.status = SAJS_SUCCESS;
+      break;
+    }
+
+    size_t const    length = next_length(end, result.offset, step);
+    size_t          count  = 0U;
+    SajsEvent const e =
+      read_func(lexer, length, input->data + result.offset, &count);
+
+    result.offset += count;
+    if (e.status) {
+      result.status = e.status;
+      break;
+    }
+
+    if (trace && e.type) {
+      trace_event(trace, lexer, e);
+    }
+
+    if ((e.type == SAJS_EVENT_END || e.type == SAJS_EVENT_DOUBLE_END) &&
+        (e.flags & SAJS_IS_ROOT)) {
+      ++result.roots;
+    }
+
+    eofs += length ? 0U : 1U;
+  }
+
+  return result;
+}
+
+static Outcome
+engine_buffers(Input const* const input,
+               size_t const       step,
+               Trace* const       trace,
+               ReadFunc const     read_func)
+{
+  uintptr_t        mem[LEXER_WORDS];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+
+  return read_part(lexer, input, 0U, input->length, step, trace, read_func);
+}
+
+static Outcome
+engine_buffer(Input const* const input, size_t const step, Trace* const trace)
+{
+  return engine_buffers(input, step, trace, sajs_read_buffer);
+}
+
+static Outcome
+engine_spans(Input const* const input, size_t const step, Trace* const trace)
+{
+  return engine_buffers(input, step, trace, sajs_read_spans);
+}
+
+static Outcome
+engine_validate(Input const* const input, size_t const step, Trace* const trace)
+{
+  uintptr_t        mem[LEXER_WORDS];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  Outcome          result = {SAJS_RETRY, 0U, 0U};
+
+  (void)trace;
+  for (unsigned eofs = 0U; eofs < MAX_EOFS;) {
+    size_t const     length = next_length(input->length, result.offset, step);
+    size_t           count  = 0U;
+    SajsStatus const st =
+      sajs_validate(lexer, length, input->data + result.offset, &count);
+
+    result.offset += count;
+    if (st == SAJS_SUCCESS) {
+      ++result.roots;
+    } else if (st != SAJS_RETRY) {
+      result.status = st;
+      break;
+    }
+
+    eofs += length ? 0U : 1U;
+  }
+
+  return result;
+}
+
+static Outcome
+engine_lex(Input const* const input, size_t const step, Trace* const trace)
+{
+  static SajsHandlers const handlers = {trace_start,
+                                        trace_end,
+                                        trace_name,
+                                        trace_string,
+                                        trace_number,
+                                        trace_literal};
+
+  static SajsHandlers const no_handlers = {NULL, NULL, NULL, NULL, NULL, NULL};
+
+  uintptr_t        mem[LEXER_WORDS];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  Outcome          result = {SAJS_RETRY, 0U, 0U};
+
+  for (unsigned eofs = 0U; eofs < MAX_EOFS;) {
+    size_t const     length = next_length(input->length, result.offset, step);
+    size_t           count  = 0U;
+    SajsStatus const st     = sajs_lex(lexer,
+                                   length,
+                                   input->data + result.offset,
+                                   &count,
+                                   trace ? &handlers : &no_handlers,
+                                   trace);
+
+    result.offset += count;
+    if (st) {
+      result.status = st;
+      break;
+    }
+
+    eofs += length ? 0U : 1U;
+  }
+
+  return result;
+}
+
+/// Reformat an input without reading events, like sajs_bench -b minify
+static Outcome
+copy_text(Input const* const   input,
+          size_t const         step,
+          SajsWriteFlags const flags,
+          Buffer* const        out)
+{
+  char              text[TEXT_SIZE];
+  uintptr_t         mem[8U];
+  SajsWriter* const writer = sajs_writer_init(sizeof(mem), mem);
+  Outcome           result = {SAJS_FAILURE, 0U, 0U};
+
+  // Keep going until a final call with no input finishes everything
+  for (bool finished = false; !finished;) {
+    size_t const     length = next_length(input->length, result.offset, step);
+    size_t           count  = 0U;
+    size_t           n      = 0U;
+    SajsStatus const st     = sajs_write_text(writer,
+                                          flags,
+                                          length,
+                                          input->data + result.offset,
+                                          &count,
+                                          sizeof(text),
+                                          text,
+                                          &n);
+
+    result.offset += count;
+    finished = !length && st == SAJS_SUCCESS;
+    if (out) {
+      append(out, n, text);
+    }
+  }
+
+  return result;
+}
+
+static Outcome
+engine_minify(Input const* const input, size_t const step, Trace* const trace)
+{
+  return copy_text(input,
+                   step,
+                   SAJS_WRITE_TERSE | SAJS_WRITE_NEWLINES,
+                   trace ? &trace->text : NULL);
+}
+
+static Outcome
+engine_reindent(Input const* const input, size_t const step, Trace* const trace)
+{
+  return copy_text(
+    input, step, SAJS_WRITE_NEWLINES, trace ? &trace->text : NULL);
+}
+
+/// Return the kind of a top-level container that starts an input, or zero
+static SajsValueKind
+root_kind(Input const* const input)
+{
+  for (size_t i = 0U; i < input->length; ++i) {
+    char const c = input->data[i];
+    if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+      return (c == '[')   ? SAJS_ARRAY
+             : (c == '{') ? SAJS_OBJECT
+                          : (SajsValueKind)0;
+    }
+  }
+
+  return (SajsValueKind)0;
+}
+
+/// Find where an input can be split for reading, and return the number
+static size_t
+find_splits(Input const* const input, size_t* const starts)
+{
+  SajsChunk chunks[NUM_CHUNKS];
+  size_t    num_parts = 1U;
+
+  starts[0] = 0U;
+  for (size_t i = 0U; i < NUM_CHUNKS; ++i) {
+    SajsChunk const chunk = {input->length * i / NUM_CHUNKS,
+                             input->length * (i + 1U) / NUM_CHUNKS,
+                             {0, 0},
+                             0,
+                             0U,
+                             0U};
+
+    chunks[i] = chunk;
+    sajs_scan_chunk(input->length, input->data, &chunks[i]);
+    sajs_link_chunk(i ? &chunks[i - 1U] : NULL, &chunks[i]);
+
+    size_t const split =
+      i ? sajs_find_split(input->length, input->data, &chunks[i]) : 0U;
+    if (split) {
+      starts[num_parts++] = split;
+    }
+  }
+
+  return num_parts;
+}
+
+/**
+   Read an input in parts split like sajs-pipe -j, one after another.
+
+   Each part after the first is read with a lexer set up by
+   sajs_lexer_resume(), as if it was read in parallel.  If a part doesn't
+   end where the next can resume, then the rest of the input is read from
+   there with the same lexer, as sajs-pipe does, so the result should always
+   be the same as reading the whole input.
+*/
+static Outcome
+engine_split(Input const* const input, size_t const step, Trace* const trace)
+{
+  uintptr_t           mem[LEXER_WORDS];
+  SajsLexer* const    lexer = sajs_lexer_init(sizeof(mem), mem);
+  SajsValueKind const kind  = root_kind(input);
+  size_t              starts[NUM_CHUNKS + 1U];
+  size_t const        num_parts = kind ? find_splits(input, starts) : 1U;
+  Outcome             result    = {SAJS_SUCCESS, 0U, 0U};
+
+  starts[0]         = 0U;
+  starts[num_parts] = input->length;
+  for (size_t p = 0U; p < num_parts && result.status == SAJS_SUCCESS; ++p) {
+    bool const resume =
+      p && !result.roots && sajs_lexer_depth(lexer) == 1U;
+
+    size_t const end = resume || !p ? starts[p + 1U] : input->length;
+    if (resume) {
+      sajs_lexer_resume(lexer, kind);
+    }
+
+    result = read_part(
+      lexer, input, result.offset, end, step, trace, sajs_read_spans);
+  }
+
+  return result;
+}
+
+static Engine const engines[] = {
+  {"byte", engine_byte, TRACE_EVENTS | TRACE_VALUES, false},
+  {"buffer", engine_buffer, TRACE_EVENTS | TRACE_VALUES, false},
+  {"spans", engine_spans, TRACE_EVENTS | TRACE_VALUES, false},
+  {"validate", engine_validate, 0U, false},
+  {"lex", engine_lex, TRACE_VALUES, false},
+  {"split", engine_split, TRACE_EVENTS | TRACE_VALUES, false},
+  {"minify", engine_minify, TRACE_TERSE, true},
+  {"reindent", engine_reindent, TRACE_PRETTY, true},
+};
+
+/*
+  Checking
+*/
+
+/// Read an input a byte at a time and write every event as text
+static void
+write_events(Input const* const   input,
+             SajsWriteFlags const flags,
+             Buffer* const        out)
+{
+  char              text[TEXT_SIZE];
+  uintptr_t         lexer_mem[LEXER_WORDS];
+  uintptr_t         writer_mem[8U];
+  SajsLexer* const  lexer = sajs_lexer_init(sizeof(lexer_mem), lexer_mem);
+  SajsWriter* const writer =
+    sajs_writer_init(sizeof(writer_mem), writer_mem);
+
+  for (size_t i = 0U; i <= input->length;) {
+    int const            c = (i < input->length) ? (uint8_t)input->data[i] : -1;
+    SajsEvent const      e = sajs_read_byte(lexer, c);
+    SajsStringView const string = sajs_string(lexer);
+    if (e.status) {
+      break;
+    }
+
+    SajsStatus st = e.type ? SAJS_RETRY : SAJS_SUCCESS;
+    while (st == SAJS_RETRY) {
+      size_t num_written = 0U;
+      size_t length      = 0U;
+      st                 = sajs_write_events(writer,
+                                             flags,
+                                             1U,
+                                             &e,
+                                             &string,
+                                             &num_written,
+                                             sizeof(text),
+                                             text,
+                                             &length);
+
+      append(out, length, text);
+    }
+
+    // Read the end again after an event, until it's reached between values
+    if (i < input->length) {
+      ++i;
+    } else if (!e.type) {
+      break;
+    }
+  }
+}
+
+static bool
+report(Input const* const  input,
+       Engine const* const engine,
+       size_t const        step,
+       char const* const   problem)
+{
+  if (step) {
+    (void)fprintf(stderr,
+                  "error: %s: %s (buffer size %zu) %s\n",
+                  input->name,
+                  engine->name,
+                  step,
+                  problem);
+  } else {
+    (void)fprintf(
+      stderr, "error: %s: %s %s\n", input->name, engine->name, problem);
+  }
+
+  return false;
+}
+
+/// Check that an engine reads an input like reading a byte at a time
+static bool
+check_engine(Input const* const  input,
+             Engine const* const engine,
+             size_t const        step,
+             Outcome const       expected,
+             Trace const* const  ref)
+{
+  Trace         trace  = no_trace;
+  Outcome const result = engine->func(input, step, &trace);
+  bool          ok     = true;
+
+  if (result.status != expected.status || result.offset != expected.offset) {
+    char problem[160];
+    (void)snprintf(problem,
+                   sizeof(problem),
+                   "stopped at %zu with \"%s\", not at %zu with \"%s\"",
+                   result.offset,
+                   sajs_strerror(result.status),
+                   expected.offset,
+                   sajs_strerror(expected.status));
+
+    ok = report(input, engine, step, problem);
+  } else if ((engine->traced & TRACE_EVENTS) &&
+             !equals(&trace.events, &ref->events)) {
+    ok = report(input, engine, step, "read different events");
+  } else if ((engine->traced & TRACE_VALUES) &&
+             !equals(&trace.values, &ref->values)) {
+    ok = report(input, engine, step, "read different values");
+  } else if ((engine->traced & TRACE_TERSE) &&
+             !equals(&trace.text, &ref->text)) {
+    ok = report(input, engine, step, "wrote different terse text");
+  } else if ((engine->traced & TRACE_PRETTY) &&
+             !equals(&trace.text, &ref[1].text)) {
+    ok = report(input, engine, step, "wrote different indented text");
+  }
+
+  free_trace(&trace);
+  return ok;
+}
+
+/// Return true if reading an input ended cleanly
+static bool
+is_valid(Input const* const input, Outcome const outcome)
+{
+  return outcome.status == SAJS_FAILURE && outcome.offset == input->length;
+}
+
+/// Check that every engine reads an input the same way, or print why not
+static bool
+check_input(Input const* const input)
+{
+  /* The reference is read a byte at a time, with the text for every event
+     written tersely into the first trace, and indented into the second. */
+  Trace         ref[2]   = {no_trace, no_trace};
+  Outcome const expected = engine_byte(input, 0U, &ref[0]);
+  bool const    valid    = is_valid(input, expected);
+  bool          ok       = true;
+
+  if (expected.status == SAJS_RETRY) {
+    ok = report(input, &engines[0], 0U, "didn't reach the end");
+  }
+
+  if (valid) {
+    write_events(input, SAJS_WRITE_TERSE | SAJS_WRITE_NEWLINES, &ref[0].text);
+    write_events(input, SAJS_WRITE_NEWLINES, &ref[1].text);
+  }
+
+  for (size_t i = 1U; i < sizeof(engines) / sizeof(engines[0]); ++i) {
+    Engine const* const engine = &engines[i];
+    if (valid || !engine->valid_only) {
+      for (size_t s = 0U; s < sizeof(steps) / sizeof(steps[0]); ++s) {
+        ok = check_engine(input, engine, steps[s], expected, ref) && ok;
+      }
+    }
+  }
+
+  free_trace(&ref[1]);
+  free_trace(&ref[0]);
+  return ok;
+}
+
+/*
+  Fuzzing
+*/
+
+#ifdef SAJS_FUZZ
+
+int
+LLVMFuzzerTestOneInput(uint8_t const* data, size_t size);
+
+int
+LLVMFuzzerTestOneInput(uint8_t const* const data, size_t const size)
+{
+  Input const input = {"fuzz input", size ? (char const*)data : "", size};
+
+  if (!check_input(&input)) {
+    abort();
+  }
+
+  return 0;
+}
+
+#else
+
+/*
+  Random Inputs
+*/
+
+static unsigned const default_count = 1000U; ///< Number of random inputs
+
+static void
+append_str(Buffer* const buffer, char const* const str)
+{
+  append(buffer, strlen(str), str);
+}
+
+static uint32_t rng_state = 1U;
+
+/// Return a pseudo-random number with a fixed sequence (xorshift32)
+static uint32_t
+rng(void)
+{
+  rng_state ^= rng_state << 13U;
+  rng_state ^= rng_state >> 17U;
+  rng_state ^= rng_state << 5U;
+  return rng_state;
+}
+
+/// Return a pseudo-random number less than n
+static unsigned
+rng_below(unsigned const n)
+{
+  return (unsigned)(rng() % n);
+}
+
+/// Return a random string from an array
+#define PICK(strings) \
+  (strings)[rng_below((unsigned)(sizeof(strings) / sizeof(*(strings))))]
+
+static void
+gen_space(Buffer* const doc)
+{
+  static char const* const spaces[] = {"", "", "", " ", "\n", "\t", "\r\n  "};
+
+  append_str(doc, PICK(spaces));
+}
+
+static void
+gen_string(Buffer* const doc)
+{
+  static char const* const parts[] = {
+    "a",
+    "key",
+    "lorem ipsum",
+    ",:[]{}",
+    "\\\"",
+    "\\\\",
+    "\\/",
+    "\\b\\f\\n\\r\\t",
+    "\\u0000",
+    "\\u00e9",
+    "\\uD834\\uDD1E",
+    "\xC3\xA9",
+    "\xE2\x82\xAC",
+    "\xF0\x9D\x84\x9E",
+    "some longer text that is read as a span by most engines",
+  };
+
+  append_str(doc, "\"");
+  for (unsigned i = 0U, n = rng_below(6U); i < n; ++i) {
+    append_str(doc, PICK(parts));
+  }
+  append_str(doc, "\"");
+}
+
+static void
+gen_number(Buffer* const doc)
+{
+  static char const* const signs[]    = {"", "", "-"};
+  static char const* const integers[] = {"0",
+                                         "1",
+                                         "42",
+                                         "9007199254740993",
+                                         "18446744073709551615",
+                                         "18446744073709551616",
+                                         "123456789012345678901234567890"};
+  static char const* const fractions[] = {
+    "", "", ".5", ".000001", ".14159265358979323846264338327950288"};
+  static char const* const exponents[] = {
+    "", "", "e3", "E+10", "e-7", "e400", "E-400"};
+
+  append_str(doc, PICK(signs));
+  append_str(doc, PICK(integers));
+  append_str(doc, PICK(fractions));
+  append_str(doc, PICK(exponents));
+}
+
+static void
+gen_value(Buffer* const doc, unsigned const depth)
+{
+  static char const* const literals[] = {"false", "null", "true"};
+
+  unsigned const choice = rng_below((depth < GEN_DEPTH) ? 6U : 4U);
+  if (choice == 0U) {
+    append_str(doc, PICK(literals));
+  } else if (choice == 1U) {
+    gen_string(doc);
+  } else if (choice < 4U) {
+    gen_number(doc);
+  } else {
+    bool const is_object = choice == 5U;
+
+    append_str(doc, is_object ? "{" : "[");
+    for (unsigned i = 0U, n = rng_below(6U); i < n; ++i) {
+      append_str(doc, i ? "," : "");
+      gen_space(doc);
+      if (is_object) {
+        gen_string(doc);
+        gen_space(doc);
+        append_str(doc, ":");
+        gen_space(doc);
+      }
+
+      gen_value(doc, depth + 1U);
+      gen_space(doc);
+    }
+    append_str(doc, is_object ? "}" : "]");
+  }
+}
+
+/// Generate a valid document with one or a few values
+static void
+gen_doc(Buffer* const doc)
+{
+  // Occasionally nest too deeply for the lexer stack
+  if (!rng_below(64U)) {
+    unsigned const depth = 2U * STACK_SIZE;
+    for (unsigned i = 0U; i < depth; ++i) {
+      append_str(doc, "[");
+    }
+    gen_value(doc, GEN_DEPTH);
+    for (unsigned i = 0U; i < depth; ++i) {
+      append_str(doc, "]");
+    }
+    return;
+  }
+
+  unsigned const num_values = 1U + (rng_below(4U) ? 0U : rng_below(3U));
+  for (unsigned i = 0U; i < num_values; ++i) {
+    gen_space(doc);
+    gen_value(doc, 0U);
+    gen_space(doc);
+    append_str(doc, "\n");
+  }
+}
+
+/// Change a few random bytes of a document, which usually makes it invalid
+static void
+mutate(Buffer* const doc)
+{
+  static char const bytes[] = "\"\\{}[],:0-.eE+tfnu \t\n\x01\x7F\x80\xBF\xC0"
+                              "\xC3\xE2\xED\xF0\xF4\xFF";
+
+  for (unsigned i = 0U, n = 1U + rng_below(3U); i < n && doc->length; ++i) {
+    size_t const   pos  = rng() % doc->length;
+    char const     byte = bytes[rng_below((unsigned)sizeof(bytes) - 1U)];
+    unsigned const op   = rng_below(4U);
+
+    if (op == 0U) {
+      doc->data[pos] = byte;
+    } else if (op == 1U) {
+      memmove(doc->data + pos, doc->data + pos + 1U, doc->length - pos - 1U);
+      --doc->length;
+    } else if (op == 2U) {
+      append(doc, 1U, &byte);
+      memmove(doc->data + pos + 1U, doc->data + pos, doc->length - pos - 1U);
+      doc->data[pos] = byte;
+    } else {
+      doc->length = pos;
+    }
+  }
+}
+
+/*
+  Benchmarks
+*/
+
+static unsigned const default_repeats = 5U; ///< Runs of each benchmark
+
+/// Return a monotonic time in seconds
+static double
+now(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec t = {0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + ((double)t.tv_nsec * 1e-9);
+#else
+  return (double)clock() / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+/// A list of documents to benchmark
+typedef struct {
+  Buffer* docs;
+  size_t  num_docs;
+} DocList;
+
+static void
+add_doc(DocList* const list, Buffer const doc)
+{
+  Buffer* const docs =
+    (Buffer*)realloc(list->docs, (list->num_docs + 1U) * sizeof(Buffer));
+  if (!docs) {
+    (void)fprintf(stderr, "error: failed to allocate inputs\n");
+    exit(1);
+  }
+
+  list->docs                   = docs;
+  list->docs[list->num_docs++] = doc;
+}
+
+/// Return an input that reads a document
+static Input
+doc_input(char const* const name, Buffer const* const doc)
+{
+  Input const input = {name, doc->data ? doc->data : "", doc->length};
+  return input;
+}
+
+/// Return the name of the scanning code, which depends on the compiler
+static char const*
+scan_name(void)
+{
+#if defined(SAJS_SCAN_AVX2)
+  return "avx2";
+#elif defined(SAJS_SCAN_SSE2)
+  return "sse2";
+#elif defined(SAJS_SCAN_NEON)
+  return "neon";
+#else
+  return "swar";
+#endif
+}
+
+/// Run each engine over valid inputs several times and print the best result
+static void
+run_benches(DocList const* const list, unsigned const repeats)
+{
+#ifdef SAJS_TABLE_DISPATCH
+  static char const* const dispatch = "table";
+#else
+  static char const* const dispatch = "functions";
+#endif
+
+  size_t bytes = 0U;
+  for (size_t i = 0U; i < list->num_docs; ++i) {
+    bytes += list->docs[i].length;
+  }
+
+  for (size_t e = 0U; e < sizeof(engines) / sizeof(engines[0]); ++e) {
+    Engine const* const engine = &engines[e];
+
+    double best = 0.0;
+    for (unsigned r = 0U; r < repeats; ++r) {
+      double const start = now();
+      for (size_t i = 0U; i < list->num_docs; ++i) {
+        Input const input = doc_input("benchmark", &list->docs[i]);
+        (void)engine->func(&input, 0U, NULL);
+      }
+
+      double const t = now() - start;
+      if (!r || t < best) {
+        best = t;
+      }
+    }
+
+    double const secs = (best > 0.0) ? best : 1e-9;
+
+    printf("{\"benchmark\": \"%s\", \"scan\": \"%s\", \"dispatch\": \"%s\", "
+           "\"inputs\": %zu, \"bytes\": %zu, \"seconds\": %.6f, "
+           "\"MB_per_s\": %.2f}\n",
+           engine->name,
+           scan_name(),
+           dispatch,
+           list->num_docs,
+           bytes,
+           best,
+           (double)bytes / secs / 1e6);
+  }
+}
+
+/*
+  Entry Points
+*/
+
+static bool
+load(char const* const path, Buffer* const buffer)
+{
+  FILE* const stream = fopen(path, "rb");
+  if (!stream) {
+    return false;
+  }
+
+  char   buf[65536U];
+  size_t n = 0U;
+  while ((n = fread(buf, 1U, sizeof(buf), stream))) {
+    append(buffer, n, buf);
+  }
+
+  return !fclose(stream);
+}
+
+/**
+   Check a document, or add it to a list to benchmark if it's valid.
+
+   This takes ownership of the document, which is either freed, or owned by
+   the list.  Returns false if checking the document failed.
+*/
+static bool
+use_doc(DocList* const list, char const* const name, Buffer const doc)
+{
+  Input const input = doc_input(name, &doc);
+
+  if (!list) {
+    bool const ok = check_input(&input);
+    free(doc.data);
+    return ok;
+  }
+
+  // Only benchmark valid inputs, since some engines can't read invalid ones
+  if (is_valid(&input, engine_validate(&input, 0U, NULL))) {
+    add_doc(list, doc);
+  } else {
+    free(doc.data);
+  }
+
+  return true;
+}
+
+static int
+print_usage(char const* const name, bool const error)
+{
+  (void)fprintf(
+    error ? stderr : stdout,
+    "Usage: %s [OPTION]... [INPUT]...\n"
+    "Check that every lexer engine reads INPUT files and random inputs the "
+    "same.\n\n"
+    "  -b          Benchmark each engine on valid inputs instead.\n"
+    "  -h          Display this help and exit.\n"
+    "  -n REPEATS  Run each benchmark REPEATS times and report the best.\n"
+    "  -r COUNT    Generate COUNT random inputs.\n"
+    "  -s SEED     Generate random inputs from SEED.\n",
+    name);
+  return error ? 1 : 0;
+}
+
+int
+main(int const argc, char** const argv)
+{
+  bool     bench   = false;
+  unsigned count   = default_count;
+  unsigned repeats = default_repeats;
+  unsigned seed    = 1U;
+
+  int a = 1;
+  for (; a < argc && argv[a][0] == '-' && argv[a][1]; ++a) {
+    char const  opt = argv[a][1];
+    char const* arg = (a + 1 < argc) ? argv[a + 1] : NULL;
+    if (argv[a][2]) {
+      return print_usage(argv[0], true);
+    }
+
+    if (opt == 'b') {
+      bench = true;
+    } else if (opt == 'h') {
+      return print_usage(argv[0], false);
+    } else if (!arg) {
+      return print_usage(argv[0], true);
+    } else if (opt == 'n') {
+      repeats = (unsigned)strtoul(argv[++a], NULL, 10);
+    } else if (opt == 'r') {
+      count = (unsigned)strtoul(argv[++a], NULL, 10);
+    } else if (opt == 's') {
+      seed = (unsigned)strtoul(argv[++a], NULL, 10);
+    } else {
+      return print_usage(argv[0], true);
+    }
+  }
+
+  // Check or collect the input files, then random inputs
+  DocList  list     = {NULL, 0U};
+  unsigned failures = 0U;
+  for (; a < argc; ++a) {
+    Buffer doc = {NULL, 0U, 0U};
+    if (!load(argv[a], &doc)) {
+      (void)fprintf(stderr, "error: failed to read \"%s\"\n", argv[a]);
+      ++failures;
+      free(doc.data);
+    } else if (!use_doc(bench ? &list : NULL, argv[a], doc)) {
+      ++failures;
+    }
+  }
+
+  rng_state = seed ? seed : 1U;
+  for (unsigned i = 0U; i < count; ++i) {
+    char   name[64];
+    Buffer doc = {NULL, 0U, 0U};
+
+    (void)snprintf(name, sizeof(name), "random input %u (seed %u)", i, seed);
+    gen_doc(&doc);
+    if (!bench && rng_below(2U)) {
+      mutate(&doc);
+    }
+
+    failures += use_doc(bench ? &list : NULL, name, doc) ? 0U : 1U;
+  }
+
+  if (bench) {
+    run_benches(&list, repeats ? repeats : 1U);
+  }
+
+  for (size_t i = 0U; i < list.num_docs; ++i) {
+    free(list.docs[i].data);
+  }
+
+  free(list.docs);
+  if (failures) {
+    (void)fprintf(stderr, "error: %u inputs failed\n", failures);
+    return 1;
+  }
+
+  return 0;
+}
+
+#endif // SAJS_FUZZ
@@ -0,0 +1,232 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_EVENTS 256U
+
+/// Events and strings produced by a filter
+typedef struct {
+  SajsEvent      events[MAX_EVENTS];
+  SajsStringView strings[MAX_EVENTS];
+  char           bytes[MAX_EVENTS][4U];
+  size_t         num_events;
+} EventLog;
+
+/// Add some pointers to a new filter in the given memory
+static SajsFilter*
+make_filter(size_t const             mem_size,
+            void* const              mem,
+            size_t const             num_pointers,
+            char const* const* const pointers)
+{
+  SajsFilter* const filter = sajs_filter_init(mem_size, mem);
+  assert(filter);
+
+  for (size_t i = 0U; i < num_pointers; ++i) {
+    assert(!sajs_filter_add(filter, strlen(pointers[i]), pointers[i]));
+  }
+
+  return filter;
+}
+
+/// Read a document in pieces of `step` bytes, and return the final status
+static SajsStatus
+read_doc(SajsFilter* const filter,
+         char const* const doc,
+         size_t const      step,
+         EventLog* const   log)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  size_t const     length = strlen(doc);
+
+  log->num_events = 0U;
+  for (size_t offset = 0U; offset <= length;) {
+    size_t const    end   = (length - offset < step) ? length : (offset + step);
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_filter_read(filter, lexer, end - offset, doc + offset, &count);
+
+    assert(count <= end - offset);
+    offset += count;
+    if (e.status) {
+      return e.status;
+    }
+
+    if (e.type) {
+      size_t const   i      = log->num_events++;
+      SajsStringView string = sajs_string(lexer);
+      assert(i < MAX_EVENTS);
+      if (string.length <= 4U) {
+        memcpy(log->bytes[i], string.data, string.length);
+        string.data = log->bytes[i];
+      }
+
+      log->events[i]  = e;
+      log->strings[i] = string;
+    }
+  }
+
+  return SAJS_SUCCESS;
+}
+
+/// Write the events in a log as terse text with a line for each value
+static void
+write_text(EventLog const* const log, size_t const size, char* const text)
+{
+  uintptr_t         mem[8U];
+  SajsWriter* const writer      = sajs_writer_init(sizeof(mem), mem);
+  size_t            num_written = 0U;
+  size_t            length      = 0U;
+
+  assert(!sajs_write_events(writer,
+                            SAJS_WRITE_TERSE | SAJS_WRITE_NEWLINES,
+                            log->num_events,
+                            log->events,
+                            log->strings,
+                            &num_written,
+                            size - 1U,
+                            text,
+                            &length));
+
+  text[length] = '\0';
+}
+
+/// Check the values of a document matched by some pointers
+static void
+check_filter(char const* const        doc,
+             size_t const             num_pointers,
+             char const* const* const pointers,
+             char const* const        expected)
+{
+  static EventLog log;
+
+  uintptr_t         mem[4096U / sizeof(uintptr_t)];
+  SajsFilter* const filter =
+    make_filter(sizeof(mem), mem, num_pointers, pointers);
+
+  for (size_t step = 1U; step <= strlen(doc); ++step) {
+    char text[256U];
+
+    assert(read_doc(filter, doc, step, &log) == SAJS_FAILURE);
+    write_text(&log, sizeof(text), text);
+    if (strcmp(text, expected)) {
+      (void)fprintf(stderr, "Expected:\n%s\nActual:\n%s\n", expected, text);
+      assert(false);
+    }
+  }
+}
+
+static void
+test_filter(void)
+{
+  static char const* const doc =
+    "{\"a\": [1, {\"b\": 2}, [3]], \"c\\/\": \"x\\ty\", \"~\": 4, "
+    "\"d\": {\"b\": [5], \"e\": true}}";
+
+  static char const* const single[] = {"/a/1/b"};
+  check_filter(doc, 1U, single, "2\n");
+
+  static char const* const escaped[] = {"/c~1", "/~0"};
+  check_filter(doc, 2U, escaped, "\"x\\ty\"\n4\n");
+
+  static char const* const elements[] = {"/a/*"};
+  check_filter(doc, 1U, elements, "1\n{\"b\":2}\n[3]\n");
+
+  static char const* const members[] = {"/*/b"};
+  check_filter(doc, 1U, members, "[5]\n");
+
+  static char const* const last[] = {"/a/2/0", "/d/e"};
+  check_filter(doc, 2U, last, "3\ntrue\n");
+
+  static char const* const nested[] = {"/a/0", "/a", "/d/b/0"};
+  check_filter(doc, 3U, nested, "[1,{\"b\":2},[3]]\n5\n");
+
+  static char const* const missing[] = {"/a/3", "/b", "/d/b/x", "/~1"};
+  check_filter(doc, 4U, missing, "");
+
+  static char const* const root[] = {""};
+  check_filter(doc,
+               1U,
+               root,
+               "{\"a\":[1,{\"b\":2},[3]],\"c/\":\"x\\ty\",\"~\":4,"
+               "\"d\":{\"b\":[5],\"e\":true}}\n");
+}
+
+static void
+test_filter_roots(void)
+{
+  static char const* const doc = "[1, 2] {\"a\": 3} \"s\" 4";
+
+  static char const* const root[] = {""};
+  check_filter(doc, 1U, root, "[1,2]\n{\"a\":3}\n\"s\"\n4\n");
+
+  static char const* const element[] = {"/1", "/a"};
+  check_filter(doc, 2U, element, "2\n3\n");
+
+  static char const* const none[] = {"/0/0"};
+  check_filter(doc, 1U, none, "");
+}
+
+static void
+test_filter_errors(void)
+{
+  uintptr_t mem[4096U / sizeof(uintptr_t)];
+
+  assert(!sajs_filter_init(sizeof(mem) / 2U, mem));
+
+  // Invalid pointers
+  SajsFilter* const filter = sajs_filter_init(sizeof(mem), mem);
+  assert(sajs_filter_add(filter, 1U, "a") == SAJS_FAILURE);
+  assert(sajs_filter_add(filter, 2U, "/~") == SAJS_FAILURE);
+  assert(sajs_filter_add(filter, 3U, "/~2") == SAJS_FAILURE);
+
+  // Too many segments
+  for (unsigned i = 0U; i < 63U; ++i) {
+    char pointer[8U] = {'/', 'k', (char)('0' + (i / 10U)), '0', '\0'};
+    pointer[3]       = (char)('0' + (i % 10U));
+    assert(!sajs_filter_add(filter, 4U, pointer));
+  }
+
+  assert(sajs_filter_add(filter, 4U, "/k99") == SAJS_OVERFLOW);
+  assert(sajs_filter_add(filter, 6U, "/k00/a") == SAJS_OVERFLOW);
+  assert(!sajs_filter_add(filter, 4U, "/k00"));
+
+  // Errors in matching values are reported
+  static EventLog log;
+  assert(read_doc(filter, "{\"k01\": [1 2]}", 4U, &log) ==
+         SAJS_EXPECTED_COMMA);
+
+  // Errors in names are reported
+  sajs_filter_reset(filter);
+  assert(read_doc(filter, "{\"k\\x\": 1}", 4U, &log) ==
+         SAJS_EXPECTED_STRING_ESCAPE);
+
+  // Errors in skipped strings are reported
+  sajs_filter_reset(filter);
+  assert(read_doc(filter, "{\"z\": \"\\x\"}", 4U, &log) ==
+         SAJS_EXPECTED_STRING_ESCAPE);
+
+  // Incomplete input is reported
+  sajs_filter_reset(filter);
+  assert(read_doc(filter, "{\"k00\": [1", 4U, &log) == SAJS_NO_DATA);
+}
+
+int
+main(void)
+{
+  test_filter();
+  test_filter_roots();
+  test_filter_errors();
+  return 0;
+}
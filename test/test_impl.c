@@ -0,0 +1,115 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#define SAJS_MAX_DEPTH 4U
+#define SAJS_NO_NUMBER_VALUES
+#define SAJS_NO_SURROGATES
+
+#ifndef SAJS_STATS
+#  define SAJS_STATS // Counters fill the minimum lexer memory of pool slabs
+#endif
+
+#include "sajs_impl.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// Return the status of reading a whole document with a lexer
+static SajsStatus
+read_doc(SajsLexer* const lexer, char const* const doc)
+{
+  size_t const length = strlen(doc);
+  size_t       offset = 0U;
+
+  SajsEvent e = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, SAJS_OBJECT, 0U};
+
+  sajs_lexer_reset(lexer);
+  while (!e.status) {
+    size_t count = 0U;
+    e = sajs_read_buffer(lexer, length - offset, doc + offset, &count);
+    offset += count;
+  }
+
+  return e.status;
+}
+
+static void
+test_max_depth(void)
+{
+  uintptr_t mem[(sizeof(SajsLexer) + 64U) / sizeof(uintptr_t)];
+
+  // Memory must have room for the fixed maximum depth
+  size_t const min_size = sizeof(SajsLexer) + (SAJS_MAX_DEPTH) - 1U;
+  assert(!sajs_lexer_init(min_size, mem));
+
+  // More memory doesn't allow any more depth
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+  assert(lexer);
+  assert(read_doc(lexer, "[[[]]]") == SAJS_FAILURE);
+  assert(read_doc(lexer, "[[[[]]]]") == SAJS_OVERFLOW);
+}
+
+static void
+test_pool_depth(void)
+{
+  static uintptr_t mem[1024U / sizeof(uintptr_t)];
+
+  SajsPool* const pool   = sajs_pool_init(sizeof(mem), mem, 0U);
+  SajsLexer*      lexer  = NULL;
+  SajsWriter*     writer = NULL;
+  assert(pool);
+
+  // Pool lexers have room for the fixed maximum depth, whatever was asked
+  assert(!sajs_pool_acquire(pool, &lexer, &writer));
+  assert(read_doc(lexer, "[[[]]]") == SAJS_FAILURE);
+  assert(read_doc(lexer, "[[[[]]]]") == SAJS_OVERFLOW);
+}
+
+static void
+test_no_number_values(void)
+{
+  uintptr_t        mem[(sizeof(SajsLexer) + 64U) / sizeof(uintptr_t)];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  size_t           offset = 0U;
+
+  SajsEvent e = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, SAJS_OBJECT, 0U};
+
+  // Numbers are still checked, but every value is zero
+  while (!e.status && e.type != SAJS_EVENT_END) {
+    size_t count = 0U;
+    e = sajs_read_spans(lexer, 6U - offset, "-12.5 " + offset, &count);
+    offset += count;
+  }
+
+  assert(!e.status);
+  assert(e.kind == SAJS_NUMBER);
+  assert(sajs_number(lexer).real == 0.0);
+  assert(read_doc(lexer, "[1, 2.0e3, -0]") == SAJS_FAILURE);
+  assert(read_doc(lexer, "[1, 2.e3]") == SAJS_EXPECTED_DIGIT);
+}
+
+static void
+test_no_surrogates(void)
+{
+  uintptr_t        mem[(sizeof(SajsLexer) + 64U) / sizeof(uintptr_t)];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+
+  assert(read_doc(lexer, "\"\\u00E9\\uFFFD\"") == SAJS_FAILURE);
+  assert(read_doc(lexer, "\"\xF0\x9D\x84\x9E\"") == SAJS_FAILURE);
+  assert(read_doc(lexer, "\"\\uD834\\uDD1E\"") == SAJS_EXPECTED_UTF8);
+  assert(read_doc(lexer, "\"\\uDD1E\"") == SAJS_EXPECTED_UTF8);
+}
+
+int
+main(void)
+{
+  test_max_depth();
+  test_pool_depth();
+  test_no_number_values();
+  test_no_surrogates();
+  return 0;
+}
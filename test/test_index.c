@@ -0,0 +1,257 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define INDEX_SIZE 1024U
+
+/// A pointer to find, and the text that the value starts with, if any
+typedef struct {
+  char const* pointer;
+  char const* value;
+} Lookup;
+
+static char const* const doc =
+  " {\"a\": [1, {\"b\": 2}, [3, \"]\"], \"c\\\"d\"], \"e/f\": {}, "
+  "\"g~h\": [[], [[4]]], \"\\u0069\": true, \"j\": -5.5e1, \"\": null} ";
+
+static Lookup const lookups[] = {
+  {"", "{\"a\""},
+  {"/a", "[1,"},
+  {"/a/0", "1,"},
+  {"/a/1", "{\"b\""},
+  {"/a/1/b", "2}"},
+  {"/a/2", "[3,"},
+  {"/a/2/1", "\"]\"]"},
+  {"/a/3", "\"c\\\"d\""},
+  {"/e~1f", "{}"},
+  {"/g~0h/0", "[]"},
+  {"/g~0h/1/0/0", "4]"},
+  {"/i", "true"},
+  {"/j", "-5.5e1"},
+  {"/", "null"},
+  {"/a/4", NULL},
+  {"/a/1/c", NULL},
+  {"/a/2/1/0", NULL},
+  {"/a/01", NULL},
+  {"/a/x", NULL},
+  {"/e~1f/0", NULL},
+  {"/g~0h/0/0", NULL},
+  {"/j/0", NULL},
+  {"/k", NULL},
+  {"a", NULL},
+  {"/~2", NULL},
+};
+
+/**
+   Index a document read in pieces of `step` bytes.
+
+   If `tight` is true, then every event is first indexed with no free space,
+   which must fail without changing the index.
+*/
+static size_t
+index_doc(char const* const text,
+          size_t const      step,
+          bool const        tight,
+          uint8_t* const    index)
+{
+  uintptr_t          lexer_mem[16U];
+  uintptr_t          indexer_mem[256U / sizeof(uintptr_t)];
+  SajsLexer* const   lexer = sajs_lexer_init(sizeof(lexer_mem), lexer_mem);
+  SajsIndexer* const indexer =
+    sajs_indexer_init(sizeof(indexer_mem), indexer_mem);
+
+  size_t const length       = strlen(text);
+  size_t       index_length = 0U;
+
+  assert(indexer);
+  for (size_t offset = 0U; offset <= length;) {
+    size_t const    end   = (length - offset < step) ? length : (offset + step);
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_read_spans(lexer, end - offset, text + offset, &count);
+
+    offset += count;
+    if (e.status) {
+      assert(e.status == SAJS_FAILURE);
+      break;
+    }
+
+    if (tight) {
+      size_t const     old_length = index_length;
+      SajsStatus const st         = sajs_index_event(
+        indexer, lexer, e, offset, index_length, index, &index_length);
+
+      assert(!st || st == SAJS_OVERFLOW);
+      assert(st || index_length == old_length);
+      assert(!st || !index_length || index_length == old_length);
+    }
+
+    assert(!sajs_index_event(
+      indexer, lexer, e, offset, INDEX_SIZE, index, &index_length));
+  }
+
+  return index_length;
+}
+
+/// Zero the skip distance of every container in an index
+static void
+clear_skips(size_t const length, uint8_t* const index)
+{
+  for (size_t i = 8U; i < length;) {
+    uint8_t const first = index[i];
+    while (index[i++] & 0x80U) {
+    }
+
+    if ((first & 3U) <= 1U) {
+      memset(index + i, 0, 4U);
+      i += 4U;
+    }
+  }
+}
+
+/// Check every lookup in the document with an index
+static void
+check_lookups(size_t const length, uint8_t const* const index)
+{
+  size_t const doc_length = strlen(doc);
+  for (size_t i = 0U; i < sizeof(lookups) / sizeof(lookups[0]); ++i) {
+    Lookup const     lookup = lookups[i];
+    size_t           offset = 0U;
+    SajsStatus const st     = sajs_index_find(length,
+                                          index,
+                                          doc_length,
+                                          doc,
+                                          strlen(lookup.pointer),
+                                          lookup.pointer,
+                                          &offset);
+
+    if (!lookup.value) {
+      assert(st == SAJS_FAILURE);
+    } else if (st ||
+               strncmp(doc + offset, lookup.value, strlen(lookup.value))) {
+      (void)fprintf(stderr, "Failed to find \"%s\"\n", lookup.pointer);
+      assert(false);
+    }
+  }
+}
+
+static void
+test_index(void)
+{
+  static uint8_t index[INDEX_SIZE];
+  static uint8_t other[INDEX_SIZE];
+
+  // The index is the same however the document is split up
+  size_t const length = index_doc(doc, strlen(doc), true, index);
+  assert(length > 8U);
+  assert(length < strlen(doc));
+  for (size_t step = 1U; step < strlen(doc); ++step) {
+    assert(index_doc(doc, step, false, other) == length);
+    assert(!memcmp(index, other, length));
+  }
+
+  check_lookups(length, index);
+
+  // Containers are scanned if they can't be skipped
+  clear_skips(length, index);
+  check_lookups(length, index);
+}
+
+static void
+test_index_roots(void)
+{
+  static uint8_t index[INDEX_SIZE];
+
+  static char const* const scalar_first = "1 [2]";
+  size_t const             length = index_doc(scalar_first, 1U, false, index);
+  size_t                   offset = 0U;
+
+  // Only the first top-level value is searched
+  assert(!sajs_index_find(length, index, 5U, scalar_first, 0U, "", &offset));
+  assert(offset == 0U);
+  assert(sajs_index_find(length, index, 5U, scalar_first, 2U, "/0", &offset) ==
+         SAJS_FAILURE);
+
+  // An empty document has no values
+  assert(index_doc("  ", 1U, false, index) == 8U);
+  assert(sajs_index_find(8U, index, 2U, "  ", 0U, "", &offset) ==
+         SAJS_FAILURE);
+}
+
+static void
+test_index_errors(void)
+{
+  static uint8_t index[INDEX_SIZE];
+
+  uintptr_t          lexer_mem[16U];
+  uintptr_t          indexer_mem[4U];
+  SajsLexer* const   lexer = sajs_lexer_init(sizeof(lexer_mem), lexer_mem);
+  SajsIndexer* const indexer =
+    sajs_indexer_init(sizeof(indexer_mem), indexer_mem);
+
+  // Memory too small
+  assert(!sajs_indexer_init(sizeof(uintptr_t), indexer_mem));
+
+  // Not enough space for a header
+  SajsEvent const nothing = {
+    SAJS_SUCCESS, SAJS_EVENT_NOTHING, (SajsValueKind)0, 0U};
+  size_t length = 0U;
+  assert(sajs_index_event(indexer, lexer, nothing, 0U, 7U, index, &length) ==
+         SAJS_OVERFLOW);
+  assert(!length);
+
+  // Containers nested too deeply for the indexer
+  size_t count = 0U;
+  assert(indexer);
+  for (size_t offset = 0U; offset < 2U; offset += count) {
+    SajsEvent const e =
+      sajs_read_spans(lexer, 3U - offset, "[[]" + offset, &count);
+    SajsStatus const st = sajs_index_event(
+      indexer, lexer, e, offset + count, INDEX_SIZE, index, &length);
+
+    assert(st == (offset ? SAJS_OVERFLOW : SAJS_SUCCESS));
+  }
+
+  // Invalid indices
+  size_t const doc_length = strlen(doc);
+  size_t       offset     = 0U;
+  length                  = index_doc(doc, doc_length, false, index);
+  assert(sajs_index_find(7U, index, doc_length, doc, 2U, "/a", &offset) ==
+         SAJS_EXPECTED_VALUE);
+
+  for (size_t n = 8U; n < length; ++n) {
+    SajsStatus const st =
+      sajs_index_find(n, index, doc_length, doc, 4U, "/j/0", &offset);
+    assert(st == SAJS_NO_DATA || st == SAJS_FAILURE ||
+           st == SAJS_EXPECTED_VALUE);
+  }
+
+  // An index that doesn't match the document
+  static char const* const other = " {\"a\": {\"b\": 2}}";
+  assert(sajs_index_find(
+           length, index, strlen(other), other, 4U, "/a/b", &offset) ==
+         SAJS_EXPECTED_VALUE);
+
+  index[0] = 'X';
+  assert(sajs_index_find(length, index, doc_length, doc, 2U, "/a", &offset) ==
+         SAJS_EXPECTED_VALUE);
+}
+
+int
+main(void)
+{
+  test_index();
+  test_index_roots();
+  test_index_errors();
+  return 0;
+}
@@ -10,13 +10,19 @@
 static void
 test_init(void)
 {
-  char mem[64];
+  char           mem[72];
+  SajsLexerStats stats;
 
   assert(!sajs_lexer_init(0U, mem));
   assert(!sajs_lexer_init(1U, mem));
   assert(!sajs_lexer_init(8U, mem));
   assert(sajs_lexer_init(sizeof(mem), mem));
 
+  // Without statistics, 64 bytes is enough
+  if (sajs_lexer_set_stats(sajs_lexer_init(sizeof(mem), mem), &stats)) {
+    assert(sajs_lexer_init(64U, mem));
+  }
+
   assert(!sajs_writer_init(0U, mem));
   assert(!sajs_writer_init(1U, mem));
   assert(!sajs_writer_init(8U, mem));
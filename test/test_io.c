@@ -0,0 +1,376 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#define _POSIX_C_SOURCE 200809L // NOLINT(bugprone-reserved-identifier)
+
+#undef NDEBUG
+
+#include "sajs/io.h"
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/// A driver with its own lexer and writer, and small buffers
+typedef struct {
+  uintptr_t lexer_mem[32U];
+  uintptr_t writer_mem[8U];
+  uintptr_t io_mem[4096U / sizeof(uintptr_t)];
+  SajsIo*   io;
+} Driver;
+
+static size_t const buffer_size = 64U; ///< Size of each test buffer
+
+static char text[262144U];
+
+static void
+setup(Driver* const driver, SajsWriteFlags const flags)
+{
+  size_t const mem_size = sajs_io_mem_size(buffer_size);
+  assert(mem_size <= sizeof(driver->io_mem));
+
+  SajsLexer* const lexer =
+    sajs_lexer_init(sizeof(driver->lexer_mem), driver->lexer_mem);
+  SajsWriter* const writer =
+    sajs_writer_init(sizeof(driver->writer_mem), driver->writer_mem);
+
+  driver->io = sajs_io_init(mem_size, driver->io_mem, lexer, writer, flags);
+  assert(driver->io);
+}
+
+/// Run a driver over a document, passing buffers in and out in pieces
+static SajsStatus
+run_buffers(SajsIo* const     io,
+            char const* const doc,
+            size_t const      in_step,
+            size_t const      out_step,
+            size_t* const     length)
+{
+  size_t const doc_length = strlen(doc);
+  size_t       offset     = 0U;
+
+  *length = 0U;
+
+  SajsStatus st = SAJS_RETRY;
+  while (st == SAJS_RETRY) {
+    SajsIoFlags const waiting = sajs_io_waiting(io);
+    assert(waiting);
+
+    if (waiting & SAJS_IO_WRITE) {
+      // Write some output
+      SajsStringView const output = sajs_io_output(io);
+      size_t const n = (output.length < out_step) ? output.length : out_step;
+      assert(*length + n <= sizeof(text));
+      memcpy(text + *length, output.data, n);
+      *length += n;
+      st = sajs_io_drop_output(io, n);
+    } else {
+      // Read some input
+      SajsIoBuffer const input = sajs_io_input(io);
+      size_t const       left  = doc_length - offset;
+      size_t const       max   = (in_step < input.size) ? in_step : input.size;
+      size_t const       n     = (left < max) ? left : max;
+      memcpy(input.data, doc + offset, n);
+      offset += n;
+      st = sajs_io_add_input(io, n);
+    }
+  }
+
+  // Write any output left at the end
+  for (SajsStringView out = sajs_io_output(io); out.length;) {
+    memcpy(text + *length, out.data, out.length);
+    *length += out.length;
+    assert(sajs_io_drop_output(io, out.length) == st);
+    out = sajs_io_output(io);
+  }
+
+  assert(!sajs_io_waiting(io));
+  return st;
+}
+
+/// Check that a document is reformatted correctly with every step size
+static void
+check_buffers(char const* const    doc,
+              SajsWriteFlags const flags,
+              SajsStatus const     status,
+              char const* const    expected)
+{
+  Driver driver;
+  setup(&driver, flags);
+
+  size_t const doc_length      = strlen(doc);
+  size_t const expected_length = strlen(expected);
+  for (size_t in_step = 1U; in_step <= doc_length + 1U; ++in_step) {
+    for (size_t out_step = 1U; out_step <= buffer_size; out_step *= 3U) {
+      size_t length = 0U;
+      sajs_io_reset(driver.io);
+      assert(run_buffers(driver.io, doc, in_step, out_step, &length) ==
+             status);
+      assert(length == expected_length);
+      assert(!memcmp(text, expected, length));
+    }
+  }
+}
+
+static void
+test_init(void)
+{
+  uintptr_t lexer_mem[32U];
+  uintptr_t writer_mem[8U];
+  uintptr_t io_mem[4096U / sizeof(uintptr_t)];
+
+  SajsLexer* const  lexer    = sajs_lexer_init(sizeof(lexer_mem), lexer_mem);
+  SajsWriter* const writer   = sajs_writer_init(sizeof(writer_mem), writer_mem);
+  size_t const      mem_size = sajs_io_mem_size(64U);
+
+  assert(!sajs_io_mem_size(SIZE_MAX / 2U));
+  assert(mem_size > 128U);
+  assert(mem_size <= sizeof(io_mem));
+  assert(!sajs_io_init(mem_size - 1U, io_mem, lexer, writer, 0U));
+
+  SajsIo* const io = sajs_io_init(mem_size, io_mem, lexer, writer, 0U);
+  assert(io);
+  assert(sajs_io_waiting(io) == SAJS_IO_READ);
+  assert(sajs_io_input(io).size == 64U);
+  assert(!sajs_io_output(io).length);
+
+  // Nothing can be dropped without output, or added too far
+  assert(sajs_io_drop_output(io, 1U) == SAJS_FAILURE);
+  assert(sajs_io_add_input(io, 65U) == SAJS_FAILURE);
+
+  // Input can't be added while there's still some left to read
+  memcpy(sajs_io_input(io).data, "[1, 2", 5U);
+  assert(sajs_io_add_input(io, 5U) == SAJS_RETRY);
+  assert(sajs_io_waiting(io) == (SAJS_IO_READ | SAJS_IO_WRITE));
+  assert(sajs_io_add_input(io, 0U) == SAJS_NO_DATA);
+  assert(!(sajs_io_waiting(io) & SAJS_IO_READ));
+  assert(sajs_io_add_input(io, 0U) == SAJS_FAILURE);
+}
+
+static void
+test_buffers(void)
+{
+  static char const* const doc = "{\"a\": [1, true, \"x\\ty\"], \"b\": {}}";
+
+  check_buffers(doc,
+                SAJS_WRITE_TERSE | SAJS_WRITE_NEWLINES,
+                SAJS_SUCCESS,
+                "{\"a\":[1,true,\"x\\ty\"],\"b\":{}}\n");
+
+  check_buffers(doc,
+                SAJS_WRITE_NEWLINES,
+                SAJS_SUCCESS,
+                "{\n  \"a\": [\n    1,\n    true,\n    \"x\\ty\"\n  ],\n"
+                "  \"b\": {\n  }\n}\n");
+
+  // Any number of values may be read, and a number may end the input
+  check_buffers("1 [2] \"3\" 4", 0U, SAJS_SUCCESS, "1[\n  2\n]\"3\"4");
+  check_buffers("", 0U, SAJS_SUCCESS, "");
+}
+
+static void
+test_errors(void)
+{
+  // Everything before an error is written
+  check_buffers("[1, 2, x]", SAJS_WRITE_TERSE, SAJS_EXPECTED_VALUE, "[1,2");
+  check_buffers("[1, 2", SAJS_WRITE_TERSE, SAJS_NO_DATA, "[1,2");
+
+  // Failed reads come after the existing statuses, which keep their values
+  assert(SAJS_BAD_WRITE == 6);
+  assert(SAJS_EXPECTED_VALUE == 21);
+  assert(SAJS_BAD_READ == SAJS_EXPECTED_VALUE + 1);
+  assert(!strcmp(sajs_strerror(SAJS_BAD_READ), "Failed read"));
+}
+
+static void
+test_long_strings(void)
+{
+  static char doc[4096U];
+  static char expected[4096U];
+
+  // Strings longer than the buffers are split across them
+  size_t length = 0U;
+  doc[length++] = '[';
+  for (unsigned i = 0U; i < 20U; ++i) {
+    length += (size_t)snprintf(doc + length,
+                               sizeof(doc) - length,
+                               "%s\"%0*u\"",
+                               i ? ", " : "",
+                               (int)(10U * i),
+                               i);
+  }
+
+  doc[length++] = ']';
+  doc[length]   = '\0';
+
+  size_t o = 0U;
+  for (size_t i = 0U; i < length; ++i) {
+    if (doc[i] != ' ') {
+      expected[o++] = doc[i];
+    }
+  }
+
+  expected[o] = '\0';
+  check_buffers(doc, SAJS_WRITE_TERSE, SAJS_SUCCESS, expected);
+}
+
+/// Make a non-blocking pipe
+static void
+open_pipe(int fds[2])
+{
+  assert(!pipe(fds));
+  assert(!fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK));
+  assert(!fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK));
+}
+
+/// Read everything available from a pipe into `text` and return its length
+static size_t
+drain_pipe(int const fd, size_t length)
+{
+  ssize_t n = 0;
+  while ((n = read(fd, text + length, sizeof(text) - length)) > 0) {
+    length += (size_t)n;
+  }
+
+  assert(n < 0 && errno == EAGAIN);
+  return length;
+}
+
+static void
+test_pump(void)
+{
+  static char const* const doc = "[1,{\"a\":true}]";
+
+  Driver driver;
+  setup(&driver, SAJS_WRITE_TERSE | SAJS_WRITE_NEWLINES);
+
+  SajsIoStats stats = {0U, 0U, 0U, 0U, 0U};
+  assert(!sajs_io_set_stats(driver.io, &stats));
+
+  int in[2]  = {-1, -1};
+  int out[2] = {-1, -1};
+  open_pipe(in);
+  open_pipe(out);
+
+  // Everything available is processed until reading blocks
+  assert(write(in[1], doc, 5U) == 5);
+  assert(sajs_io_pump(driver.io, in[0], out[1]) == SAJS_RETRY);
+  assert(sajs_io_waiting(driver.io) == SAJS_IO_READ);
+  assert(drain_pipe(out[0], 0U) == 5U);
+  assert(!memcmp(text, "[1,{\"", 5U));
+  assert(stats.reads == 2U);
+  assert(stats.blocked == 1U);
+  assert(stats.bytes_read == 5U);
+  assert(stats.writes == 1U);
+  assert(stats.bytes_written == 5U);
+
+  // Then continues with the rest when it arrives
+  assert(write(in[1], doc + 5U, strlen(doc) - 5U) > 0);
+  assert(!close(in[1]));
+  assert(sajs_io_pump(driver.io, in[0], out[1]) == SAJS_SUCCESS);
+  assert(!sajs_io_waiting(driver.io));
+  assert(drain_pipe(out[0], 5U) == strlen(doc) + 1U);
+  assert(!memcmp(text, "[1,{\"a\":true}]\n", strlen(doc) + 1U));
+  assert(stats.bytes_read == strlen(doc));
+  assert(stats.bytes_written == strlen(doc) + 1U);
+
+  // Failed reads and writes are reported
+  sajs_io_reset(driver.io);
+  assert(sajs_io_pump(driver.io, in[0], out[1]) == SAJS_SUCCESS);
+  assert(sajs_io_pump(driver.io, -1, out[1]) == SAJS_SUCCESS);
+  sajs_io_reset(driver.io);
+  assert(sajs_io_pump(driver.io, -1, out[1]) == SAJS_BAD_READ);
+  assert(errno == EBADF);
+
+  sajs_io_reset(driver.io);
+  memcpy(sajs_io_input(driver.io).data, "[1", 2U);
+  assert(sajs_io_add_input(driver.io, 2U) == SAJS_RETRY);
+  assert(sajs_io_pump(driver.io, in[0], -1) == SAJS_BAD_WRITE);
+  assert(errno == EBADF);
+
+  assert(!close(in[0]));
+  assert(!close(out[0]));
+  assert(!close(out[1]));
+}
+
+static void
+test_pump_blocked(void)
+{
+  static char doc[65536U];
+  static char expected[262144U];
+
+  Driver driver;
+  setup(&driver, SAJS_WRITE_NEWLINES);
+
+  // A document with output that's much larger than a pipe buffer
+  size_t doc_length      = 0U;
+  size_t expected_length = 2U;
+  doc[doc_length++]      = '[';
+  memcpy(expected, "[\n", expected_length);
+  for (unsigned i = 0U; i < 10000U; ++i) {
+    doc_length += (size_t)snprintf(
+      doc + doc_length, sizeof(doc) - doc_length, "%s%u", i ? "," : "", i);
+
+    expected_length += (size_t)snprintf(expected + expected_length,
+                                        sizeof(expected) - expected_length,
+                                        "%s  %u",
+                                        i ? ",\n" : "",
+                                        i);
+  }
+
+  doc[doc_length++] = ']';
+  memcpy(expected + expected_length, "\n]\n", 3U);
+  expected_length += 3U;
+
+  int in[2]  = {-1, -1};
+  int out[2] = {-1, -1};
+  open_pipe(in);
+  open_pipe(out);
+
+  // Feed the input and drain the output until both are done
+  bool       blocked = false;
+  size_t     offset  = 0U;
+  size_t     length  = 0U;
+  SajsStatus st      = SAJS_RETRY;
+  while (st == SAJS_RETRY) {
+    if (offset < doc_length) {
+      ssize_t const n = write(in[1], doc + offset, doc_length - offset);
+      offset += (n > 0) ? (size_t)n : 0U;
+      if (offset == doc_length) {
+        assert(!close(in[1]));
+      }
+    }
+
+    st      = sajs_io_pump(driver.io, in[0], out[1]);
+    blocked = blocked || (sajs_io_waiting(driver.io) & SAJS_IO_WRITE);
+    length  = drain_pipe(out[0], length);
+  }
+
+  assert(st == SAJS_SUCCESS);
+  assert(blocked);
+  assert(length == expected_length);
+  assert(!memcmp(text, expected, length));
+
+  assert(!close(in[0]));
+  assert(!close(out[0]));
+  assert(!close(out[1]));
+}
+
+int
+main(void)
+{
+  test_init();
+  test_buffers();
+  test_errors();
+  test_long_strings();
+  test_pump();
+  test_pump_blocked();
+  return 0;
+}
@@ -0,0 +1,159 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_NAMES 16U
+#define UNKNOWN SIZE_MAX
+
+static char const* const key_list[] = {
+  "b", "ab", "a", "abc", "", "\xC3\xA9t\xC3\xA9", "a\nb", "abd",
+};
+
+/// Make a dictionary with every key in the list
+static SajsKeys*
+make_keys(size_t const mem_size, void* const mem)
+{
+  SajsKeys* const keys = sajs_keys_init(mem_size, mem);
+  assert(keys);
+
+  for (size_t i = 0U; i < sizeof(key_list) / sizeof(key_list[0]); ++i) {
+    assert(!sajs_keys_add(keys, strlen(key_list[i]), key_list[i]));
+  }
+
+  return keys;
+}
+
+/// Read a document in pieces of `step` bytes, and return the number of names
+static size_t
+read_ids(SajsKeys* const   keys,
+         char const* const doc,
+         size_t const      step,
+         size_t* const     ids)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer     = sajs_lexer_init(sizeof(mem), mem);
+  size_t const     length    = strlen(doc);
+  size_t           num_names = 0U;
+
+  for (size_t offset = 0U; offset <= length;) {
+    size_t const    end   = (length - offset < step) ? length : (offset + step);
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_read_spans(lexer, end - offset, doc + offset, &count);
+
+    offset += count;
+    if (e.status) {
+      assert(e.status == SAJS_FAILURE);
+      break;
+    }
+
+    if (e.type) {
+      size_t const id = sajs_keys_match(keys, e, sajs_string(lexer));
+      if (e.type == SAJS_EVENT_END && e.kind == SAJS_STRING &&
+          num_names < MAX_NAMES) {
+        ids[num_names++] = id;
+      } else {
+        assert(id == UNKNOWN);
+      }
+    }
+  }
+
+  return num_names;
+}
+
+/// Check the IDs of the strings in a document, at every step size
+static void
+check_ids(SajsKeys* const     keys,
+          char const* const   doc,
+          size_t const        num_ids,
+          size_t const* const expected)
+{
+  for (size_t step = 1U; step <= strlen(doc); ++step) {
+    size_t ids[MAX_NAMES];
+
+    assert(read_ids(keys, doc, step, ids) == num_ids);
+    for (size_t i = 0U; i < num_ids; ++i) {
+      assert(ids[i] == expected[i]);
+    }
+  }
+}
+
+static void
+test_keys(void)
+{
+  uintptr_t       mem[64U];
+  SajsKeys* const keys = make_keys(sizeof(mem), mem);
+
+  // Prefixes of each other, escapes, and UTF-8
+  static char const* const doc =
+    "{\"a\": 1, \"ab\": 2, \"abc\": 3, \"abcd\": 4, \"\": {\"b\": [\"a\"]}, "
+    "\"\\u00e9t\\u00E9\": 5, \"\xC3\xA9t\xC3\xA9\": 6, \"\xC3\xA9t\": 7, "
+    "\"a\\nb\": 8, \"\\u0061b\\u0064\": 9, \"abe\": 10, \"c\": 11}";
+
+  static size_t const ids[] = {
+    2U, 1U, 3U, UNKNOWN, 4U, 0U, UNKNOWN, 5U, 5U, UNKNOWN, 6U, 7U, UNKNOWN,
+    UNKNOWN,
+  };
+
+  check_ids(keys, doc, sizeof(ids) / sizeof(ids[0]), ids);
+
+  // Strings that aren't member names are never matched
+  static char const* const values      = "[\"a\", {\"ab\": \"abc\"}] \"b\"";
+  static size_t const      value_ids[] = {UNKNOWN, 1U, UNKNOWN, UNKNOWN};
+
+  check_ids(keys, values, 4U, value_ids);
+}
+
+static void
+test_single_key(void)
+{
+  uintptr_t       mem[8U];
+  SajsKeys* const keys = sajs_keys_init(sizeof(mem), mem);
+
+  // Nothing matches an empty dictionary
+  static char const* const doc        = "{\"key\": 1, \"k\": 2, \"keys\": 3}";
+  static size_t const      none_ids[] = {UNKNOWN, UNKNOWN, UNKNOWN};
+  check_ids(keys, doc, 3U, none_ids);
+
+  // The only candidate is compared directly
+  assert(!sajs_keys_add(keys, 3U, "key"));
+  static size_t const ids[] = {0U, UNKNOWN, UNKNOWN};
+  check_ids(keys, doc, 3U, ids);
+}
+
+static void
+test_keys_errors(void)
+{
+  uintptr_t mem[8U];
+
+  // Too small for even one key
+  assert(!sajs_keys_init(sizeof(uint32_t), mem));
+
+  // Already added
+  SajsKeys* const keys = sajs_keys_init(sizeof(mem), mem);
+  assert(!sajs_keys_add(keys, 1U, "a"));
+  assert(sajs_keys_add(keys, 1U, "a") == SAJS_FAILURE);
+
+  // Not enough space for another entry, or its text
+  assert(sajs_keys_add(keys, 32U, "abcdefghijklmnopqrstuvwxyz012345") ==
+         SAJS_OVERFLOW);
+  assert(!sajs_keys_add(keys, 1U, "b"));
+  assert(sajs_keys_add(keys, 1U, "c") == SAJS_OVERFLOW);
+}
+
+int
+main(void)
+{
+  test_keys();
+  test_single_key();
+  test_keys_errors();
+  return 0;
+}
@@ -0,0 +1,206 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// A summary of everything handled, and when to stop
+typedef struct {
+  char   text[256U];
+  size_t length;
+  size_t num_calls;
+  size_t stop_call;
+} Summary;
+
+static void
+append(Summary* const summary, size_t const length, char const* const text)
+{
+  assert(summary->length + length < sizeof(summary->text));
+  memcpy(summary->text + summary->length, text, length);
+  summary->length += length;
+  summary->text[summary->length] = '\0';
+}
+
+static SajsStatus
+next_call(Summary* const summary)
+{
+  return (++summary->num_calls == summary->stop_call) ? SAJS_RETRY
+                                                      : SAJS_SUCCESS;
+}
+
+static SajsStatus
+on_start(void* const handle, SajsValueKind const kind)
+{
+  Summary* const summary = (Summary*)handle;
+  append(summary, 1U, (kind == SAJS_OBJECT) ? "{" : "[");
+  return next_call(summary);
+}
+
+static SajsStatus
+on_end(void* const handle, SajsValueKind const kind)
+{
+  Summary* const summary = (Summary*)handle;
+  append(summary, 1U, (kind == SAJS_OBJECT) ? "}" : "]");
+  return next_call(summary);
+}
+
+static SajsStatus
+on_name(void* const handle, SajsStringView const bytes, bool const last)
+{
+  Summary* const summary = (Summary*)handle;
+  append(summary, bytes.length, bytes.data);
+  append(summary, last ? 1U : 0U, "=");
+  return next_call(summary);
+}
+
+static SajsStatus
+on_string(void* const handle, SajsStringView const bytes, bool const last)
+{
+  Summary* const summary = (Summary*)handle;
+  append(summary, bytes.length, bytes.data);
+  append(summary, last ? 1U : 0U, "$");
+  return next_call(summary);
+}
+
+static SajsStatus
+on_number(void* const handle, SajsNumber const number)
+{
+  Summary* const summary = (Summary*)handle;
+  char           text[32U];
+  int const      n = snprintf(text, sizeof(text), "#%g", number.real);
+
+  assert(n > 0);
+  append(summary, (size_t)n, text);
+  return next_call(summary);
+}
+
+static SajsStatus
+on_literal(void* const handle, char const literal)
+{
+  Summary* const summary = (Summary*)handle;
+  append(summary, 1U, &literal);
+  return next_call(summary);
+}
+
+static SajsHandlers const handlers = {
+  on_start, on_end, on_name, on_string, on_number, on_literal};
+
+/// Lex a document in pieces of `step` bytes, and return the final status
+static SajsStatus
+lex_doc(char const* const         doc,
+        size_t const              step,
+        SajsHandlers const* const funcs,
+        Summary* const            summary,
+        size_t* const             offset)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  size_t const     length = strlen(doc);
+
+  summary->length    = 0U;
+  summary->num_calls = 0U;
+  summary->text[0]   = '\0';
+  for (*offset = 0U; *offset <= length;) {
+    size_t const     left  = length - *offset;
+    size_t const     n     = (left < step) ? left : step;
+    size_t           count = 0U;
+    SajsStatus const st =
+      sajs_lex(lexer, n, doc + *offset, &count, funcs, summary);
+
+    assert(count <= n);
+    *offset += count;
+    if (st) {
+      return st;
+    }
+
+    assert(count == n);
+  }
+
+  return SAJS_SUCCESS;
+}
+
+/// Check that a document is summarized correctly however it's split up
+static void
+check_lex(char const* const doc, char const* const expected)
+{
+  Summary summary = {{0}, 0U, 0U, 0U};
+  size_t  offset  = 0U;
+  for (size_t step = 1U; step <= strlen(doc); ++step) {
+    assert(lex_doc(doc, step, &handlers, &summary, &offset) == SAJS_FAILURE);
+    if (strcmp(summary.text, expected)) {
+      (void)fprintf(
+        stderr, "Expected: %s\nActual:   %s\n", expected, summary.text);
+      assert(false);
+    }
+  }
+}
+
+static void
+test_lex(void)
+{
+  check_lex("{\"a\": [1, \"b\\tc\", true, null, {}], \"d\": -2.5e1}",
+            "{a=[#1b\tc$tn{}]d=#-25}");
+
+  check_lex("[[], [false, 2], {\"\": \"\"}]", "[[][f#2]{=$}]");
+  check_lex("1 \"two\" [3] {\"\\u0066\": 4}", "#1two$[#3]{f=#4}");
+  check_lex("  ", "");
+}
+
+static void
+test_lex_stop(void)
+{
+  static char const* const doc = "{\"a\": [1, \"b\"]}";
+
+  // Any handler can stop reading just after what it's called for
+  Summary summary = {{0}, 0U, 0U, 0U};
+  size_t  offset  = 0U;
+  for (size_t i = 1U; i <= 8U; ++i) {
+    summary.stop_call = i;
+    assert(lex_doc(doc, strlen(doc), &handlers, &summary, &offset) ==
+           SAJS_RETRY);
+    assert(summary.num_calls == i);
+  }
+
+  summary.stop_call = 5U; // After "1"
+  assert(lex_doc(doc, strlen(doc), &handlers, &summary, &offset) ==
+         SAJS_RETRY);
+  assert(offset == 9U);
+
+  // Null handlers are ignored
+  SajsHandlers const names = {NULL, NULL, on_name, NULL, NULL, NULL};
+  summary.stop_call        = 0U;
+  assert(lex_doc(doc, 4U, &names, &summary, &offset) == SAJS_FAILURE);
+  assert(!strcmp(summary.text, "a="));
+}
+
+static void
+test_lex_errors(void)
+{
+  Summary summary = {{0}, 0U, 0U, 0U};
+  size_t  offset  = 0U;
+
+  assert(lex_doc("[1, 2 3]", 8U, &handlers, &summary, &offset) ==
+         SAJS_EXPECTED_COMMA);
+  assert(offset == 6U);
+  assert(!strcmp(summary.text, "[#1#2"));
+
+  assert(lex_doc("{\"a\": ", 8U, &handlers, &summary, &offset) ==
+         SAJS_NO_DATA);
+}
+
+int
+main(void)
+{
+  test_lex();
+  test_lex_stop();
+  test_lex_errors();
+  return 0;
+}
@@ -0,0 +1,177 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// Read the number in a single-element array, in chunks
+static SajsNumber
+read_number(char const* const input, size_t const chunk_size, bool const spans)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+
+  size_t const length = strlen(input);
+  size_t       offset = 0U;
+  SajsEvent    e      = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, SAJS_ARRAY, 0U};
+  while (e.type != SAJS_EVENT_DOUBLE_END) {
+    size_t const end =
+      (offset + chunk_size < length) ? (offset + chunk_size) : length;
+
+    size_t count = 0U;
+    e = spans ? sajs_read_spans(lexer, end - offset, input + offset, &count)
+              : sajs_read_buffer(lexer, end - offset, input + offset, &count);
+
+    assert(!e.status);
+    offset += count;
+  }
+
+  return sajs_number(lexer);
+}
+
+static bool
+same_real(double const a, double const b)
+{
+  return !memcmp(&a, &b, sizeof(double));
+}
+
+/// Check that a number is read the same way with every reading method
+static SajsNumber
+check(char const* const number)
+{
+  char         input[128U] = {'['};
+  size_t const length      = strlen(number);
+  assert(length + 3U < sizeof(input));
+  memcpy(input + 1U, number, length);
+  input[length + 1U] = ']';
+
+  SajsNumber const result = read_number(input, length + 2U, false);
+  for (size_t chunk_size = 1U; chunk_size <= length + 2U; ++chunk_size) {
+    for (unsigned spans = 0U; spans < 2U; ++spans) {
+      SajsNumber const other = read_number(input, chunk_size, spans);
+      assert(same_real(other.real, result.real));
+      assert(other.magnitude == result.magnitude);
+      assert(other.flags == result.flags);
+    }
+  }
+
+  return result;
+}
+
+static void
+check_integer(char const* const     number,
+              uint64_t const        magnitude,
+              SajsNumberFlags const flags)
+{
+  SajsNumber const result = check(number);
+  assert(result.magnitude == magnitude);
+  assert(result.flags == (SAJS_NUMBER_INTEGER | flags));
+}
+
+static void
+check_real(char const* const     number,
+           double const          real,
+           SajsNumberFlags const flags)
+{
+  SajsNumber const result = check(number);
+  assert(same_real(result.real, real));
+  assert(result.flags == flags);
+}
+
+static void
+test_integers(void)
+{
+  check_integer("0", 0U, 0U);
+  check_integer("-0", 0U, SAJS_NUMBER_NEGATIVE);
+  check_integer("7", 7U, 0U);
+  check_integer("-42", 42U, SAJS_NUMBER_NEGATIVE);
+  check_integer("9007199254740993", 9007199254740993U, 0U);
+  check_integer("9223372036854775808", 9223372036854775808U, 0U);
+  check_integer(
+    "-9223372036854775808", 9223372036854775808U, SAJS_NUMBER_NEGATIVE);
+  check_integer("18446744073709551615", UINT64_MAX, 0U);
+
+  // Integers that are too large still have a real value
+  check_integer("18446744073709551616", UINT64_MAX, SAJS_NUMBER_OVERFLOW);
+  check_integer("184467440737095516150", UINT64_MAX, SAJS_NUMBER_OVERFLOW);
+  assert(check("18446744073709551616").real == 18446744073709551616.0);
+
+  assert(same_real(check("-0").real, -0.0));
+  assert(same_real(check("9007199254740993").real, 9007199254740992.0));
+}
+
+static void
+test_reals(void)
+{
+  check_real("0.0", 0.0, 0U);
+  check_real("-0.0", -0.0, SAJS_NUMBER_NEGATIVE);
+  check_real("0.5", 0.5, 0U);
+  check_real("-1.25", -1.25, SAJS_NUMBER_NEGATIVE);
+  check_real("0.1", 0.1, 0U);
+  check_real("0.3", 0.3, 0U);
+  check_real("1e23", 1e23, 0U);
+  check_real("1E+2", 100.0, 0U);
+  check_real("1.5E3", 1500.0, 0U);
+  check_real("1.5e-3", 1.5e-3, 0U);
+  check_real("123.456e78", 123.456e78, 0U);
+  check_real("7.3177701707893310e+15", 7.3177701707893310e+15, 0U);
+  check_real("0.00000000000000000000000000000000000001", 1e-38, 0U);
+  check_real("1e0000000000000000000000000000000000002", 100.0, 0U);
+
+  // Exactly halfway between two doubles, which rounds to even
+  check_real("9007199254740993.0", 9007199254740992.0, 0U);
+  check_real("9007199254740995e0", 9007199254740996.0, 0U);
+  check_real("4503599627370496.5", 4503599627370496.0, 0U);
+  check_real("4503599627370497.5", 4503599627370498.0, 0U);
+
+  // Limits
+  check_real("1.7976931348623157e308", 1.7976931348623157e308, 0U);
+  check_real("2.2250738585072014e-308", 2.2250738585072014e-308, 0U);
+  check_real("2.2250738585072011e-308", 2.2250738585072011e-308, 0U);
+  check_real("4.9e-324", 4.9e-324, 0U);
+  check_real("2.4703282292062328e-324", 4.9e-324, 0U);
+  check_real("2.4703282292062327e-324", 0.0, 0U);
+  check_real("1e-400", 0.0, 0U);
+  check_real("-1e-400", -0.0, SAJS_NUMBER_NEGATIVE);
+  check_real("0e400", 0.0, 0U);
+
+  // Overflow to infinity
+  SajsNumber const huge = check("-1.8e308");
+  assert(huge.flags == (SAJS_NUMBER_NEGATIVE | SAJS_NUMBER_OVERFLOW));
+  assert(huge.real < -1.7976931348623157e308);
+  assert(check("1e309").flags == SAJS_NUMBER_OVERFLOW);
+
+  // More significant digits than fit in the significand
+  check_real("3.14159265358979323846264338327950288", 3.141592653589793, 0U);
+  check_real("123456789012345678901234567890e-10", 12345678901234567890.0, 0U);
+  check_real("0.000000000000000000000000000000000000000000000000000001234"
+             "5678901234567890123456789",
+             1.2345678901234568e-54,
+             0U);
+}
+
+static void
+test_inexact(void)
+{
+  // Too close to halfway to tell with 64 bits of significand
+  SajsNumber const result = check("9007199254740993.000000000000000000000001");
+  assert(result.flags == SAJS_NUMBER_INEXACT);
+  assert(result.real == 9007199254740992.0 ||
+         result.real == 9007199254740994.0);
+}
+
+int
+main(void)
+{
+  test_integers();
+  test_reals();
+  test_inexact();
+  return 0;
+}
@@ -6,6 +6,7 @@
 """Test that JSON input is successfully parsed.
 
 The input is read via stdin to avoid filesystem access for testing in node.
+If an error is given, then the input must fail with exactly that message.
 """
 
 import argparse
@@ -20,21 +21,43 @@ def main():
 
     parser = argparse.ArgumentParser(description=__doc__)
     parser.add_argument("--tool", default="test/test_sajs", help="executable")
+    parser.add_argument("--ndjson", action="store_true", help="NDJSON mode")
+    parser.add_argument("--jobs", type=int, default=1, help="threads")
+    parser.add_argument("--validate", action="store_true", help="only check")
+    parser.add_argument("--error", help="expected error message")
     parser.add_argument("input", help="valid JSON input file")
     args = parser.parse_args(sys.argv[1:])
 
     wrapper = shlex.split(os.environ.get("MESON_EXE_WRAPPER", ""))
     command = wrapper + [args.tool]
+    if args.ndjson:
+        command += ["-l"]
+    if args.jobs > 1:
+        command += ["-j", str(args.jobs)]
+    if args.validate:
+        command += ["-n"]
 
     with open(args.input, "r", encoding="utf-8") as in_file:
         proc = subprocess.run(
             command,
-            check=True,
+            check=args.error is None,
             stdin=in_file,
             stdout=subprocess.DEVNULL,
             stderr=subprocess.PIPE,
         )
 
+        if args.error is not None:
+            expected = "error: " + args.error + "\n"
+            output = proc.stderr.decode("utf-8")
+            if proc.returncode == 0 or output != expected:
+                sys.stderr.write("error: Expected error output:\n")
+                sys.stderr.write(expected)
+                sys.stderr.write("error: But got:\n")
+                sys.stderr.write(output)
+                return 1
+
+            return 0
+
         if len(proc.stderr):
             sys.stderr.write("error: Output written to stderr on success:\n")
             sys.stderr.write(proc.stderr.decode("utf-8"))
@@ -0,0 +1,161 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NUM_SLABS 4U
+#define MAX_DEPTH 40U
+
+/// Return the status of reading a whole document with a lexer
+static SajsStatus
+read_doc(SajsLexer* const lexer, size_t const length, char const* const doc)
+{
+  size_t offset = 0U;
+
+  SajsEvent e = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, SAJS_OBJECT, 0U};
+  while (!e.status) {
+    size_t count = 0U;
+    e = sajs_read_buffer(lexer, length - offset, doc + offset, &count);
+    offset += count;
+  }
+
+  return e.status;
+}
+
+static void
+test_mem_size(void)
+{
+  size_t const one = sajs_pool_mem_size(1U, MAX_DEPTH);
+  size_t const two = sajs_pool_mem_size(2U, MAX_DEPTH);
+
+  assert(one > MAX_DEPTH + 64U);
+  assert(two - one >= 128U);
+  assert(!sajs_pool_mem_size(SIZE_MAX, MAX_DEPTH));
+  assert(!sajs_pool_mem_size(1U, SIZE_MAX));
+}
+
+static void
+test_pool(void)
+{
+  static uintptr_t mem[2048U / sizeof(uintptr_t)];
+
+  size_t const mem_size = sajs_pool_mem_size(NUM_SLABS, MAX_DEPTH);
+  assert(mem_size + sizeof(uintptr_t) <= sizeof(mem));
+  assert(!sajs_pool_init(mem_size, mem, 1U << 16U));
+  assert(!sajs_pool_init(8U, mem, MAX_DEPTH));
+
+  // Start the pool at an odd word to check that slabs are aligned anyway
+  SajsPool* const pool = sajs_pool_init(mem_size, mem + 1U, MAX_DEPTH);
+  assert(pool);
+
+  SajsLexer*  lexers[NUM_SLABS];
+  SajsWriter* writers[NUM_SLABS];
+  for (size_t i = 0U; i < NUM_SLABS; ++i) {
+    assert(!sajs_pool_acquire(pool, &lexers[i], &writers[i]));
+    assert(!((uintptr_t)lexers[i] % 64U));
+    assert((uintptr_t)writers[i] > (uintptr_t)lexers[i] + MAX_DEPTH);
+    assert((uint8_t*)writers[i] + 64U <= (uint8_t*)(mem + 1U) + mem_size);
+    for (size_t j = 0U; j < i; ++j) {
+      uintptr_t const a = (uintptr_t)lexers[i];
+      uintptr_t const b = (uintptr_t)lexers[j];
+      assert((a > b ? a - b : b - a) >= 128U);
+    }
+  }
+
+  // Every slab is in use
+  SajsLexer*  lexer  = NULL;
+  SajsWriter* writer = NULL;
+  assert(sajs_pool_acquire(pool, &lexer, &writer) == SAJS_OVERFLOW);
+
+  // Each lexer has room for the full depth
+  char doc[2U * MAX_DEPTH];
+  memset(doc, '[', MAX_DEPTH - 1U);
+  memset(doc + MAX_DEPTH - 1U, ']', MAX_DEPTH - 1U);
+  for (size_t i = 0U; i < NUM_SLABS; ++i) {
+    assert(read_doc(lexers[i], 2U * (MAX_DEPTH - 1U), doc) == SAJS_FAILURE);
+  }
+
+  // Only lexers from the pool can be released
+  assert(sajs_pool_release(pool, (SajsLexer*)mem) == SAJS_FAILURE);
+  assert(sajs_pool_release(pool, (SajsLexer*)writers[0]) == SAJS_FAILURE);
+  for (size_t i = 0U; i < NUM_SLABS; ++i) {
+    assert(!sajs_pool_release(pool, lexers[i]));
+  }
+
+  assert(sajs_pool_release(pool, lexers[0]) == SAJS_UNDERFLOW);
+}
+
+static void
+test_no_depth(void)
+{
+  static uintptr_t mem[1024U / sizeof(uintptr_t)];
+
+  SajsPool* const pool   = sajs_pool_init(sizeof(mem), mem, 0U);
+  SajsLexer*      lexer  = NULL;
+  SajsWriter*     writer = NULL;
+  assert(pool);
+
+  // Slabs still have a whole lexer, which overflows rather than nesting deep
+  char doc[MAX_DEPTH];
+  memset(doc, '[', sizeof(doc));
+  assert(!sajs_pool_acquire(pool, &lexer, &writer));
+  assert(read_doc(lexer, 2U, "1 ") == SAJS_FAILURE);
+  assert(!sajs_pool_release(pool, lexer));
+  assert(!sajs_pool_acquire(pool, &lexer, &writer));
+  assert(read_doc(lexer, sizeof(doc), doc) == SAJS_OVERFLOW);
+}
+
+static void
+test_reuse(void)
+{
+  static uintptr_t mem[1024U / sizeof(uintptr_t)];
+
+  SajsPool* const pool  = sajs_pool_init(sizeof(mem), mem, MAX_DEPTH);
+  SajsLexer*      lexer = NULL;
+  SajsWriter*     first = NULL;
+  SajsWriter*     again = NULL;
+  size_t          count = 0U;
+  assert(pool);
+
+  // Leave a document unfinished in both the lexer and writer
+  assert(!sajs_pool_acquire(pool, &lexer, &first));
+
+  SajsEvent const e = sajs_read_buffer(lexer, 3U, "[1,", &count);
+  assert(e.type == SAJS_EVENT_START);
+  assert(!sajs_write_event(first, e, sajs_string(lexer)).status);
+  assert(!sajs_pool_release(pool, lexer));
+
+  // The last slab released is acquired next, and everything is reset
+  SajsLexer* const old = lexer;
+  assert(!sajs_pool_acquire(pool, &lexer, &again));
+  assert(lexer == old);
+  assert(again == first);
+  assert(!sajs_lexer_depth(lexer));
+
+  SajsEvent const f = sajs_read_buffer(lexer, 2U, "{}", &count);
+  assert(f.type == SAJS_EVENT_START);
+  assert(f.kind == SAJS_OBJECT);
+  assert(f.flags & SAJS_IS_ROOT);
+
+  SajsTextOutput const out = sajs_write_event(again, f, sajs_string(lexer));
+  assert(!out.status);
+  assert(out.prefix == SAJS_PREFIX_NONE);
+}
+
+int
+main(void)
+{
+  test_mem_size();
+  test_pool();
+  test_no_depth();
+  test_reuse();
+  return 0;
+}
@@ -0,0 +1,161 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// A method of reading a document
+typedef enum {
+  METHOD_BYTE,
+  METHOD_BUFFER,
+  METHOD_SPANS,
+  METHOD_VALIDATE,
+} Method;
+
+/// Read a document in pieces of `step` bytes, and return the final status
+static SajsStatus
+read_doc(SajsLexer* const    lexer,
+         char const* const   doc,
+         Method const        method,
+         size_t const        step,
+         SajsPosition* const position)
+{
+  size_t const length = strlen(doc);
+
+  sajs_lexer_reset(lexer);
+  assert(!sajs_lexer_set_position(lexer, position));
+
+  SajsStatus st = SAJS_SUCCESS;
+  for (size_t offset = 0U; !st || st == SAJS_RETRY;) {
+    size_t const left  = length - offset;
+    size_t const n     = (left < step) ? left : step;
+    size_t       count = 0U;
+
+    if (method == METHOD_BYTE) {
+      st    = sajs_read_byte(lexer, n ? (uint8_t)doc[offset] : -1).status;
+      count = (n && !st) ? 1U : 0U;
+    } else if (method == METHOD_BUFFER) {
+      st = sajs_read_buffer(lexer, n, doc + offset, &count).status;
+    } else if (method == METHOD_SPANS) {
+      st = sajs_read_spans(lexer, n, doc + offset, &count).status;
+    } else {
+      st = sajs_validate(lexer, n, doc + offset, &count);
+    }
+
+    offset += count;
+    assert(position->offset == offset);
+  }
+
+  return st;
+}
+
+/// Check the position of the end or error in a document read in every way
+static void
+check_position(char const* const doc,
+               SajsStatus const  status,
+               uint64_t const    offset,
+               uint64_t const    line,
+               uint64_t const    column)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  size_t const     length = strlen(doc);
+
+  for (unsigned m = METHOD_BYTE; m <= METHOD_VALIDATE; ++m) {
+    for (size_t step = 1U; step <= length; ++step) {
+      SajsPosition lines = {0U, 1U, 1U};
+      assert(read_doc(lexer, doc, (Method)m, step, &lines) == status);
+      assert(lines.offset == offset);
+      assert(lines.line == line);
+      assert(lines.column == column);
+
+      // Lines aren't counted unless asked for
+      SajsPosition offsets = {0U, 0U, 0U};
+      assert(read_doc(lexer, doc, (Method)m, step, &offsets) == status);
+      assert(offsets.offset == offset);
+      assert(!offsets.line);
+      assert(!offsets.column);
+    }
+  }
+}
+
+static void
+test_position(void)
+{
+  check_position("[1, 2]", SAJS_FAILURE, 6U, 1U, 7U);
+  check_position("[1,\n 2 3]", SAJS_EXPECTED_COMMA, 7U, 2U, 4U);
+  check_position("\n\n\"a\nb\"", SAJS_EXPECTED_PRINTABLE, 4U, 3U, 3U);
+  check_position(
+    "{\"a\":\n\n\ttrue,\n\"b\" 1}", SAJS_EXPECTED_COLON, 18U, 4U, 5U);
+  check_position("[\n", SAJS_NO_DATA, 2U, 2U, 1U);
+}
+
+static void
+test_long_lines(void)
+{
+  static char doc[1024U];
+
+  // Lines of different lengths, long enough to be counted a block at a time
+  size_t length = 0U;
+  doc[length++] = '[';
+  for (size_t i = 0U; i < 40U; ++i) {
+    memset(doc + length, ' ', i);
+    length += i;
+    doc[length++] = '\n';
+  }
+
+  memcpy(doc + length, "  1,\n  x]", 10U);
+  check_position(doc, SAJS_EXPECTED_VALUE, length + 7U, 42U, 3U);
+}
+
+static void
+test_skip(void)
+{
+  static char const* const doc = "[{\"a\":\n[1, 2]},\n \"b\"]";
+
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer    = sajs_lexer_init(sizeof(mem), mem);
+  SajsPosition     position = {0U, 1U, 1U};
+  size_t           count    = 0U;
+
+  assert(!sajs_lexer_set_position(lexer, &position));
+  assert(sajs_read_buffer(lexer, 1U, doc, &count).type == SAJS_EVENT_START);
+  assert(sajs_read_buffer(lexer, 1U, doc + 1U, &count).kind == SAJS_OBJECT);
+
+  // Skipped input is counted like everything else
+  assert(!sajs_skip_value(lexer, strlen(doc) - 2U, doc + 2U, &count));
+  assert(position.offset == 14U);
+  assert(position.line == 2U);
+  assert(position.column == 8U);
+
+  // The position is left alone once it's cleared
+  assert(!sajs_lexer_set_position(lexer, NULL));
+  assert(!sajs_read_buffer(lexer, 3U, doc + 14U, &count).status);
+  assert(position.offset == 14U);
+}
+
+int
+main(void)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer    = sajs_lexer_init(sizeof(mem), mem);
+  SajsPosition     position = {0U, 1U, 1U};
+
+  // Clearing the position always works
+  assert(!sajs_lexer_set_position(lexer, NULL));
+  if (sajs_lexer_set_position(lexer, &position)) {
+    return 0; // Positions aren't supported in this build
+  }
+
+  test_position();
+  test_long_lines();
+  test_skip();
+  return 0;
+}
@@ -0,0 +1,429 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static bool
+events_equal(SajsEvent const a, SajsEvent const b)
+{
+  return a.status == b.status && a.type == b.type && a.kind == b.kind &&
+         a.flags == b.flags;
+}
+
+static bool
+strings_equal(SajsStringView const a, SajsStringView const b)
+{
+  return a.length == b.length && !memcmp(a.data, b.data, a.length);
+}
+
+/// Check that reading a buffer produces the same events as reading bytes
+static void
+check_same_events(char const* const input)
+{
+  uintptr_t byte_mem[16U];
+  uintptr_t buffer_mem[16U];
+
+  SajsLexer* const byte_lexer = sajs_lexer_init(sizeof(byte_mem), byte_mem);
+  SajsLexer* const buffer_lexer =
+    sajs_lexer_init(sizeof(buffer_mem), buffer_mem);
+
+  size_t const length = strlen(input);
+  size_t       offset = 0U;
+  size_t       i      = 0U;
+  SajsStatus   st     = SAJS_SUCCESS;
+  while (!st) {
+    // Read bytes until the next event from the byte-wise lexer
+    SajsEvent e = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, (SajsValueKind)0U, 0U};
+    while (!e.status && !e.type) {
+      e = sajs_read_byte(byte_lexer, i < length ? (uint8_t)input[i] : -1);
+      i += (!e.status && i < length) ? 1U : 0U;
+    }
+
+    // Read the next event from the buffer-wise lexer
+    size_t          count = 0U;
+    SajsEvent const f     = sajs_read_buffer(
+      buffer_lexer, length - offset, input + offset, &count);
+
+    offset += count;
+    assert(events_equal(e, f));
+    assert(offset == i);
+    assert(strings_equal(sajs_string(byte_lexer), sajs_string(buffer_lexer)));
+    st = e.status;
+  }
+}
+
+static void
+test_same_events(void)
+{
+  check_same_events("");
+  check_same_events("[]");
+  check_same_events("{}");
+  check_same_events("12");
+  check_same_events("-1.5e+3 ");
+  check_same_events("\"a\\nb\\u0041\\uD834\\uDD1E\"");
+  check_same_events("[1,[2,3],{\"a\":4},true,null,false]");
+  check_same_events("{\"k\" : [ 1.0 , \"v\" ] }\n[]");
+  check_same_events("[1,,2]");
+  check_same_events("[true,fals]");
+  check_same_events("{\"a\"}");
+  check_same_events("[\n                                        1,\n"
+                    "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t{\"a\"\r\n"
+                    "                                      :2}\n"
+                    "                                                   ]");
+  check_same_events("[                                 \f]");
+}
+
+static void
+test_resume(void)
+{
+  static char const* const input = "[12, \"ab\"]";
+
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+
+  // Each call stops at the end of the buffer or after the next event
+  size_t    count = 0U;
+  SajsEvent e     = sajs_read_buffer(lexer, 2U, input, &count);
+  assert(!e.status);
+  assert(e.type == SAJS_EVENT_START);
+  assert(e.kind == SAJS_ARRAY);
+  assert(count == 1U);
+
+  e = sajs_read_buffer(lexer, 1U, input + 1U, &count);
+  assert(!e.status);
+  assert(e.type == SAJS_EVENT_START);
+  assert(e.kind == SAJS_NUMBER);
+  assert(count == 1U);
+
+  e = sajs_read_buffer(lexer, 1U, input + 2U, &count);
+  assert(!e.status);
+  assert(e.type == SAJS_EVENT_BYTES);
+  assert(count == 1U);
+  assert(sajs_string(lexer).length == 1U);
+  assert(sajs_string(lexer).data[0] == '2');
+
+  e = sajs_read_buffer(lexer, 8U, input + 3U, &count);
+  assert(!e.status);
+  assert(e.type == SAJS_EVENT_END);
+  assert(e.kind == SAJS_NUMBER);
+  assert(count == 1U);
+
+  // Whitespace produces nothing, so reading runs to the end of the buffer
+  e = sajs_read_buffer(lexer, 1U, input + 4U, &count);
+  assert(!e.status);
+  assert(e.type == SAJS_EVENT_NOTHING);
+  assert(count == 1U);
+}
+
+static void
+test_error_offset(void)
+{
+  static char const* const input = "[1 2]";
+
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  size_t           offset = 0U;
+  size_t           count  = 0U;
+  SajsEvent        e      = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, SAJS_ARRAY, 0U};
+  while (!e.status) {
+    e = sajs_read_buffer(lexer, 5U - offset, input + offset, &count);
+    offset += count;
+  }
+
+  assert(e.status == SAJS_EXPECTED_COMMA);
+  assert(offset == 3U);
+  assert(input[offset] == '2');
+}
+
+/// Append the text of all events read from input to a buffer
+static size_t
+read_text(char const* const input,
+          size_t const      chunk_size,
+          bool const        spans,
+          size_t const      buf_size,
+          char* const       buf)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+
+  size_t const length     = strlen(input);
+  size_t       offset     = 0U;
+  size_t       buf_length = 0U;
+  SajsStatus   st         = SAJS_SUCCESS;
+  while (!st) {
+    size_t const chunk_end =
+      ((offset / chunk_size) + 1U) * chunk_size < length
+        ? ((offset / chunk_size) + 1U) * chunk_size
+        : length;
+
+    size_t          count = 0U;
+    SajsEvent const e =
+      spans ? sajs_read_spans(
+                lexer, chunk_end - offset, input + offset, &count)
+            : sajs_read_buffer(
+                lexer, chunk_end - offset, input + offset, &count);
+
+    offset += count;
+    if (!(st = e.status) && (e.flags & SAJS_HAS_BYTES)) {
+      SajsStringView const string = sajs_string(lexer);
+      assert(buf_length + string.length < buf_size);
+      memcpy(buf + buf_length, string.data, string.length);
+      buf_length += string.length;
+    }
+  }
+
+  buf[buf_length] = '\0';
+  return buf_length;
+}
+
+static void
+check_spans(char const* const input, char const* const expected)
+{
+  char         buf[256U];
+  size_t const length = strlen(expected);
+
+  for (size_t chunk_size = 1U; chunk_size <= strlen(input); ++chunk_size) {
+    assert(read_text(input, chunk_size, false, sizeof(buf), buf) == length);
+    assert(!strcmp(buf, expected));
+    assert(read_text(input, chunk_size, true, sizeof(buf), buf) == length);
+    assert(!strcmp(buf, expected));
+  }
+}
+
+static void
+test_spans(void)
+{
+  check_spans("\"abc\"", "abc");
+  check_spans("\"a\\tb\\u0063\"", "a\tbc");
+  check_spans("[-12.5e+10,0.25,7,1E3]", "-12.5e+10" "0.25" "7" "1E3");
+  check_spans("[true,false,null]", "truefalsenull");
+  check_spans("{\"k\":\"v\\u00E9\"}", "kv\xC3\xA9");
+
+  static char const* const input = "[\"a long string\",12345,true]";
+
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+  size_t const     len   = strlen(input);
+  size_t           off   = 0U;
+  size_t           count = 0U;
+
+  // Array and string start
+  SajsEvent e = sajs_read_spans(lexer, len - off, input + off, &count);
+  assert(e.type == SAJS_EVENT_START && e.kind == SAJS_ARRAY);
+  off += count;
+  e = sajs_read_spans(lexer, len - off, input + off, &count);
+  assert(e.type == SAJS_EVENT_START && e.kind == SAJS_STRING);
+  off += count;
+
+  // The whole string body is one event pointing into the input
+  e = sajs_read_spans(lexer, len - off, input + off, &count);
+  assert(!e.status);
+  assert(e.type == SAJS_EVENT_BYTES);
+  assert(count == 13U);
+  assert(sajs_string(lexer).data == input + off);
+  assert(sajs_string(lexer).length == 13U);
+  off += count;
+
+  // String end, then the number start with its first digit
+  e = sajs_read_spans(lexer, len - off, input + off, &count);
+  assert(e.type == SAJS_EVENT_END && e.kind == SAJS_STRING);
+  off += count;
+  e = sajs_read_spans(lexer, len - off, input + off, &count);
+  assert(e.type == SAJS_EVENT_START && e.kind == SAJS_NUMBER);
+  off += count;
+
+  // The rest of the number is one event
+  e = sajs_read_spans(lexer, len - off, input + off, &count);
+  assert(e.type == SAJS_EVENT_BYTES);
+  assert(sajs_string(lexer).data == input + off);
+  assert(sajs_string(lexer).length == 4U);
+}
+
+static void
+test_long_strings(void)
+{
+  // Place a special character at every position in a long string
+  for (size_t i = 0U; i < 80U; ++i) {
+    char input[96U];
+    char expected[96U];
+    memset(input, 'a', sizeof(input));
+    memset(expected, 'a', sizeof(expected));
+
+    input[0U]     = '"';
+    input[1U + i] = '\\';
+    input[2U + i] = '"';
+    input[84U]    = '"';
+    input[85U]    = '\0';
+
+    expected[i]   = '"';
+    expected[82U] = '\0';
+    check_spans(input, expected);
+
+    // An unescaped control character is an error
+    uintptr_t        mem[16U];
+    SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+    size_t           offset = 0U;
+    size_t           count  = 0U;
+
+    SajsEvent e = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, SAJS_ARRAY, 0U};
+
+    input[1U + i] = '\t';
+    while (!e.status) {
+      e = sajs_read_spans(lexer, 85U - offset, input + offset, &count);
+      offset += count;
+    }
+
+    assert(e.status == SAJS_EXPECTED_PRINTABLE);
+    assert(offset == 1U + i);
+  }
+}
+
+static void
+test_continued(void)
+{
+  static char const* const input = "[\"ab\\ncd\", 123, true, \"\\u00E9\"]";
+
+  // Only bytes that reach the end of the buffer continue in the next one
+  size_t const length = strlen(input);
+  for (size_t chunk_size = 1U; chunk_size <= length; ++chunk_size) {
+    uintptr_t        mem[16U];
+    SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+    size_t           offset = 0U;
+
+    SajsEvent e = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, SAJS_ARRAY, 0U};
+    while (!e.status) {
+      size_t const end =
+        (length - offset < chunk_size) ? length : (offset + chunk_size);
+
+      size_t count = 0U;
+      e = sajs_read_spans(lexer, end - offset, input + offset, &count);
+      offset += count;
+
+      bool const continued = e.flags & SAJS_IS_CONTINUED;
+      assert(continued == (e.type == SAJS_EVENT_BYTES && offset == end));
+    }
+
+    assert(e.status == SAJS_FAILURE);
+  }
+
+  // Reading a buffer byte-wise doesn't set the flag
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+  size_t           count = 0U;
+  SajsEvent        e     = sajs_read_buffer(lexer, 2U, "\"a", &count);
+  assert(e.type == SAJS_EVENT_START);
+  e = sajs_read_buffer(lexer, 1U, "a", &count);
+  assert(e.type == SAJS_EVENT_BYTES);
+  assert(!(e.flags & SAJS_IS_CONTINUED));
+}
+
+static void
+test_roots(void)
+{
+  static char const* const input = "{\"a\":[1]}\n2\n[3]";
+
+  static SajsEvent const expected[] = {
+    {SAJS_SUCCESS, SAJS_EVENT_START, SAJS_OBJECT, SAJS_IS_ROOT},
+    {SAJS_SUCCESS, SAJS_EVENT_START, SAJS_STRING, 0U},
+    {SAJS_SUCCESS, SAJS_EVENT_END, SAJS_STRING, 0U},
+    {SAJS_SUCCESS, SAJS_EVENT_START, SAJS_ARRAY, 0U},
+    {SAJS_SUCCESS, SAJS_EVENT_START, SAJS_NUMBER, 0U},
+    {SAJS_SUCCESS, SAJS_EVENT_DOUBLE_END, SAJS_ARRAY, 0U},
+    {SAJS_SUCCESS, SAJS_EVENT_END, SAJS_OBJECT, SAJS_IS_ROOT},
+    {SAJS_SUCCESS, SAJS_EVENT_START, SAJS_NUMBER, SAJS_IS_ROOT},
+    {SAJS_SUCCESS, SAJS_EVENT_END, SAJS_NUMBER, SAJS_IS_ROOT},
+    {SAJS_SUCCESS, SAJS_EVENT_START, SAJS_ARRAY, SAJS_IS_ROOT},
+    {SAJS_SUCCESS, SAJS_EVENT_START, SAJS_NUMBER, 0U},
+    {SAJS_SUCCESS, SAJS_EVENT_DOUBLE_END, SAJS_ARRAY, SAJS_IS_ROOT},
+  };
+
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+
+  size_t const length = strlen(input);
+  size_t       offset = 0U;
+  size_t       n      = 0U;
+  SajsStatus   st     = SAJS_SUCCESS;
+  while (!st) {
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_read_buffer(lexer, length - offset, input + offset, &count);
+
+    offset += count;
+    if (!(st = e.status) && e.type != SAJS_EVENT_NOTHING &&
+        e.type != SAJS_EVENT_BYTES) {
+      assert(n < sizeof(expected) / sizeof(expected[0]));
+      assert(e.type == expected[n].type);
+      assert(e.kind == expected[n].kind);
+      assert((e.flags & SAJS_IS_ROOT) == expected[n].flags);
+      ++n;
+    }
+  }
+
+  assert(st == SAJS_FAILURE);
+  assert(n == sizeof(expected) / sizeof(expected[0]));
+}
+
+static void
+test_reset(void)
+{
+  static char const* const input = "[[\"\\u0";
+
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+
+  // Abandon a document part way through a string escape
+  size_t offset = 0U;
+  while (offset < 6U) {
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_read_buffer(lexer, 6U - offset, input + offset, &count);
+
+    assert(!e.status);
+    offset += count;
+  }
+
+  assert(sajs_lexer_depth(lexer) == 3U);
+  sajs_lexer_reset(lexer);
+  assert(!sajs_lexer_depth(lexer));
+
+  // Read a new document from the start
+  size_t    count = 0U;
+  SajsEvent e     = sajs_read_buffer(lexer, 2U, "7 ", &count);
+  assert(!e.status);
+  assert(e.type == SAJS_EVENT_START);
+  assert(e.kind == SAJS_NUMBER);
+  assert(e.flags & SAJS_IS_ROOT);
+  assert(sajs_lexer_depth(lexer) == 1U);
+
+  e = sajs_read_buffer(lexer, 1U, " ", &count);
+  assert(!e.status);
+  assert(e.type == SAJS_EVENT_END);
+  assert(e.flags & SAJS_IS_ROOT);
+  assert(!sajs_lexer_depth(lexer));
+
+  e = sajs_read_buffer(lexer, 0U, "", &count);
+  assert(e.status == SAJS_FAILURE);
+}
+
+int
+main(void)
+{
+  test_same_events();
+  test_resume();
+  test_error_offset();
+  test_spans();
+  test_long_strings();
+  test_continued();
+  test_roots();
+  test_reset();
+  return 0;
+}
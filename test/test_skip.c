@@ -0,0 +1,274 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_EVENTS 1024U
+#define NO_SKIP SIZE_MAX
+
+/// Events read from a document
+typedef struct {
+  SajsEvent events[MAX_EVENTS];
+  size_t    num_events;
+} EventLog;
+
+static char const* const docs[] = {
+  "[]",
+  "{}",
+  "[1,2,3]",
+  "[ 1 , 2 ,3 ]",
+  "[\"a,b\", \"\\\",\", {\"k\": [1, 2]}, \"x]\\\\\", 3, [], {}, true]",
+  "{\"a\": 1, \"b,\": [2, 3], \"\\\\\": {\"c\": \"}\"}, \"d\": null}",
+  "[[1, [2, 3]], {\"a\": [4, 5]}, \"[,]\", -6.5e7]",
+  "[1] {\"a\": \"}\"} 2 \"s\" null",
+  "[1] 23",
+};
+
+/**
+   Read a document in pieces of `step` bytes, skipping one value.
+
+   The value skipped is the one started by the START event with index `skip`,
+   counting from zero, which is logged before skipping.
+*/
+static SajsStatus
+read_doc(char const* const doc,
+         size_t const      step,
+         size_t const      skip,
+         EventLog* const   log)
+{
+  uintptr_t        mem[32U];
+  SajsLexer* const lexer    = sajs_lexer_init(sizeof(mem), mem);
+  size_t const     length   = strlen(doc);
+  size_t           starts   = 0U;
+  bool             skipping = false;
+
+  log->num_events = 0U;
+  for (size_t offset = 0U; offset < length;) {
+    size_t const end   = (length - offset < step) ? length : (offset + step);
+    size_t       count = 0U;
+    if (skipping) {
+      SajsStatus const st =
+        sajs_skip_value(lexer, end - offset, doc + offset, &count);
+
+      assert(count <= end - offset);
+      offset += count;
+      if (st && st != SAJS_RETRY) {
+        return st;
+      }
+
+      skipping = st == SAJS_RETRY;
+      continue;
+    }
+
+    SajsEvent const e =
+      sajs_read_buffer(lexer, end - offset, doc + offset, &count);
+
+    offset += count;
+    if (e.status) {
+      return e.status;
+    }
+
+    if (e.type) {
+      assert(log->num_events < MAX_EVENTS);
+      log->events[log->num_events++] = e;
+      skipping = e.type == SAJS_EVENT_START && starts++ == skip;
+    }
+  }
+
+  // Finish reading at the end of the input
+  size_t count = 0U;
+  if (skipping) {
+    SajsStatus const st = sajs_skip_value(lexer, 0U, "", &count);
+    if (st) {
+      return st;
+    }
+  }
+
+  for (;;) {
+    SajsEvent const e = sajs_read_buffer(lexer, 0U, "", &count);
+    if (e.status) {
+      return e.status;
+    }
+
+    assert(e.type);
+    log->events[log->num_events++] = e;
+  }
+}
+
+/// Return the expected log after skipping the value at a start event
+static void
+remove_value(EventLog const* const full,
+             size_t const          skip,
+             EventLog* const       log)
+{
+  size_t i      = 0U;
+  size_t starts = 0U;
+
+  // Copy events up to and including the start of the skipped value
+  log->num_events = 0U;
+  for (; i < full->num_events; ++i) {
+    SajsEvent const e = full->events[i];
+
+    log->events[log->num_events++] = e;
+    if (e.type == SAJS_EVENT_START && starts++ == skip) {
+      break;
+    }
+  }
+
+  // Drop events up to the end of the value (and its parent, for a number)
+  long depth = 1;
+  while (depth > 0 && ++i < full->num_events) {
+    SajsEventType const type = full->events[i].type;
+
+    depth += (type == SAJS_EVENT_START)        ? 1
+             : (type == SAJS_EVENT_END)        ? -1
+             : (type == SAJS_EVENT_DOUBLE_END) ? -2
+                                               : 0;
+  }
+
+  // Copy the remaining events
+  while (++i < full->num_events) {
+    log->events[log->num_events++] = full->events[i];
+  }
+}
+
+static bool
+same_events(EventLog const* const a, EventLog const* const b)
+{
+  if (a->num_events != b->num_events) {
+    return false;
+  }
+
+  for (size_t i = 0U; i < a->num_events; ++i) {
+    SajsEvent const x = a->events[i];
+    SajsEvent const y = b->events[i];
+    if (x.status != y.status || x.type != y.type || x.kind != y.kind ||
+        x.flags != y.flags) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// Check that skipping every value in a document, in every step size, works
+static void
+check_skips(char const* const doc)
+{
+  static EventLog full;
+  static EventLog expected;
+  static EventLog actual;
+
+  size_t const length = strlen(doc);
+  assert(read_doc(doc, length, NO_SKIP, &full) == SAJS_FAILURE);
+
+  size_t num_starts = 0U;
+  for (size_t i = 0U; i < full.num_events; ++i) {
+    num_starts += (full.events[i].type == SAJS_EVENT_START) ? 1U : 0U;
+  }
+
+  for (size_t skip = 0U; skip < num_starts; ++skip) {
+    remove_value(&full, skip, &expected);
+    for (size_t step = 1U; step <= length; ++step) {
+      assert(read_doc(doc, step, skip, &actual) == SAJS_FAILURE);
+      assert(same_events(&expected, &actual));
+    }
+  }
+}
+
+/// Make a long document with strings and escapes across block boundaries
+static void
+make_long_doc(char* const doc, size_t const size)
+{
+  static char const* const elements[] = {
+    "\"\\\\\"",
+    "\"\\\"[\"",
+    "{\"k\": [1, \"]\", {\"}\": \"\\\\\\\"]\"}]}",
+    "\"abcdefghijklmnopqrstuvwxyz {[\"",
+    "[[7]]",
+  };
+
+  size_t length = 0U;
+  doc[length++] = '[';
+  for (unsigned i = 0U; length < size - 64U; ++i) {
+    char const* const element = elements[i % 5U];
+    size_t const      n       = strlen(element);
+
+    if (i) {
+      doc[length++] = ',';
+    }
+
+    memcpy(doc + length, element, n);
+    length += n;
+  }
+
+  doc[length++] = ']';
+  doc[length]   = '\0';
+}
+
+static void
+test_skip(void)
+{
+  for (size_t i = 0U; i < sizeof(docs) / sizeof(docs[0]); ++i) {
+    check_skips(docs[i]);
+  }
+
+  char doc[320U];
+  make_long_doc(doc, sizeof(doc));
+  check_skips(doc);
+}
+
+static void
+test_skip_errors(void)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+  size_t           count = 0U;
+
+  // Nothing to skip between values
+  assert(sajs_skip_value(lexer, 3U, "[1]", &count) == SAJS_FAILURE);
+  assert(!count);
+
+  // Mismatched closing bracket, which isn't consumed
+  assert(!sajs_read_byte(lexer, '{').status);
+  assert(sajs_skip_value(lexer, 7U, "\"a\": 1]", &count) ==
+         SAJS_EXPECTED_COMMA);
+  assert(count == 6U);
+
+  // Input ends in the skipped value
+  sajs_lexer_reset(lexer);
+  assert(!sajs_read_byte(lexer, '[').status);
+  assert(sajs_skip_value(lexer, 4U, "1, 2", &count) == SAJS_RETRY);
+  assert(count == 4U);
+  assert(sajs_skip_value(lexer, 0U, "", &count) == SAJS_NO_DATA);
+
+  // Invalid strings are still caught
+  sajs_lexer_reset(lexer);
+  assert(!sajs_read_byte(lexer, '"').status);
+  assert(sajs_skip_value(lexer, 3U, "a\\x", &count) ==
+         SAJS_EXPECTED_STRING_ESCAPE);
+  assert(count == 2U);
+
+  // But the contents of containers aren't checked
+  sajs_lexer_reset(lexer);
+  assert(!sajs_read_byte(lexer, '[').status);
+  assert(!sajs_skip_value(lexer, 9U, "x, {[}] ]", &count));
+  assert(count == 9U);
+  assert(!sajs_lexer_depth(lexer));
+}
+
+int
+main(void)
+{
+  test_skip();
+  test_skip_errors();
+  return 0;
+}
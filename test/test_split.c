@@ -0,0 +1,268 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_LENGTH 1024U
+
+/// Events and bytes read from a document
+typedef struct {
+  SajsEvent events[MAX_LENGTH];
+  size_t    num_events;
+  char      bytes[MAX_LENGTH * 4U];
+  size_t    num_bytes;
+} EventLog;
+
+static char const* const docs[] = {
+  "[]",
+  "{}",
+  "[1,2,3]",
+  "[ 1 , 2 ,3 ]",
+  "[\"a,b\", \"\\\",\", {\"k\": [1, 2]}, \"x]\\\\\", 3, [], {}, true]",
+  "{\"a\": 1, \"b,\": [2, 3], \"\\\\\": {\"c\": \"}\"}, \"d\": null}",
+  "[[1, [2, 3]], {\"a\": [4, 5]}, \"[,]\", -6.5e7]",
+};
+
+/// Return the offsets after every comma at depth 1, using the lexer
+static size_t
+find_commas(char const* const doc, size_t* const offsets)
+{
+  uintptr_t        mem[32U];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+
+  size_t n = 0U;
+  for (size_t i = 0U; doc[i]; ++i) {
+    SajsEvent const e = sajs_read_byte(lexer, (uint8_t)doc[i]);
+    assert(!e.status);
+    if (doc[i] == ',' && sajs_lexer_depth(lexer) == 1U) {
+      offsets[n++] = i + 1U;
+    }
+  }
+
+  return n;
+}
+
+/// Make a long document with escapes that cross block boundaries
+static size_t
+make_long_doc(char* const doc)
+{
+  static char const* const elements[] = {
+    "\"\\\\\"", "\"\\\"[\"", "{\"k\": [1, \"]\"]}", "\"abcdefghijklmnop\"", "7",
+  };
+
+  size_t length = 0U;
+  doc[length++] = '[';
+  for (unsigned i = 0U; length < MAX_LENGTH - 64U; ++i) {
+    char const* const element = elements[i % 5U];
+    size_t const      n       = strlen(element);
+
+    if (i) {
+      doc[length++] = ',';
+    }
+
+    memcpy(doc + length, element, n);
+    length += n;
+  }
+
+  doc[length++] = ']';
+  doc[length]   = '\0';
+  return length;
+}
+
+/// Check that every chunk size finds the same splits as the lexer
+static void
+check_splits(char const* const doc)
+{
+  size_t const length = strlen(doc);
+  size_t       commas[MAX_LENGTH];
+  size_t const num_commas = find_commas(doc, commas);
+
+  for (size_t chunk_size = 1U; chunk_size <= length; ++chunk_size) {
+    SajsChunk    chunks[MAX_LENGTH];
+    size_t const num_chunks = (length + chunk_size - 1U) / chunk_size;
+
+    for (size_t i = 0U; i < num_chunks; ++i) {
+      SajsChunk* const chunk = &chunks[i];
+
+      chunk->begin = i * chunk_size;
+      chunk->end   = chunk->begin + chunk_size;
+      sajs_scan_chunk(length, doc, chunk);
+    }
+
+    size_t c = 0U;
+    for (size_t i = 0U; i < num_chunks; ++i) {
+      SajsChunk* const chunk = &chunks[i];
+      sajs_link_chunk(i ? &chunks[i - 1U] : NULL, chunk);
+
+      while (c < num_commas && commas[c] <= chunk->begin) {
+        ++c;
+      }
+
+      size_t const expected =
+        (c < num_commas && commas[c] <= chunk->end) ? commas[c] : 0U;
+
+      assert(sajs_find_split(length, doc, chunk) == expected);
+    }
+
+    // Check that the document ends at the top level outside strings
+    SajsChunk end = {length, length, {0, 0}, 0, 0U, 0U};
+    sajs_link_chunk(&chunks[num_chunks - 1U], &end);
+    assert(!end.depth);
+    assert(!end.in_string);
+  }
+}
+
+/// Read input into a log until the end of input or the end of the root
+static void
+read_events(SajsLexer* const  lexer,
+            size_t const      length,
+            char const* const data,
+            bool const        eof,
+            EventLog* const   log)
+{
+  size_t offset = 0U;
+  while (offset < length || eof) {
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_read_buffer(lexer, length - offset, data + offset, &count);
+
+    offset += count;
+    if (e.status) {
+      assert(e.status == SAJS_FAILURE);
+      assert(offset == length);
+      break;
+    }
+
+    if (e.type) {
+      SajsStringView const string = sajs_string(lexer);
+
+      log->events[log->num_events++] = e;
+      memcpy(log->bytes + log->num_bytes, string.data, string.length);
+      log->num_bytes += string.length;
+    }
+  }
+}
+
+static bool
+same_events(EventLog const* const a, EventLog const* const b)
+{
+  if (a->num_events != b->num_events || a->num_bytes != b->num_bytes ||
+      memcmp(a->bytes, b->bytes, a->num_bytes)) {
+    return false;
+  }
+
+  for (size_t i = 0U; i < a->num_events; ++i) {
+    SajsEvent const x = a->events[i];
+    SajsEvent const y = b->events[i];
+    if (x.status != y.status || x.type != y.type || x.kind != y.kind ||
+        x.flags != y.flags) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// Check that resuming at every split produces the same events
+static void
+check_resume(char const* const doc)
+{
+  static EventLog expected;
+  static EventLog actual;
+
+  size_t const length = strlen(doc);
+  uintptr_t    mem[32U];
+  SajsLexer*   lexer = sajs_lexer_init(sizeof(mem), mem);
+
+  expected.num_events = expected.num_bytes = 0U;
+  read_events(lexer, length, doc, true, &expected);
+
+  size_t       commas[MAX_LENGTH];
+  size_t const num_commas = find_commas(doc, commas);
+  for (size_t c = 0U; c < num_commas; ++c) {
+    size_t const split = commas[c];
+
+    // Read up to the split
+    actual.num_events = actual.num_bytes = 0U;
+    lexer                                = sajs_lexer_init(sizeof(mem), mem);
+    read_events(lexer, split, doc, false, &actual);
+    assert(sajs_lexer_depth(lexer) == 1U);
+
+    // Read the rest with a fresh lexer
+    SajsValueKind const kind = (doc[0] == '[') ? SAJS_ARRAY : SAJS_OBJECT;
+    lexer                    = sajs_lexer_init(sizeof(mem), mem);
+    assert(!sajs_lexer_resume(lexer, kind));
+    read_events(lexer, length - split, doc + split, true, &actual);
+
+    assert(same_events(&expected, &actual));
+  }
+}
+
+static void
+test_splits(void)
+{
+  for (size_t i = 0U; i < sizeof(docs) / sizeof(docs[0]); ++i) {
+    check_splits(docs[i]);
+  }
+
+  char doc[MAX_LENGTH];
+  make_long_doc(doc);
+  check_splits(doc);
+}
+
+static void
+test_escape_runs(void)
+{
+  // Backslash runs of every length, which may start before the chunk
+  char   doc[MAX_LENGTH] = {'['};
+  size_t length          = 1U;
+  for (unsigned n = 0U; n < 20U; ++n) {
+    doc[length++] = '"';
+    for (unsigned i = 0U; i < 2U * n; ++i) {
+      doc[length++] = '\\';
+    }
+
+    doc[length++] = '"';
+    doc[length++] = ',';
+  }
+
+  doc[length++] = '0';
+  doc[length++] = ']';
+  doc[length]   = '\0';
+  check_splits(doc);
+}
+
+static void
+test_resume(void)
+{
+  for (size_t i = 0U; i < sizeof(docs) / sizeof(docs[0]); ++i) {
+    check_resume(docs[i]);
+  }
+
+  char doc[MAX_LENGTH];
+  make_long_doc(doc);
+  check_resume(doc);
+
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+  assert(sajs_lexer_resume(lexer, SAJS_STRING) == SAJS_FAILURE);
+  assert(!sajs_lexer_resume(lexer, SAJS_OBJECT));
+  assert(sajs_lexer_depth(lexer) == 1U);
+}
+
+int
+main(void)
+{
+  test_splits();
+  test_escape_runs();
+  test_resume();
+  return 0;
+}
@@ -0,0 +1,110 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static char const* const doc =
+  "{\"a\": [1, 23, -4.5e6], \"b\\t\\u00E9\": [[true]], \"c\": null}";
+
+/// Read a whole document with spans, and write every event
+static void
+read_write(SajsLexer* const lexer, SajsWriter* const writer)
+{
+  size_t const length = strlen(doc);
+
+  for (size_t offset = 0U; offset <= length;) {
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_read_spans(lexer, length - offset, doc + offset, &count);
+
+    assert(e.status == SAJS_SUCCESS || e.status == SAJS_FAILURE);
+    if (e.status) {
+      break;
+    }
+
+    offset += count;
+    if (e.type) {
+      assert(!sajs_write_event(writer, e, sajs_string(lexer)).status);
+    }
+  }
+}
+
+static void
+test_stats(void)
+{
+  uintptr_t         lexer_mem[16U];
+  uintptr_t         writer_mem[8U];
+  SajsLexer* const  lexer  = sajs_lexer_init(sizeof(lexer_mem), lexer_mem);
+  SajsWriter* const writer = sajs_writer_init(sizeof(writer_mem), writer_mem);
+
+  SajsLexerStats  lexer_stats;
+  SajsWriterStats writer_stats;
+  memset(&lexer_stats, 0, sizeof(lexer_stats));
+  memset(&writer_stats, 0, sizeof(writer_stats));
+
+  // Clearing statistics always works
+  assert(!sajs_lexer_set_stats(lexer, NULL));
+  assert(!sajs_writer_set_stats(writer, NULL));
+
+  SajsStatus const st = sajs_lexer_set_stats(lexer, &lexer_stats);
+  assert(sajs_writer_set_stats(writer, &writer_stats) == st);
+  if (st) {
+    // Statistics aren't enabled in this build, so nothing is counted
+    assert(st == SAJS_FAILURE);
+    read_write(lexer, writer);
+    assert(!lexer_stats.events[SAJS_EVENT_START]);
+    assert(!writer_stats.events[SAJS_EVENT_START]);
+    return;
+  }
+
+  read_write(lexer, writer);
+
+  // 4 containers, 3 strings, 3 numbers, and 2 literals
+  assert(lexer_stats.events[SAJS_EVENT_START] == 12U);
+  assert(lexer_stats.events[SAJS_EVENT_END] +
+           lexer_stats.events[SAJS_EVENT_DOUBLE_END] * 2U ==
+         12U);
+
+  assert(lexer_stats.escapes == 2U);
+  assert(lexer_stats.bytes[SAJS_STATE_ESCAPE] == 6U);
+  assert(lexer_stats.retries == 3U);
+  assert(lexer_stats.max_depth == 4U);
+
+  uint64_t total = 0U;
+  for (unsigned i = 0U; i <= SAJS_STATE_LITERAL; ++i) {
+    total += lexer_stats.bytes[i];
+  }
+
+  assert(total == strlen(doc));
+
+  // Every event was written
+  for (unsigned i = 0U; i <= SAJS_EVENT_BYTES; ++i) {
+    assert(writer_stats.events[i] == lexer_stats.events[i] ||
+           i == SAJS_EVENT_NOTHING);
+  }
+
+  assert(writer_stats.escapes == 1U);
+  assert(writer_stats.max_depth == 3U);
+
+  // Counting stops when statistics are cleared
+  assert(!sajs_lexer_set_stats(lexer, NULL));
+  assert(!sajs_writer_set_stats(writer, NULL));
+  sajs_lexer_reset(lexer);
+  read_write(lexer, writer);
+  assert(lexer_stats.events[SAJS_EVENT_START] == 12U);
+  assert(writer_stats.escapes == 1U);
+}
+
+int
+main(void)
+{
+  test_stats();
+  return 0;
+}
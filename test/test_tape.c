@@ -0,0 +1,345 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_EVENTS 256U
+#define TAPE_SIZE 4096U
+#define NO_SKIP SIZE_MAX
+
+/// Events, strings, and numbers read from a document or a tape
+typedef struct {
+  SajsEvent      events[MAX_EVENTS];
+  SajsStringView strings[MAX_EVENTS];
+  SajsNumber     numbers[MAX_EVENTS];
+  char           text[TAPE_SIZE];
+  size_t         num_events;
+  size_t         text_length;
+} EventLog;
+
+static char const* const docs[] = {
+  "[]",
+  "{\"a\": 1}",
+  "[1, -23, 4.5e-6, 18446744073709551616, true, null]",
+  "{\"a\\tb\": [\"c\\u00E9\", {\"d\": false}], \"e\": [[0], 7]}",
+  "[1] {\"a\": \"}\"} 2 \"s\" null",
+  "[[1, [2, 3.25]], {\"a\": [4, 5]}, \"[,]\", -6.5e7]",
+};
+
+/// Add an event to a log, copying its bytes and number
+static void
+add_event(EventLog* const      log,
+          SajsEvent const      event,
+          SajsStringView const string,
+          SajsNumber const     number)
+{
+  size_t const i = log->num_events++;
+  assert(i < MAX_EVENTS);
+  assert(log->text_length + string.length <= sizeof(log->text));
+
+  memcpy(log->text + log->text_length, string.data, string.length);
+  log->events[i]         = event;
+  log->strings[i].data   = log->text + log->text_length;
+  log->strings[i].length = string.length;
+  log->numbers[i]        = number;
+  log->text_length += string.length;
+}
+
+/// Return true if an event ends a number (possibly with its container)
+static bool
+ends_number(SajsEvent const event, SajsValueKind const scalar_kind)
+{
+  return scalar_kind == SAJS_NUMBER && (event.type == SAJS_EVENT_END ||
+                                        event.type == SAJS_EVENT_DOUBLE_END);
+}
+
+/// Return the kind of the scalar value being read after an event
+static SajsValueKind
+next_scalar_kind(SajsEvent const event, SajsValueKind const scalar_kind)
+{
+  return (event.type == SAJS_EVENT_START && event.kind > SAJS_ARRAY)
+           ? event.kind
+         : (event.type == SAJS_EVENT_BYTES) ? scalar_kind
+                                            : (SajsValueKind)0;
+}
+
+/**
+   Record a document in pieces of `step` bytes on a tape.
+
+   The events read are also logged, with the bytes events in each value
+   combined, as they are on the tape.  If `tight` is true, then every event
+   is first written with no free space, which must fail without changing the
+   tape.
+*/
+static size_t
+record_doc(char const* const doc,
+           size_t const      step,
+           bool const        tight,
+           uint8_t* const    tape,
+           EventLog* const   log)
+{
+  static SajsNumber const     zero  = {0.0, 0U, 0U};
+  static SajsStringView const empty = {"", 0U};
+
+  uintptr_t             lexer_mem[16U];
+  uintptr_t             writer_mem[32U / sizeof(uintptr_t)];
+  SajsLexer* const      lexer = sajs_lexer_init(sizeof(lexer_mem), lexer_mem);
+  SajsTapeWriter* const writer =
+    sajs_tape_writer_init(sizeof(writer_mem), writer_mem);
+
+  size_t const  length      = strlen(doc);
+  size_t        tape_length = 0U;
+  SajsValueKind scalar_kind = (SajsValueKind)0;
+  bool          is_run      = false;
+
+  assert(writer);
+  log->num_events  = 0U;
+  log->text_length = 0U;
+  for (size_t offset = 0U; offset <= length;) {
+    size_t const    end   = (length - offset < step) ? length : (offset + step);
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_read_spans(lexer, end - offset, doc + offset, &count);
+
+    offset += count;
+    if (e.status) {
+      assert(e.status == SAJS_FAILURE);
+      break;
+    }
+
+    if (!e.type) {
+      continue;
+    }
+
+    // Check that writing fails without changing anything if there's no space
+    if (tight) {
+      size_t const     old_length = tape_length;
+      SajsStatus const st =
+        sajs_tape_write(writer, lexer, e, tape_length, tape, &tape_length);
+
+      assert(st == SAJS_OVERFLOW);
+      assert(tape_length == old_length);
+    }
+
+    assert(!sajs_tape_write(writer, lexer, e, TAPE_SIZE, tape, &tape_length));
+
+    // Log the event, combining consecutive bytes events
+    SajsStringView const string =
+      (e.flags & SAJS_HAS_BYTES) ? sajs_string(lexer) : empty;
+
+    if (e.type == SAJS_EVENT_BYTES && is_run) {
+      memcpy(log->text + log->text_length, string.data, string.length);
+      log->strings[log->num_events - 1U].length += string.length;
+      log->text_length += string.length;
+    } else {
+      // Whether bytes continue in the next buffer isn't recorded
+      SajsEvent logged = e;
+      logged.flags     = (uint8_t)(e.flags & ~(SajsFlags)SAJS_IS_CONTINUED);
+
+      add_event(log,
+                logged,
+                string,
+                ends_number(e, scalar_kind) ? sajs_number(lexer) : zero);
+    }
+
+    is_run      = e.type == SAJS_EVENT_BYTES;
+    scalar_kind = next_scalar_kind(e, scalar_kind);
+  }
+
+  return tape_length;
+}
+
+/// Replay a tape, skipping the value started by the START event `skip`
+static SajsStatus
+replay_tape(size_t const         length,
+            uint8_t const* const tape,
+            size_t const         skip,
+            EventLog* const      log)
+{
+  static SajsNumber const zero = {0.0, 0U, 0U};
+
+  uintptr_t             mem[96U / sizeof(uintptr_t)];
+  SajsTapeReader* const reader =
+    sajs_tape_reader_init(sizeof(mem), mem, length, tape);
+
+  assert(reader);
+  log->num_events  = 0U;
+  log->text_length = 0U;
+
+  size_t        starts      = 0U;
+  SajsValueKind scalar_kind = (SajsValueKind)0;
+  for (;;) {
+    SajsEvent const e = sajs_tape_read(reader);
+    if (e.status) {
+      return e.status;
+    }
+
+    add_event(log,
+              e,
+              sajs_tape_string(reader),
+              ends_number(e, scalar_kind) ? sajs_tape_number(reader) : zero);
+
+    scalar_kind = next_scalar_kind(e, scalar_kind);
+    if (e.type == SAJS_EVENT_START && starts++ == skip) {
+      SajsStatus const st = sajs_tape_skip(reader);
+      if (st) {
+        return st;
+      }
+
+      assert(sajs_tape_skip(reader) == SAJS_FAILURE);
+      scalar_kind = (SajsValueKind)0;
+    }
+  }
+}
+
+/// Return true if two event logs are the same
+static bool
+same_logs(EventLog const* const a, EventLog const* const b)
+{
+  if (a->num_events != b->num_events) {
+    return false;
+  }
+
+  for (size_t i = 0U; i < a->num_events; ++i) {
+    SajsEvent const      x  = a->events[i];
+    SajsEvent const      y  = b->events[i];
+    SajsStringView const xs = a->strings[i];
+    SajsStringView const ys = b->strings[i];
+    SajsNumber const     xn = a->numbers[i];
+    SajsNumber const     yn = b->numbers[i];
+    if (x.type != y.type || x.kind != y.kind || x.flags != y.flags ||
+        xs.length != ys.length || memcmp(xs.data, ys.data, xs.length) ||
+        memcmp(&xn.real, &yn.real, sizeof(xn.real)) ||
+        xn.magnitude != yn.magnitude || xn.flags != yn.flags) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// Return the expected log after skipping the value at a start event
+static void
+remove_value(EventLog const* const full,
+             size_t const          skip,
+             EventLog* const       log)
+{
+  size_t starts = 0U;
+  size_t i      = 0U;
+
+  log->num_events  = 0U;
+  log->text_length = 0U;
+  for (; i < full->num_events; ++i) {
+    add_event(log, full->events[i], full->strings[i], full->numbers[i]);
+    if (full->events[i].type == SAJS_EVENT_START && starts++ == skip) {
+      break;
+    }
+  }
+
+  long depth = 1;
+  while (depth > 0 && ++i < full->num_events) {
+    SajsEventType const type = full->events[i].type;
+
+    depth += (type == SAJS_EVENT_START)        ? 1
+             : (type == SAJS_EVENT_END)        ? -1
+             : (type == SAJS_EVENT_DOUBLE_END) ? -2
+                                               : 0;
+  }
+
+  while (++i < full->num_events) {
+    add_event(log, full->events[i], full->strings[i], full->numbers[i]);
+  }
+}
+
+/// Check recording and replaying a document with every step size and skip
+static void
+check_doc(char const* const doc)
+{
+  static uint8_t  tape[TAPE_SIZE];
+  static EventLog recorded;
+  static EventLog replayed;
+  static EventLog expected;
+
+  size_t const length = strlen(doc);
+  for (size_t step = 1U; step <= length; ++step) {
+    // Record a tape and check that replaying it produces the same events
+    size_t const tape_length =
+      record_doc(doc, step, step == 1U, tape, &recorded);
+
+    assert(replay_tape(tape_length, tape, NO_SKIP, &replayed) ==
+           SAJS_FAILURE);
+    assert(same_logs(&recorded, &replayed));
+
+    // Check skipping every value
+    size_t num_starts = 0U;
+    for (size_t i = 0U; i < recorded.num_events; ++i) {
+      num_starts += (recorded.events[i].type == SAJS_EVENT_START) ? 1U : 0U;
+    }
+
+    for (size_t skip = 0U; skip < num_starts; ++skip) {
+      remove_value(&recorded, skip, &expected);
+      assert(replay_tape(tape_length, tape, skip, &replayed) ==
+             SAJS_FAILURE);
+      assert(same_logs(&expected, &replayed));
+    }
+  }
+}
+
+static void
+test_tape(void)
+{
+  for (size_t i = 0U; i < sizeof(docs) / sizeof(docs[0]); ++i) {
+    check_doc(docs[i]);
+  }
+}
+
+static void
+test_tape_errors(void)
+{
+  static uint8_t  tape[TAPE_SIZE];
+  static EventLog log;
+
+  uintptr_t mem[96U / sizeof(uintptr_t)];
+
+  // Memory too small
+  assert(!sajs_tape_writer_init(sizeof(uintptr_t), mem));
+  assert(!sajs_tape_reader_init(sizeof(uintptr_t), mem, 8U, "SAJSTP\1"));
+
+  // Not a tape
+  assert(!sajs_tape_reader_init(sizeof(mem), mem, 7U, "SAJSTP\1"));
+  assert(!sajs_tape_reader_init(sizeof(mem), mem, 8U, "SAJSTP\2"));
+
+  // Truncated tapes
+  static char const* const doc = "{\"a\": [1.5, \"bc\"]}";
+  size_t const length = record_doc(doc, strlen(doc), false, tape, &log);
+  for (size_t n = 8U; n < length; ++n) {
+    SajsStatus const st = replay_tape(n, tape, NO_SKIP, &log);
+    assert(st == SAJS_FAILURE || st == SAJS_NO_DATA);
+  }
+
+  // A container that ends past the end of the tape
+  assert(replay_tape(length - 1U, tape, 0U, &log) == SAJS_NO_DATA);
+
+  // Invalid records
+  tape[8] = 0x0FU;
+  assert(replay_tape(length, tape, NO_SKIP, &log) == SAJS_EXPECTED_VALUE);
+  tape[8]  = (uint8_t)(SAJS_EVENT_START | (SAJS_OBJECT << 4U));
+  tape[10] = 0xFFU;
+  assert(replay_tape(length, tape, NO_SKIP, &log) == SAJS_EXPECTED_VALUE);
+}
+
+int
+main(void)
+{
+  test_tape();
+  test_tape_errors();
+  return 0;
+}
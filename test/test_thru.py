@@ -23,6 +23,11 @@ def main():
     parser = argparse.ArgumentParser(description=__doc__)
     parser.add_argument("--tool", default="test/test_sajs", help="executable")
     parser.add_argument("--terse", action="store_true", help="terse output")
+    parser.add_argument("--ndjson", action="store_true", help="NDJSON mode")
+    parser.add_argument("--jobs", type=int, default=1, help="threads")
+    parser.add_argument("--read", help="input method")
+    parser.add_argument("--write", help="output method")
+    parser.add_argument("--tape", action="store_true", help="via event tape")
     parser.add_argument("input", help="valid JSON input file")
     args = parser.parse_args(sys.argv[1:])
 
@@ -30,19 +35,48 @@ def main():
     command = wrapper + [args.tool]
     if args.terse:
         command += ["-t"]
+    if args.ndjson:
+        command += ["-l"]
+    if args.jobs > 1:
+        command += ["-j", str(args.jobs)]
+    if args.read:
+        command += ["-r", args.read]
+    if args.write:
+        command += ["-w", args.write]
 
     status = 0
     with tempfile.TemporaryFile("w+", encoding="utf-8") as out_file:
         with open(args.input, "r", encoding="utf-8") as in_file:
-            # Run input through command and write to output
-            proc = subprocess.run(
-                command,
-                check=True,
-                encoding="utf-8",
-                stderr=subprocess.PIPE,
-                stdin=in_file,
-                stdout=out_file,
-            )
+            # Record input on a tape, and read that instead if requested
+            if args.tape:
+                ndjson = ["-l"] if args.ndjson else []
+                with tempfile.TemporaryFile("w+b") as tape_file:
+                    subprocess.run(
+                        wrapper + [args.tool, "-e"] + ndjson,
+                        check=True,
+                        stdin=in_file,
+                        stdout=tape_file,
+                    )
+
+                    tape_file.seek(0)
+                    proc = subprocess.run(
+                        command + ["-E"],
+                        check=True,
+                        encoding="utf-8",
+                        stderr=subprocess.PIPE,
+                        stdin=tape_file,
+                        stdout=out_file,
+                    )
+            else:
+                # Run input through command and write to output
+                proc = subprocess.run(
+                    command,
+                    check=True,
+                    encoding="utf-8",
+                    stderr=subprocess.PIPE,
+                    stdin=in_file,
+                    stdout=out_file,
+                )
 
             # Ensure there were no errors logged
             if "error:" in proc.stderr:
@@ -0,0 +1,215 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// A method of reading a document
+typedef enum {
+  METHOD_BYTE,
+  METHOD_BUFFER,
+  METHOD_SPANS,
+  METHOD_VALIDATE,
+} Method;
+
+/// The result of reading a document
+typedef struct {
+  SajsStatus status; ///< Final status
+  size_t     offset; ///< Offset of the end or error
+  size_t     length; ///< Length of string bytes
+} Result;
+
+static char bytes[256U];
+
+/// Read a document in pieces of `step` bytes, and collect its string bytes
+static Result
+read_doc(SajsLexer* const  lexer,
+         size_t const      length,
+         char const* const doc,
+         Method const      method,
+         size_t const      step)
+{
+  Result r = {SAJS_SUCCESS, 0U, 0U};
+
+  sajs_lexer_reset(lexer);
+  while (!r.status || r.status == SAJS_RETRY) {
+    size_t const left  = length - r.offset;
+    size_t const n     = (left < step) ? left : step;
+    size_t       count = 0U;
+    SajsEvent    e     = {SAJS_SUCCESS, SAJS_EVENT_NOTHING, SAJS_STRING, 0U};
+
+    if (method == METHOD_BYTE) {
+      e     = sajs_read_byte(lexer, n ? (uint8_t)doc[r.offset] : -1);
+      count = (n && !e.status) ? 1U : 0U;
+    } else if (method == METHOD_BUFFER) {
+      e = sajs_read_buffer(lexer, n, doc + r.offset, &count);
+    } else if (method == METHOD_SPANS) {
+      e = sajs_read_spans(lexer, n, doc + r.offset, &count);
+    } else {
+      e.status = sajs_validate(lexer, n, doc + r.offset, &count);
+    }
+
+    if (!e.status && (e.flags & SAJS_HAS_BYTES)) {
+      SajsStringView const string = sajs_string(lexer);
+      assert(r.length + string.length <= sizeof(bytes));
+      memcpy(bytes + r.length, string.data, string.length);
+      r.length += string.length;
+    }
+
+    r.status = e.status;
+    r.offset += count;
+  }
+
+  return r;
+}
+
+/**
+   Check reading a string in every way.
+
+   The string is quoted and placed after `pad` bytes of ASCII, so the
+   interesting part falls at different places in any blocks.  If the status
+   is an error, then `error` is its offset in the string, otherwise the string
+   must be read unchanged if it has no escapes.
+*/
+static void
+check_string(size_t const      pad,
+             char const* const string,
+             SajsStatus const  status,
+             size_t const      error)
+{
+  static char doc[256U];
+
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer   = sajs_lexer_init(sizeof(mem), mem);
+  size_t const     length  = strlen(string);
+  size_t const     total   = pad + length + 2U;
+  bool const       escapes = strchr(string, '\\') != NULL;
+  assert(total + 1U <= sizeof(doc));
+
+  doc[0U] = '"';
+  memset(doc + 1U, 'a', pad);
+  memcpy(doc + 1U + pad, string, length);
+  doc[1U + pad + length] = '"';
+
+  for (unsigned m = METHOD_BYTE; m <= METHOD_VALIDATE; ++m) {
+    for (size_t step = 1U; step <= total; ++step) {
+      Result const r = read_doc(lexer, total, doc, (Method)m, step);
+
+      assert(r.status == status);
+      if (status == SAJS_FAILURE) {
+        assert(r.offset == total);
+        if (m != METHOD_VALIDATE && !escapes) {
+          assert(r.length == pad + length);
+          assert(!memcmp(bytes + pad, string, length));
+        }
+      } else {
+        assert(r.offset == 1U + pad + error);
+      }
+    }
+  }
+}
+
+static void
+check_strings(size_t const pad)
+{
+  // The smallest and largest characters of every length and range
+  check_string(pad, "\x7F", SAJS_FAILURE, 0U);
+  check_string(pad, "\xC2\x80", SAJS_FAILURE, 0U);
+  check_string(pad, "\xDF\xBF", SAJS_FAILURE, 0U);
+  check_string(pad, "\xE0\xA0\x80", SAJS_FAILURE, 0U);
+  check_string(pad, "\xEC\xBF\xBF", SAJS_FAILURE, 0U);
+  check_string(pad, "\xED\x80\x80", SAJS_FAILURE, 0U);
+  check_string(pad, "\xED\x9F\xBF", SAJS_FAILURE, 0U);
+  check_string(pad, "\xEE\x80\x80", SAJS_FAILURE, 0U);
+  check_string(pad, "\xEF\xBF\xBF", SAJS_FAILURE, 0U);
+  check_string(pad, "\xF0\x90\x80\x80", SAJS_FAILURE, 0U);
+  check_string(pad, "\xF3\xBF\xBF\xBF", SAJS_FAILURE, 0U);
+  check_string(pad, "\xF4\x8F\xBF\xBF", SAJS_FAILURE, 0U);
+  check_string(pad, "\xC3\xA9\xE2\x82\xAC\xF0\x9D\x84\x9E", SAJS_FAILURE, 0U);
+
+  // Bytes that can't start a character
+  check_string(pad, "\x80", SAJS_EXPECTED_UTF8, 0U);
+  check_string(pad, "\xBF", SAJS_EXPECTED_UTF8, 0U);
+  check_string(pad, "\xC0\x80", SAJS_EXPECTED_UTF8, 0U);
+  check_string(pad, "\xC1\xBF", SAJS_EXPECTED_UTF8, 0U);
+  check_string(pad, "\xF5\x80\x80\x80", SAJS_EXPECTED_UTF8, 0U);
+  check_string(pad, "\xFF", SAJS_EXPECTED_UTF8, 0U);
+  check_string(pad, "\xC3\xA9\x80", SAJS_EXPECTED_UTF8, 2U);
+
+  // Overlong encodings, surrogates, and code points past U+10FFFF
+  check_string(pad, "\xE0\x9F\xBF", SAJS_EXPECTED_CONTINUATION, 1U);
+  check_string(pad, "\xED\xA0\x80", SAJS_EXPECTED_CONTINUATION, 1U);
+  check_string(pad, "\xED\xBF\xBF", SAJS_EXPECTED_CONTINUATION, 1U);
+  check_string(pad, "\xF0\x8F\xBF\xBF", SAJS_EXPECTED_CONTINUATION, 1U);
+  check_string(pad, "\xF4\x90\x80\x80", SAJS_EXPECTED_CONTINUATION, 1U);
+
+  // Characters cut short by something else
+  check_string(pad, "\xC3z", SAJS_EXPECTED_CONTINUATION, 1U);
+  check_string(pad, "\xE2\x82z", SAJS_EXPECTED_CONTINUATION, 2U);
+  check_string(pad, "\xF0\x9D\x84z", SAJS_EXPECTED_CONTINUATION, 3U);
+  check_string(pad, "\xE2\x82\\n", SAJS_EXPECTED_CONTINUATION, 2U);
+  check_string(pad, "\xE2\x82\xC3\xA9", SAJS_EXPECTED_CONTINUATION, 2U);
+  check_string(pad, "\xF0\x9D\x84", SAJS_EXPECTED_CONTINUATION, 3U);
+}
+
+static void
+test_strings(void)
+{
+  // Move the characters across the edges of any blocks
+  for (size_t pad = 0U; pad < 72U; ++pad) {
+    check_strings(pad);
+  }
+}
+
+static void
+test_escapes(void)
+{
+  // Escapes are decoded to valid UTF-8, and reset the decoder after them
+  check_string(0U, "\\u00E9\xC3\xA9", SAJS_FAILURE, 0U);
+  check_string(0U, "\\uD834\\uDD1E\x80", SAJS_EXPECTED_UTF8, 12U);
+  check_string(0U, "\xC3\xA9\\u0041\xC3\xA9", SAJS_FAILURE, 0U);
+}
+
+static void
+test_long_string(void)
+{
+  static char string[200U];
+
+  // A long string of mixed characters, with every byte in turn made invalid
+  size_t length = 0U;
+  while (length + 10U < sizeof(string)) {
+    memcpy(string + length, "\xC3\xA9\xE2\x82\xAC\xF0\x9D\x84\x9Ez", 10U);
+    length += 10U;
+  }
+
+  string[length] = '\0';
+  check_string(0U, string, SAJS_FAILURE, 0U);
+
+  for (size_t i = 0U; i < length; i += 7U) {
+    char const c       = string[i];
+    bool const in_char = ((uint8_t)c & 0xC0U) == 0x80U;
+
+    string[i] = '\xFF';
+    check_string(0U,
+                 string,
+                 in_char ? SAJS_EXPECTED_CONTINUATION : SAJS_EXPECTED_UTF8,
+                 i);
+    string[i] = c;
+  }
+}
+
+int
+main(void)
+{
+  test_strings();
+  test_escapes();
+  test_long_string();
+  return 0;
+}
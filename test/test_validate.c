@@ -0,0 +1,137 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// Validate a whole input, returning the first error and its offset
+static SajsStatus
+validate(char const* const input,
+         size_t* const     num_values,
+         size_t* const     offset)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  size_t const     length = strlen(input);
+
+  SajsStatus st = SAJS_SUCCESS;
+  *num_values   = 0U;
+  *offset       = 0U;
+  while (!st || st == SAJS_RETRY) {
+    size_t count = 0U;
+    st = sajs_validate(lexer, length - *offset, input + *offset, &count);
+    *offset += count;
+    *num_values += st ? 0U : 1U;
+  }
+
+  return st;
+}
+
+/// Read a whole input, returning the first error and its offset
+static SajsStatus
+read_all(char const* const input, size_t* const offset)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  size_t const     length = strlen(input);
+
+  SajsStatus st = SAJS_SUCCESS;
+  *offset       = 0U;
+  while (!st) {
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_read_buffer(lexer, length - *offset, input + *offset, &count);
+
+    st = e.status;
+    *offset += count;
+  }
+
+  return st;
+}
+
+/// Check that validating an input has the same result as reading it
+static void
+check(char const* const input,
+      SajsStatus const  expected_status,
+      size_t const      expected_num_values)
+{
+  size_t     num_values  = 0U;
+  size_t     offset      = 0U;
+  size_t     read_offset = 0U;
+  SajsStatus st          = validate(input, &num_values, &offset);
+
+  assert(st == expected_status);
+  assert(num_values == expected_num_values);
+  assert(read_all(input, &read_offset) == st);
+  assert(offset == read_offset);
+}
+
+static void
+test_validate(void)
+{
+  check("", SAJS_FAILURE, 0U);
+  check("  ", SAJS_FAILURE, 0U);
+  check("[]", SAJS_FAILURE, 1U);
+  check("12", SAJS_FAILURE, 1U);
+  check("12 ", SAJS_FAILURE, 1U);
+  check("\"str\"\n", SAJS_FAILURE, 1U);
+  check("{\"a\": [1, true, null, \"\\u00E9\\n\"]}", SAJS_FAILURE, 1U);
+  check("[] {} 12 \"s\" true", SAJS_FAILURE, 5U);
+  check("[1 2]", SAJS_EXPECTED_COMMA, 0U);
+  check("[1, 2", SAJS_NO_DATA, 0U);
+  check("\"abc", SAJS_NO_DATA, 0U);
+  check("{\"a\" 1}", SAJS_EXPECTED_COLON, 0U);
+  check("{\"a\":1}}", SAJS_EXPECTED_VALUE, 1U);
+  check("[tru]", SAJS_EXPECTED_LITERAL, 0U);
+  check("[\"a\tb\"]", SAJS_EXPECTED_PRINTABLE, 0U);
+  check("\"\\ud800\"", SAJS_EXPECTED_HEX, 0U);
+  check("\"\\udc00\"", SAJS_EXPECTED_UTF16_HI, 0U);
+  check("-", SAJS_NO_DATA, 0U);
+  check("[1.]", SAJS_EXPECTED_DIGIT, 0U);
+  check("1.5-7", SAJS_EXPECTED_DIGIT, 0U);
+  check("1.5true", SAJS_EXPECTED_DIGIT, 0U);
+}
+
+static void
+test_chunks(void)
+{
+  static char const* const input = "[\"some text\", 1234, {\"k\": false}] 5";
+
+  // Validating in chunks of any size gives the same result
+  size_t const length = strlen(input);
+  for (size_t chunk_size = 1U; chunk_size <= length; ++chunk_size) {
+    uintptr_t        mem[16U];
+    SajsLexer* const lexer = sajs_lexer_init(sizeof(mem), mem);
+
+    SajsStatus st         = SAJS_SUCCESS;
+    size_t     offset     = 0U;
+    size_t     num_values = 0U;
+    while (!st || st == SAJS_RETRY) {
+      size_t const chunk_end =
+        (offset + chunk_size < length) ? offset + chunk_size : length;
+
+      size_t count = 0U;
+      st = sajs_validate(lexer, chunk_end - offset, input + offset, &count);
+      offset += count;
+      num_values += st ? 0U : 1U;
+    }
+
+    assert(st == SAJS_FAILURE);
+    assert(offset == length);
+    assert(num_values == 2U);
+  }
+}
+
+int
+main(void)
+{
+  test_validate();
+  test_chunks();
+  return 0;
+}
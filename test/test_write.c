@@ -0,0 +1,316 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+#undef NDEBUG
+
+#include "sajs/sajs.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_EVENTS 256U
+
+/// Events and strings read from a document
+typedef struct {
+  SajsEvent      events[MAX_EVENTS];
+  SajsStringView strings[MAX_EVENTS];
+  char           bytes[MAX_EVENTS][4U];
+  size_t         num_events;
+} EventLog;
+
+/// Read all the events in a document, with spans
+static void
+read_events(char const* const doc, EventLog* const log)
+{
+  uintptr_t        mem[16U];
+  SajsLexer* const lexer  = sajs_lexer_init(sizeof(mem), mem);
+  size_t const     length = strlen(doc);
+
+  log->num_events = 0U;
+  for (size_t offset = 0U; offset <= length;) {
+    size_t          count = 0U;
+    SajsEvent const e =
+      sajs_read_spans(lexer, length - offset, doc + offset, &count);
+
+    if (e.status == SAJS_FAILURE) {
+      break;
+    }
+
+    assert(!e.status);
+    assert(log->num_events < MAX_EVENTS);
+    offset += count;
+    if (e.type) {
+      size_t const   i      = log->num_events++;
+      SajsStringView string = sajs_string(lexer);
+      if (string.length <= 4U) {
+        memcpy(log->bytes[i], string.data, string.length);
+        string.data = log->bytes[i];
+      }
+
+      log->events[i]  = e;
+      log->strings[i] = string;
+    }
+  }
+}
+
+/// Write events into a text buffer in pieces of at most `step` bytes
+static size_t
+write_text(EventLog const* const log,
+           SajsWriteFlags const  flags,
+           size_t const          step,
+           size_t const          size,
+           char* const           text)
+{
+  uintptr_t         mem[8U];
+  SajsWriter* const writer = sajs_writer_init(sizeof(mem), mem);
+
+  size_t     e      = 0U;
+  size_t     length = 0U;
+  SajsStatus st     = SAJS_RETRY;
+  while (st == SAJS_RETRY) {
+    size_t const space       = (size - length < step) ? (size - length) : step;
+    size_t       num_written = 0U;
+    size_t       n           = 0U;
+
+    assert(space);
+    st = sajs_write_events(writer,
+                           flags,
+                           log->num_events - e,
+                           log->events + e,
+                           log->strings + e,
+                           &num_written,
+                           space,
+                           text + length,
+                           &n);
+
+    assert(n <= space);
+    assert(st == SAJS_SUCCESS || st == SAJS_RETRY);
+    assert(st == SAJS_RETRY || e + num_written == log->num_events);
+    e += num_written;
+    length += n;
+  }
+
+  text[length] = '\0';
+  return length;
+}
+
+static void
+check_log(EventLog const* const log,
+          SajsWriteFlags const  flags,
+          char const* const     expected)
+{
+  char         text[1024U];
+  size_t const length =
+    write_text(log, flags, sizeof(text), sizeof(text), text);
+  assert(!strcmp(text, expected));
+
+  // Check that writing resumes correctly if the buffer fills at any point
+  for (size_t step = 1U; step <= length; ++step) {
+    char         other[1024U];
+    size_t const other_length =
+      write_text(log, flags, step, sizeof(other), other);
+
+    assert(other_length == length);
+    assert(!strcmp(other, expected));
+  }
+}
+
+/// Reformat a document in pieces of `in_step` and `out_step` bytes
+static size_t
+copy_text(char const* const    doc,
+          SajsWriteFlags const flags,
+          size_t const         in_step,
+          size_t const         out_step,
+          size_t const         size,
+          char* const          text)
+{
+  uintptr_t         mem[8U];
+  SajsWriter* const writer = sajs_writer_init(sizeof(mem), mem);
+  size_t const      length = strlen(doc);
+
+  size_t offset      = 0U;
+  size_t text_length = 0U;
+  for (;;) {
+    size_t const left  = length - offset;
+    size_t const n     = (left < in_step) ? left : in_step;
+    size_t const space =
+      (size - text_length < out_step) ? (size - text_length) : out_step;
+
+    size_t           count   = 0U;
+    size_t           written = 0U;
+    SajsStatus const st      = sajs_write_text(writer,
+                                          flags,
+                                          n,
+                                          doc + offset,
+                                          &count,
+                                          space,
+                                          text + text_length,
+                                          &written);
+
+    assert(st == SAJS_SUCCESS || st == SAJS_RETRY);
+    assert(count <= n);
+    assert(written <= space);
+    assert(st == SAJS_RETRY || count == n);
+    offset += count;
+    text_length += written;
+    if (!st && !n) {
+      break;
+    }
+  }
+
+  text[text_length] = '\0';
+  return text_length;
+}
+
+static void
+check_copy(char const* const    doc,
+           SajsWriteFlags const flags,
+           char const* const    expected)
+{
+  char         text[1024U];
+  size_t const length          = strlen(doc);
+  size_t const expected_length = strlen(expected);
+
+  // Check that the same text is written however the input and output split
+  for (size_t in_step = 1U; in_step <= length; ++in_step) {
+    for (size_t out_step = 1U; out_step <= 9U; ++out_step) {
+      size_t const text_length = copy_text(
+        doc, flags, in_step, out_step * out_step, sizeof(text) - 1U, text);
+
+      assert(text_length == expected_length);
+      assert(!strcmp(text, expected));
+    }
+  }
+}
+
+static void
+check_write(char const* const    doc,
+            SajsWriteFlags const flags,
+            char const* const    expected)
+{
+  static EventLog log;
+
+  read_events(doc, &log);
+  check_log(&log, flags, expected);
+  check_copy(doc, flags, expected);
+}
+
+static void
+test_write_events(void)
+{
+  static char const* const doc =
+    "{\"a\": [1, -2.5e3, \"t\\twx\\u00E9\\uD834\\uDD1E\"], \"b\": {}, "
+    "\"c\": [[]], \"d\": [true, {\"e\": null}], \"f\": \"\\u0001\"}";
+
+  check_write(doc,
+              SAJS_WRITE_TERSE,
+              "{\"a\":[1,-2.5e3,\"t\\twx\xC3\xA9\xF0\x9D\x84\x9E\"],\"b\":{},"
+              "\"c\":[[]],\"d\":[true,{\"e\":null}],\"f\":\"\\u0001\"}");
+
+  check_write(doc,
+              0U,
+              "{\n"
+              "  \"a\": [\n"
+              "    1,\n"
+              "    -2.5e3,\n"
+              "    \"t\\twx\xC3\xA9\xF0\x9D\x84\x9E\"\n"
+              "  ],\n"
+              "  \"b\": {\n"
+              "  },\n"
+              "  \"c\": [\n"
+              "    [\n"
+              "    ]\n"
+              "  ],\n"
+              "  \"d\": [\n"
+              "    true,\n"
+              "    {\n"
+              "      \"e\": null\n"
+              "    }\n"
+              "  ],\n"
+              "  \"f\": \"\\u0001\"\n"
+              "}");
+}
+
+static void
+test_write_roots(void)
+{
+  static char const* const doc = "1 [2] \"three\" 4";
+
+  check_write(doc, SAJS_WRITE_TERSE, "1[2]\"three\"4");
+  check_write(
+    doc, SAJS_WRITE_TERSE | SAJS_WRITE_NEWLINES, "1\n[2]\n\"three\"\n4\n");
+  check_write(doc, SAJS_WRITE_NEWLINES, "1\n[\n  2\n]\n\"three\"\n4\n");
+
+  // Literals can be followed by another root without any space
+  check_write("null0 truefalse",
+              SAJS_WRITE_TERSE | SAJS_WRITE_NEWLINES,
+              "null\n0\ntrue\nfalse\n");
+}
+
+/// Append an event with a string to a log
+static void
+add_event(EventLog* const      log,
+          SajsEventType const  type,
+          char const* const    data,
+          size_t const         length)
+{
+  SajsEvent const      event  = {SAJS_SUCCESS, type, SAJS_STRING, 0U};
+  SajsStringView const string = {data, length};
+
+  log->events[log->num_events]    = event;
+  log->strings[log->num_events++] = string;
+}
+
+static void
+test_write_spans(void)
+{
+  static char const span[] = "a\"b\\c\x01\x1F"
+                             "d\ne\tf\b\f\r "
+                             "long enough to need more than one scan, "
+                             "and with a \"quote\" near the end";
+
+  static EventLog log;
+
+  log.num_events = 0U;
+  add_event(&log, SAJS_EVENT_START, "\"", 1U);
+  add_event(&log, SAJS_EVENT_BYTES, span, sizeof(span) - 1U);
+  add_event(&log, SAJS_EVENT_END, "\"", 1U);
+
+  check_log(&log,
+            0U,
+            "\"a\\\"b\\\\c\\u0001\\u001Fd\\ne\\tf\\b\\f\\r "
+            "long enough to need more than one scan, "
+            "and with a \\\"quote\\\" near the end\"");
+}
+
+static void
+test_write_escapes(void)
+{
+  // Escapes are written like the characters they're read as
+  check_write("[\"\\u0041\\u00e9\\u20AC\\ud834\\udd1e\\/\\u002f\"]",
+              SAJS_WRITE_TERSE,
+              "[\"A\xC3\xA9\xE2\x82\xAC\xF0\x9D\x84\x9E//\"]");
+
+  check_write("\"\\\"\\\\\\b\\f\\n\\r\\t\\u0022\\u005C\\u0000\\u001f\\u007F\"",
+              0U,
+              "\"\\\"\\\\\\b\\f\\n\\r\\t\\\"\\\\\\u0000\\u001F\x7F\"");
+
+  // Plain bytes are copied through in runs, however long
+  check_write("{\"a long key with \\\"quotes\\\" in it\": "
+              "\"and a long value without any at all\"}",
+              SAJS_WRITE_NEWLINES,
+              "{\n  \"a long key with \\\"quotes\\\" in it\": "
+              "\"and a long value without any at all\"\n}\n");
+}
+
+int
+main(void)
+{
+  test_write_events();
+  test_write_roots();
+  test_write_spans();
+  test_write_escapes();
+  return 0;
+}
@@ -1,9 +1,14 @@
 // Copyright 2017-2023 David Robillard <d@drobilla.net>
 // SPDX-License-Identifier: ISC
 
+#ifdef SAJS_PIPE_POSIX
+#  define _POSIX_C_SOURCE 200809L // NOLINT(bugprone-reserved-identifier)
+#endif
+
 #include "sajs/sajs.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -12,6 +17,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef SAJS_PIPE_POSIX
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#ifdef SAJS_PIPE_PARALLEL
+#  include <pthread.h>
+#endif
+
 static unsigned const default_stack_size = 1024U;
 
 // GCC print format attributes
@@ -23,71 +38,250 @@ static unsigned const default_stack_size = 1024U;
 #  define SAJS_LOG_FUNC(fmt, a0) ///< Has printf-like parameters
 #endif
 
+/// Method used to read input
+typedef enum {
+  READ_STDIO, ///< Read small blocks with fread()
+  READ_RAW,   ///< Read large blocks with read()
+  READ_MMAP,  ///< Map a file into memory, or read large blocks
+} ReadMethod;
+
+/// Method used to write output
+typedef enum {
+  WRITE_STDIO, ///< Write small blocks with fwrite()
+  WRITE_RAW,   ///< Write large blocks with write()
+} WriteMethod;
+
 /// Command line options
 typedef struct {
-  char*  out_path;
-  size_t stack_size;
-  bool   terse;
+  char*       out_path;
+  char const* pointers[64U];
+  unsigned    num_pointers;
+  size_t      stack_size;
+  unsigned    num_jobs;
+  ReadMethod  read_method;
+  WriteMethod write_method;
+  bool        ndjson;
+  bool        read_tape;
+  bool        stats;
+  bool        terse;
+  bool        validate;
+  bool        write_tape;
 } PipeOptions;
 
+#ifdef SAJS_PIPE_POSIX
+static size_t const raw_buffer_size = 1048576U; ///< Size of raw I/O buffers
+
+static ReadMethod const  default_read_method  = READ_MMAP;
+static WriteMethod const default_write_method = WRITE_RAW;
+
+static char const* const read_methods[]  = {"stdio", "read", "mmap", NULL};
+static char const* const write_methods[] = {"stdio", "write", NULL};
+#else
+static ReadMethod const  default_read_method  = READ_STDIO;
+static WriteMethod const default_write_method = WRITE_STDIO;
+
+static char const* const read_methods[]  = {"stdio", NULL};
+static char const* const write_methods[] = {"stdio", NULL};
+#endif
+
+/// A large buffer for reading or writing a file descriptor directly
+typedef struct {
+  char*  data;   ///< Buffer memory
+  size_t size;   ///< Size of buffer
+  size_t length; ///< Length of pending output
+  int    fd;     ///< File descriptor
+} PipeBuffer;
+
+/// A tape being recorded in memory
+typedef struct {
+  SajsTapeWriter* writer; ///< Tape writer
+  char*           data;   ///< Tape buffer
+  size_t          size;   ///< Size of tape buffer
+  size_t          length; ///< Length of tape so far
+} PipeTape;
+
 /// "Global" state passed as user data to callbacks
 typedef struct {
-  FILE*      in_stream;  ///< Input stream
-  FILE*      out_stream; ///< Output stream
-  SajsLexer* lexer;      ///< Lexer for reading input stream
-  unsigned   num_values; ///< Number of top-level values parsed
-  unsigned   depth;      ///< Stack depth
-  bool       terse;      ///< True if writing terse output
+  FILE*            in_stream;    ///< Input stream, or null to read in_data
+  FILE*            out_stream;   ///< Output stream
+  SajsLexer*       lexer;        ///< Lexer for reading input stream
+  SajsWriter*      writer;       ///< Writer for writing output stream
+  SajsFilter*      filter;       ///< Filter for extracting values, or null
+  PipeTape*        tape;         ///< Tape to record instead of output, or null
+  PipeBuffer*      in_buf;       ///< Buffer for raw input, or null for stdio
+  PipeBuffer*      out_buf;      ///< Buffer for raw output, or null for stdio
+  SajsLexerStats*  lexer_stats;  ///< Statistics for reading, or null
+  SajsWriterStats* writer_stats; ///< Statistics for writing, or null
+  SajsPosition*    position;     ///< Position of the lexer in input, or null
+  char const*      in_data;      ///< Remaining input in memory
+  size_t           in_length;    ///< Length of remaining input in memory
+  char const*      error;        ///< Error message for invalid lines
+  unsigned         num_values;   ///< Number of top-level values parsed
+  unsigned         line_values;  ///< Number of values on the current line
+  unsigned         depth;        ///< Stack depth
+  bool             terse;        ///< True if writing terse output
+  bool             ndjson;       ///< True if reading newline-delimited JSON
+  bool             is_partial;   ///< True if in_data is followed by more input
 } PipeState;
 
-/// Write a newline with indentation
-static int
-write_newline(unsigned const depth, FILE* const out_stream)
+/// A batch of events to write at once
+typedef struct {
+  SajsEvent      events[256U];    ///< Events to write
+  SajsStringView strings[256U];   ///< String for each event
+  char           bytes[256U][4U]; ///< Copies of short strings from the lexer
+  char           text[16384U];    ///< Output text
+  size_t         num_events;      ///< Number of events in batch
+} EventBatch;
+
+// Read into a raw input buffer and return the length, which is zero at the end
+static size_t
+read_raw(PipeBuffer* const buf)
+{
+#ifdef SAJS_PIPE_POSIX
+  ssize_t n = -1;
+  do {
+    n = read(buf->fd, buf->data, buf->size);
+  } while (n < 0 && errno == EINTR);
+
+  return (n > 0) ? (size_t)n : 0U;
+#else
+  (void)buf;
+  return 0U;
+#endif
+}
+
+// Write and clear all the pending output in a raw output buffer
+static SajsStatus
+flush_raw(PipeBuffer* const buf)
 {
-  size_t written = fwrite("\n", 1U, 1U, out_stream);
-  for (unsigned i = 0U; i < depth; ++i) {
-    written += fwrite("  ", 1U, 2U, out_stream);
+#ifdef SAJS_PIPE_POSIX
+  for (size_t offset = 0U; offset < buf->length;) {
+    ssize_t const n =
+      write(buf->fd, buf->data + offset, buf->length - offset);
+    if (n < 0 && errno != EINTR) {
+      return SAJS_BAD_WRITE;
+    }
+
+    offset += (n > 0) ? (size_t)n : 0U;
   }
 
-  return written != 1U + 2U * depth;
+  buf->length = 0U;
+  return SAJS_SUCCESS;
+#else
+  (void)buf;
+  return SAJS_BAD_WRITE;
+#endif
 }
 
-// Write an output prefix (delimiter and whitespace) in normal or terse mode
-static int
-write_prefix(SajsTextOutput const out, bool terse, FILE* const out_stream)
+// Write some text to the output
+static SajsStatus
+write_output(PipeState* const  state,
+             size_t const      length,
+             char const* const text)
 {
-  switch (out.prefix) {
-  case SAJS_PREFIX_NONE:
-    break;
+  PipeBuffer* const buf = state->out_buf;
+  if (!buf) {
+    return (!length || fwrite(text, 1U, length, state->out_stream) == length)
+             ? SAJS_SUCCESS
+             : SAJS_BAD_WRITE;
+  }
 
-  case SAJS_PREFIX_OBJECT_START:
-  case SAJS_PREFIX_ARRAY_START:
-  case SAJS_PREFIX_OBJECT_END:
-  case SAJS_PREFIX_ARRAY_END:
-    return terse ? 0 : write_newline(out.depth, out_stream);
+  for (size_t offset = 0U; offset < length;) {
+    if (buf->length == buf->size && flush_raw(buf)) {
+      return SAJS_BAD_WRITE;
+    }
 
-  case SAJS_PREFIX_MEMBER_COLON:
-    return fwrite(": ", 1U, 2U - terse, out_stream) != 2U - terse;
+    size_t const space = buf->size - buf->length;
+    size_t const n     = (length - offset < space) ? (length - offset) : space;
 
-  case SAJS_PREFIX_MEMBER_COMMA:
-  case SAJS_PREFIX_ARRAY_COMMA:
-    return (fwrite(",", 1U, 1U, out_stream) != 1U) ? 1
-           : terse                                 ? 0
-                   : write_newline(out.depth, out_stream);
+    memcpy(buf->data + buf->length, text + offset, n);
+    buf->length += n;
+    offset += n;
   }
 
-  return 0;
+  return SAJS_SUCCESS;
 }
 
-// Write an output fragment with prefix
+// Add an event to a batch, copying any bytes that are in the lexer
+static void
+add_event(EventBatch* const    batch,
+          SajsEvent const      event,
+          SajsStringView const string)
+{
+  size_t const i = batch->num_events++;
+
+  batch->events[i]  = event;
+  batch->strings[i] = string;
+  if (string.length <= sizeof(batch->bytes[i])) {
+    memcpy(batch->bytes[i], string.data, string.length);
+    batch->strings[i].data = batch->bytes[i];
+  }
+}
+
+// Record an event on a tape, growing the tape buffer as necessary
 static SajsStatus
-write_output(SajsTextOutput const out, bool terse, FILE* const out_stream)
+record_event(PipeTape* const        tape,
+             SajsLexer const* const lexer,
+             SajsEvent const        event)
 {
-  return write_prefix(out, terse, out_stream) ? SAJS_BAD_WRITE
-         : (!out.length ||
-            fwrite(out.bytes, 1U, out.length, out_stream) == out.length)
-           ? SAJS_SUCCESS
-           : SAJS_BAD_WRITE;
+  for (;;) {
+    SajsStatus const st = sajs_tape_write(
+      tape->writer, lexer, event, tape->size, tape->data, &tape->length);
+    if (st != SAJS_OVERFLOW) {
+      return st;
+    }
+
+    size_t const size = tape->size * 2U;
+    char* const  data = (char*)realloc(tape->data, size);
+    if (!data) {
+      return SAJS_BAD_WRITE;
+    }
+
+    tape->data = data;
+    tape->size = size;
+  }
+}
+
+// Write and clear a batch of events
+static SajsStatus
+flush_events(PipeState* const state, EventBatch* const batch)
+{
+  SajsWriteFlags const flags =
+    SAJS_WRITE_NEWLINES | (state->terse ? SAJS_WRITE_TERSE : 0U);
+
+  // Render directly into the raw output buffer if there is one
+  PipeBuffer* const out = state->out_buf;
+
+  SajsStatus st     = SAJS_RETRY;
+  size_t     offset = 0U;
+  while (st == SAJS_RETRY) {
+    if (out && out->length == out->size && (st = flush_raw(out))) {
+      break;
+    }
+
+    size_t num_written = 0U;
+    size_t length      = 0U;
+    st                 = sajs_write_events(
+      state->writer,
+      flags,
+      batch->num_events - offset,
+      batch->events + offset,
+      batch->strings + offset,
+      &num_written,
+      out ? (out->size - out->length) : sizeof(batch->text),
+      out ? (out->data + out->length) : batch->text,
+      &length);
+
+    offset += num_written;
+    if (out) {
+      out->length += length;
+    } else if (write_output(state, length, batch->text)) {
+      st = SAJS_BAD_WRITE;
+    }
+  }
+
+  batch->num_events = 0U;
+  return st;
 }
 
 // Update depth and return true if this was the end of the top value
@@ -104,39 +298,948 @@ update_depth(PipeState* const state, SajsEvent const e)
   return false;
 }
 
+// Read more input and return its length, which is zero at the end
+static size_t
+read_input(PipeState* const   state,
+           size_t const       size,
+           char* const        buf,
+           char const** const data)
+{
+  if (!state->in_stream) { // Provide all the remaining input at once
+    size_t const length = state->in_length;
+    *data               = state->in_data;
+    state->in_data += length;
+    state->in_length = 0U;
+    return length;
+  }
+
+  if (state->in_buf) { // Read a large block directly
+    *data = state->in_buf->data;
+    return read_raw(state->in_buf);
+  }
+
+  *data = buf;
+  return fread(buf, 1U, size, state->in_stream);
+}
+
+// Return the end of the next input to read, the end of a line in NDJSON mode
+static size_t
+read_end(PipeState const* const state,
+         size_t const           length,
+         char const* const      data,
+         size_t const           offset)
+{
+  char const* const next =
+    state->ndjson ? (char const*)memchr(data + offset, '\n', length - offset)
+                  : NULL;
+
+  return next ? (size_t)(next + 1 - data) : length;
+}
+
+// Check that every line has at most one complete document in NDJSON mode
+static bool
+check_line(PipeState* const state, bool const is_value, bool const is_line_end)
+{
+  if (is_value && state->line_values++) {
+    state->error = "Expected newline";
+    return false;
+  }
+
+  if (is_line_end) {
+    if (sajs_lexer_depth(state->lexer)) {
+      state->error = "Unexpected newline";
+      return false;
+    }
+
+    state->line_values = 0U;
+  }
+
+  return true;
+}
+
+// Return the exit status for the end of reading all input
 static int
-run(PipeState* const state, FILE* const in_stream)
+finish(PipeState const* const state, SajsStatus const st)
 {
-  uintptr_t         write_mem[8U] = {0U, 0U, 0U, 0U};
-  SajsWriter* const writer = sajs_writer_init(sizeof(write_mem), write_mem);
+  char const* const message = state->error           ? state->error
+                              : (st > SAJS_FAILURE) ? sajs_strerror(st)
+                                                    : NULL;
+
+  // Any number of values may be extracted from a single document
+  bool const is_single = !state->ndjson && !state->filter;
+
+  // Errors in the input are at the position of the lexer, if it's known
+  SajsPosition const* const position =
+    (st != SAJS_BAD_WRITE) ? state->position : NULL;
+
+  if (message) {
+    (void)fprintf(stderr, "error: ");
+    if (position) {
+      (void)fprintf(
+        stderr, "%" PRIu64 ":%" PRIu64 ": ", position->line, position->column);
+    }
+
+    if (state->ndjson) {
+      (void)fprintf(stderr, "document %u: ", state->num_values + 1U);
+    }
+
+    (void)fprintf(stderr, "%s\n", message);
+  }
+
+  return state->error                            ? 65 // EX_DATAERR
+         : (is_single && state->num_values != 1U) ? 65 // EX_DATAERR
+         : (st == SAJS_FAILURE)                   ? 0
+                                                  : ((int)st + 100);
+}
+
+// Print the statistics collected while reading and writing
+static void
+print_stats(SajsLexerStats const* const  lexer,
+            SajsWriterStats const* const writer)
+{
+  static char const* const event_names[] = {
+    "nothing", "start", "end", "double_end", "bytes"};
+
+  static char const* const class_names[] = {
+    "structure", "string", "escape", "number", "literal"};
+
+  for (unsigned i = 0U; i <= SAJS_EVENT_BYTES; ++i) {
+    (void)fprintf(stderr,
+                  "read.events.%-10s %20" PRIu64 "\n",
+                  event_names[i],
+                  lexer->events[i]);
+  }
+
+  for (unsigned i = 0U; i <= SAJS_STATE_LITERAL; ++i) {
+    (void)fprintf(stderr,
+                  "read.bytes.%-11s %20" PRIu64 "\n",
+                  class_names[i],
+                  lexer->bytes[i]);
+  }
+
+  (void)fprintf(stderr, "read.retries %30" PRIu64 "\n", lexer->retries);
+  (void)fprintf(stderr, "read.escapes %30" PRIu64 "\n", lexer->escapes);
+  (void)fprintf(stderr, "read.max_depth %28" PRIu64 "\n", lexer->max_depth);
+
+  for (unsigned i = 0U; i <= SAJS_EVENT_BYTES; ++i) {
+    (void)fprintf(stderr,
+                  "write.events.%-10s %19" PRIu64 "\n",
+                  event_names[i],
+                  writer->events[i]);
+  }
+
+  (void)fprintf(stderr, "write.escapes %29" PRIu64 "\n", writer->escapes);
+  (void)fprintf(stderr, "write.max_depth %27" PRIu64 "\n", writer->max_depth);
+}
+
+static SajsStatus
+run(PipeState* const state)
+{
+  EventBatch  batch;
+  char        buf[4096U];
+  char const* data   = buf;
+  size_t      length = 0U;
+  size_t      offset = 0U;
+  size_t      end    = 0U;
+
+  batch.num_events = 0U;
 
   SajsStatus st = SAJS_SUCCESS;
   while (!st) {
-    SajsEvent const e = sajs_read_byte(state->lexer, fgetc(in_stream));
+    if (offset == length) { // Refill buffer, reading nothing signals EOF
+      if ((st = flush_events(state, &batch))) {
+        break; // Spans in the batch point into the buffer
+      }
+
+      length = read_input(state, sizeof(buf), buf, &data);
+      offset = 0U;
+      end    = 0U;
+      if (!length && state->is_partial) {
+        st = SAJS_RETRY; // End of this part of the input
+        break;
+      }
+    }
+
+    if (offset == end) {
+      end = read_end(state, length, data, offset);
+    }
+
+    size_t          count = 0U;
+    SajsEvent const e =
+      state->filter ? sajs_filter_read(state->filter,
+                                       state->lexer,
+                                       end - offset,
+                                       data + offset,
+                                       &count)
+                    : sajs_read_spans(
+                        state->lexer, end - offset, data + offset, &count);
+
+    offset += count;
+    if (!(st = e.status)) {
+      // Check lines (extracted values aren't documents) and update state
+      bool const is_root_start = e.type == SAJS_EVENT_START &&
+                                 (e.flags & SAJS_IS_ROOT) && !state->filter;
+      bool const is_line_end = end != 0U && offset == end &&
+                               data[end - 1U] == '\n';
+      if (state->ndjson && !check_line(state, is_root_start, is_line_end)) {
+        break;
+      }
+
+      state->num_values += update_depth(state, e) ? 1U : 0U;
+
+      // Record the event, or add it to the batch and write that if it's full
+      if (state->tape) {
+        st = record_event(state->tape, state->lexer, e);
+      } else {
+        add_event(&batch, e, sajs_string(state->lexer));
+        if (batch.num_events == sizeof(batch.events) / sizeof(SajsEvent)) {
+          st = flush_events(state, &batch);
+        }
+      }
+    }
+  }
+
+  SajsStatus const flush_st = flush_events(state, &batch);
+  return flush_st ? flush_st : st;
+}
+
+// Replay a tape in memory as output
+static SajsStatus
+run_tape(PipeState* const state, bool const validate)
+{
+  EventBatch            batch;
+  uintptr_t             mem[128U / sizeof(uintptr_t)];
+  SajsTapeReader* const reader =
+    sajs_tape_reader_init(sizeof(mem), mem, state->in_length, state->in_data);
+
+  if (!reader) {
+    state->error = "Input isn't a tape";
+    return SAJS_FAILURE;
+  }
+
+  batch.num_events = 0U;
+
+  SajsStatus st = SAJS_SUCCESS;
+  while (!st) {
+    SajsEvent const e = sajs_tape_read(reader);
     if (!(st = e.status)) {
-      // Update state
-      bool const is_top_end = update_depth(state, e);
-
-      // Write output
-      SajsStringView const string = sajs_string(state->lexer);
-      SajsTextOutput const out    = sajs_write_event(writer, e, string);
-      st = write_output(out, state->terse, state->out_stream);
-
-      if (!st && is_top_end) { // Write top-level trailing newline
-        ++state->num_values;
-        st = (fwrite("\n", 1U, 1U, state->out_stream) == 1U) ? SAJS_SUCCESS
-                                                             : SAJS_BAD_WRITE;
+      state->num_values += update_depth(state, e) ? 1U : 0U;
+      if (!validate) {
+        add_event(&batch, e, sajs_tape_string(reader));
+        if (batch.num_events == sizeof(batch.events) / sizeof(SajsEvent)) {
+          st = flush_events(state, &batch);
+        }
+      }
+    }
+  }
+
+  SajsStatus const flush_st = flush_events(state, &batch);
+  return flush_st ? flush_st : st;
+}
+
+static SajsStatus
+run_validate(PipeState* const state)
+{
+  char        buf[4096U];
+  char const* data   = buf;
+  size_t      length = 0U;
+  size_t      offset = 0U;
+  size_t      end    = 0U;
+
+  SajsStatus st = SAJS_SUCCESS;
+  while (!st || st == SAJS_RETRY) {
+    if (offset == length) { // Refill buffer, reading nothing signals EOF
+      length = read_input(state, sizeof(buf), buf, &data);
+      offset = 0U;
+      end    = 0U;
+      if (!length && state->is_partial) {
+        return SAJS_RETRY; // End of this part of the input
+      }
+    }
+
+    if (offset == end) {
+      end = read_end(state, length, data, offset);
+    }
+
+    size_t count    = 0U;
+    bool   is_value = false;
+    if (state->ndjson && state->line_values) {
+      // Read the rest of the line as events to stop at the start of any value
+      SajsEvent const e =
+        sajs_read_spans(state->lexer, end - offset, data + offset, &count);
+
+      st       = e.status;
+      is_value = !st && e.type == SAJS_EVENT_START;
+    } else {
+      st = sajs_validate(state->lexer, end - offset, data + offset, &count);
+      is_value = !st;
+    }
+
+    offset += count;
+    if (!st || st == SAJS_RETRY) {
+      bool const is_line_end = end != 0U && offset == end &&
+                               data[end - 1U] == '\n';
+      if (state->ndjson && !check_line(state, is_value, is_line_end)) {
+        break;
       }
+
+      state->num_values += is_value ? 1U : 0U;
+    }
+  }
+
+  return st;
+}
+
+// Reformat valid input in memory directly, or read it as events if invalid
+static SajsStatus
+run_text(PipeState* const state)
+{
+  char const* const data   = state->in_data;
+  size_t const      length = state->in_length;
+
+  // Check all the input first, since only valid text can be copied
+  SajsStatus st = run_validate(state);
+  if (st != SAJS_FAILURE || state->error) {
+    // Start again with events, to write everything up to the error
+    state->in_data     = data;
+    state->in_length   = length;
+    state->error       = NULL;
+    state->num_values  = 0U;
+    state->line_values = 0U;
+    sajs_lexer_reset(state->lexer);
+    if (state->position) {
+      state->position->offset = 0U;
+      state->position->line   = 1U;
+      state->position->column = 1U;
+    }
+
+    return run(state);
+  }
+
+  // Render directly into the raw output buffer if there is one
+  SajsWriteFlags const flags =
+    SAJS_WRITE_NEWLINES | (state->terse ? SAJS_WRITE_TERSE : 0U);
+  PipeBuffer* const out = state->out_buf;
+  char              text[16384U];
+
+  for (size_t offset = 0U;;) {
+    if (out && out->length == out->size && flush_raw(out)) {
+      return SAJS_BAD_WRITE;
     }
+
+    size_t const left        = length - offset;
+    size_t       count       = 0U;
+    size_t       text_length = 0U;
+
+    st = sajs_write_text(state->writer,
+                         flags,
+                         left,
+                         data + offset,
+                         &count,
+                         out ? (out->size - out->length) : sizeof(text),
+                         out ? (out->data + out->length) : text,
+                         &text_length);
+
+    offset += count;
+    if (out) {
+      out->length += text_length;
+    } else if (write_output(state, text_length, text)) {
+      return SAJS_BAD_WRITE;
+    }
+
+    if (!st && !left) {
+      return SAJS_FAILURE; // End of input
+    }
+  }
+}
+
+#ifdef SAJS_PIPE_PARALLEL
+
+static size_t const parallel_chunk_size = 4194304U; ///< Input bytes per task
+
+/// A task that processes part of the input in a worker thread
+typedef struct {
+  PipeState       state;        ///< Pipe state for this part
+  SajsPosition    position;     ///< Position of the lexer in this part
+  char const*     begin;        ///< Start of this part in the input
+  void*           mem;          ///< Lexer memory
+  uintptr_t       write_mem[8]; ///< Writer memory
+  SajsLexerStats  lexer_stats;  ///< Statistics for reading this part
+  SajsWriterStats writer_stats; ///< Statistics for writing this part
+  char*           out;          ///< Output text
+  size_t          out_size;     ///< Length of output text
+  SajsValueKind   kind;         ///< Kind of container to resume in, or zero
+  SajsStatus      status;       ///< Final status of reading the part
+  bool            validate;     ///< True if only checking input
+} PipeTask;
+
+/// A task that scans the structure of some chunks of a document
+typedef struct {
+  SajsChunk*  chunks;     ///< First chunk to scan
+  size_t      num_chunks; ///< Number of chunks to scan
+  size_t      length;     ///< Length of the whole document
+  char const* data;       ///< The whole document
+} ScanTask;
+
+// Start a thread, or run the function in this thread if that fails
+static void
+start_thread(pthread_t* const thread,
+             void* (*const func)(void*),
+             void* const arg)
+{
+  if (pthread_create(thread, NULL, func, arg)) {
+    func(arg);
+    *thread = pthread_self();
+  }
+}
+
+// Wait for a thread started by start_thread() to finish
+static void
+join_thread(pthread_t const thread)
+{
+  if (!pthread_equal(thread, pthread_self())) {
+    pthread_join(thread, NULL);
+  }
+}
+
+// Set up a task to read some input
+static void
+setup_task(PipeTask* const     task,
+           char const* const   data,
+           size_t const        length,
+           bool const          is_partial,
+           SajsValueKind const kind)
+{
+  SajsPosition const start = {0U, 1U, 1U};
+
+  task->state.in_data     = data;
+  task->state.in_length   = length;
+  task->state.error       = NULL;
+  task->state.num_values  = 0U;
+  task->state.line_values = 0U;
+  task->state.depth       = kind ? 1U : 0U;
+  task->state.is_partial  = is_partial;
+  task->position          = start;
+  task->begin             = data;
+  task->out               = NULL;
+  task->out_size          = 0U;
+  task->kind              = kind;
+}
+
+static void*
+run_task(void* const arg)
+{
+  PipeTask* const  task  = (PipeTask*)arg;
+  PipeState* const state = &task->state;
+
+  // Set up the lexer and writer as if they've read up to this part
+  state->writer = sajs_writer_init(sizeof(task->write_mem), task->write_mem);
+  if (task->kind) {
+    SajsEvent const      start = {
+      SAJS_SUCCESS, SAJS_EVENT_START, task->kind, SAJS_IS_ROOT};
+    SajsStringView const empty = {"", 0U};
+
+    sajs_lexer_resume(state->lexer, task->kind);
+    sajs_write_event(state->writer, start, empty);
+  } else {
+    sajs_lexer_reset(state->lexer);
+  }
+
+  sajs_writer_set_stats(state->writer, state->writer_stats);
+  if (task->validate) {
+    task->status = run_validate(state);
+    return NULL;
+  }
+
+  if (!(state->out_stream = open_memstream(&task->out, &task->out_size))) {
+    task->status = SAJS_BAD_WRITE;
+    return NULL;
+  }
+
+  task->status = run(state);
+  if (fclose(state->out_stream) && task->status <= SAJS_RETRY) {
+    task->status = SAJS_BAD_WRITE;
+  }
+
+  return NULL;
+}
+
+static void*
+run_scan_task(void* const arg)
+{
+  ScanTask const* const task = (ScanTask const*)arg;
+
+  for (size_t i = 0U; i < task->num_chunks; ++i) {
+    sajs_scan_chunk(task->length, task->data, &task->chunks[i]);
+  }
+
+  return NULL;
+}
+
+// Set the position of the lexer to the error in a task, or unknown
+static void
+locate_error(PipeState* const      state,
+             PipeTask const* const task,
+             char const* const     data)
+{
+  SajsPosition* const       position = state->position;
+  SajsPosition const* const part     = task->state.position;
+  if (!position || !part) {
+    state->position = NULL;
+    return;
+  }
+
+  // Find the line that the part begins on, and where that line starts
+  size_t const begin      = (size_t)(task->begin - data);
+  uint64_t     line       = 1U;
+  size_t       line_start = 0U;
+  for (size_t i = 0U; i < begin; ++i) {
+    if (data[i] == '\n') {
+      line_start = i + 1U;
+      ++line;
+    }
+  }
+
+  // Shift the position in the part by everything before it
+  position->offset = begin + part->offset;
+  position->line   = line + part->line - 1U;
+  position->column = (part->line == 1U)
+                       ? (begin - line_start) + part->column
+                       : part->column;
+}
+
+// Write the output of a finished task, and return its status
+static SajsStatus
+finish_task(PipeState* const      state,
+            PipeTask const* const task,
+            char const* const     data)
+{
+  if (write_output(state, task->out_size, task->out)) {
+    return SAJS_BAD_WRITE;
   }
 
-  if (st > SAJS_FAILURE) {
-    (void)fprintf(stderr, "error: %s\n", sajs_strerror(st));
+  // The task read with its own lexer, so its position is relative to its part
+  if (task->state.error || task->status > SAJS_RETRY) {
+    locate_error(state, task, data);
   }
 
-  return (state->num_values != 1U) ? 65 // EX_DATAERR
-         : (st == SAJS_FAILURE)    ? 0
-                                   : ((int)st + 100);
+  state->error = task->state.error;
+  state->num_values += task->state.num_values;
+  return task->status;
+}
+
+// Return the end of a chunk starting at offset, just after a newline
+static size_t
+chunk_end(size_t const length, char const* const data, size_t const offset)
+{
+  size_t const min_end = offset + parallel_chunk_size;
+  if (min_end >= length) {
+    return length;
+  }
+
+  char const* const next =
+    (char const*)memchr(data + min_end, '\n', length - min_end);
+
+  return next ? (size_t)(next + 1 - data) : length;
+}
+
+// Run tasks on a round of chunks of lines, and write their output in order
+static SajsStatus
+run_lines(PipeState* const  state,
+          unsigned const    num_tasks,
+          PipeTask* const   tasks,
+          pthread_t* const  threads,
+          size_t const      length,
+          char const* const data,
+          size_t* const     offset)
+{
+  // Start a thread for each chunk
+  unsigned n = 0U;
+  for (; n < num_tasks && *offset < length; ++n) {
+    size_t const end = chunk_end(length, data, *offset);
+
+    setup_task(
+      &tasks[n], data + *offset, end - *offset, false, (SajsValueKind)0);
+    start_thread(&threads[n], run_task, &tasks[n]);
+    *offset = end;
+  }
+
+  // Finish each task in order until the first error
+  SajsStatus st = SAJS_FAILURE;
+  for (unsigned i = 0U; i < n; ++i) {
+    join_thread(threads[i]);
+    if (st == SAJS_FAILURE && !state->error) {
+      st = finish_task(state, &tasks[i], data);
+    }
+
+    free(tasks[i].out);
+  }
+
+  return st;
+}
+
+// Find where a document can be split, and return the number of parts
+static size_t
+split_document(unsigned const    num_tasks,
+               ScanTask* const   scans,
+               pthread_t* const  threads,
+               size_t const      length,
+               char const* const data,
+               size_t const      num_chunks,
+               SajsChunk* const  chunks,
+               size_t* const     starts)
+{
+  // Scan the structure of every chunk in parallel
+  for (size_t i = 0U; i < num_chunks; ++i) {
+    chunks[i].begin = (size_t)((uint64_t)length * i / num_chunks);
+    chunks[i].end   = (size_t)((uint64_t)length * (i + 1U) / num_chunks);
+  }
+
+  for (unsigned t = 0U; t < num_tasks; ++t) {
+    size_t const first = num_chunks * t / num_tasks;
+    size_t const last  = num_chunks * (t + 1U) / num_tasks;
+    ScanTask     scan  = {chunks + first, last - first, length, data};
+
+    scans[t] = scan;
+    start_thread(&threads[t], run_scan_task, &scans[t]);
+  }
+
+  for (unsigned t = 0U; t < num_tasks; ++t) {
+    join_thread(threads[t]);
+  }
+
+  // Link the chunks in order and find the first split in each
+  size_t num_parts = 1U;
+  starts[0]        = 0U;
+  for (size_t i = 0U; i < num_chunks; ++i) {
+    sajs_link_chunk(i ? &chunks[i - 1U] : NULL, &chunks[i]);
+
+    size_t const split = i ? sajs_find_split(length, data, &chunks[i]) : 0U;
+    if (split) {
+      starts[num_parts++] = split;
+    }
+  }
+
+  return num_parts;
+}
+
+// Return true if a task stopped at a split where the next part can resume
+static bool
+can_resume(PipeTask const* const task)
+{
+  return task->status == SAJS_RETRY && !task->state.num_values &&
+         sajs_lexer_depth(task->state.lexer) == 1U;
+}
+
+/**
+   Read the rest of a document after a task with one thread.
+
+   This is used if a task didn't end where the next part can resume, which
+   means the document was split incorrectly (so it must be invalid).  The
+   lexer and writer of the task are in the correct state, so reading can
+   continue from there to find the error, exactly as if it wasn't split.
+*/
+static SajsStatus
+read_rest(PipeState* const  state,
+          PipeTask* const   task,
+          size_t const      length,
+          char const* const data)
+{
+  PipeState* const rest = &task->state;
+
+  rest->out_stream = state->out_stream;
+  rest->out_buf    = state->out_buf;
+  rest->in_length  = length - (size_t)(rest->in_data - data);
+  rest->num_values = 0U;
+  rest->is_partial = false;
+
+  SajsStatus const st = task->validate ? run_validate(rest) : run(rest);
+  if (rest->error || st > SAJS_RETRY) {
+    locate_error(state, task, data);
+  }
+
+  state->error = rest->error;
+  state->num_values += rest->num_values;
+  return st;
+}
+
+// Read a single document by splitting it into parts between top-level items
+static SajsStatus
+run_document(PipeState* const  state,
+             unsigned const    num_tasks,
+             PipeTask* const   tasks,
+             pthread_t* const  threads,
+             size_t const      length,
+             char const* const data,
+             bool const        validate)
+{
+  // Only a top-level array or object can be split
+  size_t first = 0U;
+  while (first < length && (data[first] == ' ' || data[first] == '\t' ||
+                            data[first] == '\n' || data[first] == '\r')) {
+    ++first;
+  }
+
+  SajsValueKind const kind = (first == length)    ? (SajsValueKind)0
+                             : data[first] == '[' ? SAJS_ARRAY
+                             : data[first] == '{' ? SAJS_OBJECT
+                                                  : (SajsValueKind)0;
+
+  size_t const     num_chunks = kind ? (length / parallel_chunk_size) : 0U;
+  SajsChunk* const chunks = (SajsChunk*)calloc(num_chunks, sizeof(SajsChunk));
+  size_t* const    starts = (size_t*)calloc(num_chunks, sizeof(size_t));
+  ScanTask* const  scans  = (ScanTask*)calloc(num_tasks, sizeof(ScanTask));
+
+  size_t num_parts = 0U;
+  if (num_chunks > 1U && chunks && starts && scans) {
+    num_parts = split_document(
+      num_tasks, scans, threads, length, data, num_chunks, chunks, starts);
+  }
+
+  // Read each round of parts in parallel, then finish them in order
+  SajsStatus st = num_parts ? SAJS_RETRY : SAJS_FAILURE;
+  for (size_t p = 0U; p < num_parts && st == SAJS_RETRY; p += num_tasks) {
+    unsigned n = 0U;
+    for (; n < num_tasks && p + n < num_parts; ++n) {
+      size_t const i   = p + n;
+      size_t const end = (i + 1U < num_parts) ? starts[i + 1U] : length;
+
+      setup_task(&tasks[n],
+                 data + starts[i],
+                 end - starts[i],
+                 i + 1U < num_parts,
+                 i ? kind : (SajsValueKind)0);
+      start_thread(&threads[n], run_task, &tasks[n]);
+    }
+
+    PipeTask* rest = NULL;
+    for (unsigned i = 0U; i < n; ++i) {
+      join_thread(threads[i]);
+      if (st == SAJS_RETRY) {
+        st = finish_task(state, &tasks[i], data);
+        if (st == SAJS_RETRY && !can_resume(&tasks[i])) {
+          rest = &tasks[i];
+          st   = SAJS_SUCCESS;
+        }
+      }
+
+      free(tasks[i].out);
+    }
+
+    if (rest) {
+      st = read_rest(state, rest, length, data);
+    }
+  }
+
+  free(scans);
+  free(starts);
+  free(chunks);
+  return num_parts ? st : validate ? run_validate(state) : run(state);
+}
+
+// Add the statistics from a task to the totals
+static void
+add_stats(PipeState* const state, PipeTask const* const task)
+{
+  SajsLexerStats* const        lexer       = state->lexer_stats;
+  SajsWriterStats* const       writer      = state->writer_stats;
+  SajsLexerStats const* const  part_lexer  = &task->lexer_stats;
+  SajsWriterStats const* const part_writer = &task->writer_stats;
+
+  for (unsigned i = 0U; i <= SAJS_EVENT_BYTES; ++i) {
+    lexer->events[i] += part_lexer->events[i];
+    writer->events[i] += part_writer->events[i];
+  }
+
+  for (unsigned i = 0U; i <= SAJS_STATE_LITERAL; ++i) {
+    lexer->bytes[i] += part_lexer->bytes[i];
+  }
+
+  lexer->retries += part_lexer->retries;
+  lexer->escapes += part_lexer->escapes;
+  writer->escapes += part_writer->escapes;
+  if (part_lexer->max_depth > lexer->max_depth) {
+    lexer->max_depth = part_lexer->max_depth;
+  }
+
+  if (part_writer->max_depth > writer->max_depth) {
+    writer->max_depth = part_writer->max_depth;
+  }
+}
+
+static SajsStatus
+run_parallel(PipeState* const state,
+             unsigned const   num_tasks,
+             size_t const     mem_size,
+             bool const       validate)
+{
+  PipeTask* const  tasks   = (PipeTask*)calloc(num_tasks, sizeof(PipeTask));
+  pthread_t* const threads = (pthread_t*)calloc(num_tasks, sizeof(pthread_t));
+
+  // Set up a lexer for every task
+  unsigned n = 0U;
+  for (; tasks && threads && n < num_tasks; ++n) {
+    PipeTask* const task = &tasks[n];
+    if (!(task->mem = malloc(mem_size)) ||
+        !(task->state.lexer = sajs_lexer_init(mem_size, task->mem))) {
+      break;
+    }
+
+    if (state->position &&
+        !sajs_lexer_set_position(task->state.lexer, &task->position)) {
+      task->state.position = &task->position;
+    }
+
+    task->state.terse  = state->terse;
+    task->state.ndjson = state->ndjson;
+    task->validate     = validate;
+    if (state->lexer_stats) {
+      task->state.lexer_stats  = &task->lexer_stats;
+      task->state.writer_stats = &task->writer_stats;
+      sajs_lexer_set_stats(task->state.lexer, &task->lexer_stats);
+    }
+  }
+
+  // The whole input must be mapped into memory to split it between tasks
+  SajsStatus        st     = SAJS_FAILURE;
+  char const* const data   = state->in_data;
+  size_t const      length = state->in_length;
+  if (state->in_stream || !length || n < num_tasks) {
+    // Fall back to reading the input in this thread
+    st = validate ? run_validate(state) : run(state);
+  } else if (state->ndjson) {
+    for (size_t offset = 0U; offset < length && st == SAJS_FAILURE;) {
+      st = run_lines(state, num_tasks, tasks, threads, length, data, &offset);
+    }
+  } else {
+    st = run_document(state, num_tasks, tasks, threads, length, data, validate);
+  }
+
+  for (unsigned i = 0U; i < n; ++i) {
+    if (state->lexer_stats) {
+      add_stats(state, &tasks[i]);
+    }
+
+    free(tasks[i].mem);
+  }
+
+  free(threads);
+  free(tasks);
+  return st;
+}
+
+#endif
+
+// Map an input file into memory, or return null if it isn't a regular file
+static void*
+map_input(FILE* const stream, size_t* const length)
+{
+#ifdef SAJS_PIPE_POSIX
+  int const   fd   = fileno(stream);
+  struct stat info = {0};
+  if (!fstat(fd, &info) && S_ISREG(info.st_mode) && info.st_size > 0 &&
+      (uintmax_t)info.st_size <= SIZE_MAX) {
+    void* const map =
+      mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (map != MAP_FAILED) {
+      posix_madvise(map, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+      *length = (size_t)info.st_size;
+      return map;
+    }
+  }
+#else
+  (void)stream;
+#endif
+
+  *length = 0U;
+  return NULL;
+}
+
+// Unmap an input file mapped by map_input()
+static void
+unmap_input(void* const map, size_t const length)
+{
+#ifdef SAJS_PIPE_POSIX
+  if (map) {
+    munmap(map, length);
+  }
+#else
+  (void)map;
+  (void)length;
+#endif
+}
+
+// Read all the input from a stream into a new buffer
+static char*
+read_all(FILE* const stream, size_t* const length)
+{
+  size_t size = 65536U;
+  char*  data = (char*)malloc(size);
+
+  *length = 0U;
+  while (data) {
+    *length += fread(data + *length, 1U, size - *length, stream);
+    if (*length < size) {
+      break; // End of input, or an error
+    }
+
+    char* const new_data = (char*)realloc(data, size * 2U);
+    if (!new_data) {
+      free(data);
+      return NULL;
+    }
+
+    data = new_data;
+    size *= 2U;
+  }
+
+  return data;
+}
+
+// Set up a raw buffer for a stream, or return null to use stdio instead
+static PipeBuffer*
+setup_buffer(PipeBuffer* const buf, FILE* const stream, bool const enable)
+{
+#ifdef SAJS_PIPE_POSIX
+  buf->data   = enable ? (char*)malloc(raw_buffer_size) : NULL;
+  buf->size   = buf->data ? raw_buffer_size : 0U;
+  buf->length = 0U;
+  buf->fd     = buf->data ? fileno(stream) : -1;
+  return buf->data ? buf : NULL;
+#else
+  (void)buf;
+  (void)stream;
+  (void)enable;
+  return NULL;
+#endif
+}
+
+// Run the selected mode over all the input
+static SajsStatus
+run_all(PipeState* const         state,
+        PipeOptions const* const opts,
+        size_t const             mem_size)
+{
+  if (opts->read_tape) {
+    return run_tape(state, opts->validate);
+  }
+
+#ifdef SAJS_PIPE_PARALLEL
+  if (opts->num_jobs > 1U && !state->filter && !state->tape) {
+    return run_parallel(state, opts->num_jobs, mem_size, opts->validate);
+  }
+#else
+  (void)mem_size;
+#endif
+
+  // Input in memory can be reformatted without events, unless they're needed
+  if (!state->in_stream && !state->filter && !state->tape && !state->ndjson &&
+      !opts->stats && !opts->validate) {
+    return run_text(state);
+  }
+
+  return opts->validate ? run_validate(state) : run(state);
 }
 
 static int
@@ -154,12 +1257,21 @@ static int
 print_usage(char const* const name, bool const error)
 {
   (void)fprintf(stderr,
-                "Usage: %s [INPUT]\n"
+                "Usage: %s [OPTION]... [INPUT]\n"
                 "Read and write JSON.\n\n"
-                "  -V           Display version information and exit.\n"
-                "  -h           Display this help and exit.\n"
-                "  -o FILENAME  Write output to FILENAME instead of stdout.\n"
-                "  -t           Write terse output without newlines.\n",
+                "  -E             Read a binary event tape instead of JSON.\n"
+                "  -V, --version  Display version information and exit.\n"
+                "  -e             Write a binary event tape instead of JSON.\n"
+                "  -h, --help     Display this help and exit.\n"
+                "  -j JOBS        Use JOBS threads to read large files.\n"
+                "  -l, --ndjson   Read and write newline-delimited JSON.\n"
+                "  -n             Only check input, without writing output.\n"
+                "  -o FILENAME    Write output to FILENAME instead of stdout.\n"
+                "  -p POINTER     Only write values at JSON Pointer POINTER.\n"
+                "  -r METHOD      Read input with stdio, read, or mmap.\n"
+                "  -s, --stats    Print reading and writing statistics.\n"
+                "  -t             Write terse output without newlines.\n"
+                "  -w METHOD      Write output with stdio or write.\n",
                 name);
   return error ? -1 : 0;
 }
@@ -194,60 +1306,192 @@ missing_arg(char const* const name, char const opt)
   return print_usage(name, true);
 }
 
+// Parse a positive integer argument up to max, or return zero on error
+static long
+parse_count(char const* const string, long const max)
+{
+  char*      endptr = NULL;
+  long const count  = strtol(string, &endptr, 10);
+
+  return (count > 0 && count <= max && *endptr == '\0') ? count : 0;
+}
+
+// Parse the name of an I/O method, or return -1 if it isn't supported
+static int
+parse_method(char const* const string, char const* const* const names)
+{
+  for (int i = 0; names[i]; ++i) {
+    if (!strcmp(string, names[i])) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
 static int
 parse_flag(PipeOptions* const opts,
            int const          argc,
            char** const       argv,
            int const          a,
-           int const          o)
+           char const         opt,
+           bool const         last)
 {
   char const* const name = argv[0];
 
-  switch (argv[a][o]) {
+  switch (opt) {
+  case 'E':
+    opts->read_tape = true;
+    return 1;
   case 'V':
     return print_version();
+  case 'e':
+    opts->write_tape = true;
+    return 1;
   case 'h':
     return print_usage(name, false);
+  case 'l':
+    opts->ndjson = true;
+    opts->terse  = true;
+    return 1;
+  case 'n':
+    opts->validate = true;
+    return 1;
+  case 's':
+    opts->stats = true;
+    return 1;
   case 't':
     opts->terse = true;
     return 1;
   case 'k':
-    if (argv[a][o + 1] || a + 1 == argc) {
+    if (!last || a + 1 == argc) {
       return missing_arg(name, 'k');
     }
 
-    char const* const string = argv[a + 1];
-    char*             endptr = NULL;
-    long const        size   = strtol(string, &endptr, 10);
-    if (size <= 0 || size == LONG_MAX || *endptr != '\0') {
-      log_error("%s: invalid size \"%s\"\n\n", name, string);
+    long const size = parse_count(argv[a + 1], LONG_MAX - 1);
+    if (!size) {
+      log_error("%s: invalid size \"%s\"\n\n", name, argv[a + 1]);
       return print_usage(name, true);
     }
 
     opts->stack_size = (size_t)size;
     return 2;
 
+  case 'j':
+    if (!last || a + 1 == argc) {
+      return missing_arg(name, 'j');
+    }
+
+    long const jobs = parse_count(argv[a + 1], 4096);
+    if (!jobs) {
+      log_error("%s: invalid number of jobs \"%s\"\n\n", name, argv[a + 1]);
+      return print_usage(name, true);
+    }
+
+    opts->num_jobs = (unsigned)jobs;
+    return 2;
+
   case 'o':
-    if (argv[a][o + 1] || a + 1 == argc) {
+    if (!last || a + 1 == argc) {
       return missing_arg(name, 'o');
     }
 
     opts->out_path = argv[a + 1];
     return 2;
 
+  case 'p':
+    if (!last || a + 1 == argc) {
+      return missing_arg(name, 'p');
+    }
+
+    if (opts->num_pointers ==
+        sizeof(opts->pointers) / sizeof(opts->pointers[0])) {
+      log_error("%s: too many pointers\n\n", name);
+      return print_usage(name, true);
+    }
+
+    opts->pointers[opts->num_pointers++] = argv[a + 1];
+    return 2;
+
+  case 'r':
+    if (!last || a + 1 == argc) {
+      return missing_arg(name, 'r');
+    }
+
+    int const read_method = parse_method(argv[a + 1], read_methods);
+    if (read_method < 0) {
+      log_error("%s: invalid read method \"%s\"\n\n", name, argv[a + 1]);
+      return print_usage(name, true);
+    }
+
+    opts->read_method = (ReadMethod)read_method;
+    return 2;
+
+  case 'w':
+    if (!last || a + 1 == argc) {
+      return missing_arg(name, 'w');
+    }
+
+    int const write_method = parse_method(argv[a + 1], write_methods);
+    if (write_method < 0) {
+      log_error("%s: invalid write method \"%s\"\n\n", name, argv[a + 1]);
+      return print_usage(name, true);
+    }
+
+    opts->write_method = (WriteMethod)write_method;
+    return 2;
+
   default:
-    log_error("%s: invalid option -- '%c'\n\n", name, argv[a][o]);
+    log_error("%s: invalid option -- '%c'\n\n", name, opt);
     return print_usage(name, true);
   }
 }
 
+static int
+parse_long_flag(PipeOptions* const opts,
+                int const          argc,
+                char** const       argv,
+                int const          a)
+{
+  static char const* const names[][2] = {
+    {"help", "h"},
+    {"ndjson", "l"},
+    {"stats", "s"},
+    {"version", "V"},
+  };
+
+  for (size_t i = 0U; i < sizeof(names) / sizeof(names[0]); ++i) {
+    if (!strcmp(argv[a] + 2, names[i][0])) {
+      return parse_flag(opts, argc, argv, a, names[i][1][0], true);
+    }
+  }
+
+  log_error("%s: unrecognized option '%s'\n\n", argv[0], argv[a]);
+  return print_usage(argv[0], true);
+}
+
 static int
 parse_args(PipeOptions* const opts, int const argc, char** const argv)
 {
   int a = 1;
   for (; a < argc && argv[a][0] == '-'; ++a) {
+    if (argv[a][1] == '-' && !argv[a][2]) {
+      ++a; // End of options
+      break;
+    }
+
+    if (argv[a][1] == '-') {
+      int const rc = parse_long_flag(opts, argc, argv, a);
+      if (rc <= 0) {
+        return rc;
+      }
+
+      continue;
+    }
+
     for (int o = 1; argv[a][o]; ++o) {
-      int const rc = parse_flag(opts, argc, argv, a, o);
+      int const rc =
+        parse_flag(opts, argc, argv, a, argv[a][o], !argv[a][o + 1]);
       if (rc <= 0) {
         return rc;
       }
@@ -267,12 +1511,55 @@ main(int const argc, char** const argv)
 {
   // Parse command line options
   char const* const name = argv[0];
-  PipeOptions       opts = {NULL, default_stack_size, false};
-  int const         a    = parse_args(&opts, argc, argv);
+  PipeOptions       opts = {NULL,
+                            {NULL},
+                            0U,
+                            default_stack_size,
+                            1U,
+                            default_read_method,
+                            default_write_method,
+                            false,
+                            false,
+                            false,
+                            false,
+                            false,
+                            false};
+
+  int const a = parse_args(&opts, argc, argv);
   if (a <= 0) {
     return a;
   }
 
+  if (opts.read_tape && (opts.num_pointers || opts.write_tape)) {
+    log_error("%s: -E can't be used with -e or -p\n\n", name);
+    return print_usage(name, true);
+  }
+
+  // Set up the writer first to check that statistics are supported
+  uintptr_t         write_mem[8U] = {0U, 0U, 0U, 0U};
+  SajsWriter* const writer = sajs_writer_init(sizeof(write_mem), write_mem);
+  SajsLexerStats    lexer_stats  = {{0U}, {0U}, 0U, 0U, 0U};
+  SajsWriterStats   writer_stats = {{0U}, 0U, 0U};
+  if (opts.stats && sajs_writer_set_stats(writer, &writer_stats)) {
+    return log_error("%s: statistics aren't supported by this build\n", name);
+  }
+
+  // Set up the filter if any pointers are given
+  uintptr_t         filter_mem[4096U / sizeof(uintptr_t)] = {0U};
+  SajsFilter* const filter =
+    opts.num_pointers ? sajs_filter_init(sizeof(filter_mem), filter_mem) : NULL;
+  for (unsigned i = 0U; i < opts.num_pointers; ++i) {
+    char const* const pointer = opts.pointers[i];
+    SajsStatus const  st = sajs_filter_add(filter, strlen(pointer), pointer);
+    if (st) {
+      return log_error("%s: %s \"%s\"\n",
+                       name,
+                       (st == SAJS_OVERFLOW) ? "too many pointers at"
+                                             : "invalid pointer",
+                       pointer);
+    }
+  }
+
   // Open input stream
   FILE* const in_stream = a < argc ? fopen(argv[a], "r") : stdin;
   if (!in_stream) {
@@ -287,15 +1574,90 @@ main(int const argc, char** const argv)
     return log_errno("%s: failed to open output", name);
   }
 
-  size_t const     mem_size = 64U + opts.stack_size;
-  void*            mem      = malloc(mem_size);
-  SajsLexer* const lexer    = sajs_lexer_init(mem_size, mem);
-  PipeState        state = {in_stream, out_stream, lexer, 0U, 0U, opts.terse};
+  // Set up input and output with the selected methods
+  size_t      in_length = 0U;
+  void* const map =
+    (opts.read_method == READ_MMAP) ? map_input(in_stream, &in_length) : NULL;
+
+  // A tape is read from memory, so read the whole input if it isn't mapped
+  size_t      tape_in_length = 0U;
+  char* const tape_in =
+    (opts.read_tape && !map) ? read_all(in_stream, &tape_in_length) : NULL;
+
+  // Set up a tape to record events on if writing one
+  uintptr_t tape_writer_mem[4U] = {0U, 0U, 0U, 0U};
+  PipeTape  tape                = {
+    sajs_tape_writer_init(sizeof(tape_writer_mem), tape_writer_mem),
+    opts.write_tape ? (char*)malloc(65536U) : NULL,
+    65536U,
+    0U};
+
+  PipeBuffer        in_raw  = {NULL, 0U, 0U, -1};
+  PipeBuffer        out_raw = {NULL, 0U, 0U, -1};
+  PipeBuffer* const in_buf =
+    setup_buffer(&in_raw, in_stream, !map && opts.read_method != READ_STDIO);
+  PipeBuffer* const out_buf =
+    setup_buffer(&out_raw, out_stream, opts.write_method == WRITE_RAW);
+
+  size_t const      mem_size      = 64U + opts.stack_size;
+  void*             mem           = malloc(mem_size);
+  SajsLexer* const  lexer         = sajs_lexer_init(mem_size, mem);
+  PipeState         state         = {(map || tape_in) ? NULL : in_stream,
+                                     out_stream,
+                                     lexer,
+                                     writer,
+                                     filter,
+                                     opts.write_tape ? &tape : NULL,
+                                     in_buf,
+                                     out_buf,
+                                     opts.stats ? &lexer_stats : NULL,
+                                     opts.stats ? &writer_stats : NULL,
+                                     NULL,
+                                     map ? (char const*)map : tape_in,
+                                     map ? in_length : tape_in_length,
+                                     NULL,
+                                     0U,
+                                     0U,
+                                     0U,
+                                     opts.terse,
+                                     opts.ndjson,
+                                     false};
+
+  // Track the position of the lexer for error messages if it's supported
+  SajsPosition position = {0U, 1U, 1U};
+  if (lexer) {
+    sajs_lexer_set_stats(lexer, state.lexer_stats);
+    if (!opts.read_tape && !sajs_lexer_set_position(lexer, &position)) {
+      state.position = &position;
+    }
+  }
+
+  bool const ready = lexer && (!opts.write_tape || tape.data) &&
+                     (!opts.read_tape || map || tape_in);
+
+  SajsStatus st = ready ? run_all(&state, &opts, mem_size) : SAJS_FAILURE;
+  if (state.tape && write_output(&state, tape.length, tape.data) &&
+      st <= SAJS_FAILURE) {
+    st = SAJS_BAD_WRITE;
+  }
+
+  if (out_buf && flush_raw(out_buf) && st <= SAJS_FAILURE) {
+    st = SAJS_BAD_WRITE;
+  }
+
+  int const rc0 = ready ? finish(&state, st) : -12;
+  if (opts.stats) {
+    print_stats(&lexer_stats, &writer_stats);
+  }
 
-  int const rc0 = lexer ? run(&state, in_stream) : -12;
   int const rc1 = fclose(in_stream);
   int const rc2 = out_file ? fclose(out_file) : 0;
 
+  unmap_input(map, in_length);
+  free(tape.data);
+  free(tape_in);
+  free(out_raw.data);
+  free(in_raw.data);
   free(mem);
   return rc0 ? rc0 : (rc1 || rc2) ? log_errno("%s: failed on close", name) : 0;
 }
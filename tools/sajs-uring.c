@@ -0,0 +1,496 @@
+// Copyright 2024 David Robillard <d@drobilla.net>
+// SPDX-License-Identifier: ISC
+
+/*
+  An example of driving Sajs from an event loop.
+
+  This reformats JSON like sajs-pipe, but with the non-blocking I/O driver,
+  either with io_uring, or with poll and non-blocking descriptors.  With
+  io_uring, a read and a write can be in flight at once, and are submitted
+  together, with a single system call that also waits for one to finish.
+*/
+
+#define _GNU_SOURCE // NOLINT(bugprone-reserved-identifier)
+
+#include "sajs/io.h"
+#include "sajs/sajs.h"
+
+#include <linux/io_uring.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// GCC print format attributes
+#if defined(__GNUC__)
+#  define SAJS_LOG_FUNC(fmt, a0) __attribute__((format(printf, fmt, a0)))
+#else
+#  define SAJS_LOG_FUNC(fmt, a0) ///< Has printf-like parameters
+#endif
+
+static size_t const   default_buffer_size = 1048576U; ///< Size of each buffer
+static size_t const   stack_size          = 1024U;    ///< Lexer stack depth
+static unsigned const ring_size           = 4U;       ///< Entries in ring
+
+/// Tag for a read in a submission
+static uint64_t const read_tag = 1U;
+
+/// Tag for a write in a submission
+static uint64_t const write_tag = 2U;
+
+/// An io_uring instance with its queues mapped into memory
+typedef struct {
+  struct io_uring_sqe* sqes;        ///< Submission queue entries
+  struct io_uring_cqe* cqes;        ///< Completion queue entries
+  unsigned*            sq_head;     ///< Head of submission queue
+  unsigned*            sq_tail;     ///< Tail of submission queue
+  unsigned*            sq_array;    ///< Submission queue entry indices
+  unsigned*            cq_head;     ///< Head of completion queue
+  unsigned*            cq_tail;     ///< Tail of completion queue
+  void*                sq_map;      ///< Mapped submission queue ring
+  void*                cq_map;      ///< Mapped completion queue ring
+  size_t               sq_map_size; ///< Size of submission queue ring
+  size_t               cq_map_size; ///< Size of completion queue ring
+  size_t               sqes_size;   ///< Size of submission queue entries
+  unsigned             sq_mask;     ///< Mask for submission queue indices
+  unsigned             cq_mask;     ///< Mask for completion queue indices
+  unsigned             num_queued;  ///< Entries queued since last submission
+  int                  fd;          ///< Ring file descriptor
+} Ring;
+
+/// Command line options
+typedef struct {
+  size_t buffer_size;
+  bool   poll;
+  bool   stats;
+  bool   terse;
+} UringOptions;
+
+static int
+print_usage(char const* const name, bool const error)
+{
+  (void)fprintf(error ? stderr : stdout,
+                "Usage: %s [OPTION]... [INPUT]\n"
+                "Read and write JSON with asynchronous I/O.\n\n"
+                "  -b SIZE  Use SIZE bytes for each I/O buffer.\n"
+                "  -h       Display this help and exit.\n"
+                "  -p       Use poll and non-blocking I/O, not io_uring.\n"
+                "  -s       Print I/O statistics.\n"
+                "  -t       Write terse output without newlines.\n",
+                name);
+  return error ? 1 : 0;
+}
+
+SAJS_LOG_FUNC(1, 2)
+static int
+log_error(char const* const fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  (void)vfprintf(stderr, fmt, args);
+  va_end(args);
+  return 1;
+}
+
+SAJS_LOG_FUNC(1, 2)
+static int
+log_errno(char const* const fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  (void)vfprintf(stderr, fmt, args);
+  (void)fprintf(stderr, " (%s)\n", strerror(errno));
+  va_end(args);
+  return 1;
+}
+
+/*
+ * io_uring
+ */
+
+static void
+free_ring(Ring* const ring)
+{
+  if (ring->sqes) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+
+  if (ring->cq_map) {
+    munmap(ring->cq_map, ring->cq_map_size);
+  }
+
+  if (ring->sq_map) {
+    munmap(ring->sq_map, ring->sq_map_size);
+  }
+
+  if (ring->fd >= 0) {
+    close(ring->fd);
+  }
+}
+
+// Map a region of a ring into memory, or return null
+static void*
+map_ring(int const fd, size_t const size, off_t const offset)
+{
+  void* const map =
+    mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+
+  return (map == MAP_FAILED) ? NULL : map;
+}
+
+// Set up a ring, or return non-zero with errno set
+static int
+setup_ring(Ring* const ring, unsigned const entries)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  memset(ring, 0, sizeof(Ring));
+
+  if ((ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params)) < 0) {
+    return 1;
+  }
+
+  // Reads and writes from the current position need Linux 5.6
+  if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+    errno = ENOSYS;
+    return 1;
+  }
+
+  ring->sq_map_size =
+    params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+  ring->cq_map_size =
+    params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  ring->sq_map = map_ring(ring->fd, ring->sq_map_size, IORING_OFF_SQ_RING);
+  ring->cq_map = map_ring(ring->fd, ring->cq_map_size, IORING_OFF_CQ_RING);
+  ring->sqes   = (struct io_uring_sqe*)map_ring(
+    ring->fd, ring->sqes_size, (off_t)IORING_OFF_SQES);
+  if (!ring->sq_map || !ring->cq_map || !ring->sqes) {
+    return 1;
+  }
+
+  char* const sq = (char*)ring->sq_map;
+  char* const cq = (char*)ring->cq_map;
+
+  ring->sq_head  = (unsigned*)(sq + params.sq_off.head);
+  ring->sq_tail  = (unsigned*)(sq + params.sq_off.tail);
+  ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+  ring->sq_mask  = *(unsigned*)(sq + params.sq_off.ring_mask);
+  ring->cq_head  = (unsigned*)(cq + params.cq_off.head);
+  ring->cq_tail  = (unsigned*)(cq + params.cq_off.tail);
+  ring->cq_mask  = *(unsigned*)(cq + params.cq_off.ring_mask);
+  ring->cqes     = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+  return 0;
+}
+
+// Queue a read or write from the current file position to submit later
+static void
+queue_io(Ring* const       ring,
+         uint8_t const     opcode,
+         int const         fd,
+         void const* const data,
+         size_t const      size,
+         uint64_t const    tag)
+{
+  unsigned const tail  = *ring->sq_tail + ring->num_queued++;
+  unsigned const index = tail & ring->sq_mask;
+
+  struct io_uring_sqe* const sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode    = opcode;
+  sqe->fd        = fd;
+  sqe->off       = (uint64_t)-1;
+  sqe->addr      = (uint64_t)(uintptr_t)data;
+  sqe->len       = (size > UINT32_MAX) ? UINT32_MAX : (uint32_t)size;
+  sqe->user_data = tag;
+
+  ring->sq_array[index] = index;
+}
+
+// Submit all queued entries and wait for at least one to complete
+static int
+submit_and_wait(Ring* const ring)
+{
+  unsigned const n = ring->num_queued;
+
+  __atomic_store_n(ring->sq_tail, *ring->sq_tail + n, __ATOMIC_RELEASE);
+  ring->num_queued = 0U;
+
+  long rc = -1;
+  do {
+    rc = syscall(
+      __NR_io_uring_enter, ring->fd, n, 1U, IORING_ENTER_GETEVENTS, NULL, 0);
+  } while (rc < 0 && errno == EINTR);
+
+  return (rc < 0 || (unsigned long)rc < n) ? 1 : 0;
+}
+
+// Reformat all the input with io_uring
+static SajsStatus
+run_uring(Ring* const        ring,
+          SajsIo* const      io,
+          int const          in_fd,
+          int const          out_fd,
+          SajsIoStats* const stats,
+          uint64_t* const    num_waits)
+{
+  bool       reading = false;
+  bool       writing = false;
+  SajsStatus st      = SAJS_RETRY;
+  while (st != SAJS_BAD_READ && st != SAJS_BAD_WRITE) {
+    // Queue a read and a write for whatever the driver is waiting for
+    SajsIoFlags const waiting = sajs_io_waiting(io);
+    if ((waiting & SAJS_IO_READ) && !reading) {
+      SajsIoBuffer const input = sajs_io_input(io);
+      queue_io(ring, IORING_OP_READ, in_fd, input.data, input.size, read_tag);
+      reading = true;
+      ++stats->reads;
+    }
+
+    if ((waiting & SAJS_IO_WRITE) && !writing) {
+      SajsStringView const out = sajs_io_output(io);
+      queue_io(ring, IORING_OP_WRITE, out_fd, out.data, out.length, write_tag);
+      writing = true;
+      ++stats->writes;
+    }
+
+    if (!reading && !writing) {
+      break; // Finished, and all the output is written, even after errors
+    }
+
+    // Submit both at once, and wait for either to finish
+    ++*num_waits;
+    if (submit_and_wait(ring)) {
+      st = reading ? SAJS_BAD_READ : SAJS_BAD_WRITE;
+      break;
+    }
+
+    // Pass every completion back to the driver
+    unsigned const tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned       head = *ring->cq_head;
+    for (; head != tail; ++head) {
+      struct io_uring_cqe const* const cqe = &ring->cqes[head & ring->cq_mask];
+      size_t const length = (cqe->res > 0) ? (size_t)cqe->res : 0U;
+
+      if (cqe->user_data == read_tag) {
+        reading = false;
+        stats->bytes_read += length;
+        st = (cqe->res < 0) ? SAJS_BAD_READ : sajs_io_add_input(io, length);
+      } else {
+        writing = false;
+        stats->bytes_written += length;
+        st = (cqe->res <= 0) ? SAJS_BAD_WRITE
+                             : sajs_io_drop_output(io, length);
+      }
+
+      if (cqe->res < 0) {
+        errno = -cqe->res;
+      }
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  return st;
+}
+
+/*
+ * Polling
+ */
+
+// Make a file descriptor non-blocking, and return its previous flags
+static int
+set_nonblocking(int const fd)
+{
+  int const flags = fcntl(fd, F_GETFL);
+  if (flags >= 0 && !(flags & O_NONBLOCK)) {
+    (void)fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  }
+
+  return flags;
+}
+
+// Reformat all the input with poll and non-blocking descriptors
+static SajsStatus
+run_poll(SajsIo* const   io,
+         int const       in_fd,
+         int const       out_fd,
+         uint64_t* const num_waits)
+{
+  int const in_flags  = set_nonblocking(in_fd);
+  int const out_flags = set_nonblocking(out_fd);
+
+  SajsStatus st = SAJS_RETRY;
+  while ((st = sajs_io_pump(io, in_fd, out_fd)) == SAJS_RETRY) {
+    SajsIoFlags const waiting = sajs_io_waiting(io);
+    struct pollfd     fds[2]  = {
+      {in_fd, (short)((waiting & SAJS_IO_READ) ? POLLIN : 0), 0},
+      {out_fd, (short)((waiting & SAJS_IO_WRITE) ? POLLOUT : 0), 0},
+    };
+
+    ++*num_waits;
+    if (poll(fds, 2U, -1) < 0 && errno != EINTR) {
+      st = SAJS_BAD_READ;
+      break;
+    }
+  }
+
+  // Restore the original flags, since descriptors may be shared
+  if (in_flags >= 0) {
+    (void)fcntl(in_fd, F_SETFL, in_flags);
+  }
+
+  if (out_flags >= 0) {
+    (void)fcntl(out_fd, F_SETFL, out_flags);
+  }
+
+  return st;
+}
+
+/*
+ * Main
+ */
+
+static void
+print_stats(SajsIoStats const* const stats,
+            uint64_t const           num_waits,
+            uint64_t const           num_syscalls)
+{
+  double const megabytes = (double)stats->bytes_read / 1000000.0;
+
+  (void)fprintf(stderr, "io.reads %20" PRIu64 "\n", stats->reads);
+  (void)fprintf(stderr, "io.writes %19" PRIu64 "\n", stats->writes);
+  (void)fprintf(stderr, "io.blocked %18" PRIu64 "\n", stats->blocked);
+  (void)fprintf(stderr, "io.waits %20" PRIu64 "\n", num_waits);
+  (void)fprintf(stderr, "io.syscalls %17" PRIu64 "\n", num_syscalls);
+  (void)fprintf(stderr, "io.bytes_read %15" PRIu64 "\n", stats->bytes_read);
+  (void)fprintf(
+    stderr, "io.bytes_written %12" PRIu64 "\n", stats->bytes_written);
+  (void)fprintf(stderr,
+                "io.syscalls_per_MB %10.2f\n",
+                megabytes > 0.0 ? (double)num_syscalls / megabytes : 0.0);
+}
+
+// Parse command line options and return the index of the first argument
+static int
+parse_args(UringOptions* const opts, int const argc, char** const argv)
+{
+  int a = 1;
+  for (; a < argc && argv[a][0] == '-' && argv[a][1]; ++a) {
+    char const opt = argv[a][1];
+    if (argv[a][2]) {
+      (void)fprintf(stderr, "%s: invalid option \"%s\"\n\n", argv[0], argv[a]);
+      return -print_usage(argv[0], true);
+    }
+
+    if (opt == 'b') {
+      char*      end  = NULL;
+      long const size = (a + 1 < argc) ? strtol(argv[++a], &end, 10) : 0;
+      if (size < 64 || *end) {
+        (void)fprintf(stderr, "%s: invalid buffer size\n\n", argv[0]);
+        return -print_usage(argv[0], true);
+      }
+
+      opts->buffer_size = (size_t)size;
+    } else if (opt == 'h') {
+      return -print_usage(argv[0], false);
+    } else if (opt == 'p') {
+      opts->poll = true;
+    } else if (opt == 's') {
+      opts->stats = true;
+    } else if (opt == 't') {
+      opts->terse = true;
+    } else {
+      (void)fprintf(stderr, "%s: invalid option -- '%c'\n\n", argv[0], opt);
+      return -print_usage(argv[0], true);
+    }
+  }
+
+  return a;
+}
+
+int
+main(int const argc, char** const argv)
+{
+  UringOptions opts = {default_buffer_size, false, false, false};
+
+  int const a = parse_args(&opts, argc, argv);
+  if (a <= 0) {
+    return -a;
+  }
+
+  int const in_fd = (a < argc) ? open(argv[a], O_RDONLY) : STDIN_FILENO;
+  if (in_fd < 0) {
+    return log_errno("%s: failed to open input", argv[0]);
+  }
+
+  // Set up the lexer, writer, and driver, with all their memory together
+  size_t const lexer_size = 64U + stack_size;
+  size_t const io_size    = sajs_io_mem_size(opts.buffer_size);
+  uintptr_t    writer_mem[8U];
+  void* const  mem = io_size ? malloc(lexer_size + io_size) : NULL;
+
+  SajsWriteFlags const flags =
+    SAJS_WRITE_NEWLINES | (opts.terse ? SAJS_WRITE_TERSE : 0U);
+  SajsLexer* const  lexer  = mem ? sajs_lexer_init(lexer_size, mem) : NULL;
+  SajsWriter* const writer = sajs_writer_init(sizeof(writer_mem), writer_mem);
+  SajsIo* const     io =
+    lexer ? sajs_io_init(io_size, (char*)mem + lexer_size, lexer, writer, flags)
+          : NULL;
+
+  Ring ring;
+  int  rc = 0;
+  if (!io) {
+    rc = log_error("%s: failed to allocate memory\n", argv[0]);
+  } else if (!opts.poll && setup_ring(&ring, ring_size)) {
+    rc = log_errno("%s: failed to set up io_uring", argv[0]);
+    free_ring(&ring);
+  }
+
+  SajsIoStats stats     = {0U, 0U, 0U, 0U, 0U};
+  uint64_t    num_waits = 0U;
+  if (!rc) {
+    SajsStatus st = SAJS_SUCCESS;
+    if (opts.poll) {
+      (void)sajs_io_set_stats(io, &stats);
+      st = run_poll(io, in_fd, STDOUT_FILENO, &num_waits);
+    } else {
+      st = run_uring(&ring, io, in_fd, STDOUT_FILENO, &stats, &num_waits);
+      free_ring(&ring);
+    }
+
+    if (st == SAJS_BAD_READ || st == SAJS_BAD_WRITE) {
+      (void)log_errno("error: %s", sajs_strerror(st));
+    } else if (st) {
+      (void)log_error("error: %s\n", sajs_strerror(st));
+    }
+
+    rc = st ? ((int)st + 100) : 0;
+  }
+
+  if (opts.stats) {
+    // Reads and writes are submitted without system calls with io_uring
+    uint64_t const num_syscalls =
+      num_waits + (opts.poll ? (stats.reads + stats.writes) : 0U);
+
+    print_stats(&stats, num_waits, num_syscalls);
+  }
+
+  if (in_fd != STDIN_FILENO) {
+    close(in_fd);
+  }
+
+  free(mem);
+  return rc;
+}